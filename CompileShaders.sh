@@ -1,6 +1,11 @@
 glslc shaders/shader.vert -o shaders/vert.spv
 glslc shaders/tri_mesh.vert -o shaders/tri_mesh_vertex.spv
-glslc shaders/shader.frag -o shaders/frag.spv
 glslc shaders/vertex_shader.vert -o shaders/vertex_shader.spv
-glslc shaders/fragment_shader.frag -o shaders/fragment_shader.spv
-glslc shaders/textured.frag -o shaders/textured.spv
\ No newline at end of file
+glslc shaders/depth_only.vert -o shaders/depth_only.spv
+glslc shaders/material.frag -o shaders/material.spv
+glslc shaders/overlay.vert -o shaders/overlay_vert.spv
+glslc shaders/overlay.frag -o shaders/overlay_frag.spv
+glslc shaders/hzb_reduce.comp -o shaders/hzb_reduce.spv
+glslc shaders/occlusion_cull.comp -o shaders/occlusion_cull.spv
+glslc shaders/light_cluster.comp -o shaders/light_cluster.spv
+glslc shaders/shadow.vert -o shaders/shadow.spv
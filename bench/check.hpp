@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+/**
+ * @brief The checks of the tests in bench/, every one prints its line, and the test fails if one of them did
+ */
+inline uint32_t failures = 0;
+
+inline void check( bool condition, const std::string& what )
+{
+    std::cout << ( condition ? "ok   " : "FAIL " ) << what << "\n";
+    failures += condition ? 0 : 1;
+}
+
+// the exit code of the test
+inline int checkResult()
+{
+    std::cout << ( failures ? "FAILED" : "passed" ) << "\n";
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
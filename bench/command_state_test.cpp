@@ -0,0 +1,117 @@
+#include <string>
+#include <array>
+
+#include "CommandStateTracker.hpp"
+#include "check.hpp"
+
+/**
+ * @brief The issued and elided commands of the state tracker on a synthetic sorted draw list, checked without a device
+ * usage: ./bin/command_state_test
+ */
+namespace
+{
+// counts what gets through the tracker, like the stats count the issued commands
+class CountingSink : public CommandStateTracker::Sink
+{
+public:
+    void bindPipeline( vk::PipelineBindPoint, vk::Pipeline ) override { ++m_calls[CommandStateTracker::CommandPipeline]; }
+    void bindDescriptorSets( vk::PipelineBindPoint, vk::PipelineLayout, uint32_t, uint32_t setCount,
+                             const vk::DescriptorSet*, uint32_t, const uint32_t* ) override { m_calls[CommandStateTracker::CommandDescriptorSet] += setCount; }
+    void bindVertexBuffer( uint32_t, vk::Buffer, vk::DeviceSize ) override { ++m_calls[CommandStateTracker::CommandVertexBuffer]; }
+    void pushConstants( vk::PipelineLayout, vk::ShaderStageFlags, uint32_t, uint32_t, const void* ) override { ++m_calls[CommandStateTracker::CommandPushConstant]; }
+    void setViewport( const vk::Viewport& ) override { ++m_calls[CommandStateTracker::CommandViewport]; }
+    void setScissor( const vk::Rect2D& ) override { ++m_calls[CommandStateTracker::CommandScissor]; }
+    void draw( uint32_t, uint32_t, uint32_t, uint32_t ) override { ++m_calls[CommandStateTracker::CommandDraw]; }
+    void drawIndirect( vk::Buffer, vk::DeviceSize, uint32_t, uint32_t ) override { ++m_calls[CommandStateTracker::CommandDraw]; }
+
+    std::array<uint32_t, CommandStateTracker::CommandCount> m_calls {};
+};
+
+void checkCounts( const CommandStateTracker::Stats& stats, CommandStateTracker::Command command, uint32_t issued, uint32_t elided )
+{
+    check( stats.issued[command] == issued && stats.elided[command] == elided,
+           std::string( CommandStateTracker::name( command ) ) + ": " + std::to_string( issued ) + " issued, " + std::to_string( elided ) + " elided"
+           + " (got " + std::to_string( stats.issued[command] ) + ", " + std::to_string( stats.elided[command] ) + ")" );
+}
+
+// the handles are only compared, they never reach a device
+template<typename Handle>
+Handle fakeHandle( uint64_t value )
+{
+    return Handle( reinterpret_cast<typename Handle::CType>( value ) );
+}
+
+struct Run
+{
+    uint32_t pipeline;
+    uint32_t mesh;
+    uint32_t instances;
+};
+} // namespace
+
+int main()
+{
+    const auto layout = fakeHandle<vk::PipelineLayout>( 1 );
+    const auto otherLayout = fakeHandle<vk::PipelineLayout>( 2 );
+    const std::array<vk::Pipeline, 3> pipelines = { fakeHandle<vk::Pipeline>( 10 ), fakeHandle<vk::Pipeline>( 11 ), fakeHandle<vk::Pipeline>( 12 ) };
+    const std::array<vk::Buffer, 3> meshes = { fakeHandle<vk::Buffer>( 20 ), fakeHandle<vk::Buffer>( 21 ), fakeHandle<vk::Buffer>( 22 ) };
+    const auto globalSet = fakeHandle<vk::DescriptorSet>( 30 );
+    const std::array<vk::DescriptorSet, 2> objectAndTextureSets = { fakeHandle<vk::DescriptorSet>( 31 ), fakeHandle<vk::DescriptorSet>( 32 ) };
+
+    // sorted by pipeline and then mesh, like the render queue, every material shares the layout
+    const std::array<Run, 5> runs = { Run{ 0, 0, 4 }, Run{ 0, 1, 2 }, Run{ 1, 1, 8 }, Run{ 2, 1, 1 }, Run{ 2, 2, 3 } };
+
+    CommandStateTracker tracker;
+    CountingSink sink;
+
+    /**
+     * @brief The scene pass of Engine::draw()
+     */
+    tracker.begin( sink );
+    const vk::Viewport viewport { 0.0f, 0.0f, 1600.0f, 800.0f, 0.0f, 1.0f };
+    const vk::Rect2D scissor { { 0, 0 }, { 1600, 800 } };
+    tracker.setViewport( viewport );
+    tracker.setScissor( scissor );
+    for( const Run& run : runs )
+    {
+        tracker.bindPipeline( vk::PipelineBindPoint::eGraphics, pipelines[run.pipeline] );
+        tracker.bindDescriptorSets( vk::PipelineBindPoint::eGraphics, layout, 0, globalSet, 256U );
+        tracker.bindDescriptorSets( vk::PipelineBindPoint::eGraphics, layout, 1, objectAndTextureSets );
+        tracker.bindVertexBuffer( 0, meshes[run.mesh] );
+        tracker.draw( 36, run.instances, 0, 0 );
+    }
+    // the depth prepass sets them again
+    tracker.setViewport( viewport );
+    tracker.setScissor( scissor );
+
+    const auto& stats = tracker.stats();
+    checkCounts( stats, CommandStateTracker::CommandPipeline, 3, 2 );
+    checkCounts( stats, CommandStateTracker::CommandDescriptorSet, 3, 12 );
+    checkCounts( stats, CommandStateTracker::CommandVertexBuffer, 3, 2 );
+    checkCounts( stats, CommandStateTracker::CommandViewport, 1, 1 );
+    checkCounts( stats, CommandStateTracker::CommandScissor, 1, 1 );
+    checkCounts( stats, CommandStateTracker::CommandDraw, 5, 0 );
+    check( stats.totalIssued() == 16 && stats.totalElided() == 18, "totals: 16 issued, 18 elided" );
+    check( sink.m_calls == stats.issued, "the sink got exactly the issued commands" );
+
+    /**
+     * @brief Dynamic offsets, push constants, and a layout change
+     */
+    tracker.begin( sink );
+    sink.m_calls = {};
+    tracker.bindDescriptorSets( vk::PipelineBindPoint::eGraphics, layout, 0, globalSet, 0U );
+    tracker.bindDescriptorSets( vk::PipelineBindPoint::eGraphics, layout, 0, globalSet, 256U );       // new offset
+    const uint32_t value = 7;
+    tracker.pushConstants( layout, vk::ShaderStageFlagBits::eVertex, 0, value );
+    tracker.pushConstants( layout, vk::ShaderStageFlagBits::eVertex, 0, value );
+    tracker.bindDescriptorSets( vk::PipelineBindPoint::eGraphics, otherLayout, 0, globalSet, 256U ); // the layout change forgets the sets
+    tracker.pushConstants( otherLayout, vk::ShaderStageFlagBits::eVertex, 0, value );               // and the push constants
+
+    const auto& moreStats = tracker.stats();
+    checkCounts( moreStats, CommandStateTracker::CommandDescriptorSet, 3, 0 );
+    checkCounts( moreStats, CommandStateTracker::CommandPushConstant, 2, 1 );
+    checkCounts( moreStats, CommandStateTracker::CommandPipeline, 0, 0 );
+    check( sink.m_calls == moreStats.issued, "begin() forgets the counters of the last recording" );
+
+    return checkResult();
+}
@@ -0,0 +1,25 @@
+#include <iostream>
+#include <cstdlib>
+
+#include "Culling.hpp"
+
+/**
+ * @brief Throughput of the CPU frustum culling (objects/ms)
+ * usage: ./bin/culling_bench [iterations]
+ */
+int main( int argc, char** argv )
+{
+    uint32_t iterations = argc > 1 ? static_cast<uint32_t>( std::atoi( argv[1] ) ) : 100U;
+
+    FrustumCuller culler;
+    std::cout << "AVX2 kernel : " << ( culler.m_useAvx2 ? "yes" : "no" ) << "\n"
+              << "Threads     : " << culler.m_threadCount << "\n\n";
+
+    for( size_t count : { 1000UL, 10000UL, 100000UL, 1000000UL } )
+    {
+        double throughput = FrustumCuller::benchmark( count, iterations );
+        std::cout << count << " objects : " << throughput << " objects/ms\n";
+    }
+
+    return EXIT_SUCCESS;
+}
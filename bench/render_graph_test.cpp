@@ -0,0 +1,235 @@
+#include <array>
+#include <string>
+#include <vector>
+
+#include "RenderGraph.hpp"
+#include "check.hpp"
+
+/**
+ * @brief The barriers, the transient packing, and the load and store ops of the render graph, checked without a device
+ * The barriers: only imported resources and compute/transfer passes, compiling them creates nothing (no transient image, no render pass).
+ * The ops: planAttachments() instead of compile(), it creates nothing either.
+ * usage: ./bin/render_graph_test
+ */
+namespace
+{
+struct Barrier
+{
+    std::string pass;
+    vk::PipelineStageFlags srcStages;
+    vk::PipelineStageFlags dstStages;
+    vk::AccessFlags srcAccess;      // of the memory barrier and the image barriers
+    vk::AccessFlags dstAccess;
+    uint32_t imageBarriers;
+};
+
+class RecordingSink : public RenderGraph::BarrierSink
+{
+public:
+    void pipelineBarrier( const char* pass, vk::PipelineStageFlags srcStages, vk::PipelineStageFlags dstStages,
+                          const vk::MemoryBarrier* memoryBarrier, const std::vector<vk::ImageMemoryBarrier>& imageBarriers ) override
+    {
+        Barrier barrier { pass ? pass : "final layouts", srcStages, dstStages, {}, {}, static_cast<uint32_t>( imageBarriers.size() ) };
+        if( memoryBarrier )
+        {
+            barrier.srcAccess |= memoryBarrier->srcAccessMask;
+            barrier.dstAccess |= memoryBarrier->dstAccessMask;
+        }
+        for( const auto& imageBarrier : imageBarriers )
+        {
+            barrier.srcAccess |= imageBarrier.srcAccessMask;
+            barrier.dstAccess |= imageBarrier.dstAccessMask;
+        }
+        m_barriers.push_back( barrier );
+    }
+
+    const Barrier* find( const std::string& pass ) const
+    {
+        for( const auto& barrier : m_barriers )
+        {
+            if( barrier.pass == pass )
+                return &barrier;
+        }
+        return nullptr;
+    }
+
+    std::vector<Barrier> m_barriers;
+};
+
+constexpr vk::PipelineStageFlags Compute = vk::PipelineStageFlagBits::eComputeShader;
+constexpr vk::PipelineStageFlags Transfer = vk::PipelineStageFlagBits::eTransfer;
+
+RenderGraph::ImportedImage storageImage()
+{
+    // the content is there before the graph, nothing to wait
+    RenderGraph::ImportedImage image {};
+    image.desc = RenderGraph::ImageDesc{ vk::Format::eR8G8B8A8Unorm, vk::Extent2D{ 64, 64 } };
+    image.initialLayout = vk::ImageLayout::eGeneral;
+    image.initialStages = {};
+    image.finalLayout = vk::ImageLayout::eGeneral;
+    return image;
+}
+
+vk::MemoryRequirements requirements( vk::DeviceSize size, vk::DeviceSize alignment, uint32_t memoryTypeBits )
+{
+    return vk::MemoryRequirements{ size, alignment, memoryTypeBits };
+}
+
+bool hasOps( const std::vector<RenderGraph::AttachmentOps>& ops, const std::string& pass, const std::string& attachment,
+             vk::AttachmentLoadOp loadOp, vk::AttachmentStoreOp storeOp )
+{
+    for( const auto& op : ops )
+    {
+        if( pass == op.pass && attachment == op.attachment )
+            return op.loadOp == loadOp && op.storeOp == storeOp;
+    }
+    return false;
+}
+} // namespace
+
+int main()
+{
+    RenderGraph graph;
+    vk::Buffer buffer;
+
+    /**
+     * @brief Read after write in the same stages: every read waits the last write once
+     */
+    {
+        graph.reset();
+        auto image = graph.importImage( "image", storageImage() );
+        auto data = graph.importBuffer( "data", buffer );
+        graph.addPass( "compute write", RenderGraph::PassType::eCompute ).storageWrite( image ).execute( nullptr );
+        graph.addPass( "compute read", RenderGraph::PassType::eCompute ).storageRead( image ).sideEffect().execute( nullptr );
+        graph.addPass( "compute read again", RenderGraph::PassType::eCompute ).storageRead( image ).sideEffect().execute( nullptr );
+        graph.addPass( "copy write", RenderGraph::PassType::eTransfer ).transferDst( data ).execute( nullptr );
+        graph.addPass( "copy read", RenderGraph::PassType::eTransfer ).transferSrc( data ).sideEffect().execute( nullptr );
+        graph.compile();
+
+        RecordingSink sink;
+        graph.executeBarriers( sink );
+
+        const Barrier* read = sink.find( "compute read" );
+        check( read && read->srcStages == Compute && read->dstStages == Compute, "compute read waits the compute write" );
+        check( read && ( read->srcAccess & vk::AccessFlagBits::eShaderWrite ) && ( read->dstAccess & vk::AccessFlagBits::eShaderRead ),
+               "compute read makes the shader write visible" );
+        check( read && read->imageBarriers == 0, "compute read in the same layout is a memory barrier" );
+        check( !sink.find( "compute read again" ), "second compute read has no barrier" );
+
+        const Barrier* copy = sink.find( "copy read" );
+        check( copy && copy->srcStages == Transfer && copy->dstStages == Transfer, "transfer src waits the transfer dst" );
+        check( copy && ( copy->srcAccess & vk::AccessFlagBits::eTransferWrite ) && ( copy->dstAccess & vk::AccessFlagBits::eTransferRead ),
+               "transfer src makes the transfer write visible" );
+    }
+
+    /**
+     * @brief Write after read, and the layout transitions
+     */
+    {
+        graph.reset();
+        auto image = graph.importImage( "image", storageImage() );
+        graph.addPass( "compute read", RenderGraph::PassType::eCompute ).storageRead( image ).sideEffect().execute( nullptr );
+        graph.addPass( "copy write", RenderGraph::PassType::eTransfer ).transferDst( image ).execute( nullptr );
+        graph.addPass( "sample", RenderGraph::PassType::eCompute ).sampled( image ).sideEffect().execute( nullptr );
+        graph.addPass( "sample again", RenderGraph::PassType::eCompute ).sampled( image ).sideEffect().execute( nullptr );
+        graph.addPass( "compute write", RenderGraph::PassType::eCompute ).storageWrite( image ).execute( nullptr );
+        graph.compile();
+
+        RecordingSink sink;
+        graph.executeBarriers( sink );
+
+        check( !sink.find( "compute read" ), "first read of an image nothing wrote has no barrier" );
+        const Barrier* copy = sink.find( "copy write" );
+        check( copy && copy->srcStages == Compute && copy->dstStages == Transfer && copy->imageBarriers == 1,
+               "transfer write waits the compute read and changes the layout" );
+        const Barrier* sample = sink.find( "sample" );
+        check( sample && sample->srcStages == Transfer && sample->imageBarriers == 1
+               && ( sample->srcAccess & vk::AccessFlagBits::eTransferWrite ), "sampled read waits the transfer write and changes the layout" );
+        check( !sink.find( "sample again" ), "the layout transition made the write visible to the next sampled read" );
+        const Barrier* write = sink.find( "compute write" );
+        check( write && write->srcStages == Compute && write->imageBarriers == 1, "storage write waits the sampled reads" );
+        check( !sink.find( "final layouts" ), "image already in its final layout" );
+    }
+
+    /**
+     * @brief Transient packing: the images that are never used at the same time share a block, if they can share a memory type
+     */
+    {
+        const std::vector<RenderGraph::TransientImage> images = {
+            { 0, 1, requirements( 4096, 1024, 0x3 ), false },   // a
+            { 2, 3, requirements( 8192, 256, 0x3 ), false },    // b, after a
+            { 1, 2, requirements( 1024, 256, 0x3 ), false },    // c, at the same time as a and b
+            { 4, 4, requirements( 2048, 256, 0x4 ), false },    // d, after all of them, in another memory type
+        };
+        auto noLazyType = []( uint32_t ){ return false; };
+
+        auto packing = RenderGraph::packTransients( images, true, noLazyType );
+        check( packing.blocks.size() == 3, "4 images in 3 blocks" );
+        check( packing.imageBlocks == std::vector<uint32_t>{ 0, 0, 2, 1 }, "a goes with b (the biggest, first), d and then c get their own" );
+        check( packing.blocks.size() == 3 && packing.blocks[0].requirements.size == 8192 && packing.blocks[0].requirements.alignment == 1024
+               && packing.blocks[0].requirements.memoryTypeBits == 0x3, "the shared block has the biggest size and alignment of its images" );
+
+        auto unaliased = RenderGraph::packTransients( images, false, noLazyType );
+        check( unaliased.blocks.size() == 4 && unaliased.imageBlocks == std::vector<uint32_t>{ 1, 0, 3, 2 },
+               "without aliasing every image has its own block, the biggest first" );
+    }
+    {
+        const std::vector<RenderGraph::TransientImage> images = {
+            { 0, 0, requirements( 4096, 256, 0x3 ), true },
+            { 1, 1, requirements( 4096, 256, 0x3 ), true },
+            { 2, 2, requirements( 4096, 256, 0x3 ), false },
+            { 3, 3, requirements( 4096, 256, 0x2 ), true },
+        };
+        // only the memory type 0 is lazily allocated
+        auto lazyType = []( uint32_t memoryTypeBits ){ return ( memoryTypeBits & 0x1 ) != 0; };
+
+        auto packing = RenderGraph::packTransients( images, true, lazyType );
+        check( packing.imageBlocks.size() == 4 && packing.imageBlocks[0] == packing.imageBlocks[1], "lazy images share with each other" );
+        check( packing.imageBlocks.size() == 4 && packing.imageBlocks[2] != packing.imageBlocks[0], "a lazy and a normal image never share" );
+        check( packing.imageBlocks.size() == 4 && packing.imageBlocks[3] != packing.imageBlocks[0],
+               "a lazy image doesn't join a block it would take out of the lazy memory type" );
+        check( packing.blocks.size() == 3 && packing.blocks[packing.imageBlocks[0]].lazy && !packing.blocks[packing.imageBlocks[2]].lazy,
+               "the blocks are lazy like their images" );
+    }
+
+    /**
+     * @brief Load and store ops: clear when asked, load what was written before, store what is used after
+     */
+    {
+        graph.reset();
+        RenderGraph::ImportedImage swapchainImage {};
+        swapchainImage.desc = RenderGraph::ImageDesc{ vk::Format::eB8G8R8A8Srgb, vk::Extent2D{ 64, 64 } };
+        swapchainImage.finalLayout = vk::ImageLayout::ePresentSrcKHR;
+        RenderGraph::ImportedImage historyImage {};
+        historyImage.desc = RenderGraph::ImageDesc{ vk::Format::eR8G8B8A8Unorm, vk::Extent2D{ 64, 64 } };
+        historyImage.initialLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+        historyImage.initialStages = {};
+        historyImage.finalLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+
+        auto swapchain = graph.importImage( "swapchain", swapchainImage );
+        auto history = graph.importImage( "history", historyImage );
+        auto scene = graph.createImage( "scene", RenderGraph::ImageDesc{ vk::Format::eR8G8B8A8Unorm, vk::Extent2D{ 64, 64 } } );
+        auto depth = graph.createImage( "depth", RenderGraph::ImageDesc{ vk::Format::eD32Sfloat, vk::Extent2D{ 64, 64 } } );
+        auto debug = graph.createImage( "debug", RenderGraph::ImageDesc{ vk::Format::eR8G8B8A8Unorm, vk::Extent2D{ 64, 64 } } );
+        const vk::ClearColorValue black { std::array<float, 4>{ 0.0f, 0.0f, 0.0f, 1.0f } };
+
+        graph.addPass( "scene", RenderGraph::PassType::eGraphics ).colorAttachment( scene, black ).depthAttachment( depth, vk::ClearDepthStencilValue{ 1.0f, 0 } ).execute( nullptr );
+        graph.addPass( "decals", RenderGraph::PassType::eGraphics ).colorAttachment( scene ).depthAttachment( depth ).execute( nullptr );
+        graph.addPass( "debug", RenderGraph::PassType::eGraphics ).colorAttachment( debug, black ).execute( nullptr );
+        graph.addPass( "composite", RenderGraph::PassType::eGraphics ).colorAttachment( swapchain ).sampled( scene ).execute( nullptr );
+        graph.addPass( "history", RenderGraph::PassType::eGraphics ).colorAttachment( history ).sampled( scene ).execute( nullptr );
+        auto ops = graph.planAttachments();
+
+        using Load = vk::AttachmentLoadOp;
+        using Store = vk::AttachmentStoreOp;
+        check( ops.size() == 6, "6 attachments in the passes that are left (debug is culled)" );
+        check( hasOps( ops, "scene", "scene", Load::eClear, Store::eStore ), "scene: cleared, and stored for the passes after" );
+        check( hasOps( ops, "scene", "depth", Load::eClear, Store::eStore ), "scene: depth cleared, and stored for the decals" );
+        check( hasOps( ops, "decals", "scene", Load::eLoad, Store::eStore ), "decals: loads what the scene pass wrote" );
+        check( hasOps( ops, "decals", "depth", Load::eLoad, Store::eDontCare ), "decals: the last use of the depth doesn't store it" );
+        check( hasOps( ops, "composite", "swapchain", Load::eDontCare, Store::eStore ), "composite: nothing to load in an undefined import, kept for the present" );
+        check( hasOps( ops, "history", "history", Load::eLoad, Store::eStore ), "history: an import with content is loaded" );
+    }
+
+    return checkResult();
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cstdint>
+
+#include <vulkan/vulkan.hpp>
+
+/**
+ * @brief Redundant state filter between the recording code and the command buffer.
+ *
+ * It remembers what has been bound on the command buffer (pipeline, descriptor sets with their dynamic offsets,
+ * vertex buffers, push constant bytes, viewport and scissor), and a call that would set the same state again is not recorded.
+ * Every call is counted as issued or elided, so the HUD can show how much the filter saves.
+ *
+ * The state is only valid inside one recording, begin() must be called after the command buffer begins
+ * (and again if something else records on the command buffer behind the tracker's back).
+ * A pipeline layout change invalidates the bound descriptor sets and push constants,
+ * the layouts are not checked for compatibility here, so that is the safe side.
+ */
+class CommandStateTracker
+{
+public:
+    enum Command : uint32_t
+    {
+        CommandPipeline = 0,
+        CommandDescriptorSet,
+        CommandVertexBuffer,
+        CommandPushConstant,
+        CommandViewport,
+        CommandScissor,
+        CommandDraw,
+        CommandCount
+    };
+
+    struct Stats
+    {
+        std::array<uint32_t, CommandCount> issued {};
+        std::array<uint32_t, CommandCount> elided {};
+
+        uint32_t totalIssued() const;
+        uint32_t totalElided() const;
+    };
+
+    static const char* name( Command command );
+
+    /**
+     * @brief Where the calls that get through are recorded, the command buffer of begin( cmd ).
+     * begin( sink ) records them somewhere else, bench/command_state_test.cpp counts them like that.
+     */
+    class Sink
+    {
+    public:
+        virtual ~Sink() = default;
+        virtual void bindPipeline( vk::PipelineBindPoint bindPoint, vk::Pipeline pipeline ) = 0;
+        virtual void bindDescriptorSets( vk::PipelineBindPoint bindPoint, vk::PipelineLayout layout, uint32_t firstSet, uint32_t setCount,
+                                         const vk::DescriptorSet* sets, uint32_t offsetCount, const uint32_t* offsets ) = 0;
+        virtual void bindVertexBuffer( uint32_t binding, vk::Buffer buffer, vk::DeviceSize offset ) = 0;
+        virtual void pushConstants( vk::PipelineLayout layout, vk::ShaderStageFlags stages, uint32_t offset, uint32_t size, const void* data ) = 0;
+        virtual void setViewport( const vk::Viewport& viewport ) = 0;
+        virtual void setScissor( const vk::Rect2D& scissor ) = 0;
+        virtual void draw( uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance ) = 0;
+        virtual void drawIndirect( vk::Buffer buffer, vk::DeviceSize offset, uint32_t drawCount, uint32_t stride ) = 0;
+    };
+
+public:
+    // forget the bound state and the counters
+    void begin( vk::CommandBuffer cmd );
+    void begin( Sink& sink );
+    vk::CommandBuffer commandBuffer() const { return m_commandBufferSink.m_cmd; }
+
+public:
+    void bindPipeline( vk::PipelineBindPoint bindPoint, vk::Pipeline pipeline );
+    // every set is filtered on its own, a run of sets that changed is bound with one call
+    void bindDescriptorSets( vk::PipelineBindPoint bindPoint, vk::PipelineLayout layout, uint32_t firstSet,
+                             vk::ArrayProxy<const vk::DescriptorSet> sets, vk::ArrayProxy<const uint32_t> dynamicOffsets = nullptr );
+    void bindVertexBuffer( uint32_t binding, vk::Buffer buffer, vk::DeviceSize offset = 0 );
+    void pushConstants( vk::PipelineLayout layout, vk::ShaderStageFlags stages, uint32_t offset, uint32_t size, const void* data );
+    void setViewport( const vk::Viewport& viewport );
+    void setScissor( const vk::Rect2D& scissor );
+
+    // draws are never elided, they're counted so the stats have the whole picture
+    void draw( uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance );
+    void drawIndirect( vk::Buffer buffer, vk::DeviceSize offset, uint32_t drawCount, uint32_t stride );
+
+    template<typename T>
+    void pushConstants( vk::PipelineLayout layout, vk::ShaderStageFlags stages, uint32_t offset, const T& value )
+    {
+        pushConstants( layout, stages, offset, sizeof( T ), &value );
+    }
+
+public:
+    const Stats& stats() const { return m_stats; }
+
+private:
+    void setLayout( vk::PipelineLayout layout );
+    void count( Command command, bool issued );
+
+private:
+    static constexpr uint32_t MaxSets = 8;
+    static constexpr uint32_t MaxDynamicOffsets = 4;
+    static constexpr uint32_t MaxVertexBindings = 4;
+    static constexpr uint32_t MaxPushConstantSize = 128;    // the minimum maxPushConstantsSize of the spec
+
+    struct BoundSet
+    {
+        vk::DescriptorSet set;
+        std::array<uint32_t, MaxDynamicOffsets> offsets {};
+        uint32_t offsetCount = 0;
+        bool valid = false;
+    };
+
+    struct BoundVertexBuffer
+    {
+        vk::Buffer buffer;
+        vk::DeviceSize offset = 0;
+    };
+
+    class CommandBufferSink : public Sink
+    {
+    public:
+        void bindPipeline( vk::PipelineBindPoint bindPoint, vk::Pipeline pipeline ) override;
+        void bindDescriptorSets( vk::PipelineBindPoint bindPoint, vk::PipelineLayout layout, uint32_t firstSet, uint32_t setCount,
+                                 const vk::DescriptorSet* sets, uint32_t offsetCount, const uint32_t* offsets ) override;
+        void bindVertexBuffer( uint32_t binding, vk::Buffer buffer, vk::DeviceSize offset ) override;
+        void pushConstants( vk::PipelineLayout layout, vk::ShaderStageFlags stages, uint32_t offset, uint32_t size, const void* data ) override;
+        void setViewport( const vk::Viewport& viewport ) override;
+        void setScissor( const vk::Rect2D& scissor ) override;
+        void draw( uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance ) override;
+        void drawIndirect( vk::Buffer buffer, vk::DeviceSize offset, uint32_t drawCount, uint32_t stride ) override;
+
+        vk::CommandBuffer m_cmd;
+    };
+
+private:
+    CommandBufferSink m_commandBufferSink;
+    Sink* m_sink = nullptr;
+    Stats m_stats;
+
+    vk::Pipeline m_pipeline;
+    vk::PipelineLayout m_layout;
+    std::array<BoundSet, MaxSets> m_sets {};
+    std::array<BoundVertexBuffer, MaxVertexBindings> m_vertexBuffers {};
+
+    std::array<uint8_t, MaxPushConstantSize> m_pushData {};
+    std::array<bool, MaxPushConstantSize> m_pushValid {};
+
+    vk::Viewport m_viewport;
+    vk::Rect2D m_scissor;
+    bool m_viewportValid = false;
+    bool m_scissorValid = false;
+};
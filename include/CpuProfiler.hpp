@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief Scoped CPU zones, dumped to Chrome trace_event JSON (chrome://tracing or ui.perfetto.dev).
+ *
+ * Build with ENGINE_PROFILE defined (make PROFILE=1) to enable it,
+ * otherwise every macro is empty and nothing of the profiler is compiled in.
+ *
+ * PROFILE_ZONE( "name" )       time the rest of the enclosing block, the name must be a literal (or live forever)
+ * PROFILE_FUNCTION()           zone named after the function
+ * PROFILE_FRAME()              mark the end of a frame, once per frame on the main thread
+ * PROFILE_CAPTURE( frames )    write the next "frames" frames to trace_<frame number>.json
+ */
+#ifdef ENGINE_PROFILE
+
+namespace cpuprof
+{
+uint64_t now();
+void pushZone( const char* name, uint64_t begin, uint64_t end );
+void frameMark();
+void requestCapture( uint32_t frameCount );
+
+class Zone
+{
+public:
+    explicit Zone( const char* name ) : m_name( name ), m_begin( now() ) {}
+    ~Zone() { pushZone( m_name, m_begin, now() ); }
+
+    Zone( const Zone& ) = delete;
+    Zone& operator=( const Zone& ) = delete;
+
+private:
+    const char* m_name;
+    uint64_t m_begin;
+};
+} // namespace cpuprof
+
+#define PROFILE_CONCAT_IMPL( a, b ) a##b
+#define PROFILE_CONCAT( a, b ) PROFILE_CONCAT_IMPL( a, b )
+#define PROFILE_ZONE( name ) ::cpuprof::Zone PROFILE_CONCAT( profileZone, __LINE__ )( name )
+#define PROFILE_FUNCTION() PROFILE_ZONE( __func__ )
+#define PROFILE_FRAME() ::cpuprof::frameMark()
+#define PROFILE_CAPTURE( frames ) ::cpuprof::requestCapture( frames )
+
+#else
+
+#define PROFILE_ZONE( name )
+#define PROFILE_FUNCTION()
+#define PROFILE_FRAME()
+#define PROFILE_CAPTURE( frames )
+
+#endif
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "utils.hpp"
+
+/**
+ * @brief The six planes of the camera frustum.
+ * Every plane is stored as (normal.xyz, distance.w) and the normal is pointing to the inside of the frustum,
+ * so a point is inside the plane when dot( normal, point ) + distance >= 0
+ */
+struct Frustum
+{
+    glm::vec4 planes[6];
+
+    static Frustum fromViewProjection( const glm::mat4& viewproj );
+};
+
+/**
+ * @brief Bounding spheres of the renderable objects, laid out as structure of arrays (SoA).
+ * With this layout the AVX2 kernel can load 8 centers/radii with a single load instead of gathering them.
+ * The arrays are always padded to a multiple of 8, the padding spheres have a negative infinite radius so they never pass the test.
+ */
+struct BoundsSoA
+{
+    std::vector<float> centerX;
+    std::vector<float> centerY;
+    std::vector<float> centerZ;
+    std::vector<float> radius;
+
+    void resize( size_t count );
+    void set( size_t index, const glm::vec3& center, float r );
+    size_t size() const { return m_count; }
+
+private:
+    size_t m_count = 0;
+};
+
+class FrustumCuller
+{
+public:
+    FrustumCuller();
+
+public:
+    /**
+     * @brief Test every sphere of the bounds againts the frustum,
+     * and write the index of the visible ones (in ascending order) to outVisible.
+     */
+    void cull( const Frustum& frustum, const BoundsSoA& bounds, std::vector<uint32_t>& outVisible );
+
+public:
+    /**
+     * @brief Culling a synthetic scene of random spheres several times.
+     * @return the throughput in objects/ms
+     */
+    static double benchmark( size_t objectCount, uint32_t iterations );
+
+public:
+    // under this count, culling in one thread is faster than spawning the threads
+    size_t m_parallelThreshold = 16384;
+    unsigned int m_threadCount;
+    bool m_useAvx2;
+
+private:
+    static size_t cullRange( const Frustum& frustum, const BoundsSoA& bounds, size_t begin, size_t end, uint32_t* out, bool useAvx2 );
+    static size_t cullRangeScalar( const Frustum& frustum, const BoundsSoA& bounds, size_t begin, size_t end, uint32_t* out );
+    static size_t cullRangeAvx2( const Frustum& frustum, const BoundsSoA& bounds, size_t begin, size_t end, uint32_t* out );
+
+private:
+    std::vector<std::vector<uint32_t>> m_threadResults;
+};
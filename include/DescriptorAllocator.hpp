@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+/**
+ * @brief Descriptor sets from a growing list of pools
+ *
+ * When a pool is out of memory (or too fragmented), it's put on the full list and the allocation is retried on an other pool,
+ * a new pool is 1.5 times bigger than the last one (up to MaxSetsPerPool).
+ * reset() gives every set back at once and keeps the pools, so a per frame allocator can hand out transient sets without growing.
+ */
+class DescriptorAllocator
+{
+public:
+    // the descriptor count of a type in a pool is its ratio times the number of sets of the pool
+    struct PoolSizeRatio
+    {
+        vk::DescriptorType type;
+        float ratio;
+    };
+
+    struct Stats
+    {
+        uint32_t pools = 0;
+        uint32_t fullPools = 0;
+        uint32_t allocatedSets = 0;     // since the last reset
+        uint32_t totalAllocations = 0;  // since init
+        uint32_t resets = 0;
+    };
+
+public:
+    void init( vk::Device device, uint32_t initialSetsPerPool, const std::vector<PoolSizeRatio>& ratios );
+    void destroy();
+
+    vk::DescriptorSet allocate( vk::DescriptorSetLayout layout );
+    void reset();
+
+public:
+    const Stats& stats() const { return m_stats; }
+    vk::Device device() const { return m_device; }
+
+public:
+    static constexpr uint32_t MaxSetsPerPool = 4096;
+
+private:
+    vk::DescriptorPool acquirePool();
+    vk::DescriptorPool createPool( uint32_t setCount );
+
+private:
+    vk::Device m_device;
+    std::vector<PoolSizeRatio> m_ratios;
+    std::vector<vk::DescriptorPool> m_readyPools;   // the last one is the one being used
+    std::vector<vk::DescriptorPool> m_fullPools;
+    uint32_t m_setsPerPool = 0;
+    Stats m_stats;
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "DescriptorAllocator.hpp"
+
+/**
+ * @brief Descriptor set layouts, one per distinct binding array
+ *
+ * The bindings are sorted before they're compared, so the same bindings in an other order are the same layout.
+ * The same layout handle everywhere means the pipeline layouts are compatible, and the sets don't have to be bound again.
+ * Immutable samplers are not supported (they'd need to be part of the key).
+ */
+class DescriptorLayoutCache
+{
+public:
+    void init( vk::Device device );
+    void destroy();
+
+    vk::DescriptorSetLayout createLayout( std::vector<vk::DescriptorSetLayoutBinding> bindings );
+
+public:
+    size_t size() const { return m_layouts.size(); }
+
+private:
+    struct LayoutKey
+    {
+        std::vector<vk::DescriptorSetLayoutBinding> bindings;
+
+        bool operator==( const LayoutKey& other ) const;
+    };
+    struct LayoutKeyHash
+    {
+        size_t operator()( const LayoutKey& key ) const;
+    };
+
+private:
+    vk::Device m_device;
+    std::unordered_map<LayoutKey, vk::DescriptorSetLayout, LayoutKeyHash> m_layouts;
+};
+
+/**
+ * @brief Fluent builder of a descriptor set and its layout
+ *
+ *  DescriptorBuilder::begin( layoutCache, allocator )
+ *      .bindBuffer( 0, cameraInfo, vk::DescriptorType::eUniformBuffer, vk::ShaderStageFlagBits::eVertex )
+ *      .bindImage( 1, textureInfo, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment )
+ *      .build( set, layout );
+ *
+ * The layout comes from the cache, the set from the allocator, and all the writes go in a single updateDescriptorSets.
+ * bindEmpty() is a binding of the layout that is written later by someone else.
+ */
+class DescriptorBuilder
+{
+public:
+    static DescriptorBuilder begin( DescriptorLayoutCache& layoutCache, DescriptorAllocator& allocator );
+
+    DescriptorBuilder& bindBuffer( uint32_t binding, const vk::DescriptorBufferInfo& bufferInfo, vk::DescriptorType type, vk::ShaderStageFlags stages );
+    DescriptorBuilder& bindImage( uint32_t binding, const vk::DescriptorImageInfo& imageInfo, vk::DescriptorType type, vk::ShaderStageFlags stages );
+    DescriptorBuilder& bindEmpty( uint32_t binding, vk::DescriptorType type, vk::ShaderStageFlags stages );
+
+    void build( vk::DescriptorSet& outSet, vk::DescriptorSetLayout& outLayout );
+    void build( vk::DescriptorSet& outSet );
+    vk::DescriptorSetLayout buildLayout();
+
+private:
+    DescriptorBuilder( DescriptorLayoutCache& layoutCache, DescriptorAllocator& allocator );
+
+    void addBinding( uint32_t binding, vk::DescriptorType type, vk::ShaderStageFlags stages );
+
+private:
+    DescriptorLayoutCache* m_layoutCache;
+    DescriptorAllocator* m_allocator;
+
+    std::vector<vk::DescriptorSetLayoutBinding> m_bindings;
+    // the infos are pointed by the writes only when they're submitted, so the vectors can grow meanwhile
+    std::vector<vk::WriteDescriptorSet> m_writes;
+    std::vector<vk::DescriptorBufferInfo> m_bufferInfos;
+    std::vector<vk::DescriptorImageInfo> m_imageInfos;
+    std::vector<size_t> m_infoIndices;  // index of the info of every write, in its vector
+};
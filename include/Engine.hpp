@@ -9,42 +9,84 @@
 #include "vk_mem_alloc.hpp"
 
 #include "DeletionQueue.hpp"
+#include "EngineConfig.hpp"
+#include "FramePacer.hpp"
 #include "Mesh.hpp"
 #include "SceneManagement.hpp"
-
-#define FRAME_OVERLAP 2
+#include "Culling.hpp"
+#include "RenderQueue.hpp"
+#include "ObjectStorage.hpp"
+#include "ResolutionScaler.hpp"
+#include "GpuProfiler.hpp"
+#include "Overlay.hpp"
+#include "MemoryMonitor.hpp"
+#include "PipelineCache.hpp"
+#include "PipelineBuildQueue.hpp"
+#include "MaterialVariants.hpp"
+#include "DescriptorBuilder.hpp"
+#include "TextureTable.hpp"
+#include "OcclusionCuller.hpp"
+#include "RenderGraph.hpp"
+#include "LightClusters.hpp"
+#include "ShadowCascades.hpp"
 
 class Engine
 {
 public:
-    Engine();
+    Engine( const EngineConfig& config = EngineConfig{} );
     ~Engine();
 
+public:
+    // the swapchain is recreated at the start of the next frame
+    void setPresentMode( vk::PresentModeKHR presentMode );
+
 private:
     void run();
     void initWindow();
     void initVulkan();
     void mainLoop();
+    bool shouldClose();
     void cleanUp();
 
 private:
     void createMainVulkanComponent();
-    void createSwapchainComponent();
+    void createSwapchainComponent( vk::SwapchainKHR oldSwapchain = nullptr );
+    void createSwapchainImages( vk::SwapchainKHR oldSwapchain );
+    void createOffscreenImages();   // headless replacement of the swapchain images
+    void recreateSwapchain();
     void createCommandComponent();
 
 private:
-    void createRenderPass();
-    void createFramebuffers();
+    void createRenderGraph();
     void createSyncObject();
+    void createGpuProfiler();
+    void createPipelineCache();
+    void createOcclusionCuller();
+    void createLightClusters();
+    void createLights( uint32_t count );    // scattered over the empire map, the same ones for the same count
+    void advanceLightSweep();               // --light-sweep, after every frame
+    void createShadowCascades();
 
 private:
     void createMemoryAllocator();
 
 private:
     void beginFrame();  // begin to wait and reset the fence
-    void draw( vk::CommandBuffer cmd );
+    void writeReadback( FrameData& frame );     // the PNG of the frame copied to the readback buffer of this slot, if any
+    void animateObjects();  // the dynamic objects move every frame
+    void cullObjects( const glm::mat4& viewproj );
+    void prepareDraws();    // the CPU side of the scene: camera, objects, culling, sorting, and the runs
+    // phase 1 (0) and phase 2 (1) of the occlusion culling, without it everything is drawn by phase 0
+    void draw( vk::CommandBuffer cmd, uint32_t phase = 0 );
+    void upscale( vk::CommandBuffer cmd, vk::Image scene );  // blit the scene to the swapchain image
     void record();      // recording
     void endFrame();    // executing the command
+    void reportStats();
+    void dumpMemoryStats();     // VMA statistics of this moment to vma_stats_<frame>.json
+    static void keyCallback( GLFWwindow* window, int key, int scancode, int action, int mods );
+    static void scrollCallback( GLFWwindow* window, double xoffset, double yoffset );
+    void createOverlay();
+    void buildOverlay();    // the widgets of the performance HUD
 
 private:
     void uploadMesh( Mesh& mesh );
@@ -60,11 +102,6 @@ private:
     void createTriangleMesh();
     void createMonkeyMesh();
 
-private:
-    void defaultMaterial();
-    void colorMaterial();
-    void texturedMaterial();
-
 private:
     void initDescriptors();
 
@@ -79,13 +116,70 @@ private:
 private:
     vk::DescriptorSetLayout _globalSetLayout;
     vk::DescriptorSetLayout _objectSetLayout;
-    vk::DescriptorSetLayout _singleTextureSetLayout;
-    vk::DescriptorPool _descriptorPool;
+    TextureTable _textureTable;
+    DescriptorAllocator _descriptorAllocator;
+    DescriptorLayoutCache _layoutCache;
     SceneParameter _sceneParameter;
 
+private:
+    EngineConfig    _config;
+    FramePacer      _framePacer;
+    ResolutionScaler _resolutionScaler;
+    GpuProfiler     _gpuProfiler;
+    Overlay         _overlay;
+    MemoryMonitor   _memoryMonitor;
+    PipelineCache   _pipelineCache;
+    MaterialVariants _materialVariants;
+    double          _materialsMs = 0.0;     // createMaterials(), to compare the cold and the warm starts of the pipeline cache
+    PipelineBuildQueue::Stats _pipelineBuild;
+    bool            _cullingEnabled = true;
+    bool            _depthPrepassEnabled = false;
+    bool            _occlusionCullingEnabled = false;
+    bool            _occlusionCullingSupported = false;     // drawIndirectFirstInstance
+    double          _gpuTimeMs = 0.0;   // the whole frame on the GPU, FRAME_OVERLAP frames late
+
 private:
     SceneManagement _sceneManag;
 
+private:
+    FrustumCuller           _culler;
+    BoundsSoA               _objectBounds;
+    std::vector<uint32_t>   _visibleObjects;    // index to _sceneManag.renderable
+    std::vector<uint32_t>   _dirtyObjects;      // the objects that have to be written to this frame's object buffer
+    ObjectStorage           _objectStorage;
+    size_t                  _maxObjectCount = 1U << 21; // the ceiling of the object storage (it's also limited by maxStorageBufferRange)
+    RenderQueue             _renderQueue;
+    // the instanced draws of the sorted queue, a run is the objects of the same mesh and pipeline
+    struct DrawRun
+    {
+        uint32_t first;     // in the sorted queue, and in the Instance Buffer
+        uint32_t count;
+    };
+    std::vector<DrawRun>    _drawRuns;
+    GpuCameraData           _cameraData;
+    OcclusionCuller         _occlusionCuller;
+    bool                    _occlusionActive = false;   // the occlusion culling of the frame being recorded
+    LightClusters           _lightClusters;
+    std::vector<LightClusters::Light> _lights;
+    // --light-sweep: the step (light count) being measured, and the frame times of that step
+    struct LightSweep
+    {
+        size_t step = 0;
+        uint32_t frames = 0;
+        double cpuMs = 0.0;
+        double gpuMs = 0.0;
+        double assignMs = 0.0;
+        uint32_t overflowedFrames = 0;  // with lights cut from the pool, the step measured less lighting than it should
+        bool done = false;
+    }                       _lightSweep;
+    ShadowCascades          _shadowCascades;
+    std::vector<uint32_t>   _dynamicObjects;    // index to _sceneManag.renderable, moved by animateObjects()
+    // the sun, in radians: around the y axis, and up from the ground
+    float                   _sunAzimuth = 0.6f;
+    float                   _sunElevation = 0.9f;
+    RenderStats             _renderStats;
+    CommandStateTracker     _commandState;
+
 private:
     UploadContext _uploadContext;
 
@@ -95,6 +189,10 @@ private:
 public:
     static constexpr unsigned int ScreenWidth       = 1600U;
     static constexpr unsigned int ScreenHeight      = 800U;
+    static constexpr float CameraFovY               = 1.2217305f;      // 70 degrees
+    static constexpr float CameraAspect             = 1700.0f / 900.0f;
+    static constexpr float CameraNear               = 0.1f;
+    static constexpr float CameraFar                = 200.0f;
 
 private:
     GLFWwindow      * _window;
@@ -108,12 +206,18 @@ private:
     vk::PhysicalDeviceProperties _physicalDeviceProperties;
     vk::UniqueDevice            _device;
     vk::Queue _graphicsQueue;
+    uint32_t _graphicsQueueFamily = 0;
     vk::Queue _presentQueue;
+    bool _memoryBudgetSupported = false;    // VK_EXT_memory_budget
 
 private:
     vma::Allocator _allocator;
 
 private:
+    // everything that depends on the swapchain, it's flushed when the swapchain is recreated
+    DeletionQueue                   _swapchainDeletionQueue;
+    vk::PresentModeKHR              _presentMode;
+    vk::PresentModeKHR              _requestedPresentMode;
     vk::SwapchainKHR                _swapchain;
     vk::Format                      _swapchainFormat;
     vk::Extent2D                    _swapchainExtent;
@@ -123,16 +227,19 @@ private:
     std::vector<vk::ImageView>      _swapchainImageViews;
 
 private:
-    vk::RenderPass                  _renderPass;
-    std::vector<vk::Framebuffer>    _swapchainFramebuffers;
-    AllocatedImage                  _depthImage;
-    vk::ImageView                   _depthImageView;
+    // the passes of every frame, the scene and depth images are its transient images
+    RenderGraph                     _renderGraph;
+    vk::RenderPass                  _renderPass;        // compatible with the scene passes, for the pipelines
+    // the scene is rendered at _renderExtent in the top left corner of the scene image (which has the swapchain extent)
+    vk::Extent2D                    _renderExtent;
+    bool                            _sceneBlitSupported = false;
     vk::Format                      _depthFormat;
 
 private:
     // vk::PipelineLayout      _pipelineLayout;
     // vk::Pipeline            _graphicsPipeline;
     uint32_t                _frameNumber = 0;
+    uint64_t                _totalFrames = 0;   // never wraps, it's the frame number of the readback and the --frames limit
 
 private:
     // vk::UniqueCommandPool                   _commandPool;
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Startup settings of the engine, filled from the command line arguments
+ *
+ * --present-mode=<fifo|fifo-relaxed|mailbox|immediate>
+ * --fps=<target frame rate>        0 (default) means the frame pacing is off
+ * --headless                       render to offscreen images, without window, surface, and present
+ * --frames=<count>                 stop after this many frames, 0 (default) means run until the window is closed
+ * --readback=<directory>           (headless) write every rendered frame to <directory>/frame_<number>.png
+ * --dynamic-resolution=<on|off>    scale the render resolution to hold the GPU frame time under the budget (default off)
+ * --gpu-budget=<milliseconds>      0 (default) means the frame time of --fps, or of 60 fps if --fps is not set
+ * --min-render-scale=<scale>       the lowest scale per axis, 0.5 (default) to 1.0
+ * --trace=<frames>                 write the first <frames> frames to a Chrome trace (needs a PROFILE=1 build),
+ *                                  F9 captures the same number of frames (120 if not set) at any time
+ * --memory-warn=<fraction,...>     warn when the usage of a memory heap goes past these fractions of its budget (default 0.8,0.95)
+ * --pipeline-cache=<file|off>      where the pipeline cache is loaded from and saved to (default pipeline_cache.bin)
+ * --vma-dump=<file>                write the VMA statistics (JSON) to <file> at shutdown, F10 writes vma_stats_<frame>.json at any time
+ * --depth-prepass=<on|off>         lay down the depth of the opaque objects before shading them (default off)
+ * --occlusion-culling=<on|off>     two phase hierarchical-Z occlusion culling on the GPU (default off, needs GPU support)
+ * --lights=<count>                 point and spot lights of the clustered lighting (default 0)
+ * --light-sweep=<count,...>        benchmark: run LightSweepFrames frames with every light count, print the frame times, and exit
+ * --dynamic-casters=<count>        moving objects over the map, their shadows are rendered every frame (default 8)
+ * --shadow-cache=<on|off>          keep the shadow maps of the static objects until they're invalid (default on),
+ *                                  off renders them every frame
+ */
+struct EngineConfig
+{
+    vk::PresentModeKHR presentMode = vk::PresentModeKHR::eFifo;
+    double targetFrameRate = 0.0;
+    bool headless = false;
+    uint64_t frameCount = 0;
+    std::string readbackDirectory;
+    bool dynamicResolution = false;
+    double gpuBudgetMs = 0.0;
+    float minRenderScale = 0.5f;
+    uint32_t traceFrames = 0;
+    std::vector<double> memoryWarnings = { 0.8, 0.95 };
+    std::string vmaDumpFile;
+    std::string pipelineCacheFile = "pipeline_cache.bin";   // empty means no file, the cache only lives in the process
+    bool depthPrepass = false;
+    bool occlusionCulling = false;
+    uint32_t lightCount = 0;
+    std::vector<uint32_t> lightSweep;
+    uint32_t dynamicCasters = 8;
+    bool shadowCache = true;
+
+    static constexpr uint32_t LightSweepWarmup = 2 * 64;    // the GPU timings are averaged over 64 frames
+    static constexpr uint32_t LightSweepFrames = 256;
+
+    double resolvedGpuBudgetMs() const;
+
+    static EngineConfig fromArguments( int argc, char** argv );
+};
+
+namespace utils
+{
+bool parsePresentMode( const std::string& name, vk::PresentModeKHR& outPresentMode );
+} // namespace utils
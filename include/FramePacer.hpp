@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <array>
+
+/**
+ * @brief Holding the frame to a target frame time.
+ * The OS sleep is not precise (it can wake up late by a fraction of millisecond),
+ * so it sleeps until a bit before the deadline, and then spin for the rest of the time.
+ */
+class FramePacer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+public:
+    // 0 is turning the pacing off, but the frame time is still measured
+    void setTargetFrameRate( double framesPerSecond );
+    double targetFrameTimeMs() const;
+
+    // called once at the end of every frame
+    void wait();
+
+public:
+    double averageFrameTimeMs() const { return m_averageMs; }
+    double lastFrameTimeMs() const { return m_lastMs; }
+    // root mean square of the difference between the frame time and the target (or the average if the pacing is off), over the last SampleCount frames
+    double jitterMs() const { return m_jitterMs; }
+    // the worst difference from the target (or the average), over the last SampleCount frames
+    double maxDeviationMs() const { return m_maxDeviationMs; }
+
+public:
+    // how long before the deadline the sleep stops and the spin starts
+    Clock::duration m_spinMargin = std::chrono::microseconds( 1500 );
+
+private:
+    void record( Clock::time_point now );
+
+private:
+    Clock::duration m_targetFrameTime = Clock::duration::zero();
+    Clock::time_point m_deadline;
+    Clock::time_point m_lastFrame;
+    bool m_started = false;
+
+private:
+    static constexpr size_t SampleCount = 120;
+    std::array<double, SampleCount> m_samples {};
+    size_t m_sampleIndex = 0;
+    size_t m_sampleFilled = 0;
+    double m_averageMs = 0.0;
+    double m_lastMs = 0.0;
+    double m_jitterMs = 0.0;
+    double m_maxDeviationMs = 0.0;
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <string>
+#include <unordered_map>
+
+#include "utils.hpp"
+
+/**
+ * @brief Scoped GPU timestamps, labeled with VK_EXT_debug_utils regions.
+ *
+ * Every context (one per frame slot, and one for immediateSubmit) has its own query pool.
+ * A context is reset by begin(), gets its scopes written while recording,
+ * and is read by collect() after the fence of that submit has been waited,
+ * so collecting never stalls (for a frame slot the results are FRAME_OVERLAP frames late).
+ * Scopes with the same name in one recording are summed, and every name keeps a rolling average over AverageWindow samples.
+ *
+ * The scope name is copied, so it can be a temporary (the name of a material that is renamed or destroyed before collect()).
+ */
+class GpuProfiler
+{
+public:
+    static constexpr uint32_t ImmediateContext = FRAME_OVERLAP;
+    static constexpr uint32_t MaxScopes = 128;
+    static constexpr size_t AverageWindow = 64;
+
+    struct Timing
+    {
+        std::string name;
+        double lastMs = 0.0;
+        double averageMs = 0.0;
+        double maxMs = 0.0;     // the worst sample in the window
+        uint64_t samples = 0;
+    };
+
+public:
+    // returns false if the queue family has no timestamp, the debug labels still work in that case
+    bool init( vk::Instance instance, vk::PhysicalDevice physicalDevice, vk::Device device, uint32_t queueFamily );
+    void destroy();
+    bool hasTimestamps() const { return m_timestampPeriod > 0.0; }
+
+public:
+    // reset the queries of the context, must be recorded outside of a render pass
+    void begin( uint32_t context, vk::CommandBuffer cmd );
+
+    /**
+     * @brief Read the last recording of the context (non blocking)
+     * @param outSpanMs the time from the first begin to the last end of all scopes of that recording
+     * @return true if there were new results
+     */
+    bool collect( uint32_t context, double* outSpanMs = nullptr );
+
+    uint32_t beginScope( vk::CommandBuffer cmd, const char* name );
+    void endScope( vk::CommandBuffer cmd, uint32_t scope );
+
+public:
+    const std::vector<Timing>& timings() const { return m_timings; }
+    const Timing* find( const std::string& name ) const;
+
+private:
+    struct Scope
+    {
+        std::string name;
+        bool timed;     // false when the pool is full, the scope is just a debug label
+    };
+
+    struct Context
+    {
+        vk::QueryPool pool;
+        std::vector<Scope> scopes;
+        bool pending = false;
+    };
+
+    void addSample( const char* name, double ms );
+
+private:
+    vk::Device m_device;
+    double m_timestampPeriod = 0.0;     // nanoseconds per tick
+    std::array<Context, FRAME_OVERLAP + 1> m_contexts;
+    uint32_t m_current = 0;
+
+private:
+    PFN_vkCmdBeginDebugUtilsLabelEXT m_cmdBeginLabel = nullptr;
+    PFN_vkCmdEndDebugUtilsLabelEXT m_cmdEndLabel = nullptr;
+
+private:
+    std::vector<Timing> m_timings;
+    std::vector<std::array<double, AverageWindow>> m_windows;
+    std::unordered_map<std::string, size_t> m_timingIndex;
+    std::vector<uint64_t> m_results;
+};
+
+/**
+ * @brief RAII GPU scope
+ */
+class GpuScope
+{
+public:
+    GpuScope( GpuProfiler& profiler, vk::CommandBuffer cmd, const char* name )
+        : m_profiler( profiler ), m_cmd( cmd ), m_scope( profiler.beginScope( cmd, name ) ) {}
+    ~GpuScope() { m_profiler.endScope( m_cmd, m_scope ); }
+
+    GpuScope( const GpuScope& ) = delete;
+    GpuScope& operator=( const GpuScope& ) = delete;
+
+private:
+    GpuProfiler& m_profiler;
+    vk::CommandBuffer m_cmd;
+    uint32_t m_scope;
+};
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <array>
+#include <vector>
+
 #include <vulkan/vulkan.hpp>
 
 #include "DeletionQueue.hpp"
@@ -22,12 +25,25 @@ private:
     void createRasterizationState();
     void createMultisampleState();
     void createColorBlendState();
+    void createDynamicState();
+
+public:
+    // the constants are copied, so the info doesn't have to outlive this call (it has to be called after init)
+    void setSpecializationInfo( vk::ShaderStageFlagBits stage, const vk::SpecializationInfo& info );
+
+    /**
+     * @brief Turn the configured pipeline to its depth prepass version (it has to be called after the vertex input is set)
+     * No fragment stage, only the position attribute, no color write, and the depth is tested and written.
+     * The vertex shader has to compute gl_Position exactly like the main pass one (invariant), or the equal test of the main pass fails.
+     */
+    void makeDepthOnly();
 
 public:
     static vk::PipelineDepthStencilStateCreateInfo createDepthStencilInfo( bool bDepthTest, bool bDepthWrite, vk::CompareOp compareOp );
 
 public:
-    void createGraphicsPipeline( const vk::RenderPass& renderpass, vk::PipelineLayout pipelineLayout, DeletionQueue& deletor );
+    // with a pipeline cache, the driver reuses the compiled shaders of the earlier runs
+    void createGraphicsPipeline( const vk::RenderPass& renderpass, vk::PipelineLayout pipelineLayout, DeletionQueue& deletor, vk::PipelineCache pipelineCache = nullptr );
 
 public:
     vk::PipelineLayout getPipelineLayout() const;
@@ -38,6 +54,15 @@ public:
     vk::UniqueShaderModule m_fragShaderModule;
     std::vector<vk::PipelineShaderStageCreateInfo> m_shaderStagesInfo {};
 
+public:
+    struct StageSpecialization
+    {
+        std::vector<vk::SpecializationMapEntry> entries;
+        std::vector<uint8_t> data;
+        vk::SpecializationInfo info;
+    };
+    std::array<StageSpecialization, 2> m_specializations {};   // vertex, fragment (the order of m_shaderStagesInfo)
+
 public:
     VertexInputDescription m_vertexInputDesc;
     vk::PipelineVertexInputStateCreateInfo m_vertexInputStateInfo {};
@@ -50,6 +75,11 @@ public:
     vk::Rect2D m_scissor {};
     vk::PipelineViewportStateCreateInfo m_viewportStateInfo {};
 
+public:
+    // viewport and scissor are set by the command buffer, so the render resolution can change without rebuilding the pipeline
+    std::vector<vk::DynamicState> m_dynamicStates {};
+    vk::PipelineDynamicStateCreateInfo m_dynamicStateInfo {};
+
 public:
     vk::PipelineRasterizationStateCreateInfo m_rasterizationStateInfo {};
 
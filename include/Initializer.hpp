@@ -32,7 +32,8 @@ VKAPI_ATTR VkBool32 VKAPI_CALL
 
 std::vector<const char*> getValidationLayers();
 
-std::vector<const char*> getRequiredExtensions();
+// headless doesn't need the window system extensions of GLFW
+std::vector<const char*> getRequiredExtensions( bool headless = false );
 
 VkResult CreateDebugUtilsMessengerEXT(
     VkInstance instance,
@@ -47,9 +48,12 @@ void DestroyDebugUtilsMessengerEXT(
     const VkAllocationCallbacks* pAllocator
 );
 
+bool HasDeviceExtension( const vk::PhysicalDevice& physicalDevice, const char* extensionName );
+
 bool IsDeviceSuitable(  const vk::PhysicalDevice& physicalDevice,
                         const vk::SurfaceKHR& surface );
 
+// if the surface is null (headless), the present family is the same as the graphics family, and it's never used for presenting
 QueueFamilyIndices FindQueueFamilyIndices(  const vk::PhysicalDevice& physicalDevice,
                                             const vk::SurfaceKHR& surface );
 
@@ -58,7 +62,8 @@ namespace sc // sc = swapchain
 {
 vk::Extent2D chooseSurfaceExtent( vk::SurfaceCapabilitiesKHR& surfaceCapabilities );
 vk::SurfaceFormatKHR chooseSurfaceFormat( std::vector<vk::SurfaceFormatKHR>& surfaceFormats );
-vk::PresentModeKHR choosePresentMode( std::vector<vk::PresentModeKHR>& presentModes );
+// returns the preferred present mode if it's supported, otherwise FIFO (the only one that must be supported)
+vk::PresentModeKHR choosePresentMode( std::vector<vk::PresentModeKHR>& presentModes, vk::PresentModeKHR preferred );
 } // namespace sc
 
 namespace gp    // gp = graphics pipeline
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "Culling.hpp"
+#include "DescriptorBuilder.hpp"
+#include "DeletionQueue.hpp"
+#include "utils.hpp"
+
+/**
+ * @brief Clustered forward lighting of the point and spot lights
+ *
+ * The view frustum is split into a grid of froxels (ClusterX * ClusterY tiles of the render extent, ClusterZ slices
+ * of the view depth, exponentially spaced from the near to the far plane).
+ *  CPU    : the lights outside of the view frustum are dropped, the rest is written in view space to the Light Buffer.
+ *  compute: light_cluster.comp has one work group per cluster, it tests every light against the box of the cluster,
+ *           takes a range of the light index pool with an atomic offset, and writes the offset and the count of the
+ *           cluster, and the indices of the lights that touch it.
+ *  shading: material.frag finds the cluster of the fragment, and loops over the lights of that cluster only.
+ *
+ * The pool is shared by the clusters, so a cluster has no cap of its own. It grows from the stats of the frame slot
+ * (the sum of the lights of every cluster, before the cut to the pool), the frame that overflows it drops the lights
+ * that didn't fit, and counts its clusters in overflowedClusters.
+ *
+ * The buffers are in the global descriptor set of every frame (binding 2, 3, 4), see prepare().
+ * The stats are read FRAME_OVERLAP frames late, when the fence of the frame slot has been waited.
+ */
+class LightClusters
+{
+public:
+    static constexpr uint32_t ClusterX = 16;
+    static constexpr uint32_t ClusterY = 9;
+    static constexpr uint32_t ClusterZ = 24;
+    static constexpr uint32_t ClusterCount = ClusterX * ClusterY * ClusterZ;
+    static constexpr uint32_t MinLightIndices = ClusterCount * 16;     // the first size of the light index pool
+
+    // a light of the scene, in world space
+    struct Light
+    {
+        glm::vec3 position;
+        float range;
+        glm::vec3 color;
+        float intensity;
+        glm::vec3 direction;    // spot only
+        float innerAngle;       // spot only, radians from the direction to the edge of the full intensity
+        float outerAngle;       // 0 for a point light
+    };
+
+    struct GpuLight                     // std430, 48 bytes, in view space
+    {
+        glm::vec4 positionRange;        // xyz position, w range
+        glm::vec4 colorCosInner;        // rgb color times intensity, w cosine of the inner angle
+        glm::vec4 directionCosOuter;    // xyz direction, w cosine of the outer angle (-2 for a point light)
+    };
+
+    struct Stats
+    {
+        uint32_t lights = 0;
+        uint32_t visibleLights = 0;     // in the view frustum, the ones that are clustered
+        uint32_t lightIndices = 0;      // the sum of the lights of every cluster
+        uint32_t lightIndexCapacity = 0;
+        uint32_t maxClusterLights = 0;
+        uint32_t overflowedClusters = 0;    // the clusters that didn't fit in the pool
+    };
+
+public:
+    void init( vk::Device device, vma::Allocator allocator, DescriptorLayoutCache& layoutCache, vk::PipelineCache pipelineCache );
+    void destroy();
+
+public:
+    /**
+     * @brief Read the stats of the last recording of this frame slot, write the visible lights,
+     * and point the light bindings of the global set of this frame to the buffers (when they're new)
+     */
+    void prepare( uint32_t frameIndex, vk::DescriptorSet globalSet, const std::vector<Light>& lights, const glm::mat4& view, const glm::mat4& viewproj );
+
+    // in a compute pass of the render graph that writes the cluster buffer and the light index buffer
+    void recordAssign( vk::CommandBuffer cmd, uint32_t frameIndex, const glm::mat4& projection, vk::Extent2D renderExtent,
+                       float zNear, float zFar, DescriptorAllocator& transientDescriptors );
+
+    // the cluster of a fragment: xy is multiplied with gl_FragCoord.xy, z and w are the scale and the bias of log( view depth )
+    static glm::vec4 clusterScale( vk::Extent2D renderExtent, float zNear, float zFar );
+
+public:
+    vk::Buffer clusterBuffer( uint32_t frameIndex ) const { return m_frames[frameIndex].clusterBuffer.buffer; }
+    vk::Buffer lightIndexBuffer( uint32_t frameIndex ) const { return m_frames[frameIndex].lightIndexBuffer.buffer; }
+    const Stats& stats() const { return m_stats; }
+
+private:
+    void createPipeline( vk::PipelineCache pipelineCache );
+
+private:
+    struct FrameBuffers
+    {
+        AllocatedBuffer lightBuffer;        // persistently mapped
+        AllocatedBuffer clusterBuffer;      // the offset in the pool and the light count of every cluster
+        AllocatedBuffer lightIndexBuffer;   // the pool of the light indices, shared by the clusters
+        AllocatedBuffer statsBuffer;        // persistently mapped, read back
+        GpuLight* lights = nullptr;
+        uint32_t* stats = nullptr;
+        size_t lightCapacity = 0;
+        uint32_t lightIndexCapacity = 0;
+        uint32_t lightCount = 0;            // of the last recording
+        uint32_t totalLights = 0;
+        bool recorded = false;
+    };
+
+    struct AssignPushConstant
+    {
+        glm::mat4 inverseProjection;
+        float renderSize[2];
+        float zNear;
+        float zFar;
+        uint32_t lightCount;
+        uint32_t lightIndexCapacity;
+    };
+
+private:
+    vk::Device m_device;
+    vma::Allocator m_allocator;
+    DescriptorLayoutCache* m_layoutCache = nullptr;
+    DeletionQueue m_deletionQueue;
+
+private:
+    vk::DescriptorSetLayout m_setLayout;
+    vk::PipelineLayout m_layout;
+    vk::Pipeline m_pipeline;
+
+private:
+    std::array<FrameBuffers, FRAME_OVERLAP> m_frames;
+    std::vector<GpuLight> m_visible;
+    Stats m_stats;
+};
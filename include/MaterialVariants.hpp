@@ -0,0 +1,74 @@
+#pragma once
+
+#include <future>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "DeletionQueue.hpp"
+#include "PipelineBuildQueue.hpp"
+
+/**
+ * @brief The features of a material variant, they're the bits of the specialization constant of shaders/material.frag
+ */
+enum MaterialFeature : uint32_t
+{
+    MaterialTextured    = 1U << 0,
+    MaterialAmbient     = 1U << 1,
+    MaterialFog         = 1U << 2,
+    MaterialLights      = 1U << 3,      // the point and spot lights of the clustered lighting
+    MaterialSun         = 1U << 4,      // the sunlight, and the cascaded shadows of it
+};
+
+/**
+ * @brief Pipelines of the mesh materials, keyed by their feature bitmask
+ *
+ * Every variant is the same uber shader (vertex_shader.vert + material.frag) specialized by the bitmask,
+ * so a new combination of features is a new pipeline, not a new shader file.
+ * A variant is built once, the next request of the same bitmask gets the same pipeline.
+ *
+ * Every variant also has the pipeline of the main pass after the depth prepass (equal depth test, no depth write),
+ * and all of them share one depth only pipeline (depth_only.vert, no fragment shader):
+ * the depth doesn't depend on the material features, so there is nothing to specialize.
+ */
+class MaterialVariants
+{
+public:
+    struct Variant
+    {
+        vk::PipelineLayout layout;
+        vk::Pipeline pipeline;
+        vk::Pipeline equalPipeline;     // after the depth prepass
+        vk::Pipeline depthPipeline;     // the depth prepass
+    };
+
+public:
+    // the set layouts are global, object, and the texture table, every variant has the same pipeline layout
+    void init( vk::Device device, vk::RenderPass renderPass, vk::Extent2D extent, 
+        const std::vector<vk::DescriptorSetLayout>& setLayouts, DeletionQueue& deletor );
+
+    // queue the variant on the build queue, unless it's already built or queued
+    void request( uint32_t features, PipelineBuildQueue& buildQueue );
+    // the variant has to be requested, and the build queue built
+    Variant get( uint32_t features ) const;
+
+    static std::string name( uint32_t features );
+
+private:
+    struct Entry
+    {
+        vk::PipelineLayout layout;
+        std::shared_future<vk::Pipeline> pipeline;
+        std::shared_future<vk::Pipeline> equalPipeline;
+    };
+
+private:
+    vk::Device m_device;
+    vk::RenderPass m_renderPass;
+    vk::Extent2D m_extent;
+    vk::PipelineLayout m_layout;
+    std::unordered_map<uint32_t, Entry> m_variants;
+    std::shared_future<vk::Pipeline> m_depthPipeline;
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include "utils.hpp"
+
+/**
+ * @brief VMA budget and statistics of every memory heap.
+ *
+ * The budget (vmaGetBudget) is cheap, so it's read every update(),
+ * the full statistics (vmaCalculateStats) traverse every block, so they're only calculated every m_statsInterval updates.
+ * With VK_EXT_memory_budget the budget and the usage come from the driver (and include the other processes),
+ * without it the budget is estimated by VMA as 80% of the heap size.
+ *
+ * A warning is printed when the usage of a heap goes past one of the thresholds (fractions of the budget),
+ * once per threshold, until the usage goes back under it.
+ */
+class MemoryMonitor
+{
+public:
+    struct HeapReport
+    {
+        vk::DeviceSize size = 0;
+        bool deviceLocal = false;
+        // from the budget
+        vk::DeviceSize budget = 0;
+        vk::DeviceSize usage = 0;
+        vk::DeviceSize blockBytes = 0;
+        vk::DeviceSize allocationBytes = 0;
+        // from the statistics
+        uint32_t blockCount = 0;
+        uint32_t allocationCount = 0;
+        vk::DeviceSize unusedBytes = 0;
+        // number of thresholds the usage is past
+        size_t warningLevel = 0;
+    };
+
+public:
+    void init( vma::Allocator allocator, vk::PhysicalDevice physicalDevice, bool budgetExtension );
+    void setWarningThresholds( std::vector<double> fractions );
+
+    void update();
+    bool dumpJson( const std::string& filename ) const;
+
+public:
+    const std::vector<HeapReport>& heaps() const { return m_heaps; }
+    bool budgetExtension() const { return m_budgetExtension; }
+
+public:
+    uint32_t m_statsInterval = 60;
+
+private:
+    void checkThresholds( uint32_t heapIndex );
+
+private:
+    vma::Allocator m_allocator;
+    bool m_budgetExtension = false;
+    std::vector<HeapReport> m_heaps;
+    std::vector<double> m_thresholds = { 0.8, 0.95 };
+    uint32_t m_updateCount = 0;
+};
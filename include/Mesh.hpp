@@ -71,6 +71,10 @@ struct Mesh
 {
     std::vector<Vertex> vertices;
     AllocatedBuffer vertexBuffer;
+    // bounding sphere in the local space of the mesh, xyz is the center and w is the radius
+    glm::vec4 bounds { 0.0f };
+    uint32_t id = 0;    // assigned by SceneManagement, used by the sort key of the draw
 
     bool loadFromObj( const std::string& filename );
+    void computeBounds();
 };
\ No newline at end of file
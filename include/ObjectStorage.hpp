@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+
+#include "utils.hpp"
+
+/**
+ * @brief Per frame storage of the objects (Object Buffer and Instance Buffer) that grows with the scene.
+ *
+ * reserve() just decides the new capacity (geometric growth, shrink when it's mostly unused),
+ * the real reallocation happens in update() of every frame, i.e. after the fence of that frame is waited,
+ * so the old buffers and the descriptor set of that frame are no longer used by the GPU.
+ * The frames can have different capacity for a moment, until every frame has got its turn.
+ */
+class ObjectStorage
+{
+public:
+    void init( vma::Allocator allocator, vk::Device device, size_t initialCapacity, size_t maxCapacity );
+    void destroy();
+
+public:
+    void reserve( size_t objectCount );
+
+    /**
+     * @brief Reallocate the buffers of this frame if its capacity is not the chosen capacity,
+     * and point the object descriptor set (binding 0 and 1) to the new buffers.
+     * @return true if reallocated, the new object buffer is empty, so every object has to be written again
+     */
+    bool update( uint32_t frameIndex, vk::DescriptorSet objectSet );
+
+public:
+    GpuObjectData* objects( uint32_t frameIndex ) const { return m_frames[frameIndex].objectData; }
+    uint32_t* instances( uint32_t frameIndex ) const { return m_frames[frameIndex].instanceData; }
+    vk::Buffer objectBuffer( uint32_t frameIndex ) const { return m_frames[frameIndex].objectBuffer.buffer; }
+    // twice the capacity, the occlusion culling writes its second phase in the second half
+    vk::Buffer instanceBuffer( uint32_t frameIndex ) const { return m_frames[frameIndex].instanceBuffer.buffer; }
+    size_t capacity( uint32_t frameIndex ) const { return m_frames[frameIndex].capacity; }
+    size_t maxCapacity() const { return m_maxCapacity; }
+    vk::DeviceSize reservedBytes() const;
+
+public:
+    static constexpr size_t MinCapacity = 1024;
+    static constexpr size_t InstanceSlots = 2;     // instances per object, one for each occlusion culling phase
+
+private:
+    struct FrameBuffers
+    {
+        AllocatedBuffer objectBuffer;
+        AllocatedBuffer instanceBuffer;
+        GpuObjectData* objectData = nullptr;    // both buffers are persistently mapped
+        uint32_t* instanceData = nullptr;
+        size_t capacity = 0;
+    };
+
+    void release( FrameBuffers& frame );
+
+private:
+    std::array<FrameBuffers, FRAME_OVERLAP> m_frames;
+    size_t m_targetCapacity = MinCapacity;
+    size_t m_maxCapacity = 0;
+
+private:
+    vma::Allocator m_allocator;
+    vk::Device m_device;
+};
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <glm/vec4.hpp>
+
+#include "DeletionQueue.hpp"
+#include "DescriptorBuilder.hpp"
+#include "utils.hpp"
+
+/**
+ * @brief Hierarchical-Z occlusion culling, in two phases
+ *
+ * The frustum culled and sorted draws are the candidates, every run of them (same mesh and pipeline) has one indirect draw per phase.
+ *  phase 1: the candidates that were visible last frame are appended to their draw, and drawn.
+ *  HZB    : the depth of phase 1 is reduced to a max depth pyramid (hzb_reduce.comp).
+ *  phase 2: every candidate is tested against the HZB, the visibility is stored for the next frame,
+ *           and the visible ones that were not drawn by phase 1 are appended to their draw of phase 2, and drawn.
+ * The candidates are appended by occlusion_cull.comp, it writes the instance count of the indirect draws
+ * and the object indices to the Instance Buffer (phase 1 in the first half, phase 2 in the second half).
+ *
+ * The blended candidates are not occlusion culled (the appends would lose their back to front order): phase 2 writes them
+ * to their own slot of the sorted order, and their draws of phase 2 have the whole run as instance count from the start.
+ * A run is all blended or all opaque, it's one pipeline.
+ * The counts are read FRAME_OVERLAP frames late, when the fence of the frame slot has been waited.
+ * The draws need drawIndirectFirstInstance (every draw starts at its own place in the Instance Buffer).
+ */
+class OcclusionCuller
+{
+public:
+    struct Candidate            // std430, 32 bytes
+    {
+        glm::vec4 sphere;       // world space center, and radius
+        uint32_t objectIndex;
+        uint32_t draw;          // the run of the candidate, the same for both phases
+        uint32_t flags;
+        uint32_t padding;
+    };
+    static constexpr uint32_t CandidateBlended = 1U << 0;
+
+    struct Stats
+    {
+        uint32_t candidates = 0;
+        uint32_t phase1Objects = 0;     // visible last frame
+        uint32_t phase2Objects = 0;     // visible this frame, but not last frame, and the blended ones
+        uint32_t occludedObjects = 0;
+    };
+
+public:
+    static bool isSupported( vk::PhysicalDevice physicalDevice );
+
+    void init( vk::Device device, vma::Allocator allocator, DescriptorLayoutCache& layoutCache, vk::PipelineCache pipelineCache );
+    void destroy();
+
+    // the HZB follows the depth image, so it's remade with the swapchain
+    void createTargets( vk::Extent2D depthExtent, DeletionQueue& swapchainDeletor );
+
+public:
+    /**
+     * @brief Read the counts of the last recording of this frame slot, and write its candidates and its indirect draws
+     * @param firstInstances the first slot of every run in the Instance Buffer (the same for both phases, phase 2 adds the candidate count),
+     *        it's the index of the first candidate of the run: a blended candidate goes to the slot of its own index
+     */
+    void prepare( uint32_t frameIndex, uint32_t objectCount, const std::vector<Candidate>& candidates,
+                  const std::vector<uint32_t>& vertexCounts, const std::vector<uint32_t>& firstInstances );
+
+    /**
+     * @brief Phase 0 or 1, in a compute pass of the render graph
+     * The pass writes the draw buffer and the instance buffer, the graph puts the barrier between it and the draws.
+     * Its own buffers (candidates, visibility, counts) and the HZB are not in the graph, the culler keeps them in order.
+     */
+    void recordCull( vk::CommandBuffer cmd, uint32_t frameIndex, uint32_t phase, const glm::mat4& viewproj, vk::Extent2D renderExtent,
+                     vk::Buffer instanceBuffer, DescriptorAllocator& transientDescriptors );
+    // in a compute pass that samples the depth image (the graph moves it to eShaderReadOnlyOptimal)
+    void recordHzb( vk::CommandBuffer cmd, vk::ImageView depthView, vk::Extent2D renderExtent, DescriptorAllocator& transientDescriptors );
+
+public:
+    vk::Buffer drawBuffer( uint32_t frameIndex ) const { return m_frames[frameIndex].drawBuffer.buffer; }
+    vk::DeviceSize drawOffset( uint32_t phase, uint32_t draw ) const { return ( phase * m_drawCount + draw ) * sizeof( vk::DrawIndirectCommand ); }
+    const Stats& stats() const { return m_stats; }
+
+private:
+    void createPipelines( vk::PipelineCache pipelineCache );
+    void retireBuffer( AllocatedBuffer buffer );
+
+private:
+    struct FrameBuffers
+    {
+        AllocatedBuffer candidateBuffer;    // persistently mapped
+        AllocatedBuffer drawBuffer;         // persistently mapped, the GPU adds the instance counts
+        AllocatedBuffer statsBuffer;        // persistently mapped, read back
+        Candidate* candidates = nullptr;
+        vk::DrawIndirectCommand* draws = nullptr;
+        uint32_t* stats = nullptr;
+        size_t candidateCapacity = 0;
+        size_t drawCapacity = 0;
+        uint32_t candidateCount = 0;        // of the last recording
+        bool recorded = false;              // the stats buffer has been written by a recording
+    };
+
+    struct CullPushConstant
+    {
+        glm::mat4 viewproj;
+        float viewportSize[2];
+        int32_t hzbSize[2];
+        uint32_t candidateCount;
+        uint32_t drawCount;
+        uint32_t phase;
+        int32_t hzbLevels;
+    };
+
+    struct ReducePushConstant
+    {
+        int32_t srcSize[2];
+        int32_t dstSize[2];
+        int32_t srcLevel;   // -1 reads the depth image
+    };
+
+private:
+    vk::Device m_device;
+    vma::Allocator m_allocator;
+    DescriptorLayoutCache* m_layoutCache = nullptr;
+    DeletionQueue m_deletionQueue;
+
+private:
+    vk::DescriptorSetLayout m_cullSetLayout;
+    vk::DescriptorSetLayout m_reduceSetLayout;
+    vk::PipelineLayout m_cullLayout;
+    vk::PipelineLayout m_reduceLayout;
+    vk::Pipeline m_cullPipeline;
+    vk::Pipeline m_reducePipeline;
+    vk::Sampler m_sampler;
+
+private:
+    // max depth pyramid, level 0 is half of the depth image, every level stays in eGeneral
+    AllocatedImage m_hzbImage;
+    vk::ImageView m_hzbView;
+    std::vector<vk::ImageView> m_hzbLevelViews;
+    vk::Extent2D m_hzbExtent;
+    bool m_hzbInitialized = false;
+
+private:
+    std::array<FrameBuffers, FRAME_OVERLAP> m_frames;
+    uint32_t m_candidateCount = 0;
+    uint32_t m_drawCount = 0;
+    Stats m_stats;
+
+private:
+    // one for all frames, the visibility of every object in the last frame
+    AllocatedBuffer m_visibilityBuffer;
+    size_t m_visibilityCapacity = 0;
+    bool m_visibilityCleared = false;
+
+    // the buffers that are replaced while a frame in flight may still use them, destroyed FRAME_OVERLAP prepares later
+    std::vector<std::pair<uint64_t, AllocatedBuffer>> m_retiredBuffers;
+    uint64_t m_prepareCount = 0;
+};
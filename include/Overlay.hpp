@@ -0,0 +1,107 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <GLFW/glfw3.h>
+
+#include "DeletionQueue.hpp"
+#include "utils.hpp"
+
+/**
+ * @brief Dear ImGui renderer, drawn in its own pass on top of the swapchain image (after the upscale),
+ * so the text stays sharp whatever the render resolution is.
+ *
+ * The overlay pass is a graphics pass of the render graph that loads the swapchain image,
+ * the graph begins the render pass, and render() just records in it. Headless has no input, so it has no overlay.
+ * When it's hidden nothing is recorded at all, not even ImGui::NewFrame().
+ *
+ * Just the core of ImGui is bundled (no backends), so the GLFW input and the Vulkan rendering are done here.
+ */
+class Overlay
+{
+public:
+    // the render pass is only for the pipeline, a render pass compatible with the overlay pass (one color attachment of the swapchain format)
+    void init( vk::Device device, vma::Allocator allocator, vk::RenderPass renderPass, vk::PipelineCache pipelineCache = nullptr );
+    void destroy();
+
+    // the swapchain extent, it changes with the swapchain
+    void setExtent( vk::Extent2D extent ) { m_extent = extent; }
+
+    // the font texture is uploaded by the caller's command buffer, then the staging buffer is released
+    void recordFontUpload( vk::CommandBuffer cmd );
+    void releaseUploadBuffer();
+
+public:
+    void setVisible( bool visible ) { m_visible = visible; }
+    bool visible() const { return m_visible; }
+    void addScroll( float amount ) { m_scroll += amount; }
+
+    // feed the input and begin the ImGui frame, the widgets can be made after this
+    void newFrame( GLFWwindow* window, float deltaTime );
+    // end the ImGui frame and record the overlay, in the overlay pass
+    void render( vk::CommandBuffer cmd, uint32_t frameIndex );
+
+public:
+    // frame time history for the graphs
+    static constexpr size_t HistorySize = 120;
+    void pushFrameTimes( float cpuMs, float gpuMs );
+    const std::array<float, HistorySize>& cpuHistory() const { return m_cpuHistory; }
+    const std::array<float, HistorySize>& gpuHistory() const { return m_gpuHistory; }
+    int historyOffset() const { return static_cast<int>( m_historyOffset ); }
+
+private:
+    void createFontTexture();
+    void createPipeline( vk::PipelineCache pipelineCache );
+    void reserveGeometry( uint32_t frameIndex, size_t vertexCount, size_t indexCount );
+
+private:
+    struct FrameGeometry
+    {
+        AllocatedBuffer vertexBuffer;
+        AllocatedBuffer indexBuffer;
+        void* vertexData = nullptr;     // persistently mapped
+        void* indexData = nullptr;
+        size_t vertexCapacity = 0;
+        size_t indexCapacity = 0;
+    };
+
+    struct OverlayPushConstant
+    {
+        float scale[2];
+        float translate[2];
+    };
+
+private:
+    vk::Device m_device;
+    vma::Allocator m_allocator;
+    DeletionQueue m_deletionQueue;
+
+private:
+    vk::RenderPass m_renderPass;
+    vk::Extent2D m_extent;
+
+private:
+    vk::DescriptorPool m_descriptorPool;
+    vk::DescriptorSetLayout m_setLayout;
+    vk::DescriptorSet m_fontSet;
+    vk::PipelineLayout m_pipelineLayout;
+    vk::Pipeline m_pipeline;
+
+private:
+    AllocatedImage m_fontImage;
+    vk::ImageView m_fontImageView;
+    vk::Sampler m_fontSampler;
+    AllocatedBuffer m_uploadBuffer;
+    vk::Extent3D m_fontExtent;
+
+private:
+    std::array<FrameGeometry, FRAME_OVERLAP> m_geometry;
+
+private:
+    bool m_visible = false;
+    float m_scroll = 0.0f;
+    std::array<float, HistorySize> m_cpuHistory {};
+    std::array<float, HistorySize> m_gpuHistory {};
+    size_t m_historyOffset = 0;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <functional>
+#include <future>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "DeletionQueue.hpp"
+#include "GraphicsPipeline.hpp"
+#include "PipelineCache.hpp"
+
+/**
+ * @brief Everything to build one graphics pipeline, without touching the device yet
+ */
+struct PipelineDescription
+{
+    std::string name;       // just for the errors
+    std::string vertFile;
+    std::string fragFile;   // empty for a depth only pipeline
+    vk::RenderPass renderPass;
+    vk::PipelineLayout layout;
+    vk::Extent2D extent;
+    // sets the states of the builder (vertex input, depth, blending, ...), it's called on a worker thread
+    std::function<void( GraphicsPipeline& )> configure;
+};
+
+/**
+ * @brief Collects the pipeline descriptions, then builds all of them at once on a pool of threads
+ *
+ * Every worker reads the shaders, creates the modules and the pipelines of the descriptions it picks,
+ * with its own pipeline cache, which is merged into the process wide cache when the worker is done.
+ * The pipelines come back through the futures, a failed build is an exception of its future.
+ * A worker that fails outside of a build (its thread cache) hands its exception to every job nobody picked yet.
+ */
+class PipelineBuildQueue
+{
+public:
+    struct Stats
+    {
+        size_t pipelines = 0;
+        unsigned int threads = 0;
+        double ms = 0.0;
+    };
+
+public:
+    // 0 threads means one per core
+    void init( vk::Device device, PipelineCache* pipelineCache, unsigned int threadCount = 0 );
+
+    std::future<vk::Pipeline> push( PipelineDescription description );
+
+    // blocks until every pushed pipeline is built, their destruction is pushed to the deletor
+    void build( DeletionQueue& deletor );
+
+    const Stats& stats() const { return m_stats; }     // of the last build
+
+private:
+    struct Job
+    {
+        PipelineDescription description;
+        std::promise<vk::Pipeline> promise;
+    };
+
+private:
+    void buildJob( Job& job, DeletionQueue& workerDeletor, vk::PipelineCache cache );
+
+private:
+    vk::Device m_device;
+    PipelineCache* m_pipelineCache = nullptr;
+    unsigned int m_threadCount = 1;
+    std::vector<Job> m_jobs;
+    Stats m_stats;
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+/**
+ * @brief Process wide vk::PipelineCache, loaded from disk at startup and saved at shutdown
+ *
+ * The file is a small header of ours (magic, size, checksum, driver version) followed by the data of vkGetPipelineCacheData.
+ * The data is only given to the driver if both headers match this device (vendor, device, driver version, pipelineCacheUUID),
+ * otherwise the cache starts empty and the file is overwritten at the next save.
+ *
+ * The cache itself is internally synchronized, so any thread can create pipelines with get().
+ * A thread can also fill its own cache (createThreadCache) and merge it in later, the merge and the save are under the mutex.
+ * The save writes to a temporary file and renames it, so a crash never leaves a half written cache behind.
+ */
+class PipelineCache
+{
+public:
+    void init( vk::Device device, const vk::PhysicalDeviceProperties& properties, const std::string& filename );
+    void destroy();     // save and destroy
+
+    bool save();
+
+    vk::PipelineCache createThreadCache() const;
+    void merge( vk::PipelineCache threadCache );    // the thread cache is destroyed after the merge
+
+public:
+    vk::PipelineCache get() const { return m_cache; }
+    size_t loadedBytes() const { return m_loadedBytes; }
+
+private:
+    struct FileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t dataSize;
+        uint64_t checksum;
+        uint32_t driverVersion;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint8_t  pipelineCacheUUID[VK_UUID_SIZE];
+    };
+    static constexpr uint32_t Magic = 0x43504b56;   // "VKPC"
+    static constexpr uint32_t Version = 1;
+
+private:
+    std::vector<char> loadFile() const;
+    bool isValid( const FileHeader& header, const char* data ) const;
+    static uint64_t checksum( const char* data, size_t size );
+
+private:
+    vk::Device m_device;
+    vk::PhysicalDeviceProperties m_properties;
+    std::string m_filename;
+    vk::PipelineCache m_cache;
+    size_t m_loadedBytes = 0;
+    std::mutex m_mutex;
+};
@@ -0,0 +1,380 @@
+#pragma once
+
+#include <map>
+#include <tuple>
+#include <vector>
+#include <optional>
+#include <functional>
+
+#include "GpuProfiler.hpp"
+#include "utils.hpp"
+
+/**
+ * @brief The passes of a frame, and the images and buffers they use.
+ *
+ * Every frame, the passes are declared in the order they're recorded, with what they read and write
+ * (the resources are virtual until the graph is compiled):
+ *   - imported resources live outside of the graph (swapchain image, instance buffer, ...),
+ *     the graph is told the layout they come in, and the layout they have to be left in,
+ *   - transient images are created by the graph, their content doesn't live past the frame,
+ *     and the ones that are never used at the same time share memory.
+ *
+ * compile() drops the passes that nothing needs, sizes the transient images, and picks the render passes
+ * (load and store ops from who used the attachment before and who reads it after).
+ * execute() records every pass with one batched pipelineBarrier in front of it (image layouts, memory, write after read),
+ * begins and ends the render pass of the graphics passes, and wraps every pass in a GPU scope of its name.
+ *
+ * A transient image that is only an attachment of one render pass never leaves the tile memory of a tiler:
+ * it gets eTransientAttachment and lazily allocated memory, when the device has such memory.
+ *
+ * The passes are never reordered. The render passes, framebuffers, and transient images are cached,
+ * a frame that declares the same resources as the last one creates nothing.
+ * The transient images are shared by the frames in flight, the first use in a frame waits the last use of the frame before.
+ */
+class RenderGraph
+{
+public:
+    using Resource = uint32_t;
+    static constexpr Resource InvalidResource = UINT32_MAX;
+
+    enum class PassType
+    {
+        eGraphics,      // in a render pass made from its attachments
+        eCompute,
+        eTransfer
+    };
+
+    struct ImageDesc
+    {
+        vk::Format format = vk::Format::eUndefined;
+        vk::Extent2D extent;
+        uint32_t mipLevels = 1;
+    };
+
+    struct ImportedImage
+    {
+        vk::Image image;
+        vk::ImageView view;
+        ImageDesc desc;
+        // eUndefined: the content is not needed. The stages are what the first use waits (like the stage of a semaphore wait).
+        vk::ImageLayout initialLayout = vk::ImageLayout::eUndefined;
+        vk::PipelineStageFlags initialStages = vk::PipelineStageFlagBits::eTopOfPipe;
+        vk::AccessFlags initialAccess;
+        // eUndefined: left in the layout of its last use, and the content is not needed after the graph
+        vk::ImageLayout finalLayout = vk::ImageLayout::eUndefined;
+    };
+
+    struct Stats
+    {
+        uint32_t passes = 0;
+        uint32_t culledPasses = 0;
+        uint32_t barrierBatches = 0;            // pipelineBarrier calls
+        uint32_t imageBarriers = 0;
+        uint32_t transientImages = 0;
+        uint32_t transientBlocks = 0;           // memory allocations of the transient images
+        vk::DeviceSize transientBytes = 0;
+        vk::DeviceSize unaliasedBytes = 0;      // what the transient images would take without sharing
+        uint32_t lazyImages = 0;
+        vk::DeviceSize lazyBytes = 0;           // of transientBytes, lazily allocated (committed only if the tiles spill)
+        vk::DeviceSize attachmentLoadBytes = 0;
+        vk::DeviceSize attachmentStoreBytes = 0;
+    };
+
+    // the load and store ops of one attachment of a graphics pass
+    struct AttachmentOps
+    {
+        const char* pass;
+        const char* attachment;
+        vk::AttachmentLoadOp loadOp;
+        vk::AttachmentStoreOp storeOp;
+    };
+
+    // what the load and store ops of one attachment of a graphics pass move between the tiles and the memory
+    struct AttachmentTraffic : AttachmentOps
+    {
+        bool lazy;
+        vk::DeviceSize loadBytes;       // eLoad reads the render area
+        vk::DeviceSize storeBytes;      // eStore writes the render area
+    };
+
+    // a transient image for packTransients()
+    struct TransientImage
+    {
+        uint32_t firstPass;
+        uint32_t lastPass;
+        vk::MemoryRequirements requirements;
+        bool lazy;
+    };
+
+    struct TransientBlock
+    {
+        vk::MemoryRequirements requirements;    // the biggest size and alignment of its images, the memory types they all take
+        bool lazy;
+    };
+
+    // the memory blocks of the transient images, and the block of every image
+    struct TransientPacking
+    {
+        std::vector<TransientBlock> blocks;
+        std::vector<uint32_t> imageBlocks;
+    };
+
+private:
+    enum class Access : uint32_t
+    {
+        eColorAttachment,
+        eDepthAttachment,
+        eSampled,
+        eStorageRead,
+        eStorageWrite,
+        eTransferSrc,
+        eTransferDst,
+        eIndirect,
+    };
+
+    struct UseInfo
+    {
+        vk::PipelineStageFlags stages;
+        vk::AccessFlags access;
+        vk::ImageLayout layout;
+        vk::ImageUsageFlags usage;
+        bool write;
+    };
+
+    struct Use
+    {
+        Resource resource;
+        Access access;
+        bool clear = false;
+        vk::ClearValue clearValue;
+    };
+
+    struct Pass
+    {
+        const char* name;
+        PassType type;
+        std::vector<Use> uses;
+        std::function<void( vk::CommandBuffer )> record;
+        std::optional<vk::Extent2D> renderArea;
+        bool sideEffect = false;
+
+        // compiled
+        bool culled = false;
+        std::vector<Resource> attachments;      // the colors, and then the depth
+        std::vector<vk::AttachmentDescription> attachmentDescriptions;
+        bool hasDepth = false;
+        vk::RenderPass renderPass;
+        vk::Framebuffer framebuffer;
+        vk::Extent2D framebufferExtent;
+        std::vector<vk::ClearValue> clearValues;
+    };
+
+public:
+    /**
+     * @brief The declaration of one pass, its calls can be chained:
+     *  graph.addPass( "scene", PassType::eGraphics ).colorAttachment( color, clear ).depthAttachment( depth, clear ).execute( ... );
+     */
+    class PassBuilder
+    {
+    public:
+        PassBuilder& colorAttachment( Resource image, std::optional<vk::ClearColorValue> clear = std::nullopt );
+        PassBuilder& depthAttachment( Resource image, std::optional<vk::ClearDepthStencilValue> clear = std::nullopt );
+        // shader reads and writes, at the vertex and fragment stages of a graphics pass, or the compute stage
+        PassBuilder& sampled( Resource image );
+        PassBuilder& storageRead( Resource resource );
+        PassBuilder& storageWrite( Resource resource );
+        PassBuilder& transferSrc( Resource resource );
+        PassBuilder& transferDst( Resource resource );
+        PassBuilder& indirect( Resource buffer );
+        // the render area of a graphics pass, the whole attachment if it's not set
+        PassBuilder& renderArea( vk::Extent2D extent );
+        // never culled, even if nothing in the graph reads what it writes (a readback)
+        PassBuilder& sideEffect();
+        void execute( std::function<void( vk::CommandBuffer )> record );
+
+    private:
+        friend class RenderGraph;
+        PassBuilder( RenderGraph& graph, uint32_t pass ) : m_graph( graph ), m_pass( pass ) {}
+        PassBuilder& use( Resource resource, Access access, bool clear = false, vk::ClearValue clearValue = {} );
+
+        RenderGraph& m_graph;
+        uint32_t m_pass;
+    };
+
+    /**
+     * @brief Where execute() puts its barriers, the command buffer of the frame.
+     * executeBarriers() gives them to another sink without recording the passes, bench/render_graph_test.cpp checks them like that.
+     */
+    class BarrierSink
+    {
+    public:
+        virtual ~BarrierSink() = default;
+        // pass is nullptr for the final layouts of the imported images
+        virtual void pipelineBarrier( const char* pass, vk::PipelineStageFlags srcStages, vk::PipelineStageFlags dstStages,
+                                      const vk::MemoryBarrier* memoryBarrier, const std::vector<vk::ImageMemoryBarrier>& imageBarriers ) = 0;
+    };
+
+public:
+    // looks for lazily allocated memory, the transient attachments use it when it's there
+    void init( vk::Device device, vma::Allocator allocator );
+    void destroy();
+
+    // the transient images and the framebuffers, right now (the device has to be idle, like when the swapchain is recreated)
+    void releaseTargets();
+    // the share of memory between the transient images, without it every transient image has its own memory
+    void setAliasing( bool enabled ) { m_aliasing = enabled; }
+
+public:
+    // start the declaration of a frame, after the fence of the frame slot has been waited
+    void reset();
+
+    Resource importImage( const char* name, const ImportedImage& image );
+    Resource importBuffer( const char* name, vk::Buffer buffer );
+    Resource createImage( const char* name, const ImageDesc& desc );
+    PassBuilder addPass( const char* name, PassType type );
+
+    void compile();
+    void execute( vk::CommandBuffer cmd, GpuProfiler* profiler = nullptr );
+    // the barriers of execute() without the passes, the graph has to be compiled
+    void executeBarriers( BarrierSink& sink );
+    // the load and store ops that compile() picks, without creating anything (instead of compile())
+    std::vector<AttachmentOps> planAttachments();
+
+    /**
+     * @brief The share of memory between the transient images, the biggest images first
+     * An image goes to the first block whose images are never used at the same time as it (the lifetimes don't overlap),
+     * and that can be in the same memory type. The block grows to the biggest of its images.
+     * The lazily allocated images only share with each other, in a memory type that hasLazyType() accepts.
+     */
+    static TransientPacking packTransients( const std::vector<TransientImage>& images, bool aliasing,
+                                            const std::function<bool( uint32_t memoryTypeBits )>& hasLazyType );
+
+public:
+    // the physical image of a resource, valid after compile()
+    vk::Image image( Resource resource ) const;
+    vk::ImageView imageView( Resource resource ) const;
+    // goes up every time the transient images are recreated, the handles of the old views can come back for other images
+    uint64_t generation() const { return m_generation; }
+
+    /**
+     * @brief A render pass that is compatible with the ones of the graphics passes with the same attachment formats,
+     * for creating the pipelines before any pass exists (the compatibility doesn't look at the load and store ops nor the layouts)
+     */
+    vk::RenderPass compatibleRenderPass( const std::vector<vk::Format>& colorFormats, vk::Format depthFormat );
+
+    bool lazyAllocationSupported() const { return m_lazySupported; }
+
+    // of the last frame that was executed
+    const Stats& stats() const { return m_lastStats; }
+    const std::vector<AttachmentTraffic>& attachmentTraffic() const { return m_lastTraffic; }
+
+private:
+    struct SyncState
+    {
+        vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+        vk::PipelineStageFlags writeStages;     // the last write (or layout transition)
+        vk::AccessFlags writeAccess;
+        vk::PipelineStageFlags readStages;      // the reads after the last write
+        vk::PipelineStageFlags visibleStages;   // the stages that have seen the last write
+    };
+
+    struct ResourceNode
+    {
+        const char* name;
+        bool isImage = true;
+        bool imported = false;
+        ImageDesc desc;
+        ImportedImage importedImage;
+        vk::Buffer buffer;
+
+        // compiled
+        vk::ImageUsageFlags usage;
+        uint32_t firstPass = UINT32_MAX;
+        uint32_t lastPass = 0;
+        uint32_t physical = UINT32_MAX;     // index of m_physicalImages
+        SyncState state;
+        bool hasContent = false;            // while compiling the load ops
+    };
+
+    struct PhysicalImage
+    {
+        ImageDesc desc;
+        vk::ImageUsageFlags usage;
+        vk::Image image;
+        vk::ImageView view;
+        vk::MemoryRequirements requirements;
+        uint32_t block = UINT32_MAX;
+        bool lazy = false;
+    };
+
+    struct MemoryBlock
+    {
+        vma::Allocation allocation;
+        vk::MemoryRequirements requirements;
+        bool lazy = false;
+        // what the last image in this memory did, the first use of the next one waits it
+        vk::PipelineStageFlags stages;
+        vk::AccessFlags writeAccess;
+    };
+
+    struct FramebufferKey
+    {
+        vk::RenderPass renderPass;
+        std::vector<vk::ImageView> views;
+        uint32_t width;
+        uint32_t height;
+
+        bool operator<( const FramebufferKey& other ) const
+        {
+            return std::tie( renderPass, views, width, height ) < std::tie( other.renderPass, other.views, other.width, other.height );
+        }
+    };
+
+    struct Retired
+    {
+        uint64_t frame;
+        std::function<void()> destroy;
+    };
+
+private:
+    void cullPasses();
+    void computeLifetimes();
+    void allocateTransients();
+    void planRenderPasses();        // the attachments and their ops, nothing is created
+    void createRenderPasses();
+    vk::RenderPass getRenderPass( const std::vector<vk::AttachmentDescription>& attachments, bool hasDepth );
+    vk::Framebuffer getFramebuffer( vk::RenderPass renderPass, const std::vector<vk::ImageView>& views, vk::Extent2D extent );
+    // the passes are recorded only with a command buffer
+    void record( BarrierSink& sink, vk::CommandBuffer cmd, GpuProfiler* profiler );
+    void retire( std::function<void()> destroy );
+    void retireTargets();
+    static UseInfo useInfo( Access access, PassType type );
+    static vk::ImageAspectFlags aspectOf( vk::Format format );
+    static vk::DeviceSize texelSize( vk::Format format );
+
+private:
+    vk::Device m_device;
+    vma::Allocator m_allocator;
+    bool m_aliasing = true;
+    bool m_lazySupported = false;
+    uint64_t m_frame = 0;
+
+private:
+    std::vector<ResourceNode> m_resources;
+    std::vector<Pass> m_passes;
+    Stats m_stats;
+    Stats m_lastStats;
+    std::vector<AttachmentTraffic> m_traffic;
+    std::vector<AttachmentTraffic> m_lastTraffic;
+
+private:
+    // the transient images of the last compile, reused while the frames declare the same ones
+    std::vector<uint64_t> m_transientKey;
+    uint64_t m_generation = 0;
+    std::vector<PhysicalImage> m_physicalImages;
+    std::vector<MemoryBlock> m_blocks;
+
+    std::map<std::vector<uint32_t>, vk::RenderPass> m_renderPasses;
+    std::map<FramebufferKey, vk::Framebuffer> m_framebuffers;
+    std::vector<Retired> m_retired;
+};
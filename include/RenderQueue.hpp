@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "SceneManagement.hpp"
+
+struct DrawItem
+{
+    uint64_t key;
+    uint32_t objectIndex;   // index to SceneManagement::renderable
+};
+
+/**
+ * @brief 64 bit sort key of a draw
+ *
+ * Opaque  : | pass (1) | pipeline (11) | mesh (16) | material (12) | depth (24) |
+ *           state first, so the binds are grouped, and then front to back to reduce the overdraw.
+ *           The textures are bindless, so the materials of a pipeline don't bind anything,
+ *           the mesh goes before the material so the objects of one mesh are in one instanced draw whatever their material is.
+ *
+ * Blended : | pass (1) | inverted depth (24) | pipeline (11) | mesh (16) | material (12) |
+ *           back to front first, because the blending is order dependent, and then the state.
+ */
+namespace sortkey
+{
+constexpr uint32_t PipelineBits = 11;
+constexpr uint32_t MaterialBits = 12;
+constexpr uint32_t MeshBits     = 16;
+constexpr uint32_t DepthBits    = 24;
+
+// depth is normalized from near (0.0) to far (1.0) plane
+uint64_t make( const Material& material, const Mesh& mesh, float depth );
+} // namespace sortkey
+
+class RenderQueue
+{
+public:
+    void clear();
+    void push( uint64_t key, uint32_t objectIndex );
+    void sort();
+
+public:
+    const std::vector<DrawItem>& items() const { return m_items; }
+    size_t size() const { return m_items.size(); }
+
+private:
+    std::vector<DrawItem> m_items;
+    std::vector<DrawItem> m_scratch;    // ping pong buffer of the radix sort
+};
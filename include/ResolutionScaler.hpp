@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+/**
+ * @brief Choosing the render resolution from the measured GPU frame time.
+ * The cost of the scene is roughly proportional to the number of pixels, i.e. scale^2,
+ * so the scale that fits the budget is scale * sqrt( budget / gpuTime ).
+ * It goes down right away when the frame is over the budget, but it goes up slowly and only when there is enough headroom,
+ * and every change is followed by a cooldown, because the GPU time of the new scale is measured a few frames later.
+ */
+class ResolutionScaler
+{
+public:
+    // 0 is turning the scaling off (the scale stays at the max scale)
+    void setBudget( double gpuBudgetMs );
+    void setRange( float minScale, float maxScale );
+    // off: update() only measures, the scale is set by hand with setScale()
+    void setEnabled( bool enabled );
+    // clamped to the range, it's followed by a cooldown like the changes of update()
+    void setScale( float scale );
+
+    // called once for every measured frame, returns the scale of the next frames
+    float update( double gpuTimeMs );
+
+public:
+    float scale() const { return m_scale; }
+    bool enabled() const { return m_enabled && m_budgetMs > 0.0; }
+    double budgetMs() const { return m_budgetMs; }
+    double smoothedGpuTimeMs() const { return m_smoothedMs; }
+    float minScale() const { return m_minScale; }
+    float maxScale() const { return m_maxScale; }
+    vk::Extent2D scaledExtent( vk::Extent2D fullExtent ) const;
+
+public:
+    // scale up only when the gpu time is under this fraction of the budget
+    double m_headroom = 0.85;
+    // the biggest step up in one update, the step down has no limit
+    float m_maxStepUp = 0.05f;
+    // number of updates that are ignored after the scale changes
+    uint32_t m_cooldownFrames = 8;
+    // weight of the new sample in the moving average
+    double m_smoothing = 0.2;
+
+private:
+    double m_budgetMs = 0.0;
+    bool m_enabled = true;
+    float m_minScale = 0.5f;
+    float m_maxScale = 1.0f;
+    float m_scale = 1.0f;
+    double m_smoothedMs = 0.0;
+    uint32_t m_cooldown = 0;
+};
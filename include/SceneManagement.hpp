@@ -7,15 +7,31 @@
 
 struct Material
 {
-    vk::DescriptorSet textureSet = nullptr; // descriptor set for texturing
     vk::PipelineLayout layout;
     vk::Pipeline pipeline;
+
+    // the depth prepass (see MaterialVariants), the material opts in with depthPrepass
+    vk::Pipeline depthPipeline;     // position only, writes the depth
+    vk::Pipeline equalPipeline;     // the main pass pipeline after the prepass, equal depth test and no depth write
+    bool depthPrepass = false;
+
+    // the slots in the TextureTable, they're written to the object buffer of every object of the material
+    uint32_t textureIndex = 0;
+    uint32_t samplerIndex = 0;
+
+    // these are used by the sort key of the draw (see RenderQueue)
+    uint32_t id = 0;
+    uint32_t pipelineId = 0;
+    bool blended = false;   // blended material is drawn after the opaque, from back to front
+
+    std::string name;       // the key in SceneManagement::materials, it's also the label of the GPU scope
 };
 
 struct Texture
 {
     AllocatedImage image;
     vk::ImageView imageView;
+    uint32_t tableIndex = 0;    // the slot in the TextureTable
 };
 
 struct RenderObject
@@ -23,7 +39,8 @@ struct RenderObject
     Mesh* pMesh;
     Material* pMaterial;
     Texture* pTexture;
-    glm::mat4 transformMatrix;
+    glm::mat4 transformMatrix;  // after pushed, change this through SceneManagement::setTransform() so the change is uploaded
+    bool dynamic = false;       // it moves, so its shadow is rendered every frame instead of cached (see ShadowCascades)
 };
 
 struct SceneManagement
@@ -32,10 +49,23 @@ struct SceneManagement
     std::unordered_map<std::string, Material> materials;
     std::unordered_map<std::string, Mesh> meshes;
     std::unordered_map<std::string, Texture> textures;
+    std::unordered_map<VkPipeline, uint32_t> pipelineIds;   // the materials that share a pipeline share the pipeline id
 
     void pushRenderableObject( RenderObject renderObject );
+    void setTransform( uint32_t index, const glm::mat4& transform );
+
+    /**
+     * @brief Change tracking of the renderable
+     * Every changed object has to be written to the object buffer of every frame in flight,
+     * so it stays on the dirty list for FRAME_OVERLAP frames (1 frame = 1 object buffer).
+     * takeDirtyObjects() is called once per frame, it returns the sorted dirty list and counts down every entry.
+     */
+    void markDirty( uint32_t index );
+    void takeDirtyObjects( std::vector<uint32_t>& outDirty );
+    std::vector<uint8_t> pendingFrames;     // per renderable, how many object buffers still have to be written
+    std::vector<uint32_t> dirtyObjects;
 
-    void createMaterial( vk::Pipeline pipeline, vk::PipelineLayout layout, const std::string& name, vk::DescriptorSet dscSet = nullptr );
+    void createMaterial( vk::Pipeline pipeline, vk::PipelineLayout layout, const std::string& name );
     // void createMaterial( Material material, const std::string& name );
 
     void createMesh( Mesh mesh, const std::string& name );
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "Culling.hpp"
+#include "DescriptorBuilder.hpp"
+#include "DeletionQueue.hpp"
+#include "RenderGraph.hpp"
+#include "SceneManagement.hpp"
+#include "utils.hpp"
+
+/**
+ * @brief Cascaded shadow maps of the sun, the static casters are cached
+ *
+ * The view depth up to Settings::distance is split into CascadeCount slices (between uniform and logarithmic splits),
+ * and every slice gets an orthographic box along the sun direction around its bounding sphere.
+ *  static : every cascade has its own persistent map of the static casters. It's rendered with a box a bit bigger
+ *           than the cascade (Settings::margin), and it stays valid until the sun turns past Settings::lightThreshold,
+ *           the cascade leaves the box, or a static object changes. Most frames render nothing here.
+ *  dynamic: the objects with RenderObject::dynamic are rendered every frame, on a copy of the static map
+ *           (a transient image of the render graph), with the same box. Without dynamic casters the static map is sampled as is.
+ * Every cascade culls its own casters with the frustum of its box.
+ *
+ * material.frag samples the map of a cascade at binding FirstBinding + cascade of the global set, see writeDescriptors().
+ * The render graph wraps every pass in a GPU scope of its name, which is the cost of every cascade (staticPassName, copyPassName, dynamicPassName).
+ */
+class ShadowCascades
+{
+public:
+    static constexpr uint32_t CascadeCount = 4;
+    static constexpr uint32_t Resolution = 2048;
+    static constexpr vk::Format Format = vk::Format::eD32Sfloat;
+    static constexpr uint32_t FirstBinding = 5;     // of the global set, one sampler2DShadow per cascade
+
+    struct Settings
+    {
+        float distance = 80.0f;             // the view depth where the shadows end
+        float splitLambda = 0.75f;          // 0 for uniform splits, 1 for logarithmic splits
+        float margin = 0.25f;               // the cached box is this much bigger than the cascade, so the camera can move in it
+        float casterDistance = 100.0f;      // how far the casters can be toward the sun from the cascade
+        float lightThreshold = 0.9999f;     // the cosine of the angle the sun can turn before the static maps are invalid
+    };
+
+    // why a static map was rendered again
+    enum class Invalidation
+    {
+        eNone,
+        eFirst,         // never rendered
+        eScene,         // a static object has changed
+        eLight,         // the sun has turned
+        eBounds,        // the cascade has left its cached box
+        eForced,        // invalidate(), or the cache is off
+    };
+
+    struct CascadeStats
+    {
+        float splitNear = 0.0f;
+        float splitFar = 0.0f;
+        float radius = 0.0f;                // of the cached box
+        uint32_t staticCasters = 0;         // in the box of the last static render
+        uint32_t dynamicCasters = 0;        // this frame
+        uint32_t staticDraws = 0;
+        uint32_t dynamicDraws = 0;
+        uint32_t staticRenders = 0;         // since the start
+        bool rendered = false;              // the static map is rendered this frame
+        Invalidation lastInvalidation = Invalidation::eNone;
+    };
+
+public:
+    void init( vk::Device device, vma::Allocator allocator, DescriptorLayoutCache& layoutCache, vk::RenderPass renderPass, vk::PipelineCache pipelineCache );
+    void destroy();
+
+public:
+    /**
+     * @brief The cascades of the camera, the static maps that have to be rendered again, and the casters of every cascade
+     * @param staticChanged a static object has moved (or the object buffer has been rewritten)
+     */
+    void prepare( uint32_t frameIndex, const glm::mat4& view, float fovY, float aspect, float zNear, const glm::vec3& sunDirection,
+                  const BoundsSoA& bounds, const std::vector<RenderObject>& renderable, FrustumCuller& culler, bool staticChanged );
+
+    // the splits and the matrices of material.frag, from the view space of the camera
+    void fillSceneParameters( GpuSceneParameterData& data, const glm::mat4& view ) const;
+
+    /**
+     * @brief The static and dynamic passes of every cascade
+     * @return the map every cascade is sampled from, the scene passes have to read them
+     */
+    std::array<RenderGraph::Resource, CascadeCount> addPasses( RenderGraph& graph, uint32_t frameIndex, vk::Buffer objectBuffer,
+                                                               DescriptorAllocator& transientDescriptors );
+
+    // after the graph is compiled, point the shadow bindings of the global set of this frame to the maps (when they've changed)
+    void writeDescriptors( const RenderGraph& graph, uint32_t frameIndex, vk::DescriptorSet globalSet );
+
+    // every static map is rendered again on the next frame
+    void invalidate() { m_forceInvalidation = true; }
+
+public:
+    Settings& settings() { return m_settings; }
+    bool& cacheEnabled() { return m_cacheEnabled; }
+    const std::array<CascadeStats, CascadeCount>& stats() const { return m_stats; }
+    static const char* staticPassName( uint32_t cascade );
+    static const char* copyPassName( uint32_t cascade );
+    static const char* dynamicPassName( uint32_t cascade );
+    static const char* name( Invalidation invalidation );
+
+private:
+    void createPipeline( vk::RenderPass renderPass, vk::PipelineCache pipelineCache );
+    void createMaps();
+    void recordCasters( vk::CommandBuffer cmd, const glm::mat4& viewproj, vk::DescriptorSet set, const std::vector<uint32_t>& runs ) const;
+
+private:
+    // the box of a cascade the static map was rendered with
+    struct CachedBox
+    {
+        glm::vec3 center { 0.0f };
+        float radius = 0.0f;                // what the cascade sphere can use of the box (the snapping is taken off)
+        glm::vec3 sunDirection { 0.0f };
+        glm::mat4 viewproj { 1.0f };
+        bool valid = false;
+    };
+
+    struct Cascade
+    {
+        AllocatedImage image;               // the static map, persistent
+        vk::ImageView view;
+        vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+        CachedBox box;
+
+        // this frame: the runs (indices into m_runs) of the casters in the instance buffer
+        std::vector<uint32_t> staticRuns;
+        std::vector<uint32_t> dynamicRuns;
+    };
+
+    // the casters of the same mesh next to each other in the instance buffer, one instanced draw
+    struct Run
+    {
+        const Mesh* mesh;
+        uint32_t first;
+        uint32_t count;
+    };
+
+    struct FrameBuffers
+    {
+        AllocatedBuffer instanceBuffer;     // persistently mapped, the object index of every caster of every cascade
+        uint32_t* instances = nullptr;
+        size_t capacity = 0;
+        std::array<vk::ImageView, CascadeCount> boundViews {};     // in the global set of the frame
+        uint64_t graphGeneration = 0;       // of the transient images the bound views belong to
+    };
+
+    struct CasterPushConstant
+    {
+        glm::mat4 viewproj;
+    };
+
+private:
+    vk::Device m_device;
+    vma::Allocator m_allocator;
+    DescriptorLayoutCache* m_layoutCache = nullptr;
+    DeletionQueue m_deletionQueue;
+
+private:
+    vk::DescriptorSetLayout m_setLayout;
+    vk::PipelineLayout m_layout;
+    vk::Pipeline m_pipeline;
+    vk::Sampler m_sampler;          // comparison, linear (2x2 PCF), white border
+
+private:
+    Settings m_settings;
+    bool m_cacheEnabled = true;
+    bool m_forceInvalidation = false;
+    std::array<Cascade, CascadeCount> m_cascades;
+    std::array<FrameBuffers, FRAME_OVERLAP> m_frames;
+    std::array<float, CascadeCount> m_splits {};
+    std::array<CascadeStats, CascadeCount> m_stats;
+    std::array<RenderGraph::Resource, CascadeCount> m_sampled {};
+
+private:
+    // of prepare(), reused every frame
+    std::vector<Run> m_runs;
+    std::vector<uint32_t> m_instances;
+    std::vector<uint32_t> m_visible;
+    std::vector<uint32_t> m_casters;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+/**
+ * @brief Bindless texture table, one descriptor set with every texture and every sampler of the engine
+ *
+ *  binding 0: texture2D textures[]   update after bind, partially bound
+ *  binding 1: sampler samplers[]     partially bound
+ *
+ * The shaders index the arrays with the texture and sampler index of the object (nonuniformEXT),
+ * so the set is bound once per frame, and the objects with different textures can still be in the same instanced draw.
+ * A texture can be added while the set is bound (update after bind), the samplers are added at startup.
+ * It needs VK_EXT_descriptor_indexing, see requiredFeatures().
+ */
+class TextureTable
+{
+public:
+    // the features to enable on the device, and if the physical device has all of them
+    static vk::PhysicalDeviceDescriptorIndexingFeaturesEXT requiredFeatures();
+    static bool isSupported( vk::PhysicalDevice physicalDevice );
+
+public:
+    void init( vk::Device device, vk::PhysicalDevice physicalDevice );
+    void destroy();
+
+    uint32_t addTexture( vk::ImageView imageView );
+    uint32_t addSampler( vk::Sampler sampler );     // the table doesn't own the sampler
+
+public:
+    vk::DescriptorSetLayout layout() const { return m_layout; }
+    vk::DescriptorSet set() const { return m_set; }
+    uint32_t textureCount() const { return m_textureCount; }
+    uint32_t textureCapacity() const { return m_textureCapacity; }
+
+public:
+    static constexpr uint32_t MaxTextures = 4096;   // the capacity is also limited by the device
+    static constexpr uint32_t MaxSamplers = 16;
+    static constexpr uint32_t DefaultSampler = 0;   // nearest filtering, made by the table
+
+private:
+    vk::Device m_device;
+    vk::DescriptorPool m_pool;
+    vk::DescriptorSetLayout m_layout;
+    vk::DescriptorSet m_set;
+    vk::Sampler m_defaultSampler;
+    uint32_t m_textureCapacity = 0;
+    uint32_t m_textureCount = 0;
+    uint32_t m_samplerCount = 0;
+};
@@ -9,15 +9,16 @@
 namespace init
 {
 
-vk::UniqueInstance  createInstance                  ();
+vk::UniqueInstance  createInstance                  ( bool headless = false );
 void                createDebugUtilsMessengerInfo   ( const vk::Instance& instance, VkDebugUtilsMessengerEXT& outDebugUtilsMessenger );
 vk::SurfaceKHR      createSurfce                    ( const vk::Instance& instance, GLFWwindow* window );
 vk::PhysicalDevice  pickPhysicalDevice              ( const vk::Instance& instance, const vk::SurfaceKHR& surface );
-vk::UniqueDevice    createDevice                    ( const vk::PhysicalDevice& physicalDevice, const vk::SurfaceKHR& surface );
+// the swapchain extension is not enabled if the surface is null, the feature chain (the structs of the extensions) goes after vk::PhysicalDeviceFeatures2
+vk::UniqueDevice    createDevice                    ( const vk::PhysicalDevice& physicalDevice, const vk::SurfaceKHR& surface, const std::vector<const char*>& extraExtensions = {}, void* featureChain = nullptr );
 
 namespace sc // swapchain
 {
-vk::SwapchainKHR    createSwapchain( const vk::PhysicalDevice& physicalDevice, const vk::Device& device, const vk::SurfaceKHR& surface );
+vk::SwapchainKHR    createSwapchain( const vk::PhysicalDevice& physicalDevice, const vk::Device& device, const vk::SurfaceKHR& surface, vk::PresentModeKHR presentMode, vk::SwapchainKHR oldSwapchain = nullptr );
 void retrieveImagesAndCreateImageViews( const vk::Device& device, const vk::SwapchainKHR& swapchain, vk::Format swapchainFormat, std::vector<vk::Image>& outSwapchainImages, std::vector<vk::ImageView>& outSwapchainImageViews );
 } // namespace sc
 
@@ -6,6 +6,10 @@
 #include <glm/gtx/transform.hpp>
 
 #include "vk_mem_alloc.hpp"
+#include "DescriptorAllocator.hpp"
+#include "CommandStateTracker.hpp"
+
+#define FRAME_OVERLAP 2
 
 struct AllocatedBuffer
 {
@@ -48,14 +52,21 @@ struct GpuSceneParameterData     // despite the name is "Scene" but this struct
     glm::vec4 fogColor;     // w is for exponent
     glm::vec4 fogDistance;  // x for min, y for max, z and w are unused
     glm::vec4 ambientColor;
-    glm::vec4 sunlightDirection;
-    glm::vec4 sunlightColor;
+    glm::vec4 sunlightDirection;    // where the sunlight goes, in view space
+    glm::vec4 sunlightColor;        // w is for intensity
+    glm::vec4 clusterScale;     // the cluster lookup of the clustered lighting (see LightClusters::clusterScale)
+    glm::vec4 cascadeSplits;    // the far view depth of every shadow cascade (see ShadowCascades)
+    glm::mat4 cascadeViewproj[4];   // from the view space of the camera to the shadow map of every cascade
 };
 // } // namespace dsc
 
 struct GpuObjectData
 {
     glm::mat4 modelMatrix;
+    // the material of the object (uvec4 on the shader side)
+    uint32_t textureIndex;
+    uint32_t samplerIndex;
+    uint32_t padding[2];
 };
 
 struct SceneParameter
@@ -64,6 +75,33 @@ struct SceneParameter
     AllocatedBuffer allocationBuffer;
 };
 
+namespace utils
+{
+namespace mem
+{
+// under this number of contiguous objects, the normal store is faster than the non temporal store
+constexpr size_t StreamCopyThreshold = 64;
+
+/**
+ * @brief Copying with non temporal (streaming) stores, so the written memory doesn't pollute the cpu cache.
+ * It's for the big write to the mapped (write combined) memory that the cpu never read again.
+ * dst must be 16 bytes aligned, and size must be multiple of 16. Call streamFence() after the last streamCopy().
+ */
+void streamCopy( void* dst, const void* src, size_t size );
+void streamFence();
+} // namespace mem
+
+namespace image
+{
+/**
+ * @brief Writing 8 bit RGBA pixels to a PNG file.
+ * The image data is stored without compression (deflate "stored" blocks), it's for debugging/readback, not for the size.
+ * rowPitch is the number of bytes between 2 rows of the pixels.
+ */
+bool writePng( const std::string& filename, uint32_t width, uint32_t height, const uint8_t* pixels, size_t rowPitch );
+} // namespace image
+} // namespace utils
+
 struct FrameData
 {
     vk::Semaphore presentSemaphore;
@@ -76,8 +114,23 @@ struct FrameData
     AllocatedBuffer cameraBuffer;
     vk::DescriptorSet globalDescriptorSet;
 
-    AllocatedBuffer objectBuffer;
+    // the object buffer and instance buffer are owned by ObjectStorage
     vk::DescriptorSet objectDescriptorSet;
+
+    // reset at the beginning of the frame, for the sets that are only used by this frame
+    DescriptorAllocator transientDescriptors;
+
+    // headless only, the copy of the rendered image, and the frame number it holds (-1 if nothing to write)
+    AllocatedBuffer readbackBuffer;
+    int64_t readbackFrame = -1;
+};
+
+struct RenderStats
+{
+    uint32_t totalObjects       = 0;
+    uint32_t visibleObjects     = 0;
+    uint32_t prepassObjects     = 0;
+    CommandStateTracker::Stats commands;    // issued and elided commands of the scene pass
 };
 
 struct UploadContext
@@ -0,0 +1,40 @@
+#version 460
+#extension GL_ARB_separate_shader_objects : enable
+
+// the depth prepass version of vertex_shader.vert: the position only, and no fragment shader after it.
+// gl_Position has to be computed exactly like vertex_shader.vert (same expression, invariant),
+// the main pass tests the depth with equal.
+layout( location = 0 ) in vec3 v3Position;
+
+invariant gl_Position;
+
+layout( set = 0, binding = 0 ) uniform GpuCameraData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewproj;
+} cameraData;
+
+struct ObjectData
+{
+    mat4 model;
+    uvec4 material;
+};
+
+layout( std140, set = 1, binding = 0 ) readonly buffer ObjectBuffer
+{
+    ObjectData objects [];
+} objectBuffer;
+
+layout( std430, set = 1, binding = 1 ) readonly buffer InstanceBuffer
+{
+    uint objectIndices [];
+} instanceBuffer;
+
+void main()
+{
+    ObjectData object = objectBuffer.objects[instanceBuffer.objectIndices[gl_InstanceIndex]];
+    mat4 modelMatrix = object.model;
+    mat4 transformMatrix = cameraData.viewproj * modelMatrix;
+    gl_Position = transformMatrix * vec4( v3Position, 1.0 );
+}
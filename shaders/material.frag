@@ -0,0 +1,165 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
+
+// the features of the material variant (see MaterialFeature), set by the specialization constant when the pipeline is created,
+// so the driver compiles out the branches of the features that are off
+layout( constant_id = 0 ) const uint MATERIAL_FEATURES = 0;
+const uint FEATURE_TEXTURED = 1;
+const uint FEATURE_AMBIENT  = 2;
+const uint FEATURE_FOG      = 4;
+const uint FEATURE_LIGHTS   = 8;
+const uint FEATURE_SUN      = 16;
+
+// the cluster grid of LightClusters
+const uint CLUSTER_X = 16;
+const uint CLUSTER_Y = 9;
+const uint CLUSTER_Z = 24;
+
+// input write
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 texCoord;
+layout(location = 2) flat in uint textureIndex;
+layout(location = 3) flat in uint samplerIndex;
+layout(location = 4) in vec3 viewPosition;
+layout(location = 5) in vec3 viewNormal;
+
+layout(location = 0) out vec4 outFragColor;
+
+layout( set = 0, binding = 1 ) uniform GpuSceneParameterData
+{
+    vec4 fogColor;     // w is for exponent
+    vec4 fogDistance;  // x for min, y for max, z and w are unused
+    vec4 ambientColor;
+    vec4 sunlightDirection;
+    vec4 sunlightColor;
+    vec4 clusterScale;  // xy from gl_FragCoord.xy to the tile, z and w the scale and bias of log( view depth ) to the slice
+    vec4 cascadeSplits;     // the far view depth of every shadow cascade
+    mat4 cascadeViewproj[4];    // from the view space to the shadow map of every cascade
+}sceneParameterData;
+
+// the point and spot lights, in view space (see LightClusters)
+struct Light
+{
+    vec4 positionRange;
+    vec4 colorCosInner;         // rgb times the intensity, and the cosine of the inner angle
+    vec4 directionCosOuter;     // -2 in w for a point light
+};
+
+layout( std430, set = 0, binding = 2 ) readonly buffer LightBuffer
+{
+    Light lights [];
+};
+
+layout( std430, set = 0, binding = 3 ) readonly buffer ClusterBuffer
+{
+    uvec2 clusters [];     // the offset in the light index pool, and the light count
+};
+
+layout( std430, set = 0, binding = 4 ) readonly buffer LightIndexBuffer
+{
+    uint lightIndices [];
+};
+
+// the shadow map of every cascade (see ShadowCascades), the sampler compares the depth
+layout( set = 0, binding = 5 ) uniform sampler2DShadow shadowMap0;
+layout( set = 0, binding = 6 ) uniform sampler2DShadow shadowMap1;
+layout( set = 0, binding = 7 ) uniform sampler2DShadow shadowMap2;
+layout( set = 0, binding = 8 ) uniform sampler2DShadow shadowMap3;
+
+// the bindless texture table (see TextureTable)
+layout( set = 2, binding = 0 ) uniform texture2D textures[];
+layout( set = 2, binding = 1 ) uniform sampler samplers[];
+
+vec3 clusteredLights( vec3 position, vec3 normal )
+{
+    uvec2 tile = min( uvec2( gl_FragCoord.xy * sceneParameterData.clusterScale.xy ), uvec2( CLUSTER_X - 1, CLUSTER_Y - 1 ) );
+    float slice = log( max( -position.z, 0.0001f ) ) * sceneParameterData.clusterScale.z + sceneParameterData.clusterScale.w;
+    uint cluster = tile.x + CLUSTER_X * ( tile.y + CLUSTER_Y * uint( clamp( slice, 0.0f, float( CLUSTER_Z - 1 ) ) ) );
+
+    vec3 lit = vec3( 0.0f );
+    uvec2 range = clusters[cluster];
+    for( uint i = 0; i < range.y; ++i )
+    {
+        Light light = lights[lightIndices[range.x + i]];
+        vec3 toLight = light.positionRange.xyz - position;
+        float distance = length( toLight );
+        vec3 direction = toLight / max( distance, 0.0001f );
+
+        // inverse square, windowed to reach 0 at the range
+        float window = clamp( 1.0f - pow( distance / light.positionRange.w, 4.0f ), 0.0f, 1.0f );
+        float attenuation = window * window / ( distance * distance + 1.0f );
+        if( light.directionCosOuter.w > -1.5f )
+        {
+            float cosAngle = dot( -direction, light.directionCosOuter.xyz );
+            attenuation *= smoothstep( light.directionCosOuter.w, light.colorCosInner.w, cosAngle );
+        }
+
+        lit += light.colorCosInner.rgb * max( dot( normal, direction ), 0.0f ) * attenuation;
+    }
+    return lit;
+}
+
+// 4 taps of the 2x2 filter of the sampler, over 4x4 texels
+float filteredShadow( sampler2DShadow shadowMap, vec3 coord )
+{
+    float lit = textureOffset( shadowMap, coord, ivec2( -1, -1 ) )
+              + textureOffset( shadowMap, coord, ivec2(  1, -1 ) )
+              + textureOffset( shadowMap, coord, ivec2( -1,  1 ) )
+              + textureOffset( shadowMap, coord, ivec2(  1,  1 ) );
+    return lit * 0.25f;
+}
+
+// 1 where the sun reaches the position, 0 in the shadow. Past the last cascade there is no shadow.
+float sunShadow( vec3 position )
+{
+    float depth = -position.z;
+    uint cascade = 0;
+    while( cascade < 4 && depth > sceneParameterData.cascadeSplits[cascade] )
+        ++cascade;
+    if( cascade == 4 )
+        return 1.0f;
+
+    vec4 clip = sceneParameterData.cascadeViewproj[cascade] * vec4( position, 1.0f );
+    vec3 coord = vec3( clip.xy * 0.5f + 0.5f, clip.z );
+    switch( cascade )
+    {
+        case 0:  return filteredShadow( shadowMap0, coord );
+        case 1:  return filteredShadow( shadowMap1, coord );
+        case 2:  return filteredShadow( shadowMap2, coord );
+        default: return filteredShadow( shadowMap3, coord );
+    }
+}
+
+void main()
+{
+    vec3 color = fragColor;
+
+    if( ( MATERIAL_FEATURES & FEATURE_TEXTURED ) != 0 )
+        color = texture( sampler2D( textures[nonuniformEXT( textureIndex )], samplers[nonuniformEXT( samplerIndex )] ), texCoord ).xyz;
+
+    if( ( MATERIAL_FEATURES & FEATURE_AMBIENT ) != 0 )
+        color += sceneParameterData.ambientColor.xyz;
+
+    if( ( MATERIAL_FEATURES & FEATURE_LIGHTS ) != 0 )
+        color += color * clusteredLights( viewPosition, normalize( viewNormal ) );
+
+    if( ( MATERIAL_FEATURES & FEATURE_SUN ) != 0 )
+    {
+        float diffuse = max( dot( normalize( viewNormal ), -sceneParameterData.sunlightDirection.xyz ), 0.0f );
+        vec3 sun = sceneParameterData.sunlightColor.rgb * sceneParameterData.sunlightColor.w;
+        color += color * sun * diffuse * sunShadow( viewPosition );
+    }
+
+    if( ( MATERIAL_FEATURES & FEATURE_FOG ) != 0 )
+    {
+        // 1 / gl_FragCoord.w is the view depth of a perspective projection
+        float depth = 1.0f / gl_FragCoord.w;
+        float range = max( sceneParameterData.fogDistance.y - sceneParameterData.fogDistance.x, 0.0001f );
+        float fog = clamp( ( depth - sceneParameterData.fogDistance.x ) / range, 0.0f, 1.0f );
+        fog = pow( fog, max( sceneParameterData.fogColor.w, 1.0f ) );
+        color = mix( color, sceneParameterData.fogColor.xyz, fog );
+    }
+
+    outFragColor = vec4( color, 1.0f );
+}
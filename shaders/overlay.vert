@@ -0,0 +1,24 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// ImDrawVert
+layout(location = 0) in vec2 vPosition;
+layout(location = 1) in vec2 vTexCoord;
+layout(location = 2) in vec4 vColor;
+
+layout(location = 0) out vec4 outColor;
+layout(location = 1) out vec2 outTexCoord;
+
+// from ImGui display coordinate (pixel) to clip space
+layout( push_constant ) uniform OverlayPushConstant
+{
+    vec2 scale;
+    vec2 translate;
+} pushConstant;
+
+void main()
+{
+    outColor = vColor;
+    outTexCoord = vTexCoord;
+    gl_Position = vec4( vPosition * pushConstant.scale + pushConstant.translate, 0.0f, 1.0f );
+}
@@ -0,0 +1,34 @@
+#version 460
+#extension GL_ARB_separate_shader_objects : enable
+
+// the casters of a cascade of ShadowCascades, depth only (the pipeline has no fragment shader)
+layout( location = 0 ) in vec3 v3Position;
+
+struct ObjectData
+{
+    mat4 model;
+    uvec4 material;
+};
+
+// the Object Buffer of the frame, the same one as vertex_shader.vert
+layout( std140, set = 0, binding = 0 ) readonly buffer ObjectBuffer
+{
+    ObjectData objects [];
+} objectBuffer;
+
+// the object index of every caster of every cascade, an instanced draw starts at its "first instance"
+layout( std430, set = 0, binding = 1 ) readonly buffer CasterBuffer
+{
+    uint objectIndices [];
+} casterBuffer;
+
+layout( push_constant ) uniform constants
+{
+    mat4 viewproj;      // of the cascade
+} cascade;
+
+void main()
+{
+    mat4 model = objectBuffer.objects[casterBuffer.objectIndices[gl_InstanceIndex]].model;
+    gl_Position = cascade.viewproj * model * vec4( v3Position, 1.0 );
+}
@@ -10,6 +10,14 @@ layout( location = 3 ) in vec2 v2TexCoord;
 // this is for the color that passed to fragment shader
 layout( location = 0 ) out vec3 fragColor;
 layout( location = 1 ) out vec2 texCoord;
+// the slots of the texture table (flat, they're the same for the whole triangle)
+layout( location = 2 ) flat out uint textureIndex;
+layout( location = 3 ) flat out uint samplerIndex;
+// the clustered lighting of material.frag is in view space
+layout( location = 4 ) out vec3 viewPosition;
+layout( location = 5 ) out vec3 viewNormal;
+// the depth prepass (depth_only.vert) computes the same position, the main pass tests its depth with equal
+invariant gl_Position;
 
 // this struct is for buffer that bound in Descriptor set
 layout( set = 0, binding = 0 ) uniform GpuCameraData
@@ -23,6 +31,7 @@ layout( set = 0, binding = 0 ) uniform GpuCameraData
 struct ObjectData
 {
     mat4 model;
+    uvec4 material;     // x for the texture index, y for the sampler index, z and w are unused
 };
 
 // std140: is used to match how arrays work in cpp. this enforce some rules about how the memory is laid out, and what is allignment.
@@ -34,6 +43,13 @@ layout( std140, set = 1, binding = 0 ) readonly buffer ObjectBuffer
     ObjectData objects [];
 } objectBuffer;
 
+// the objects of an instanced draw are not next to each other on the ObjectBuffer,
+// so every instance look up its object index here. std430 so the uint array is tightly packed (std140 would pad every element to 16 bytes)
+layout( std430, set = 1, binding = 1 ) readonly buffer InstanceBuffer
+{
+    uint objectIndices [];
+} instanceBuffer;
+
 // this struct is for push constant ( must be match with 'push contant range' when creating pipeline layout )
 layout( push_constant ) uniform constants
 {
@@ -43,9 +59,17 @@ layout( push_constant ) uniform constants
 
 void main()
 {
-    mat4 modelMatrix = objectBuffer.objects[gl_BaseInstance].model;
+    // gl_InstanceIndex already starts from "first instance" (gl_BaseInstance) of the draw
+    ObjectData object = objectBuffer.objects[instanceBuffer.objectIndices[gl_InstanceIndex]];
+    mat4 modelMatrix = object.model;
     mat4 transformMatrix = cameraData.viewproj * modelMatrix;
     gl_Position = transformMatrix * vec4( v3Position, 1.0 );
+    mat4 modelView = cameraData.view * modelMatrix;
+    viewPosition = vec3( modelView * vec4( v3Position, 1.0 ) );
+    // the models have no non uniform scale, so the upper 3x3 is enough for the normal
+    viewNormal = mat3( modelView ) * v3Normal;
     fragColor = vec3( v3Color );
     texCoord = v2TexCoord;
+    textureIndex = object.material.x;
+    samplerIndex = object.material.y;
 }
\ No newline at end of file
@@ -0,0 +1,276 @@
+#include "CommandStateTracker.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+uint32_t CommandStateTracker::Stats::totalIssued() const
+{
+    uint32_t total = 0;
+    for( uint32_t count : issued )
+        total += count;
+    return total;
+}
+
+uint32_t CommandStateTracker::Stats::totalElided() const
+{
+    uint32_t total = 0;
+    for( uint32_t count : elided )
+        total += count;
+    return total;
+}
+
+const char* CommandStateTracker::name( Command command )
+{
+    switch( command )
+    {
+        case CommandPipeline:       return "pipeline";
+        case CommandDescriptorSet:  return "descriptor set";
+        case CommandVertexBuffer:   return "vertex buffer";
+        case CommandPushConstant:   return "push constant";
+        case CommandViewport:       return "viewport";
+        case CommandScissor:        return "scissor";
+        case CommandDraw:           return "draw";
+        default:                    return "unknown";
+    }
+}
+
+void CommandStateTracker::begin( vk::CommandBuffer cmd )
+{
+    *this = CommandStateTracker{};
+    m_commandBufferSink.m_cmd = cmd;
+    m_sink = &m_commandBufferSink;
+}
+
+void CommandStateTracker::begin( Sink& sink )
+{
+    *this = CommandStateTracker{};
+    m_sink = &sink;
+}
+
+void CommandStateTracker::bindPipeline( vk::PipelineBindPoint bindPoint, vk::Pipeline pipeline )
+{
+    if( pipeline == m_pipeline )
+    {
+        count( CommandPipeline, false );
+        return;
+    }
+
+    m_sink->bindPipeline( bindPoint, pipeline );
+    m_pipeline = pipeline;
+    count( CommandPipeline, true );
+}
+
+void CommandStateTracker::bindDescriptorSets( vk::PipelineBindPoint bindPoint, vk::PipelineLayout layout, uint32_t firstSet,
+                                              vk::ArrayProxy<const vk::DescriptorSet> sets, vk::ArrayProxy<const uint32_t> dynamicOffsets )
+{
+    setLayout( layout );
+
+    const uint32_t setCount = sets.size();
+    if( firstSet + setCount > MaxSets || dynamicOffsets.size() > MaxDynamicOffsets )
+    {
+        // out of what is tracked, record it as it is and forget the sets it touched
+        m_sink->bindDescriptorSets( bindPoint, layout, firstSet, sets.size(), sets.data(), dynamicOffsets.size(), dynamicOffsets.data() );
+        for( uint32_t i = firstSet; i < std::min( firstSet + setCount, MaxSets ); ++i )
+            m_sets[i].valid = false;
+        for( uint32_t i = 0; i < setCount; ++i )
+            count( CommandDescriptorSet, true );
+        return;
+    }
+
+    auto sameSet = [&]( uint32_t i ) {
+        const BoundSet& bound = m_sets[firstSet + i];
+        return bound.valid
+            && bound.set == sets.data()[i]
+            && bound.offsetCount == dynamicOffsets.size()
+            && std::equal( dynamicOffsets.begin(), dynamicOffsets.end(), bound.offsets.begin() );
+    };
+
+    /**
+     * @brief Find the sets that changed
+     * The dynamic offsets are consumed by the sets in order and can't be split between two calls,
+     * so a call with dynamic offsets is bound as a whole. Without them, only the range from the first
+     * to the last changed set is bound (the unchanged sets in the middle come along, one call is cheaper than two).
+     */
+    uint32_t changedFirst = setCount;
+    uint32_t changedLast = 0;
+    for( uint32_t i = 0; i < setCount; ++i )
+    {
+        if( !sameSet( i ) )
+        {
+            changedFirst = std::min( changedFirst, i );
+            changedLast = i;
+        }
+    }
+
+    if( changedFirst == setCount )
+    {
+        for( uint32_t i = 0; i < setCount; ++i )
+            count( CommandDescriptorSet, false );
+        return;
+    }
+
+    if( dynamicOffsets.size() > 0 )
+    {
+        changedFirst = 0;
+        changedLast = setCount - 1;
+    }
+
+    const uint32_t bindCount = changedLast - changedFirst + 1;
+    m_sink->bindDescriptorSets( bindPoint, layout, firstSet + changedFirst, bindCount, sets.data() + changedFirst, dynamicOffsets.size(), dynamicOffsets.data() );
+
+    for( uint32_t i = 0; i < setCount; ++i )
+    {
+        const bool bound = i >= changedFirst && i <= changedLast;
+        count( CommandDescriptorSet, bound );
+        if( !bound )
+            continue;
+
+        BoundSet& set = m_sets[firstSet + i];
+        set.set = sets.data()[i];
+        set.offsetCount = dynamicOffsets.size();
+        std::copy( dynamicOffsets.begin(), dynamicOffsets.end(), set.offsets.begin() );
+        set.valid = true;
+    }
+}
+
+void CommandStateTracker::bindVertexBuffer( uint32_t binding, vk::Buffer buffer, vk::DeviceSize offset )
+{
+    if( binding < MaxVertexBindings && m_vertexBuffers[binding].buffer == buffer && m_vertexBuffers[binding].offset == offset )
+    {
+        count( CommandVertexBuffer, false );
+        return;
+    }
+
+    m_sink->bindVertexBuffer( binding, buffer, offset );
+    if( binding < MaxVertexBindings )
+        m_vertexBuffers[binding] = BoundVertexBuffer{ buffer, offset };
+    count( CommandVertexBuffer, true );
+}
+
+void CommandStateTracker::pushConstants( vk::PipelineLayout layout, vk::ShaderStageFlags stages, uint32_t offset, uint32_t size, const void* data )
+{
+    setLayout( layout );
+
+    if( offset + size > MaxPushConstantSize )
+    {
+        m_sink->pushConstants( layout, stages, offset, size, data );
+        count( CommandPushConstant, true );
+        return;
+    }
+
+    const bool known = std::all_of( m_pushValid.begin() + offset, m_pushValid.begin() + offset + size, []( bool valid ) { return valid; } );
+    if( known && std::memcmp( m_pushData.data() + offset, data, size ) == 0 )
+    {
+        count( CommandPushConstant, false );
+        return;
+    }
+
+    m_sink->pushConstants( layout, stages, offset, size, data );
+    std::memcpy( m_pushData.data() + offset, data, size );
+    std::fill( m_pushValid.begin() + offset, m_pushValid.begin() + offset + size, true );
+    count( CommandPushConstant, true );
+}
+
+void CommandStateTracker::setViewport( const vk::Viewport& viewport )
+{
+    if( m_viewportValid && m_viewport == viewport )
+    {
+        count( CommandViewport, false );
+        return;
+    }
+
+    m_sink->setViewport( viewport );
+    m_viewport = viewport;
+    m_viewportValid = true;
+    count( CommandViewport, true );
+}
+
+void CommandStateTracker::setScissor( const vk::Rect2D& scissor )
+{
+    if( m_scissorValid && m_scissor == scissor )
+    {
+        count( CommandScissor, false );
+        return;
+    }
+
+    m_sink->setScissor( scissor );
+    m_scissor = scissor;
+    m_scissorValid = true;
+    count( CommandScissor, true );
+}
+
+void CommandStateTracker::draw( uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance )
+{
+    m_sink->draw( vertexCount, instanceCount, firstVertex, firstInstance );
+    count( CommandDraw, true );
+}
+
+void CommandStateTracker::drawIndirect( vk::Buffer buffer, vk::DeviceSize offset, uint32_t drawCount, uint32_t stride )
+{
+    m_sink->drawIndirect( buffer, offset, drawCount, stride );
+    count( CommandDraw, true );
+}
+
+void CommandStateTracker::setLayout( vk::PipelineLayout layout )
+{
+    if( layout == m_layout )
+        return;
+
+    // the layouts are not compared, so nothing bound with the old one is trusted
+    m_layout = layout;
+    for( auto& set : m_sets )
+        set.valid = false;
+    m_pushValid.fill( false );
+}
+
+void CommandStateTracker::count( Command command, bool issued )
+{
+    if( issued )
+        ++m_stats.issued[command];
+    else
+        ++m_stats.elided[command];
+}
+
+/**
+ * @brief CommandBufferSink
+ */
+void CommandStateTracker::CommandBufferSink::bindPipeline( vk::PipelineBindPoint bindPoint, vk::Pipeline pipeline )
+{
+    m_cmd.bindPipeline( bindPoint, pipeline );
+}
+
+void CommandStateTracker::CommandBufferSink::bindDescriptorSets( vk::PipelineBindPoint bindPoint, vk::PipelineLayout layout, uint32_t firstSet, uint32_t setCount,
+                                                                 const vk::DescriptorSet* sets, uint32_t offsetCount, const uint32_t* offsets )
+{
+    m_cmd.bindDescriptorSets( bindPoint, layout, firstSet, setCount, sets, offsetCount, offsets );
+}
+
+void CommandStateTracker::CommandBufferSink::bindVertexBuffer( uint32_t binding, vk::Buffer buffer, vk::DeviceSize offset )
+{
+    m_cmd.bindVertexBuffers( binding, buffer, offset );
+}
+
+void CommandStateTracker::CommandBufferSink::pushConstants( vk::PipelineLayout layout, vk::ShaderStageFlags stages, uint32_t offset, uint32_t size, const void* data )
+{
+    m_cmd.pushConstants( layout, stages, offset, size, data );
+}
+
+void CommandStateTracker::CommandBufferSink::setViewport( const vk::Viewport& viewport )
+{
+    m_cmd.setViewport( 0, viewport );
+}
+
+void CommandStateTracker::CommandBufferSink::setScissor( const vk::Rect2D& scissor )
+{
+    m_cmd.setScissor( 0, scissor );
+}
+
+void CommandStateTracker::CommandBufferSink::draw( uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance )
+{
+    m_cmd.draw( vertexCount, instanceCount, firstVertex, firstInstance );
+}
+
+void CommandStateTracker::CommandBufferSink::drawIndirect( vk::Buffer buffer, vk::DeviceSize offset, uint32_t drawCount, uint32_t stride )
+{
+    m_cmd.drawIndirect( buffer, offset, drawCount, stride );
+}
@@ -0,0 +1,173 @@
+#include "CpuProfiler.hpp"
+
+#ifdef ENGINE_PROFILE
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace cpuprof
+{
+namespace
+{
+struct Event
+{
+    const char* name;
+    uint64_t begin;     // nanoseconds
+    uint64_t end;
+};
+
+/**
+ * @brief Ring of the events of one thread
+ * Just the owner thread writes, and head is published with release, so the writer never takes a lock.
+ * The reader only takes the events between the capture begin and end, the older ones may have been overwritten.
+ */
+struct Ring
+{
+    static constexpr size_t Capacity = 1 << 16;
+
+    std::vector<Event> events = std::vector<Event>( Capacity );
+    std::atomic<uint64_t> head { 0 };
+    std::atomic<bool> inUse { false };
+    uint32_t threadId = 0;
+};
+
+struct Registry
+{
+    std::mutex mutex;   // only for registering a thread and for dumping
+    std::vector<std::unique_ptr<Ring>> rings;
+
+    // the threads come and go (e.g. the culling workers), so the ring of a finished thread is reused
+    Ring* acquire()
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        for( auto& ring : rings )
+        {
+            bool expected = false;
+            if( ring->inUse.compare_exchange_strong( expected, true ) )
+                return ring.get();
+        }
+
+        rings.push_back( std::make_unique<Ring>() );
+        rings.back()->inUse = true;
+        rings.back()->threadId = static_cast<uint32_t>( rings.size() );
+        return rings.back().get();
+    }
+};
+
+Registry& registry()
+{
+    static Registry instance;
+    return instance;
+}
+
+struct ThreadRing
+{
+    Ring* ring = registry().acquire();
+    ~ThreadRing() { ring->inUse = false; }
+};
+
+thread_local ThreadRing t_ring;
+
+struct Capture
+{
+    uint32_t requestedFrames = 0;
+    uint32_t remainingFrames = 0;
+    uint64_t begin = 0;
+    uint64_t frameNumber = 0;
+};
+
+Capture g_capture;   // main thread only
+
+void writeTrace( uint64_t begin, uint64_t end )
+{
+    std::string filename = "trace_" + std::to_string( g_capture.frameNumber ) + ".json";
+    std::ofstream file( filename );
+    if( !file )
+    {
+        std::cerr << "Failed to write " << filename << "\n";
+        return;
+    }
+
+    file << "{\"traceEvents\":[\n";
+    bool first = true;
+    size_t count = 0;
+
+    std::lock_guard<std::mutex> lock( registry().mutex );
+    for( const auto& ring : registry().rings )
+    {
+        uint64_t head = ring->head.load( std::memory_order_acquire );
+        uint64_t oldest = head > Ring::Capacity ? head - Ring::Capacity : 0;
+        for( uint64_t i = oldest; i < head; ++i )
+        {
+            const Event& event = ring->events[i % Ring::Capacity];
+            if( event.begin < begin || event.end > end )
+                continue;
+
+            // trace_event wants microseconds
+            file << ( first ? "" : ",\n" )
+                << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1"
+                << ",\"tid\":" << ring->threadId
+                << ",\"ts\":" << ( event.begin - begin ) / 1000.0
+                << ",\"dur\":" << ( event.end - event.begin ) / 1000.0 << "}";
+            first = false;
+            ++count;
+        }
+    }
+    file << "\n]}\n";
+
+    std::cout << "CPU trace of " << g_capture.requestedFrames << " frames (" << count << " zones) written to " << filename << "\n";
+}
+} // namespace
+
+uint64_t now()
+{
+    return static_cast<uint64_t>( std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count() );
+}
+
+void pushZone( const char* name, uint64_t begin, uint64_t end )
+{
+    Ring& ring = *t_ring.ring;
+    uint64_t head = ring.head.load( std::memory_order_relaxed );
+    ring.events[head % Ring::Capacity] = Event{ name, begin, end };
+    ring.head.store( head + 1, std::memory_order_release );
+}
+
+void frameMark()
+{
+    uint64_t time = now();
+    ++g_capture.frameNumber;
+
+    if( g_capture.remainingFrames == 0 )
+        return;
+
+    // the capture starts at the first frame boundary after the request
+    if( g_capture.begin == 0 )
+    {
+        g_capture.begin = time;
+        return;
+    }
+
+    if( --g_capture.remainingFrames == 0 )
+    {
+        writeTrace( g_capture.begin, time );
+        g_capture.begin = 0;
+    }
+}
+
+void requestCapture( uint32_t frameCount )
+{
+    if( g_capture.remainingFrames > 0 || frameCount == 0 )
+        return;
+
+    g_capture.requestedFrames = frameCount;
+    g_capture.remainingFrames = frameCount;
+    g_capture.begin = 0;
+}
+} // namespace cpuprof
+
+#endif
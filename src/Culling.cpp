@@ -0,0 +1,238 @@
+#include "Culling.hpp"
+#include "CpuProfiler.hpp"
+
+#include <thread>
+#include <chrono>
+#include <random>
+#include <limits>
+#include <algorithm>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#define CULLING_HAS_X86 1
+#include <immintrin.h>
+#endif
+
+Frustum Frustum::fromViewProjection( const glm::mat4& viewproj )
+{
+    // glm is column major, so the row i is ( m[0][i], m[1][i], m[2][i], m[3][i] )
+    auto row = [&viewproj]( int i ){
+        return glm::vec4{ viewproj[0][i], viewproj[1][i], viewproj[2][i], viewproj[3][i] };
+    };
+
+    Frustum frustum;
+    frustum.planes[0] = row( 3 ) + row( 0 );    // left
+    frustum.planes[1] = row( 3 ) - row( 0 );    // right
+    frustum.planes[2] = row( 3 ) + row( 1 );    // bottom
+    frustum.planes[3] = row( 3 ) - row( 1 );    // top
+    frustum.planes[4] = row( 3 ) + row( 2 );    // near
+    frustum.planes[5] = row( 3 ) - row( 2 );    // far
+
+    // normalize, so the plane distance is in world unit (the sphere radius is also in world unit)
+    for( auto& plane : frustum.planes )
+    {
+        float length = glm::length( glm::vec3{ plane } );
+        plane /= length;
+    }
+
+    return frustum;
+}
+
+void BoundsSoA::resize( size_t count )
+{
+    m_count = count;
+    size_t padded = ( count + 7 ) & ~size_t{ 7 };
+
+    centerX.resize( padded, 0.0f );
+    centerY.resize( padded, 0.0f );
+    centerZ.resize( padded, 0.0f );
+    radius.resize( padded, 0.0f );
+
+    // padding spheres will always be culled
+    for( size_t i = count; i < padded; ++i )
+        radius[i] = -std::numeric_limits<float>::infinity();
+}
+
+void BoundsSoA::set( size_t index, const glm::vec3& center, float r )
+{
+    centerX[index] = center.x;
+    centerY[index] = center.y;
+    centerZ[index] = center.z;
+    radius[index] = r;
+}
+
+FrustumCuller::FrustumCuller()
+{
+    m_threadCount = std::max( 1U, std::thread::hardware_concurrency() );
+
+#ifdef CULLING_HAS_X86
+    m_useAvx2 = __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" );
+#else
+    m_useAvx2 = false;
+#endif
+}
+
+void FrustumCuller::cull( const Frustum& frustum, const BoundsSoA& bounds, std::vector<uint32_t>& outVisible )
+{
+    const size_t count = bounds.size();
+    outVisible.resize( count );
+
+    if( count < m_parallelThreshold || m_threadCount == 1 )
+    {
+        size_t visibleCount = cullRange( frustum, bounds, 0, count, outVisible.data(), m_useAvx2 );
+        outVisible.resize( visibleCount );
+        return;
+    }
+
+    /**
+     * @brief Parallel culling
+     * Every thread get a chunk (multiple of 8, so the kernel never straddle 2 threads) and its own output,
+     * then the outputs are concatenated in order, so the visible list is still sorted by object index.
+     */
+    const size_t chunk = ( ( count + m_threadCount - 1 ) / m_threadCount + 7 ) & ~size_t{ 7 };
+    m_threadResults.resize( m_threadCount );
+
+    std::vector<std::thread> workers;
+    std::vector<size_t> visibleCounts( m_threadCount, 0 );
+    workers.reserve( m_threadCount );
+    for( unsigned int t = 0; t < m_threadCount; ++t )
+    {
+        size_t begin = std::min( count, chunk * t );
+        size_t end = std::min( count, begin + chunk );
+        m_threadResults[t].resize( end - begin );
+
+        workers.emplace_back(
+            [&, t, begin, end](){
+                PROFILE_ZONE( "cull chunk" );
+                visibleCounts[t] = cullRange( frustum, bounds, begin, end, m_threadResults[t].data(), m_useAvx2 );
+            }
+        );
+    }
+
+    size_t offset = 0;
+    for( unsigned int t = 0; t < m_threadCount; ++t )
+    {
+        workers[t].join();
+        std::copy_n( m_threadResults[t].begin(), visibleCounts[t], outVisible.begin() + offset );
+        offset += visibleCounts[t];
+    }
+    outVisible.resize( offset );
+}
+
+size_t FrustumCuller::cullRange( const Frustum& frustum, const BoundsSoA& bounds, size_t begin, size_t end, uint32_t* out, bool useAvx2 )
+{
+    if( useAvx2 )
+        return cullRangeAvx2( frustum, bounds, begin, end, out );
+
+    return cullRangeScalar( frustum, bounds, begin, end, out );
+}
+
+size_t FrustumCuller::cullRangeScalar( const Frustum& frustum, const BoundsSoA& bounds, size_t begin, size_t end, uint32_t* out )
+{
+    size_t visibleCount = 0;
+    for( size_t i = begin; i < end; ++i )
+    {
+        bool visible = true;
+        for( const auto& plane : frustum.planes )
+        {
+            float distance = plane.x * bounds.centerX[i] + plane.y * bounds.centerY[i] + plane.z * bounds.centerZ[i] + plane.w;
+            if( distance < -bounds.radius[i] )
+            {
+                visible = false;
+                break;
+            }
+        }
+
+        if( visible )
+            out[visibleCount++] = static_cast<uint32_t>( i );
+    }
+
+    return visibleCount;
+}
+
+#ifdef CULLING_HAS_X86
+__attribute__(( target( "avx2,fma" ) ))
+size_t FrustumCuller::cullRangeAvx2( const Frustum& frustum, const BoundsSoA& bounds, size_t begin, size_t end, uint32_t* out )
+{
+    /**
+     * @brief Broadcast every plane component once, they're the same for all 8 spheres
+     */
+    __m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+    for( int p = 0; p < 6; ++p )
+    {
+        planeX[p] = _mm256_set1_ps( frustum.planes[p].x );
+        planeY[p] = _mm256_set1_ps( frustum.planes[p].y );
+        planeZ[p] = _mm256_set1_ps( frustum.planes[p].z );
+        planeW[p] = _mm256_set1_ps( frustum.planes[p].w );
+    }
+    const __m256 signMask = _mm256_set1_ps( -0.0f );
+
+    size_t visibleCount = 0;
+    // "begin" is always multiple of 8, and the arrays are padded, so it's safe to read until the padded end
+    for( size_t i = begin; i < end; i += 8 )
+    {
+        __m256 cx = _mm256_loadu_ps( bounds.centerX.data() + i );
+        __m256 cy = _mm256_loadu_ps( bounds.centerY.data() + i );
+        __m256 cz = _mm256_loadu_ps( bounds.centerZ.data() + i );
+        __m256 negRadius = _mm256_xor_ps( _mm256_loadu_ps( bounds.radius.data() + i ), signMask );
+
+        __m256 inside = _mm256_castsi256_ps( _mm256_set1_epi32( -1 ) );
+        for( int p = 0; p < 6; ++p )
+        {
+            __m256 distance = _mm256_fmadd_ps( planeX[p], cx, planeW[p] );
+            distance = _mm256_fmadd_ps( planeY[p], cy, distance );
+            distance = _mm256_fmadd_ps( planeZ[p], cz, distance );
+            inside = _mm256_and_ps( inside, _mm256_cmp_ps( distance, negRadius, _CMP_GE_OQ ) );
+        }
+
+        // compact the visible lanes to the output
+        unsigned int mask = static_cast<unsigned int>( _mm256_movemask_ps( inside ) );
+        if( i + 8 > end )
+            mask &= ( 1U << ( end - i ) ) - 1U;
+        while( mask )
+        {
+            unsigned int lane = __builtin_ctz( mask );
+            out[visibleCount++] = static_cast<uint32_t>( i + lane );
+            mask &= mask - 1U;
+        }
+    }
+
+    return visibleCount;
+}
+#else
+size_t FrustumCuller::cullRangeAvx2( const Frustum& frustum, const BoundsSoA& bounds, size_t begin, size_t end, uint32_t* out )
+{
+    return cullRangeScalar( frustum, bounds, begin, end, out );
+}
+#endif
+
+double FrustumCuller::benchmark( size_t objectCount, uint32_t iterations )
+{
+    /**
+     * @brief Synthetic scene
+     * Random spheres in a 400 unit cube around the camera, so roughly a fraction of them are inside the frustum
+     */
+    std::mt19937 rng( 1234 );
+    std::uniform_real_distribution<float> position( -200.0f, 200.0f );
+    std::uniform_real_distribution<float> size( 0.1f, 4.0f );
+
+    BoundsSoA bounds;
+    bounds.resize( objectCount );
+    for( size_t i = 0; i < objectCount; ++i )
+        bounds.set( i, glm::vec3{ position( rng ), position( rng ), position( rng ) }, size( rng ) );
+
+    glm::mat4 view = glm::translate( glm::mat4{ 1.0f }, glm::vec3{ 0.0f, -6.0f, -10.0f } );
+    glm::mat4 projection = glm::perspective( glm::radians( 70.0f ), 1700.0f / 900.0f, 0.1f, 200.0f );
+    Frustum frustum = Frustum::fromViewProjection( projection * view );
+
+    FrustumCuller culler;
+    std::vector<uint32_t> visible;
+    culler.cull( frustum, bounds, visible );   // warm up
+
+    auto start = std::chrono::steady_clock::now();
+    for( uint32_t i = 0; i < iterations; ++i )
+        culler.cull( frustum, bounds, visible );
+    auto stop = std::chrono::steady_clock::now();
+
+    double ms = std::chrono::duration<double, std::milli>( stop - start ).count();
+    return static_cast<double>( objectCount ) * iterations / ms;
+}
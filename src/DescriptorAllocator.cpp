@@ -0,0 +1,111 @@
+#include "DescriptorAllocator.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#ifndef ENGINE_CATCH
+#define ENGINE_CATCH                            \
+    catch( const vk::SystemError& err )         \
+    {                                           \
+        throw std::runtime_error( err.what() ); \
+    }
+#endif
+
+void DescriptorAllocator::init( vk::Device device, uint32_t initialSetsPerPool, const std::vector<PoolSizeRatio>& ratios )
+{
+    m_device = device;
+    m_ratios = ratios;
+    m_setsPerPool = std::clamp( initialSetsPerPool, 1U, MaxSetsPerPool );
+    m_stats = Stats{};
+}
+
+void DescriptorAllocator::destroy()
+{
+    for( auto pool : m_readyPools )
+        m_device.destroyDescriptorPool( pool );
+    for( auto pool : m_fullPools )
+        m_device.destroyDescriptorPool( pool );
+
+    m_readyPools.clear();
+    m_fullPools.clear();
+}
+
+vk::DescriptorSet DescriptorAllocator::allocate( vk::DescriptorSetLayout layout )
+{
+    vk::DescriptorSetAllocateInfo setAllocInfo {};
+    setAllocInfo.setSetLayouts( layout );
+    setAllocInfo.setDescriptorSetCount( 1 );
+
+    /**
+     * @brief Retry on a fresh pool
+     * A new pool always has room for one set (unless the layout itself is bigger than a whole pool, then it throws)
+     */
+    for( int attempt = 0; attempt < 2; ++attempt )
+    {
+        setAllocInfo.setDescriptorPool( acquirePool() );
+        try
+        {
+            auto set = m_device.allocateDescriptorSets( setAllocInfo ).front();
+            m_stats.allocatedSets++;
+            m_stats.totalAllocations++;
+            return set;
+        }
+        catch( const vk::OutOfPoolMemoryError& )
+        {
+        }
+        catch( const vk::FragmentedPoolError& )
+        {
+        }
+        ENGINE_CATCH
+
+        m_fullPools.push_back( m_readyPools.back() );
+        m_readyPools.pop_back();
+        m_stats.fullPools = static_cast<uint32_t>( m_fullPools.size() );
+    }
+
+    throw std::runtime_error( "The descriptor set layout doesn't fit in an empty descriptor pool" );
+}
+
+void DescriptorAllocator::reset()
+{
+    for( auto pool : m_readyPools )
+        m_device.resetDescriptorPool( pool );
+    for( auto pool : m_fullPools )
+    {
+        m_device.resetDescriptorPool( pool );
+        m_readyPools.push_back( pool );
+    }
+    m_fullPools.clear();
+
+    m_stats.fullPools = 0;
+    m_stats.allocatedSets = 0;
+    m_stats.resets++;
+}
+
+vk::DescriptorPool DescriptorAllocator::acquirePool()
+{
+    if( m_readyPools.empty() )
+    {
+        m_readyPools.push_back( createPool( m_setsPerPool ) );
+        m_setsPerPool = std::min( MaxSetsPerPool, m_setsPerPool + m_setsPerPool / 2 );
+        m_stats.pools++;
+    }
+
+    return m_readyPools.back();
+}
+
+vk::DescriptorPool DescriptorAllocator::createPool( uint32_t setCount )
+{
+    std::vector<vk::DescriptorPoolSize> sizes;
+    sizes.reserve( m_ratios.size() );
+    for( const auto& ratio : m_ratios )
+        sizes.emplace_back( ratio.type, std::max( 1U, static_cast<uint32_t>( std::ceil( ratio.ratio * setCount ) ) ) );
+
+    vk::DescriptorPoolCreateInfo poolInfo {};
+    poolInfo.setMaxSets( setCount );
+    poolInfo.setPoolSizes( sizes );
+    try
+    {
+        return m_device.createDescriptorPool( poolInfo );
+    } ENGINE_CATCH
+}
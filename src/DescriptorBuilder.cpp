@@ -0,0 +1,173 @@
+#include "DescriptorBuilder.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+#ifndef ENGINE_CATCH
+#define ENGINE_CATCH                            \
+    catch( const vk::SystemError& err )         \
+    {                                           \
+        throw std::runtime_error( err.what() ); \
+    }
+#endif
+
+void DescriptorLayoutCache::init( vk::Device device )
+{
+    m_device = device;
+}
+
+void DescriptorLayoutCache::destroy()
+{
+    for( const auto& layout : m_layouts )
+        m_device.destroyDescriptorSetLayout( layout.second );
+
+    m_layouts.clear();
+}
+
+vk::DescriptorSetLayout DescriptorLayoutCache::createLayout( std::vector<vk::DescriptorSetLayoutBinding> bindings )
+{
+    std::sort( bindings.begin(), bindings.end(),
+        []( const vk::DescriptorSetLayoutBinding& a, const vk::DescriptorSetLayoutBinding& b ){ return a.binding < b.binding; }
+    );
+
+    LayoutKey key { std::move( bindings ) };
+    auto found = m_layouts.find( key );
+    if( found != m_layouts.end() )
+        return found->second;
+
+    vk::DescriptorSetLayoutCreateInfo layoutInfo {};
+    layoutInfo.setBindings( key.bindings );
+    vk::DescriptorSetLayout layout;
+    try
+    {
+        layout = m_device.createDescriptorSetLayout( layoutInfo );
+    } ENGINE_CATCH
+
+    m_layouts.emplace( std::move( key ), layout );
+    return layout;
+}
+
+bool DescriptorLayoutCache::LayoutKey::operator==( const LayoutKey& other ) const
+{
+    if( bindings.size() != other.bindings.size() )
+        return false;
+
+    // the immutable samplers are not compared, they're not supported
+    for( size_t i = 0; i < bindings.size(); ++i )
+    {
+        const auto& a = bindings[i];
+        const auto& b = other.bindings[i];
+        if( a.binding != b.binding || a.descriptorType != b.descriptorType || a.descriptorCount != b.descriptorCount || a.stageFlags != b.stageFlags )
+            return false;
+    }
+
+    return true;
+}
+
+size_t DescriptorLayoutCache::LayoutKeyHash::operator()( const LayoutKey& key ) const
+{
+    size_t hash = std::hash<size_t>()( key.bindings.size() );
+    for( const auto& binding : key.bindings )
+    {
+        assert( binding.pImmutableSamplers == nullptr );
+
+        // binding, type, count and stages packed in 64 bits (the count and the stages rarely go over 16 bits)
+        uint64_t packed = static_cast<uint64_t>( binding.binding )
+            | static_cast<uint64_t>( binding.descriptorType ) << 8
+            | static_cast<uint64_t>( binding.descriptorCount ) << 24
+            | static_cast<uint64_t>( static_cast<VkShaderStageFlags>( binding.stageFlags ) ) << 40;
+        hash ^= std::hash<uint64_t>()( packed ) + 0x9e3779b97f4a7c15ULL + ( hash << 6 ) + ( hash >> 2 );
+    }
+
+    return hash;
+}
+
+DescriptorBuilder DescriptorBuilder::begin( DescriptorLayoutCache& layoutCache, DescriptorAllocator& allocator )
+{
+    return DescriptorBuilder( layoutCache, allocator );
+}
+
+DescriptorBuilder::DescriptorBuilder( DescriptorLayoutCache& layoutCache, DescriptorAllocator& allocator )
+    : m_layoutCache( &layoutCache ), m_allocator( &allocator )
+{
+}
+
+DescriptorBuilder& DescriptorBuilder::bindBuffer( uint32_t binding, const vk::DescriptorBufferInfo& bufferInfo, vk::DescriptorType type, vk::ShaderStageFlags stages )
+{
+    addBinding( binding, type, stages );
+
+    m_writes.push_back( vk::WriteDescriptorSet{ nullptr, binding, 0, 1, type, nullptr, nullptr, nullptr } );
+    m_infoIndices.push_back( m_bufferInfos.size() );
+    m_bufferInfos.push_back( bufferInfo );
+
+    return *this;
+}
+
+DescriptorBuilder& DescriptorBuilder::bindImage( uint32_t binding, const vk::DescriptorImageInfo& imageInfo, vk::DescriptorType type, vk::ShaderStageFlags stages )
+{
+    addBinding( binding, type, stages );
+
+    m_writes.push_back( vk::WriteDescriptorSet{ nullptr, binding, 0, 1, type, nullptr, nullptr, nullptr } );
+    m_infoIndices.push_back( m_imageInfos.size() );
+    m_imageInfos.push_back( imageInfo );
+
+    return *this;
+}
+
+DescriptorBuilder& DescriptorBuilder::bindEmpty( uint32_t binding, vk::DescriptorType type, vk::ShaderStageFlags stages )
+{
+    addBinding( binding, type, stages );
+    return *this;
+}
+
+void DescriptorBuilder::build( vk::DescriptorSet& outSet, vk::DescriptorSetLayout& outLayout )
+{
+    outLayout = buildLayout();
+    outSet = m_allocator->allocate( outLayout );
+
+    /**
+     * @brief Every write in one update
+     * The types with a buffer info point to m_bufferInfos, the others to m_imageInfos
+     */
+    for( size_t i = 0; i < m_writes.size(); ++i )
+    {
+        auto& write = m_writes[i];
+        write.setDstSet( outSet );
+        switch( write.descriptorType )
+        {
+            case vk::DescriptorType::eUniformBuffer:
+            case vk::DescriptorType::eUniformBufferDynamic:
+            case vk::DescriptorType::eStorageBuffer:
+            case vk::DescriptorType::eStorageBufferDynamic:
+                write.setPBufferInfo( &m_bufferInfos[m_infoIndices[i]] );
+                break;
+            default:
+                write.setPImageInfo( &m_imageInfos[m_infoIndices[i]] );
+                break;
+        }
+    }
+
+    if( !m_writes.empty() )
+        m_allocator->device().updateDescriptorSets( m_writes, nullptr );
+}
+
+void DescriptorBuilder::build( vk::DescriptorSet& outSet )
+{
+    vk::DescriptorSetLayout layout;
+    build( outSet, layout );
+}
+
+vk::DescriptorSetLayout DescriptorBuilder::buildLayout()
+{
+    return m_layoutCache->createLayout( m_bindings );
+}
+
+void DescriptorBuilder::addBinding( uint32_t binding, vk::DescriptorType type, vk::ShaderStageFlags stages )
+{
+    vk::DescriptorSetLayoutBinding layoutBinding {};
+    layoutBinding.setBinding( binding );
+    layoutBinding.setDescriptorType( type );
+    layoutBinding.setDescriptorCount( 1 );
+    layoutBinding.setStageFlags( stages );
+    m_bindings.push_back( layoutBinding );
+}
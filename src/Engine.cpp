@@ -9,10 +9,17 @@
 
 #include "Vulkan_Init.hpp"
 #include "GraphicsPipeline.hpp"
+#include "CpuProfiler.hpp"
+#include "imgui.h"
 
 #include <iostream>
 #include <assert.h>
 #include <fstream>
+#include <numeric>
+#include <algorithm>
+#include <random>
+#include <cstdio>
+#include <chrono>
 
 #ifndef ENGINE_CATCH
 #define ENGINE_CATCH                            \
@@ -29,8 +36,20 @@
 #define SIN( X ) sinf( glm::radians( X ) )
 #define COS( X ) cosf( glm::radians( X ) )
 
-Engine::Engine() 
+Engine::Engine( const EngineConfig& config ) 
+    : _config( config )
 {
+    _requestedPresentMode = _config.presentMode;
+    _framePacer.setTargetFrameRate( _config.targetFrameRate );
+    _resolutionScaler.setRange( _config.minRenderScale, 1.0f );
+    _resolutionScaler.setBudget( _config.resolvedGpuBudgetMs() );
+    _resolutionScaler.setEnabled( _config.dynamicResolution );
+    _depthPrepassEnabled = _config.depthPrepass;
+    _occlusionCullingEnabled = _config.occlusionCulling;
+    _shadowCascades.cacheEnabled() = _config.shadowCache;
+    // the sweep compares the light counts at the same resolution
+    if( !_config.lightSweep.empty() )
+        _resolutionScaler.setEnabled( false );
     run();
 }
 
@@ -48,36 +67,129 @@ void Engine::run()
 
 void Engine::initWindow() 
 {
+    // headless has no window at all, and GLFW is not even initialized
+    if( _config.headless )
+        return;
+
     glfwInit();
     glfwWindowHint( GLFW_CLIENT_API, GLFW_NO_API );
     glfwWindowHint( GLFW_RESIZABLE, GLFW_FALSE );
 
     _window = glfwCreateWindow( ScreenWidth, ScreenHeight, "Vulkan Application", nullptr, nullptr );
+
+    glfwSetWindowUserPointer( _window, this );
+    glfwSetKeyCallback( _window, keyCallback );
+    glfwSetScrollCallback( _window, scrollCallback );
+}
+
+void Engine::keyCallback( GLFWwindow* window, int key, int /*scancode*/, int action, int /*mods*/ ) 
+{
+    if( action != GLFW_PRESS )
+        return;
+
+    auto engine = reinterpret_cast<Engine*>( glfwGetWindowUserPointer( window ) );
+
+    /**
+     * @brief Present mode hotkeys
+     * 1 = FIFO, 2 = FIFO relaxed, 3 = mailbox, 4 = immediate
+     */
+    switch( key )
+    {
+        case GLFW_KEY_1: engine->setPresentMode( vk::PresentModeKHR::eFifo );          break;
+        case GLFW_KEY_2: engine->setPresentMode( vk::PresentModeKHR::eFifoRelaxed );   break;
+        case GLFW_KEY_3: engine->setPresentMode( vk::PresentModeKHR::eMailbox );       break;
+        case GLFW_KEY_4: engine->setPresentMode( vk::PresentModeKHR::eImmediate );     break;
+        case GLFW_KEY_F1: engine->_overlay.setVisible( !engine->_overlay.visible() ); break;
+        // CPU trace capture, it does nothing if the profiler is not compiled in
+        case GLFW_KEY_F9: PROFILE_CAPTURE( engine->_config.traceFrames > 0 ? engine->_config.traceFrames : 120 ); break;
+        case GLFW_KEY_F10: engine->dumpMemoryStats(); break;
+        default: break;
+    }
+}
+
+void Engine::scrollCallback( GLFWwindow* window, double /*xoffset*/, double yoffset ) 
+{
+    auto engine = reinterpret_cast<Engine*>( glfwGetWindowUserPointer( window ) );
+    engine->_overlay.addScroll( static_cast<float>( yoffset ) );
+}
+
+void Engine::setPresentMode( vk::PresentModeKHR presentMode ) 
+{
+    _requestedPresentMode = presentMode;
 }
 
 void Engine::initVulkan() 
 {
+    PROFILE_FUNCTION();
     createMainVulkanComponent();
+    createPipelineCache();
     createMemoryAllocator();
     createSwapchainComponent();
+    _mainDeletionQueue.pushFunction(
+        [this](){
+            _swapchainDeletionQueue.flush();
+            if( _swapchain )
+                _device->destroySwapchainKHR( _swapchain );
+        }
+    );
     createCommandComponent();
     createSyncObject();
-    createRenderPass();
-    createFramebuffers();
+    createGpuProfiler();
+    createRenderGraph();
+    createOverlay();
     createObjectToRender();
+    createOcclusionCuller();
+    createLightClusters();
+    createShadowCascades();
+}
+
+bool Engine::shouldClose() 
+{
+    if( !_config.lightSweep.empty() )
+        return _lightSweep.done || ( !_config.headless && glfwWindowShouldClose( _window ) );
+    if( _config.frameCount > 0 && _totalFrames >= _config.frameCount )
+        return true;
+
+    return !_config.headless && glfwWindowShouldClose( _window );
 }
 
 void Engine::mainLoop() 
 {
-    while( !glfwWindowShouldClose( _window ) )
+    PROFILE_CAPTURE( _config.traceFrames );
+
+    while( !shouldClose() )
     {
-        glfwPollEvents();
-        beginFrame();
-        record();
-        endFrame();
+        {
+            PROFILE_ZONE( "frame" );
+
+            if( !_config.headless )
+            {
+                PROFILE_ZONE( "events" );
+                glfwPollEvents();
+                if( _requestedPresentMode != _presentMode )
+                    recreateSwapchain();
+            }
+
+            beginFrame();
+            record();
+            endFrame();
+            if( !_config.lightSweep.empty() )
+                advanceLightSweep();
+            {
+                PROFILE_ZONE( "frame pacing" );
+                _framePacer.wait();
+            }
+            if( _overlay.visible() )
+                _overlay.pushFrameTimes( static_cast<float>( _framePacer.lastFrameTimeMs() ), static_cast<float>( _gpuTimeMs ) );
+            if( _frameNumber % 60 == 0 )
+                reportStats();
+        }
+        PROFILE_FRAME();
+
         _frameNumber++;
         if( _frameNumber >= (UINT32_MAX - 1) )
             _frameNumber = 0;
+        _totalFrames++;
     }
 }
 
@@ -87,10 +199,21 @@ void Engine::cleanUp()
     _presentQueue.waitIdle();
     _device->waitIdle();
 
+    // the last FRAME_OVERLAP frames never had their slot come round again
+    for( auto& frame : _frames )
+        writeReadback( frame );
+
+    // before the allocator is destroyed with the main deletion queue
+    if( !_config.vmaDumpFile.empty() )
+        _memoryMonitor.dumpJson( _config.vmaDumpFile );
+
     _mainDeletionQueue.flush();
 
     utils::DestroyDebugUtilsMessengerEXT( _instance.get(), _debugUtilsMessenger, nullptr );
 
+    if( _config.headless )
+        return;
+
     vkDestroySurfaceKHR( _instance.get(), _surface, nullptr );
     glfwDestroyWindow( _window );
     glfwTerminate();
@@ -101,7 +224,7 @@ void Engine::createMainVulkanComponent()
     /**
      * @brief Instance
      */
-    _instance = init::createInstance();
+    _instance = init::createInstance( _config.headless );
 
     /**
      * @brief Debug Utils Messenger
@@ -110,8 +233,10 @@ void Engine::createMainVulkanComponent()
 
     /**
      * @brief Surface
+     * Headless has no surface (it stays null), so the rest of init picks just the graphics queue and no swapchain
      */
-    _surface = init::createSurfce( _instance.get(), _window );
+    if( !_config.headless )
+        _surface = init::createSurfce( _instance.get(), _window );
 
     /**
      * @brief Physical Device
@@ -124,82 +249,180 @@ void Engine::createMainVulkanComponent()
 
     /**
      * @brief Device and The Queues
+     * VK_EXT_memory_budget is optional, without it VMA estimates the budget
      */
-    _device = init::createDevice( _physicalDevice, _surface );
+    std::vector<const char*> extraExtensions;
+
+    // the bindless texture table is not optional, the draw has no other way to reach the textures
+    if( !TextureTable::isSupported( _physicalDevice ) )
+        throw std::runtime_error( "The GPU doesn't support the descriptor indexing features of the bindless textures (VK_EXT_descriptor_indexing)" );
+    extraExtensions.push_back( VK_KHR_MAINTENANCE3_EXTENSION_NAME );    // required by descriptor indexing
+    extraExtensions.push_back( VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME );
+    auto indexingFeatures = TextureTable::requiredFeatures();
+
+    _memoryBudgetSupported = utils::HasDeviceExtension( _physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME );
+    if( _memoryBudgetSupported )
+        extraExtensions.push_back( VK_EXT_MEMORY_BUDGET_EXTENSION_NAME );
+    else
+        std::cout << VK_EXT_MEMORY_BUDGET_EXTENSION_NAME << " is not supported, the memory budget is estimated\n";
+    // every core feature is enabled, so the occlusion culling just needs to know if the indirect draws can start at their own instance
+    _occlusionCullingSupported = OcclusionCuller::isSupported( _physicalDevice );
+    if( !_occlusionCullingSupported )
+        std::cout << "drawIndirectFirstInstance is not supported, the occlusion culling is off\n";
+
+    _device = init::createDevice( _physicalDevice, _surface, extraExtensions, &indexingFeatures );
     {
         auto graphicsAndPresentQueueFamily = utils::FindQueueFamilyIndices( _physicalDevice, _surface );
-        _graphicsQueue = _device->getQueue( graphicsAndPresentQueueFamily.graphicsAndPresentFamilyIndex()[0], 0 );
+        _graphicsQueueFamily = graphicsAndPresentQueueFamily.graphicsAndPresentFamilyIndex()[0];
+        _graphicsQueue = _device->getQueue( _graphicsQueueFamily, 0 );
         _presentQueue = _device->getQueue( graphicsAndPresentQueueFamily.graphicsAndPresentFamilyIndex()[1], 0 );
     }
 }
 
-void Engine::createSwapchainComponent() 
+void Engine::createSwapchainComponent( vk::SwapchainKHR oldSwapchain ) 
+{
+    /**
+     * @brief Headless has offscreen images in place of the swapchain images
+     */
+    if( _config.headless )
+        createOffscreenImages();
+    else
+        createSwapchainImages( oldSwapchain );
+
+    // the scene and depth images are transient images of the render graph, just their formats are picked here
+    _depthFormat = vk::Format::eD32Sfloat; // most GPU support this format
+
+    /**
+     * @brief The scaled image can be upscaled only with a (linear) blit, without it the scene is always rendered at full resolution and copied
+     * The scene image has the same format as the swapchain, so the render pass and the pipelines stay the same.
+     */
+    auto formatFeatures = _physicalDevice.getFormatProperties( _swapchainFormat ).optimalTilingFeatures;
+    _sceneBlitSupported = ( formatFeatures & vk::FormatFeatureFlagBits::eBlitSrc ) 
+                        && ( formatFeatures & vk::FormatFeatureFlagBits::eBlitDst )
+                        && ( formatFeatures & vk::FormatFeatureFlagBits::eSampledImageFilterLinear );
+    if( !_sceneBlitSupported )
+        std::cout << "The swapchain format " << vk::to_string( _swapchainFormat ) << " can't be blitted, the dynamic resolution is off\n";
+}
+
+void Engine::createOffscreenImages() 
+{
+    _swapchainExtent = vk::Extent2D{ ScreenWidth, ScreenHeight };
+    // RGBA, so the readback can be written to PNG as it is
+    _swapchainFormat = vk::Format::eR8G8B8A8Unorm;
+    _swapchainImages.clear();
+    _swapchainImageViews.clear();
+
+    vk::Extent3D imageExtent { _swapchainExtent.width, _swapchainExtent.height, 1 };
+    for( size_t i = 0; i < FRAME_OVERLAP; ++i )
+    {
+        auto imageInfo = init::image::initImageInfo(
+            _swapchainFormat,
+            vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst,
+            imageExtent
+        );
+
+        vma::AllocationCreateInfo imageAllocInfo {};
+        imageAllocInfo.setUsage( vma::MemoryUsage::eGpuOnly );
+
+        AllocatedImage image;
+        {
+            auto temp = _allocator.createImage( imageInfo, imageAllocInfo );
+            image.image = temp.first;
+            image.allocation = temp.second;
+        }
+
+        vk::ImageView imageView;
+        try
+        {
+            imageView = _device->createImageView( init::image::initImageViewInfo( _swapchainFormat, image.image, vk::ImageAspectFlagBits::eColor ) );
+        } ENGINE_CATCH
+
+        _swapchainImages.push_back( image.image );
+        _swapchainImageViews.push_back( imageView );
+        _swapchainDeletionQueue.pushFunction(
+            [d = _device.get(), a = _allocator, i = image, iv = imageView](){
+                d.destroyImageView( iv );
+                a.destroyImage( i.image, i.allocation );
+            }
+        );
+    }
+
+    /**
+     * @brief Readback Buffer
+     * Every frame copies its image to its own buffer, and it's written to file when the fence of the frame is waited
+     */
+    if( !_config.readbackDirectory.empty() )
+    {
+        for( auto& frame : _frames )
+        {
+            frame.readbackBuffer = AllocatedBuffer::createBuffer(
+                _swapchainExtent.width * _swapchainExtent.height * 4,
+                vk::BufferUsageFlagBits::eTransferDst,
+                _allocator,
+                vma::MemoryUsage::eGpuToCpu
+            );
+            _swapchainDeletionQueue.pushFunction(
+                [a = _allocator, b = frame.readbackBuffer](){
+                    a.destroyBuffer( b.buffer, b.allocation );
+                }
+            );
+        }
+    }
+}
+
+void Engine::createSwapchainImages( vk::SwapchainKHR oldSwapchain ) 
 {
     /**
      * @brief Swapchain, swapchain images, and swapchain image views
+     * The swapchain itself is destroyed by recreateSwapchain() or cleanUp, the rest by _swapchainDeletionQueue
      */
-    _swapchain = init::sc::createSwapchain( _physicalDevice, _device.get(), _surface );
-    _mainDeletionQueue.pushFunction( [=](){ _device->destroySwapchainKHR( _swapchain ); } );
+    _swapchain = init::sc::createSwapchain( _physicalDevice, _device.get(), _surface, _requestedPresentMode, oldSwapchain );
     {
         auto surfaceCapability = _physicalDevice.getSurfaceCapabilitiesKHR( _surface );
         auto surfaceFormats = _physicalDevice.getSurfaceFormatsKHR( _surface );
+        auto surfacePresentModes = _physicalDevice.getSurfacePresentModesKHR( _surface );
         auto surfaceExtent = utils::sc::chooseSurfaceExtent( surfaceCapability );
         auto surfaceFormat = utils::sc::chooseSurfaceFormat( surfaceFormats );
         _swapchainExtent = surfaceExtent;
         _swapchainFormat = surfaceFormat.format;
+        // if the requested mode is not supported, accept the fallback so it's not recreated again
+        _presentMode = utils::sc::choosePresentMode( surfacePresentModes, _requestedPresentMode );
+        _requestedPresentMode = _presentMode;
     }
+    _swapchainImageViews.clear();
     init::sc::retrieveImagesAndCreateImageViews( _device.get(), _swapchain, _swapchainFormat, _swapchainImages, _swapchainImageViews );
-    _mainDeletionQueue.pushFunction( 
+    _swapchainDeletionQueue.pushFunction( 
         [d = _device.get(), imageViews = _swapchainImageViews]{
             for( auto& imageView : imageViews )
                 d.destroyImageView( imageView );
         }
      );
+}
 
-    /***************************************************/
+void Engine::recreateSwapchain() 
+{
+    _device->waitIdle();
 
-    /**
-      * @brief This image actually not part of swapchain image. It's image is for depth image
-     */
+    _swapchainDeletionQueue.flush();
+    // the transient images follow the swapchain extent, and some framebuffers have the swapchain image views
+    _renderGraph.releaseTargets();
 
-    /**
-     * @brief Init the image info
-     */
-    vk::Extent3D depthImageExtent { ScreenWidth, ScreenHeight, 1 };
-    _depthFormat = vk::Format::eD32Sfloat; // most GPU support this format
-    auto depthImageInfo = init::image::initImageInfo( _depthFormat, vk::ImageUsageFlagBits::eDepthStencilAttachment, depthImageExtent );
+    // the old swapchain is handed to the new one, and then destroyed
+    vk::SwapchainKHR oldSwapchain = _swapchain;
+    vk::Format oldFormat = _swapchainFormat;
+    createSwapchainComponent( oldSwapchain );
+    _device->destroySwapchainKHR( oldSwapchain );
 
-    /**
-     * @brief Init the vma
-     */
-    vma::AllocationCreateInfo depthImageAllocInfo {};
-    depthImageAllocInfo.setUsage( vma::MemoryUsage::eGpuOnly ); // this because we use optimal tilling when use the image
-    depthImageAllocInfo.setRequiredFlags( vk::MemoryPropertyFlagBits::eDeviceLocal );   // because "GPU only" and optimal tilling wkwkwk
+    // the render pass (and so the pipelines) still can be used as long as the format doesn't change
+    if( _swapchainFormat != oldFormat )
+        throw std::runtime_error( "The swapchain format is changed after recreating the swapchain" );
 
-    /**
-     * @brief Creating the image
-     */
-    {
-        auto temp = _allocator.createImage( depthImageInfo, depthImageAllocInfo );
-        _depthImage.image = temp.first;
-        _depthImage.allocation = temp.second;
-    }
-
-    /**
-     * @brief Creating the image view
-     */
-    auto depthImageViewInfo = init::image::initImageViewInfo( _depthFormat, _depthImage.image, vk::ImageAspectFlagBits::eDepth );
-    _depthImageView = _device->createImageView( depthImageViewInfo );
+    _overlay.setExtent( _swapchainExtent );
+    // the HZB follows the new depth image
+    if( _occlusionCullingSupported )
+        _occlusionCuller.createTargets( _swapchainExtent, _swapchainDeletionQueue );
 
-    /**
-     * @brief Push to deletion
-     */
-    _mainDeletionQueue.pushFunction(
-        [d = _device.get(), a = _allocator, i = _depthImage, iv = _depthImageView](){
-            d.destroyImageView( iv );
-            a.destroyImage( i.image, i.allocation );
-        }
-    );
+    std::cout << "Swapchain recreated with present mode " << vk::to_string( _presentMode ) << "\n";
 }
 
 void Engine::createCommandComponent() 
@@ -229,124 +452,157 @@ void Engine::createCommandComponent()
     );
 }
 
-void Engine::createRenderPass() 
+void Engine::createRenderGraph() 
 {
-    /**
-     * @brief the renderpass will use this COLOR attachment.
-     */
-    vk::AttachmentDescription colorAttachment {};
-    //the attachment will have the format needed by the swapchain
-    colorAttachment.setFormat           ( _swapchainFormat );
-    //1 sample, we won't be doing MSAA
-    colorAttachment.setSamples          ( vk::SampleCountFlagBits::e1 );
-    // we Clear when this attachment is loaded
-    colorAttachment.setLoadOp           ( vk::AttachmentLoadOp::eClear );
-    // we keep the attachment stored when the renderpass ends
-    colorAttachment.setStoreOp          ( vk::AttachmentStoreOp::eStore );
-    //we don't care about stencil
-    colorAttachment.setStencilLoadOp    ( vk::AttachmentLoadOp::eDontCare );
-    colorAttachment.setStencilStoreOp   ( vk::AttachmentStoreOp::eDontCare );
-    //we don't know or care about the starting layout of the attachment
-    colorAttachment.setInitialLayout    ( vk::ImageLayout::eUndefined );
-    //after the renderpass ends, the image has to be on a layout ready for display
-    colorAttachment.setFinalLayout      ( vk::ImageLayout::ePresentSrcKHR );
-
-    /**
-     * @brief the renderpass will use this DEPTH attachment.
-     */
-    vk::AttachmentDescription depthAttachment {};
-    depthAttachment.setFormat( _depthFormat );
-    depthAttachment.setSamples( vk::SampleCountFlagBits::e1 );  // we won't use fancy sample for right now
-    depthAttachment.setLoadOp( vk::AttachmentLoadOp::eClear );
-    depthAttachment.setStoreOp( vk::AttachmentStoreOp::eStore );
-    depthAttachment.setStencilLoadOp( vk::AttachmentLoadOp::eClear );
-    depthAttachment.setStencilStoreOp( vk::AttachmentStoreOp::eDontCare );
-    depthAttachment.setInitialLayout( vk::ImageLayout::eUndefined );
-    depthAttachment.setFinalLayout( vk::ImageLayout::eDepthStencilAttachmentOptimal );
-
+    _renderGraph.init( _device.get(), _allocator );
+    _mainDeletionQueue.pushFunction(
+        [this](){
+            _renderGraph.destroy();
+        }
+    );
 
     /**
-     * @brief COLOR Attachment Reference, this is needed for creating Subpass
+     * @brief The render passes are made by the render graph from what the passes declare (load and store ops, layouts),
+     * the pipelines just need one that is compatible with the scene passes: the scene color and the depth
      */
-    vk::AttachmentReference colorAttachmentRef {};
-    //attachment number will index into the pAttachments array in the parent renderpass itself
-    colorAttachmentRef.setAttachment( 0 );
-    // this layout 'll be use during subpass that use this attachment ref
-    colorAttachmentRef.setLayout( vk::ImageLayout::eColorAttachmentOptimal );
+    _renderPass = _renderGraph.compatibleRenderPass( { _swapchainFormat }, _depthFormat );
 
-    /**
-     * @brief DEPTH Attachment Reference, this is needed for creating Subpass
-     */
-    vk::AttachmentReference depthAttachmentRef {};
-    depthAttachmentRef.setAttachment( 1 );
-    depthAttachmentRef.setLayout( vk::ImageLayout::eDepthStencilAttachmentOptimal );
+    std::cout << "Lazily allocated transient attachments: " << ( _renderGraph.lazyAllocationSupported() ? "on" : "off (no such memory type)" ) << "\n";
+}
 
-    /**
-     * @brief Subpass
-     */
-    vk::SubpassDescription subpass {};
-    // this bind point could be graphics, compute, or maybe ray tracing
-    subpass.setPipelineBindPoint( vk::PipelineBindPoint::eGraphics );
-    // color attachment that 'll be used
-    subpass.setColorAttachments( colorAttachmentRef );
-    // depth attachment that 'll be used
-    subpass.setPDepthStencilAttachment( &depthAttachmentRef );
+void Engine::createOverlay() 
+{
+    // headless has no input, so there is nothing to show the overlay to
+    if( _config.headless )
+        return;
 
-    // vk::SubpassDependency subpassDependecy {};
-    // subpassDependecy.setSrcSubpass( VK_SUBPASS_EXTERNAL );
-    // subpassDependecy.setDstSubpass( 0 );
-    // subpassDependecy.setSrcStageMask( vk::PipelineStageFlagBits::eColorAttachmentOutput );
-    // // subpassDependecy.setSrcAccessMask( vk::AccessFlags() );
-    // subpassDependecy.setDstStageMask( vk::PipelineStageFlagBits::eColorAttachmentOutput );
-    // subpassDependecy.setDstAccessMask( vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite );
+    // the overlay pass has just the swapchain image
+    _overlay.init( _device.get(), _allocator, _renderGraph.compatibleRenderPass( { _swapchainFormat }, vk::Format::eUndefined ), _pipelineCache.get() );
+    _overlay.setExtent( _swapchainExtent );
+    immediateSubmit(
+        [this]( vk::CommandBuffer cmd ){
+            _overlay.recordFontUpload( cmd );
+        }
+    );
+    _overlay.releaseUploadBuffer();
 
-    std::vector<vk::AttachmentDescription> attachDescs = { colorAttachment, depthAttachment };
+    _mainDeletionQueue.pushFunction(
+        [this](){
+            _overlay.destroy();
+        }
+    );
+}
 
-    vk::RenderPassCreateInfo renderPassInfo {};
-    renderPassInfo.setAttachments( attachDescs );
-    renderPassInfo.setSubpasses( subpass );
-    // renderPassInfo.setDependencies( subpassDependecy );
+void Engine::createOcclusionCuller() 
+{
+    if( !_occlusionCullingSupported )
+        return;
 
-    try
-    {
-        _renderPass = _device->createRenderPass( renderPassInfo );
-    } ENGINE_CATCH
+    _occlusionCuller.init( _device.get(), _allocator, _layoutCache, _pipelineCache.get() );
+    _occlusionCuller.createTargets( _swapchainExtent, _swapchainDeletionQueue );
 
     _mainDeletionQueue.pushFunction(
-        [device = _device.get(), renderpass = _renderPass](){
-            device.destroyRenderPass( renderpass );
+        [this](){
+            _occlusionCuller.destroy();
         }
     );
 }
 
-void Engine::createFramebuffers() 
+void Engine::createLightClusters() 
 {
-    _swapchainFramebuffers.reserve( _swapchainImageViews.size() );
+    _lightClusters.init( _device.get(), _allocator, _layoutCache, _pipelineCache.get() );
+    _mainDeletionQueue.pushFunction(
+        [this](){
+            _lightClusters.destroy();
+        }
+    );
 
-    for( auto& imageView : _swapchainImageViews )
-    {
-        std::vector<vk::ImageView> attachments = {
-            imageView,
-            _depthImageView     // each framebuffer use the same depth image view
-        };
+    createLights( _config.lightSweep.empty() ? _config.lightCount : _config.lightSweep.front() );
+}
 
-        vk::FramebufferCreateInfo framebufferInfo {};
-        framebufferInfo.setRenderPass( _renderPass );
-        framebufferInfo.setAttachments( attachments );
-        framebufferInfo.setWidth( _swapchainExtent.width );
-        framebufferInfo.setHeight( _swapchainExtent.height );
-        framebufferInfo.setLayers( 1 );
+void Engine::createLights( uint32_t count ) 
+{
+    /**
+     * @brief Random lights in the box of the bounding sphere of the empire map (flattened, the map is wider than it's tall)
+     * A quarter of them are spots that look down. The seed is fixed, so every run (and every step of the sweep) has the same lights.
+     */
+    const auto* pMap = _sceneManag.getPMehs( "empireMesh" );
+    const glm::vec3 center = glm::vec3{ pMap->bounds } + glm::vec3{ 5, -10, 0 };   // the transform of the map object
+    const float radius = pMap->bounds.w;
 
-        try
+    std::mt19937 random( 1337U );
+    std::uniform_real_distribution<float> unit( 0.0f, 1.0f );
+    std::uniform_real_distribution<float> spread( -1.0f, 1.0f );
+
+    _lights.clear();
+    _lights.reserve( count );
+    for( uint32_t i = 0; i < count; ++i )
+    {
+        LightClusters::Light light {};
+        light.position = center + glm::vec3{ spread( random ) * radius, spread( random ) * radius * 0.25f, spread( random ) * radius };
+        light.range = radius * ( 0.02f + 0.06f * unit( random ) );
+        light.color = glm::vec3{ 0.2f + 0.8f * unit( random ), 0.2f + 0.8f * unit( random ), 0.2f + 0.8f * unit( random ) };
+        light.intensity = light.range * light.range * 0.5f;     // so the light is still there close to its range
+        if( i % 4 == 3 )
         {
-            _swapchainFramebuffers.emplace_back( _device->createFramebuffer( framebufferInfo ) );
-        } ENGINE_CATCH
+            light.direction = glm::vec3{ 0.0f, -1.0f, 0.0f };
+            light.innerAngle = glm::radians( 20.0f );
+            light.outerAngle = glm::radians( 30.0f );
+        }
+        _lights.push_back( light );
     }
+}
+
+void Engine::advanceLightSweep() 
+{
+    /**
+     * @brief Every step warms up (the GPU timings are late and averaged), and then sums the frame times of LightSweepFrames frames
+     */
+    auto& sweep = _lightSweep;
+    if( sweep.done )
+        return;
+
+    ++sweep.frames;
+    if( sweep.frames <= EngineConfig::LightSweepWarmup )
+        return;
+
+    sweep.cpuMs += _framePacer.lastFrameTimeMs();
+    sweep.gpuMs += _gpuTimeMs;
+    if( const auto* assign = _gpuProfiler.find( "light clusters" ) )
+        sweep.assignMs += assign->lastMs;
+    if( _lightClusters.stats().overflowedClusters > 0 )
+        ++sweep.overflowedFrames;
+    if( sweep.frames < EngineConfig::LightSweepWarmup + EngineConfig::LightSweepFrames )
+        return;
+
+    const double frames = static_cast<double>( EngineConfig::LightSweepFrames );
+    const auto& stats = _lightClusters.stats();
+    char line[256];
+    snprintf( line, sizeof(line), "lights %6u: cpu %8.3f ms  gpu %8.3f ms  light clusters %7.3f ms",
+        _config.lightSweep[sweep.step], sweep.cpuMs / frames, sweep.gpuMs / frames, sweep.assignMs / frames );
+    std::cout << line << "  (" << stats.visibleLights << " visible, at most " << stats.maxClusterLights << " in a cluster, "
+              << stats.lightIndices << " in the pool of " << stats.lightIndexCapacity << ")\n";
+    if( sweep.overflowedFrames > 0 )
+        std::cout << "lights " << _config.lightSweep[sweep.step] << ": FAILED, the light index pool overflowed in "
+                  << sweep.overflowedFrames << " of the measured frames\n";
+
+    ++sweep.step;
+    sweep.frames = 0;
+    sweep.cpuMs = sweep.gpuMs = sweep.assignMs = 0.0;
+    sweep.overflowedFrames = 0;
+    if( sweep.step == _config.lightSweep.size() )
+        sweep.done = true;
+    else
+        createLights( _config.lightSweep[sweep.step] );
+}
 
+void Engine::createShadowCascades() 
+{
+    // the shadow passes have a depth attachment only
+    _shadowCascades.init( _device.get(), _allocator, _layoutCache, _renderGraph.compatibleRenderPass( {}, ShadowCascades::Format ), _pipelineCache.get() );
     _mainDeletionQueue.pushFunction(
-        [d = _device.get(), framebuffers = _swapchainFramebuffers](){
-            for( auto& framebuffer : framebuffers )
-                d.destroyFramebuffer( framebuffer );
+        [this](){
+            _shadowCascades.destroy();
         }
     );
 }
@@ -382,18 +638,55 @@ void Engine::createSyncObject()
     );
 }
 
+void Engine::createGpuProfiler() 
+{
+    /**
+     * @brief Without timestamp on the graphics queue, there is no GPU time, so the resolution just stays at the max scale
+     */
+    if( !_gpuProfiler.init( _instance.get(), _physicalDevice, _device.get(), _graphicsQueueFamily ) )
+    {
+        std::cout << "The graphics queue has no timestamp, the GPU profiler and the dynamic resolution are off\n";
+        _resolutionScaler.setEnabled( false );
+    }
+
+    _mainDeletionQueue.pushFunction(
+        [this](){
+            _gpuProfiler.destroy();
+        }
+    );
+}
+
+void Engine::createPipelineCache() 
+{
+    _pipelineCache.init( _device.get(), _physicalDeviceProperties, _config.pipelineCacheFile );
+
+    // pushed before every pipeline, so it's flushed after them, and the cache has everything they compiled
+    _mainDeletionQueue.pushFunction(
+        [this](){
+            _pipelineCache.destroy();
+        }
+    );
+}
+
 void Engine::createMemoryAllocator() 
 {
     vma::AllocatorCreateInfo allocatorInfo {};
     allocatorInfo.setInstance( _instance.get() );
     allocatorInfo.setPhysicalDevice( _physicalDevice );
     allocatorInfo.setDevice( _device.get() );
+    // the budget extension needs vkGetPhysicalDeviceMemoryProperties2, which is core since Vulkan 1.1
+    allocatorInfo.setVulkanApiVersion( VK_API_VERSION_1_1 );
+    if( _memoryBudgetSupported )
+        allocatorInfo.setFlags( vma::AllocatorCreateFlagBits::eExtMemoryBudget );
 
     try
     {
         _allocator = vma::createAllocator( allocatorInfo );
     } ENGINE_CATCH
 
+    _memoryMonitor.init( _allocator, _physicalDevice, _memoryBudgetSupported );
+    _memoryMonitor.setWarningThresholds( _config.memoryWarnings );
+
     _mainDeletionQueue.pushFunction(
         [a = _allocator](){
             a.destroy();
@@ -403,33 +696,113 @@ void Engine::createMemoryAllocator()
 
 void Engine::beginFrame() 
 {
-    vk::Result result;
-    result = _device->waitForFences( getCurrentFrame().renderFence, VK_TRUE, _timeOut );
-    if( result != vk::Result::eSuccess )
-        throw std::runtime_error( "Failed to wait for Fences" );
+    PROFILE_FUNCTION();
+    {
+        PROFILE_ZONE( "wait for fence" );
+        vk::Result result;
+        result = _device->waitForFences( getCurrentFrame().renderFence, VK_TRUE, _timeOut );
+        if( result != vk::Result::eSuccess )
+            throw std::runtime_error( "Failed to wait for Fences" );
+    }
 
     _device->resetFences( getCurrentFrame().renderFence );
+
+    _memoryMonitor.update();
+    getCurrentFrame().transientDescriptors.reset();
+
+    /**
+     * @brief GPU time of the last recording of this frame slot, it drives the render resolution
+     */
+    double gpuFrameMs = 0.0;
+    if( _gpuProfiler.collect( _frameNumber % FRAME_OVERLAP, &gpuFrameMs ) )
+    {
+        _gpuTimeMs = gpuFrameMs;
+        _resolutionScaler.update( _gpuTimeMs );
+    }
+
+    /**
+     * @brief Readback
+     * The copy of this frame slot has finished, so write it to file before the buffer is used again
+     */
+    writeReadback( getCurrentFrame() );
+}
+
+void Engine::writeReadback( FrameData& frame )
+{
+    if( frame.readbackFrame < 0 )
+        return;
+
+    std::string filename = _config.readbackDirectory + "/frame_" + std::to_string( frame.readbackFrame ) + ".png";
+    auto pixels = reinterpret_cast<const uint8_t*>( _allocator.mapMemory( frame.readbackBuffer.allocation ) );
+    _allocator.invalidateAllocation( frame.readbackBuffer.allocation, 0, VK_WHOLE_SIZE );
+    if( !utils::image::writePng( filename, _swapchainExtent.width, _swapchainExtent.height, pixels, _swapchainExtent.width * 4 ) )
+        std::cerr << "Failed to write " << filename << "\n";
+    _allocator.unmapMemory( frame.readbackBuffer.allocation );
+    frame.readbackFrame = -1;
 }
 
-void Engine::draw( vk::CommandBuffer cmd ) 
+void Engine::animateObjects() 
 {
     /**
-     * @brief draw() Week Point
-     * This draw function has weak point, i.e. this function just support for render with normal/dynamic uniform buffer.
-     * So, the "defaultMateril" won't work if you decide to use defaultMaterial to one of your renderable object
+     * @brief The dynamic objects go around a circle in front of the camera, and bob up and down
+     * It goes with the frame number, so a frame of the headless readback is always the same
      */
+    const float time = static_cast<float>( _frameNumber ) / 60.0f;
+    const float count = static_cast<float>( _dynamicObjects.size() );
+    for( size_t k = 0; k < _dynamicObjects.size(); ++k )
+    {
+        const float angle = time * 0.5f + glm::radians( 360.0f ) * static_cast<float>( k ) / count;
+        const glm::vec3 position = glm::vec3{ 0.0f, -2.0f, -12.0f } + glm::vec3{ cosf( angle ) * 5.0f, sinf( angle * 3.0f ) * 0.5f, sinf( angle ) * 5.0f };
+        _sceneManag.setTransform( _dynamicObjects[k], glm::translate( position ) * glm::rotate( -angle, glm::vec3{ 0.0f, 1.0f, 0.0f } ) );
+    }
+}
+
+void Engine::cullObjects( const glm::mat4& viewproj ) 
+{
+    PROFILE_FUNCTION();
+    /**
+     * @brief Update the world space bounding sphere of the changed objects
+     * The radius is scaled by the biggest axis scale, so the sphere still contains the mesh after non uniform scaling
+     */
+    _objectBounds.resize( _sceneManag.renderable.size() );
+    for( uint32_t i : _dirtyObjects )
+    {
+        const auto& object = _sceneManag.renderable[i];
+        const glm::mat4& model = object.transformMatrix;
+
+        glm::vec3 center = model * glm::vec4{ glm::vec3{ object.pMesh->bounds }, 1.0f };
+        float scale = std::max( { glm::length( glm::vec3{ model[0] } ),
+                                  glm::length( glm::vec3{ model[1] } ),
+                                  glm::length( glm::vec3{ model[2] } ) } );
+        _objectBounds.set( i, center, object.pMesh->bounds.w * scale );
+    }
+
+    if( !_cullingEnabled )
+    {
+        _visibleObjects.resize( _sceneManag.renderable.size() );
+        std::iota( _visibleObjects.begin(), _visibleObjects.end(), 0U );
+        return;
+    }
+
+    _culler.cull( Frustum::fromViewProjection( viewproj ), _objectBounds, _visibleObjects );
+}
+
+void Engine::prepareDraws() 
+{
+    PROFILE_FUNCTION();
+    const uint32_t frameIndex = _frameNumber % FRAME_OVERLAP;
 
     /**
      * @brief Camera (Normal Uniform Buffer)
      */
+    GpuCameraData& camData = _cameraData;
     {
         // camera view
         glm::vec3 camPos = { 0.0f, -6.0f, -10.0f };
         glm::mat4 view = glm::translate( glm::mat4{ 1.0f }, camPos );
-        glm::mat4 projection = glm::perspective( glm::radians(70.0f), 1700.0f/ 900.0f, 0.1f, 200.0f );
+        glm::mat4 projection = glm::perspective( CameraFovY, CameraAspect, CameraNear, CameraFar );
         projection[1][1] *= -1;
         // filling the GPU camera data
-        GpuCameraData camData;
         camData.projection = projection;
         camData.view = view;
         camData.viewproj = projection * view;
@@ -439,13 +812,59 @@ void Engine::draw( vk::CommandBuffer cmd )
         _allocator.unmapMemory( getCurrentFrame().cameraBuffer.allocation );
     }
 
-    int frameIndex = _frameNumber % FRAME_OVERLAP;
+    /**
+     * @brief Change tracking
+     * Just the changed objects are written to the object buffer and get new bounding sphere
+     */
+    animateObjects();
+    _sceneManag.takeDirtyObjects( _dirtyObjects );
+
+    /**
+     * @brief Object storage growth
+     * The fence of this frame has been waited (beginFrame), so it's safe to reallocate this frame's buffers here.
+     * New buffers are empty, so every object is dirty for this frame.
+     */
+    const uint32_t objectCount = static_cast<uint32_t>( _sceneManag.renderable.size() );
+    _objectStorage.reserve( objectCount );
+    if( _objectStorage.update( frameIndex, getCurrentFrame().objectDescriptorSet ) )
+    {
+        _dirtyObjects.resize( objectCount );
+        std::iota( _dirtyObjects.begin(), _dirtyObjects.end(), 0U );
+    }
+
+    /**
+     * @brief Frustum Culling
+     * After this, just the objects inside _visibleObjects that 'll be drawn
+     */
+    cullObjects( camData.viewproj );
+
+    /**
+     * @brief Lights, the ones in the view frustum are written to the light buffer of this frame
+     */
+    _lightClusters.prepare( frameIndex, getCurrentFrame().globalDescriptorSet, _lights, camData.view, camData.viewproj );
+
+    /**
+     * @brief Shadows of the sun
+     * The static shadow maps are rendered again only when they're invalid, a changed static object is one of the reasons
+     * (a dynamic object only touches the dynamic casters, which are rendered every frame anyway)
+     */
+    const glm::vec3 sunDirection = -glm::vec3{ cosf( _sunElevation ) * sinf( _sunAzimuth ), sinf( _sunElevation ), cosf( _sunElevation ) * cosf( _sunAzimuth ) };
+    {
+        const auto& renderable = _sceneManag.renderable;
+        const bool staticChanged = std::any_of( _dirtyObjects.begin(), _dirtyObjects.end(), [&renderable]( uint32_t i ){ return !renderable[i].dynamic; } );
+        _shadowCascades.prepare( frameIndex, camData.view, CameraFovY, CameraAspect, CameraNear, sunDirection, _objectBounds, renderable, _culler, staticChanged );
+    }
+
     /**
      * @brief Scene (Dyanamic Uniform Buffer)
      */
     {
         float framed = glm::radians( static_cast<float>( _frameNumber ) );
         _sceneParameter.sceneParameter.ambientColor = { sinf( framed ), 0, cosf( framed ), 1 };
+        _sceneParameter.sceneParameter.clusterScale = LightClusters::clusterScale( _renderExtent, CameraNear, CameraFar );
+        _sceneParameter.sceneParameter.sunlightDirection = camData.view * glm::vec4{ sunDirection, 0.0f };
+        _sceneParameter.sceneParameter.sunlightColor = { 1.0f, 0.95f, 0.85f, 1.5f };
+        _shadowCascades.fillSceneParameters( _sceneParameter.sceneParameter, camData.view );
         // mapping memory
         char* sceneData;
         auto result = _allocator.mapMemory( _sceneParameter.allocationBuffer.allocation, reinterpret_cast<void**>(&sceneData) );
@@ -482,121 +901,288 @@ void Engine::draw( vk::CommandBuffer cmd )
      * So, be carefull !.
      */
     {
-        void* data = _allocator.mapMemory( currentFrame.objectBuffer.allocation );
-        GpuObjectData* ssbo = reinterpret_cast<GpuObjectData*>( data );
-        for( int i = 0; i < _sceneManag.renderable.size(); ++i )
+        /**
+         * Just the dirty objects are written (the object buffer is persistently mapped, so there's no map/unmap either),
+         * so a static scene cost nothing here.
+         * The sorted dirty list is split to the runs of contiguous index,
+         * and the long runs are written with non temporal stores, they don't need to go through the cpu cache.
+         */
+        GpuObjectData* ssbo = _objectStorage.objects( frameIndex );
+        bool streamed = false;
+        for( size_t first = 0; first < _dirtyObjects.size(); )
         {
-            ssbo[i].modelMatrix = _sceneManag.renderable[i].transformMatrix;
+            size_t last = first + 1;
+            while( last < _dirtyObjects.size() && _dirtyObjects[last] == _dirtyObjects[last - 1] + 1 )
+                ++last;
+
+            if( last - first >= utils::mem::StreamCopyThreshold )
+            {
+                for( size_t k = first; k < last; ++k )
+                {
+                    uint32_t i = _dirtyObjects[k];
+                    const auto& object = _sceneManag.renderable[i];
+                    GpuObjectData data { object.transformMatrix, object.pMaterial->textureIndex, object.pMaterial->samplerIndex, { 0, 0 } };
+                    utils::mem::streamCopy( &ssbo[i], &data, sizeof(GpuObjectData) );
+                }
+                streamed = true;
+            }
+            else
+            {
+                for( size_t k = first; k < last; ++k )
+                {
+                    uint32_t i = _dirtyObjects[k];
+                    const auto& object = _sceneManag.renderable[i];
+                    ssbo[i].modelMatrix = object.transformMatrix;
+                    ssbo[i].textureIndex = object.pMaterial->textureIndex;
+                    ssbo[i].samplerIndex = object.pMaterial->samplerIndex;
+                }
+            }
+
+            first = last;
         }
-        _allocator.unmapMemory( currentFrame.objectBuffer.allocation );
+
+        if( streamed )
+            utils::mem::streamFence();
     }
 
     /**
-     * @brief Draw the object
+     * @brief Sort the visible objects
+     * Every visible object get a 64 bit key (pass, pipeline, material, mesh, and depth),
+     * so the objects that share the same state are next to each other no matter the order they're pushed,
+     * and the opaque objects are drawn from front to back.
      */
     {
-        Mesh* lastMesh = nullptr;
-        Material* pLastMaterial = nullptr;
-        vk::DescriptorSet* unvalidDescriptorSet = nullptr;
+        _renderQueue.clear();
+        for( uint32_t i : _visibleObjects )
+        {
+            const auto& object = _sceneManag.renderable[i];
+            glm::vec4 center { _objectBounds.centerX[i], _objectBounds.centerY[i], _objectBounds.centerZ[i], 1.0f };
+            float viewDepth = -( camData.view * center ).z;
+            float depth = ( viewDepth - CameraNear ) / ( CameraFar - CameraNear );
+            _renderQueue.push( sortkey::make( *object.pMaterial, *object.pMesh, depth ), i );
+        }
+        _renderQueue.sort();
+    }
 
-        uint32_t i = 0U;
-        for( auto& object : _sceneManag.renderable )
+    /**
+     * @brief The runs
+     * The objects of the same mesh and pipeline are next to each other after sorting, and all of them 'll be drawn by one instanced draw.
+     * The texture of every instance comes from its object data (bindless), so the run can go across materials.
+     */
+    const auto& items = _renderQueue.items();
+    _drawRuns.clear();
+    for( uint32_t first = 0; first < items.size(); )
+    {
+        const auto& object = _sceneManag.renderable[items[first].objectIndex];
+        uint32_t last = first + 1;
+        while( last < items.size()
+            && _sceneManag.renderable[items[last].objectIndex].pMesh == object.pMesh
+            && _sceneManag.renderable[items[last].objectIndex].pMaterial->pipeline == object.pMaterial->pipeline )
         {
-            /**
-             * @brief Material's things
-             */
-            if( object.pMaterial != pLastMaterial ) // just bind if the materials is valid
-            {
-                cmd.bindPipeline( vk::PipelineBindPoint::eGraphics, object.pMaterial->pipeline );
-
-                // if( object.pMaterial->textureSet != unvalidDescriptorSet )
-                cmd.bindDescriptorSets( vk::PipelineBindPoint::eGraphics, object.pMaterial->layout, 2, object.pMaterial->textureSet, nullptr );
-
-                // this bind descriptor set is just for dynamic buffer. Normal buffer no need this bind.
-                // It's makes sense, because the normal buffer just has static offset.
-                // In the other hand, the dynamic uniform buffer has dynamic offset.
-                // So, if you just want to make static offset, then just use the normal uniform buffer.
-                // Normal uniform buffer "should be" faster than the dynamic one, but I'm not sure, 
-                // I just predict it can be like the static memory and dynamic memory.
-                // And, the dynamic uniform buffer need to be bind every time, 
-                // so maybe that gonna make dynamic buffer more slower (?)
-                cmd.bindDescriptorSets(
-                    vk::PipelineBindPoint::eGraphics,           // pipeline bind point
-                    object.pMaterial->layout,                   // pipeline layout
-                    0,                                          // first descriptor set on the array of descriptor set
-                    currentFrame.globalDescriptorSet,           // the descriptor set (this could be an array, that's why there are "first descriptor set" right above this paramter)
-                    frameIndex * padUniformBufferSize(sizeof( GpuSceneParameterData ))  // dynamic offset
-                );
-                cmd.bindDescriptorSets(
-                    vk::PipelineBindPoint::eGraphics,
-                    object.pMaterial->layout,
-                    1,
-                    currentFrame.objectDescriptorSet,
-                    nullptr
-                );
-            }
+            ++last;
+        }
+        _drawRuns.push_back( DrawRun{ first, last - first } );
+        first = last;
+    }
 
-            /**
-             * @brief Push Contant's things
-             * Push constant use pipeline layout to allocate the space, and pipeline layout is about "Material".
-             * But, "Material" is about how the object will look, not about how object is represented.
-             * And it's not about the vertices that make up the "Mesh".
-             * So, in the RenderObject class, there are member variable called "transformMatrix".
-             * That member variable is used for representing the Mesh object to the 3D world.
-             * So, it's neither "Material" nor "Mesh", it's transformMatrix.
-             * That's why I make about this separate section "Push Constant's things"
-             */
-            MeshPushConstant pushconstant;
-            // final render matrix that will be calculated on the cpu
-            // pushconstant.renderMatrix = projection * view * model;
-            pushconstant.renderMatrix = object.transformMatrix;
-            vk::DeviceSize offsetMaterial = 0;
-            cmd.pushConstants<MeshPushConstant>( object.pMaterial->layout, vk::ShaderStageFlagBits::eVertex, offsetMaterial, pushconstant );
+    _renderStats = RenderStats{};
+    _renderStats.totalObjects = objectCount;
+    _renderStats.visibleObjects = static_cast<uint32_t>( _visibleObjects.size() );
 
-            /**
-             * @brief Mesh's things
-             */
-            if( object.pMesh != lastMesh ) // just bind if the mesh is valid
+    _occlusionActive = _occlusionCullingSupported && _occlusionCullingEnabled;
+    if( _occlusionActive )
+    {
+        /**
+         * @brief Occlusion culling candidates
+         * The frustum visible objects in the sorted order, the GPU picks which of them are drawn and writes the Instance Buffer
+         */
+        std::vector<OcclusionCuller::Candidate> candidates( items.size() );
+        std::vector<uint32_t> vertexCounts( _drawRuns.size() );
+        std::vector<uint32_t> firstInstances( _drawRuns.size() );
+        for( uint32_t run = 0; run < _drawRuns.size(); ++run )
+        {
+            const auto& object = _sceneManag.renderable[items[_drawRuns[run].first].objectIndex];
+            vertexCounts[run] = static_cast<uint32_t>( object.pMesh->vertices.size() );
+            firstInstances[run] = _drawRuns[run].first;
+
+            for( uint32_t slot = _drawRuns[run].first; slot < _drawRuns[run].first + _drawRuns[run].count; ++slot )
             {
-                vk::DeviceSize offsetMesh = 0;
-                cmd.bindVertexBuffers( 0, object.pMesh->vertexBuffer.buffer, offsetMesh );
+                uint32_t i = items[slot].objectIndex;
+                auto& candidate = candidates[slot];
+                candidate.sphere = { _objectBounds.centerX[i], _objectBounds.centerY[i], _objectBounds.centerZ[i], _objectBounds.radius[i] };
+                candidate.objectIndex = i;
+                candidate.draw = run;
+                candidate.flags = object.pMaterial->blended ? OcclusionCuller::CandidateBlended : 0;
             }
+        }
+        _occlusionCuller.prepare( frameIndex, objectCount, candidates, vertexCounts, firstInstances );
+        return;
+    }
 
-            /**
-             * @brief Finally, Drawing Current RenderObject to the 3D world
-             * We want draw 1 instance ( 1 object ).
-             * When initializing the buffer info in initDescriptor, 
-             * we set the range is the size of the struct itself and the offset is 0.
-             * From 0 to the offset is 1 object, right ?!.
-             * Ok, let say the size of the struct is 16 byte, 
-             * and there are 100 objects that we've inputed, then the total size is 1600 bytes.
-             * The range byte of the first object is from byte 0 until byte 16, 
-             * and the last object is from byte 1584 until byte 1600.
-             * That object is called instance.
-             * And then in the vertex shader or just shader, we do "gl_BaseInstance", 
-             * that means we accessing those instance by specifing "first instance" parameter below
-             * 
-             * Note that this is not normal/dynamic uniform buffer, so we do not worrying about the minimum padding's things.
-             */
-            cmd.draw( 
+    /**
+     * @brief Instance (Storage Buffer)
+     * The sorted draws are written in order, so the instances of one instanced draw are contiguous,
+     * and every one of them points to its own object (transform) in the Object Buffer.
+     */
+    {
+        uint32_t* instances = _objectStorage.instances( frameIndex );
+        for( size_t slot = 0; slot < items.size(); ++slot )
+        {
+            instances[slot] = items[slot].objectIndex;
+        }
+    }
+}
+
+void Engine::draw( vk::CommandBuffer cmd, uint32_t phase ) 
+{
+    PROFILE_FUNCTION();
+    /**
+     * @brief draw() Week Point
+     * This draw function has weak point, i.e. this function just support for render with normal/dynamic uniform buffer.
+     * So, the "defaultMateril" won't work if you decide to use defaultMaterial to one of your renderable object
+     */
+
+    const uint32_t frameIndex = _frameNumber % FRAME_OVERLAP;
+    const auto& currentFrame = getCurrentFrame();
+    const auto& items = _renderQueue.items();
+
+    // every run of the same pipeline is a GPU scope named after its first material (the sorted items are grouped by pipeline)
+    vk::Pipeline scopePipeline;
+    uint32_t materialScope = 0;
+
+    // the opaque materials that opt in are laid down by the prepass, and then shaded once with an equal depth test
+    auto inPrepass = [&]( const Material& material ) {
+        return _depthPrepassEnabled && material.depthPrepass && !material.blended && material.depthPipeline;
+    };
+
+    auto drawRun = [&]( vk::Pipeline pipeline, uint32_t run ) {
+        const auto& object = _sceneManag.renderable[items[_drawRuns[run].first].objectIndex];
+
+        /**
+         * @brief Material's things
+         * The materials can share a pipeline, and all of them share the layout,
+         * so most of these binds are the same as the last run and the state tracker drops them.
+         */
+        _commandState.bindPipeline( vk::PipelineBindPoint::eGraphics, pipeline );
+
+        // this bind descriptor set is just for dynamic buffer. Normal buffer no need this bind.
+        // It's makes sense, because the normal buffer just has static offset.
+        // In the other hand, the dynamic uniform buffer has dynamic offset.
+        // So, if you just want to make static offset, then just use the normal uniform buffer.
+        // Normal uniform buffer "should be" faster than the dynamic one, but I'm not sure, 
+        // I just predict it can be like the static memory and dynamic memory.
+        // And, the dynamic uniform buffer need to be bind every time, 
+        // so maybe that gonna make dynamic buffer more slower (?)
+        _commandState.bindDescriptorSets(
+            vk::PipelineBindPoint::eGraphics,           // pipeline bind point
+            object.pMaterial->layout,                   // pipeline layout
+            0,                                          // first descriptor set on the array of descriptor set
+            currentFrame.globalDescriptorSet,           // the descriptor set (this could be an array, that's why there are "first descriptor set" right above this paramter)
+            frameIndex * padUniformBufferSize(sizeof( GpuSceneParameterData ))  // dynamic offset
+        );
+        // the object set and the bindless texture table
+        std::array<vk::DescriptorSet, 2> sets = { currentFrame.objectDescriptorSet, _textureTable.set() };
+        _commandState.bindDescriptorSets(
+            vk::PipelineBindPoint::eGraphics,
+            object.pMaterial->layout,
+            1,
+            sets
+        );
+
+        /**
+         * @brief Push Contant's things
+         * Nothing is pushed per draw anymore, the vertex shader reads the model matrix
+         * from the Object Buffer through the Instance Buffer, like the texture slots.
+         */
+
+        /**
+         * @brief Mesh's things
+         */
+        _commandState.bindVertexBuffer( 0, object.pMesh->vertexBuffer.buffer );
+
+        /**
+         * @brief Finally, Drawing the run of RenderObject to the 3D world
+         * We want draw "instanceCount" instances ( 1 instance = 1 object ).
+         * The "first instance" is the position of the first object of the run in the Instance Buffer,
+         * and in the vertex shader, gl_InstanceIndex goes from "first instance" to "first instance + instanceCount - 1".
+         * Every gl_InstanceIndex picks the object index from the Instance Buffer,
+         * and that object index picks the transform from the Object Buffer.
+         * 
+         * With the occlusion culling, the instance count (and the Instance Buffer) is written by the GPU,
+         * so the same draw is an indirect draw.
+         * 
+         * Note that this is not normal/dynamic uniform buffer, so we do not worrying about the minimum padding's things.
+         */
+        if( _occlusionActive )
+        {
+            _commandState.drawIndirect( _occlusionCuller.drawBuffer( frameIndex ), _occlusionCuller.drawOffset( phase, run ), 1, sizeof( vk::DrawIndirectCommand ) );
+        }
+        else
+        {
+            _commandState.draw( 
                 object.pMesh->vertices.size(),      // vertex count
-                1,                                  // instance count
+                _drawRuns[run].count,               // instance count
                 0,                                  // first vertex
-                i                                   // first instance
+                _drawRuns[run].first                // first instance
             );
+        }
+    };
 
-            ++i;
+    /**
+     * @brief Depth prepass
+     * The same runs as the main pass (so the same first instance in the Instance Buffer),
+     * with the depth only pipeline: position only, no fragment shader, no color write.
+     * The opaque items are sorted front to back, so the prepass itself has little overdraw.
+     */
+    if( _depthPrepassEnabled )
+    {
+        GpuScope scope( _gpuProfiler, cmd, "depth prepass" );
+        for( uint32_t run = 0; run < _drawRuns.size(); ++run )
+        {
+            const auto& object = _sceneManag.renderable[items[_drawRuns[run].first].objectIndex];
+            if( !inPrepass( *object.pMaterial ) )
+                continue;
+
+            drawRun( object.pMaterial->depthPipeline, run );
+            // with the occlusion culling, these are the candidates (the GPU knows how many of them are drawn)
+            if( phase == 0 )
+                _renderStats.prepassObjects += _drawRuns[run].count;
         }
     }
+
+    for( uint32_t run = 0; run < _drawRuns.size(); ++run )
+    {
+        const auto& object = _sceneManag.renderable[items[_drawRuns[run].first].objectIndex];
+
+        if( object.pMaterial->pipeline != scopePipeline )
+        {
+            if( scopePipeline )
+                _gpuProfiler.endScope( cmd, materialScope );
+            materialScope = _gpuProfiler.beginScope( cmd, object.pMaterial->name.c_str() );
+            scopePipeline = object.pMaterial->pipeline;
+        }
+
+        // the depth of the prepassed objects is already there, only the nearest fragment is shaded
+        vk::Pipeline pipeline = inPrepass( *object.pMaterial ) ? object.pMaterial->equalPipeline : object.pMaterial->pipeline;
+        drawRun( pipeline, run );
+    }
+
+    if( scopePipeline )
+        _gpuProfiler.endScope( cmd, materialScope );
 }
 
 void Engine::record() 
 {
-    _imageIndex = _device->acquireNextImageKHR( _swapchain, 
-                            _timeOut, 
-                            getCurrentFrame().presentSemaphore, 
-                            nullptr 
-    ).value;
+    PROFILE_FUNCTION();
+    // headless has one offscreen image for every frame slot, there is nothing to acquire
+    if( _config.headless )
+        _imageIndex = _frameNumber % static_cast<uint32_t>( _swapchainImages.size() );
+    else
+        _imageIndex = _device->acquireNextImageKHR( _swapchain, 
+                                _timeOut, 
+                                getCurrentFrame().presentSemaphore, 
+                                nullptr 
+        ).value;
 
     getCurrentFrame().mainCommandBuffer.reset();
 
@@ -609,84 +1195,518 @@ void Engine::record()
         getCurrentFrame().mainCommandBuffer.begin( beginInfo );
     } ENGINE_CATCH
 
+    _gpuProfiler.begin( _frameNumber % FRAME_OVERLAP, getCurrentFrame().mainCommandBuffer );
+    uint32_t frameScope = _gpuProfiler.beginScope( getCurrentFrame().mainCommandBuffer, "frame" );
 
     /**
-     * @brief Begin to Record the render pass
+     * @brief The resolution of this frame
      */
-    vk::RenderPassBeginInfo renderPassBeginInfo {};
-    renderPassBeginInfo.setRenderPass( _renderPass );
-    renderPassBeginInfo.setFramebuffer( _swapchainFramebuffers[_imageIndex] );
-    renderPassBeginInfo.setRenderArea( 
-        vk::Rect2D{ 
-            { 0, 0 },           // offset
-            _swapchainExtent    // extent
-            }
-    );
+    _renderExtent = _sceneBlitSupported ? _resolutionScaler.scaledExtent( _swapchainExtent ) : _swapchainExtent;
+
+    prepareDraws();
+
+    const uint32_t frameIndex = _frameNumber % FRAME_OVERLAP;
+    vk::CommandBuffer cmd = getCurrentFrame().mainCommandBuffer;
+
+    /**
+     * @brief The render graph of the frame
+     * The scene and depth images are transient (the graph creates them, and they share memory when they can),
+     * the swapchain image and the buffers of the indirect draws are imported.
+     */
+    _renderGraph.reset();
+    auto& transientDescriptors = getCurrentFrame().transientDescriptors;
+
+    RenderGraph::ImportedImage target {};
+    target.image = _swapchainImages[_imageIndex];
+    target.view = _swapchainImageViews[_imageIndex];
+    target.desc = { _swapchainFormat, _swapchainExtent };
+    target.initialStages = vk::PipelineStageFlagBits::eTransfer;    // where endFrame() waits the acquire semaphore
+    // ready to present, or to be copied to the readback buffer when headless
+    target.finalLayout = _config.headless ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR;
+    auto swapchainImage = _renderGraph.importImage( "swapchain image", target );
+
+    // the scene is rendered at _renderExtent in the top left corner of the scene image (which has the swapchain extent),
+    // so changing the scale doesn't change the images
+    auto sceneImage = _renderGraph.createImage( "scene image", { _swapchainFormat, _swapchainExtent } );
+    auto depthImage = _renderGraph.createImage( "depth image", { _depthFormat, _swapchainExtent } );
+
+    /**
+     * @brief Occlusion culling, phase 1
+     * The candidates that were visible last frame are written to the first half of the Instance Buffer
+     */
+    RenderGraph::Resource drawBuffer = RenderGraph::InvalidResource;
+    RenderGraph::Resource instanceBuffer = RenderGraph::InvalidResource;
+    auto addCullPass = [&]( uint32_t phase ){
+        _renderGraph.addPass( "occlusion cull", RenderGraph::PassType::eCompute )
+            .storageWrite( drawBuffer )
+            .storageWrite( instanceBuffer )
+            .execute( [this, frameIndex, phase, &transientDescriptors]( vk::CommandBuffer cmd ){
+                _occlusionCuller.recordCull( cmd, frameIndex, phase, _cameraData.viewproj, _renderExtent,
+                                             _objectStorage.instanceBuffer( frameIndex ), transientDescriptors );
+            } );
+    };
+    if( _occlusionActive )
+    {
+        drawBuffer = _renderGraph.importBuffer( "indirect draws", _occlusionCuller.drawBuffer( frameIndex ) );
+        instanceBuffer = _renderGraph.importBuffer( "instances", _objectStorage.instanceBuffer( frameIndex ) );
+        addCullPass( 0 );
+    }
+
+    /**
+     * @brief Clustered lighting, the lights of every cluster for the fragment shaders of the scene passes
+     */
+    auto lightClusters = _renderGraph.importBuffer( "light clusters", _lightClusters.clusterBuffer( frameIndex ) );
+    auto lightIndices = _renderGraph.importBuffer( "light indices", _lightClusters.lightIndexBuffer( frameIndex ) );
+    _renderGraph.addPass( "light clusters", RenderGraph::PassType::eCompute )
+        .storageWrite( lightClusters )
+        .storageWrite( lightIndices )
+        .execute( [this, frameIndex, &transientDescriptors]( vk::CommandBuffer cmd ){
+            _lightClusters.recordAssign( cmd, frameIndex, _cameraData.projection, _renderExtent, CameraNear, CameraFar, transientDescriptors );
+        } );
 
-    // clear value for color
-    vk::ClearColorValue colorClearValue = { std::array<float, 4UL>{ 0.0f, 0.0f, 0.0f, 1.0f } };
-    // clear value for depth
-    vk::ClearDepthStencilValue depthStencilClearValue {};
-    depthStencilClearValue.setDepth( 1.0f );
+    /**
+     * @brief Shadow cascades, the static maps that are still valid are only sampled
+     */
+    auto shadowMaps = _shadowCascades.addPasses( _renderGraph, frameIndex, _objectStorage.objectBuffer( frameIndex ), transientDescriptors );
 
-    std::vector<vk::ClearValue> clearValue = { colorClearValue, depthStencilClearValue };
+    /**
+     * @brief The scene pass
+     */
+    auto scenePass = _renderGraph.addPass( "scene pass", RenderGraph::PassType::eGraphics )
+        .colorAttachment( sceneImage, vk::ClearColorValue{ std::array<float, 4UL>{ 0.0f, 0.0f, 0.0f, 1.0f } } )
+        .depthAttachment( depthImage, vk::ClearDepthStencilValue{ 1.0f, 0 } )
+        .renderArea( _renderExtent )
+        .storageRead( lightClusters )
+        .storageRead( lightIndices );
+    for( auto shadowMap : shadowMaps )
+        scenePass.sampled( shadowMap );
+    if( _occlusionActive )
+        scenePass.indirect( drawBuffer ).storageRead( instanceBuffer );
+    scenePass.execute( [this]( vk::CommandBuffer cmd ){
+        // the scene passes are recorded through the state tracker, it starts with nothing bound
+        _commandState.begin( cmd );
+
+        // the viewport and the scissor are dynamic states of every pipeline
+        vk::Viewport viewport { 0.0f, 0.0f, static_cast<float>( _renderExtent.width ), static_cast<float>( _renderExtent.height ), 0.0f, 1.0f };
+        vk::Rect2D scissor { { 0, 0 }, _renderExtent };
+        _commandState.setViewport( viewport );
+        _commandState.setScissor( scissor );
+
+        draw( cmd, 0 );
+        _renderStats.commands = _commandState.stats();
+    } );
 
-    renderPassBeginInfo.setClearValues( clearValue );
+    /**
+     * @brief Occlusion culling, phase 2
+     * The depth of phase 1 is reduced to the HZB, every candidate is tested against it,
+     * and the ones that phase 1 missed are drawn on top of what phase 1 left (the attachments are loaded)
+     */
+    if( _occlusionActive )
+    {
+        _renderGraph.addPass( "hzb", RenderGraph::PassType::eCompute )
+            .sampled( depthImage )
+            .sideEffect()       // it writes the HZB of the culler, which is not in the graph
+            .execute( [this, depthImage, &transientDescriptors]( vk::CommandBuffer cmd ){
+                _occlusionCuller.recordHzb( cmd, _renderGraph.imageView( depthImage ), _renderExtent, transientDescriptors );
+            } );
+
+        addCullPass( 1 );
+
+        // the graphics state of the tracker is still bound, the compute work has its own bind point
+        auto phase2Pass = _renderGraph.addPass( "scene pass (phase 2)", RenderGraph::PassType::eGraphics )
+            .colorAttachment( sceneImage )
+            .depthAttachment( depthImage )
+            .indirect( drawBuffer )
+            .storageRead( instanceBuffer )
+            .storageRead( lightClusters )
+            .storageRead( lightIndices )
+            .renderArea( _renderExtent );
+        for( auto shadowMap : shadowMaps )
+            phase2Pass.sampled( shadowMap );
+        phase2Pass.execute( [this]( vk::CommandBuffer cmd ){
+            draw( cmd, 1 );
+            _renderStats.commands = _commandState.stats();
+        } );
+    }
+
+    _renderGraph.addPass( "upscale", RenderGraph::PassType::eTransfer )
+        .transferSrc( sceneImage )
+        .transferDst( swapchainImage )
+        .execute( [this, sceneImage]( vk::CommandBuffer cmd ){
+            upscale( cmd, _renderGraph.image( sceneImage ) );
+        } );
 
-    getCurrentFrame().mainCommandBuffer.beginRenderPass( renderPassBeginInfo, vk::SubpassContents::eInline );
+    /**
+     * @brief Overlay, nothing of it is recorded when it's hidden
+     */
+    if( _overlay.visible() )
+    {
+        _renderGraph.addPass( "overlay", RenderGraph::PassType::eGraphics )
+            .colorAttachment( swapchainImage )
+            .execute( [this, frameIndex]( vk::CommandBuffer cmd ){
+                PROFILE_ZONE( "overlay" );
+                _overlay.newFrame( _window, static_cast<float>( _framePacer.lastFrameTimeMs() / 1000.0 ) );
+                buildOverlay();
+                _overlay.render( cmd, frameIndex );
+            } );
+    }
+
+    /**
+     * @brief Copy the rendered image to the readback buffer
+     */
+    if( _config.headless && !_config.readbackDirectory.empty() )
+    {
+        _renderGraph.addPass( "readback", RenderGraph::PassType::eTransfer )
+            .transferSrc( swapchainImage )
+            .sideEffect()
+            .execute( [this]( vk::CommandBuffer cmd ){
+                vk::BufferImageCopy copyRegion {};
+                copyRegion.setBufferOffset( 0 );
+                copyRegion.setBufferRowLength( 0 );
+                copyRegion.setBufferImageHeight( 0 );
+                copyRegion.setImageSubresource( vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, 0, 0, 1 } );
+                copyRegion.setImageExtent( vk::Extent3D{ _swapchainExtent.width, _swapchainExtent.height, 1 } );
+
+                cmd.copyImageToBuffer(
+                    _swapchainImages[_imageIndex],
+                    vk::ImageLayout::eTransferSrcOptimal,
+                    getCurrentFrame().readbackBuffer.buffer,
+                    copyRegion
+                );
+                // the PNG is written from the host once the fence is waited
+                vk::MemoryBarrier hostBarrier { vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead };
+                cmd.pipelineBarrier( vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, hostBarrier, nullptr, nullptr );
+                getCurrentFrame().readbackFrame = static_cast<int64_t>( _totalFrames );
+            } );
+    }
+
+    {
+        PROFILE_ZONE( "render graph compile" );
+        _renderGraph.compile();
+    }
+    // before anything binds the global set of this frame
+    _shadowCascades.writeDescriptors( _renderGraph, frameIndex, getCurrentFrame().globalDescriptorSet );
+    _renderGraph.execute( cmd, &_gpuProfiler );
+
+    _gpuProfiler.endScope( getCurrentFrame().mainCommandBuffer, frameScope );
+
+    /**
+     * @brief Finish recording
+     */
+    try
+    {
+        getCurrentFrame().mainCommandBuffer.end();
+    } ENGINE_CATCH
+}
+
+void Engine::upscale( vk::CommandBuffer cmd, vk::Image scene ) 
+{
+    PROFILE_FUNCTION();
+    vk::Image target = _swapchainImages[_imageIndex];
+
+    // the render graph has the scene image in eTransferSrcOptimal and the swapchain image in eTransferDstOptimal
+    vk::ImageSubresourceLayers colorLayers { vk::ImageAspectFlagBits::eColor, 0, 0, 1 };
+    if( _sceneBlitSupported )
+    {
+        vk::ImageBlit blitRegion {};
+        blitRegion.setSrcSubresource( colorLayers );
+        blitRegion.setSrcOffsets( { vk::Offset3D{ 0, 0, 0 }, vk::Offset3D{ static_cast<int32_t>( _renderExtent.width ), static_cast<int32_t>( _renderExtent.height ), 1 } } );
+        blitRegion.setDstSubresource( colorLayers );
+        blitRegion.setDstOffsets( { vk::Offset3D{ 0, 0, 0 }, vk::Offset3D{ static_cast<int32_t>( _swapchainExtent.width ), static_cast<int32_t>( _swapchainExtent.height ), 1 } } );
+
+        cmd.blitImage( 
+            scene, vk::ImageLayout::eTransferSrcOptimal, 
+            target, vk::ImageLayout::eTransferDstOptimal, 
+            blitRegion, vk::Filter::eLinear 
+        );
+    }
+    else
+    {
+        vk::ImageCopy copyRegion {};
+        copyRegion.setSrcSubresource( colorLayers );
+        copyRegion.setDstSubresource( colorLayers );
+        copyRegion.setExtent( vk::Extent3D{ _swapchainExtent.width, _swapchainExtent.height, 1 } );
+
+        cmd.copyImage( 
+            scene, vk::ImageLayout::eTransferSrcOptimal, 
+            target, vk::ImageLayout::eTransferDstOptimal, 
+            copyRegion 
+        );
+    }
+}
+
+void Engine::endFrame() 
+{
+    PROFILE_FUNCTION();
+    /**
+     * @brief Submit Info ( it could be graphics queue, compute queue, or maybe transfer queue )
+     */
+    vk::SubmitInfo submitInfo {};
+    // the swapchain image is first touched by the blit in upscale()
+    vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eTransfer;
+
+    submitInfo.setCommandBuffers( getCurrentFrame().mainCommandBuffer );
+    // headless doesn't acquire nor present, so the fence is the only synchronization
+    if( !_config.headless )
+    {
+        submitInfo.setWaitSemaphores( getCurrentFrame().presentSemaphore );
+        submitInfo.setWaitDstStageMask( waitStage );
+        submitInfo.setSignalSemaphores( getCurrentFrame().renderSemaphore );
+    }
+    try
+    {
+        _graphicsQueue.submit( submitInfo, getCurrentFrame().renderFence );
+    } ENGINE_CATCH
+
+    if( _config.headless )
+        return;
+
+
+    /**
+     * @brief Present Info ( it's just the present queue )
+     */
+    vk::PresentInfoKHR presentInfo {};
+    presentInfo.setWaitSemaphores( getCurrentFrame().renderSemaphore );
+
+    std::vector<vk::SwapchainKHR> swapchains = { _swapchain };
+    presentInfo.setSwapchains( swapchains );
+    presentInfo.setImageIndices( _imageIndex );
+
+    auto result = _presentQueue.presentKHR( presentInfo );
+    if( result != vk::Result::eSuccess )
+        throw std::runtime_error( "Failed to presenting (_presentQueue)" );
+}
 
-    draw( getCurrentFrame().mainCommandBuffer );
+void Engine::buildOverlay() 
+{
+    ImGui::SetNextWindowPos( ImVec2{ 10.0f, 10.0f }, ImGuiCond_FirstUseEver );
+    ImGui::Begin( "Performance (F1)", nullptr, ImGuiWindowFlags_AlwaysAutoResize );
 
     /**
-     * @brief End to Record the renderpass
+     * @brief Frame time
      */
-    getCurrentFrame().mainCommandBuffer.endRenderPass();
+    ImGui::Text( "CPU %.2f ms (jitter %.2f ms)  GPU %.2f ms", _framePacer.averageFrameTimeMs(), _framePacer.jitterMs(), _gpuTimeMs );
+    ImGui::PlotLines( "CPU ms", _overlay.cpuHistory().data(), static_cast<int>( Overlay::HistorySize ), _overlay.historyOffset(), nullptr, 0.0f, 33.3f, ImVec2{ 300.0f, 50.0f } );
+    ImGui::PlotLines( "GPU ms", _overlay.gpuHistory().data(), static_cast<int>( Overlay::HistorySize ), _overlay.historyOffset(), nullptr, 0.0f, 33.3f, ImVec2{ 300.0f, 50.0f } );
 
+    /**
+     * @brief The work of the last frame
+     */
+    ImGui::Separator();
+    ImGui::Text( "objects: %u visible / %u, %u in the depth prepass", _renderStats.visibleObjects, _renderStats.totalObjects, _renderStats.prepassObjects );
+    ImGui::Text( "object storage: %zu objects per frame (max %zu)", _objectStorage.capacity( _frameNumber % FRAME_OVERLAP ), _objectStorage.maxCapacity() );
+    if( _occlusionActive )
+    {
+        // read back from the GPU, FRAME_OVERLAP frames late
+        const auto& occlusion = _occlusionCuller.stats();
+        ImGui::Text( "occlusion: %u candidates, %u in phase 1, %u in phase 2, %u occluded",
+            occlusion.candidates, occlusion.phase1Objects, occlusion.phase2Objects, occlusion.occludedObjects );
+    }
+    {
+        // read back from the GPU, FRAME_OVERLAP frames late
+        const auto& lights = _lightClusters.stats();
+        ImGui::Text( "lights: %u visible / %u, %u in clusters (pool of %u, at most %u in one, %u clusters overflowed)",
+            lights.visibleLights, lights.lights, lights.lightIndices, lights.lightIndexCapacity, lights.maxClusterLights, lights.overflowedClusters );
+    }
+    {
+        const auto& commands = _renderStats.commands;
+        ImGui::Text( "commands: %u issued, %u elided", commands.totalIssued(), commands.totalElided() );
+        for( uint32_t i = 0; i < CommandStateTracker::CommandCount; ++i )
+        {
+            auto command = static_cast<CommandStateTracker::Command>( i );
+            ImGui::Text( "    %-16s %6u issued %6u elided", CommandStateTracker::name( command ), commands.issued[i], commands.elided[i] );
+        }
+    }
+    {
+        // of the last frame, this one is being executed
+        const auto& graph = _renderGraph.stats();
+        ImGui::Text( "render graph: %u passes (%u culled), %u barrier batches (%u image barriers)",
+            graph.passes, graph.culledPasses, graph.barrierBatches, graph.imageBarriers );
+        ImGui::Text( "    transient: %u images in %u blocks, %.1f MiB (%.1f MiB without aliasing)",
+            graph.transientImages, graph.transientBlocks,
+            static_cast<double>( graph.transientBytes ) / ( 1024.0 * 1024.0 ), static_cast<double>( graph.unaliasedBytes ) / ( 1024.0 * 1024.0 ) );
+        ImGui::Text( "    lazily allocated: %u images, %.1f MiB%s", graph.lazyImages, static_cast<double>( graph.lazyBytes ) / ( 1024.0 * 1024.0 ),
+            _renderGraph.lazyAllocationSupported() ? "" : " (no lazy memory on this device)" );
+    }
+    {
+        uint32_t renderedMaps = 0;
+        uint32_t dynamicCasters = 0;
+        for( const auto& cascade : _shadowCascades.stats() )
+        {
+            renderedMaps += cascade.rendered ? 1 : 0;
+            dynamicCasters += cascade.dynamicCasters;
+        }
+        ImGui::Text( "shadows: %u / %u static maps rendered, %u dynamic casters in the cascades", renderedMaps, ShadowCascades::CascadeCount, dynamicCasters );
+    }
+    ImGui::Text( "upload queue: %zu dirty objects", _dirtyObjects.size() );
+    {
+        const auto& persistent = _descriptorAllocator.stats();
+        const auto& transient = getCurrentFrame().transientDescriptors.stats();
+        ImGui::Text( "descriptor sets: %u in %u pools (%u full), transient: %u in %u pools", 
+            persistent.allocatedSets, persistent.pools, persistent.fullPools, transient.allocatedSets, transient.pools );
+        ImGui::Text( "descriptor set layouts: %zu  bindless textures: %u / %u", _layoutCache.size(), _textureTable.textureCount(), _textureTable.textureCapacity() );
+    }
+    ImGui::Text( "pipeline cache: %s, materials created in %.1f ms (%zu pipelines on %u threads, %.1f ms)",
+        _pipelineCache.loadedBytes() > 0 ? "loaded" : "cold start", _materialsMs, _pipelineBuild.pipelines, _pipelineBuild.threads, _pipelineBuild.ms );
 
     /**
-     * @brief Finish recording
+     * @brief What the load and store ops of every attachment move to and from the memory, of the last frame
      */
-    try
+    if( ImGui::CollapsingHeader( "Attachment bandwidth" ) )
     {
-        getCurrentFrame().mainCommandBuffer.end();
-    } ENGINE_CATCH
-}
+        const auto& graph = _renderGraph.stats();
+        ImGui::Text( "%.2f MiB loaded, %.2f MiB stored", 
+            static_cast<double>( graph.attachmentLoadBytes ) / ( 1024.0 * 1024.0 ), static_cast<double>( graph.attachmentStoreBytes ) / ( 1024.0 * 1024.0 ) );
+        for( const auto& traffic : _renderGraph.attachmentTraffic() )
+        {
+            ImGui::Text( "%-20s %-16s %-8s %-8s %6.2f MiB in %6.2f MiB out%s", traffic.pass, traffic.attachment,
+                vk::to_string( traffic.loadOp ).c_str(), vk::to_string( traffic.storeOp ).c_str(),
+                static_cast<double>( traffic.loadBytes ) / ( 1024.0 * 1024.0 ), static_cast<double>( traffic.storeBytes ) / ( 1024.0 * 1024.0 ),
+                traffic.lazy ? " (lazy)" : "" );
+        }
+    }
 
-void Engine::endFrame() 
-{
     /**
-     * @brief Submit Info ( it could be graphics queue, compute queue, or maybe transfer queue )
+     * @brief What every shadow cascade costs: its casters, the renders of its static map, and the GPU time of its passes
+     * The static pass only runs when the map is invalid, so its time is of the last render.
      */
-    vk::SubmitInfo submitInfo {};
-    vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+    if( ImGui::CollapsingHeader( "Shadow cascades" ) )
+    {
+        ImGui::Checkbox( "Cache static shadows", &_shadowCascades.cacheEnabled() );
+        ImGui::SameLine();
+        if( ImGui::Button( "Invalidate" ) )
+            _shadowCascades.invalidate();
+        ImGui::SliderAngle( "Sun azimuth", &_sunAzimuth, -180.0f, 180.0f );
+        ImGui::SliderAngle( "Sun elevation", &_sunElevation, 5.0f, 90.0f );
+
+        auto scopeMs = [this]( const char* name, bool last ){
+            const auto* timing = _gpuProfiler.find( name );
+            return timing ? ( last ? timing->lastMs : timing->averageMs ) : 0.0;
+        };
+        const auto& cascades = _shadowCascades.stats();
+        for( uint32_t c = 0; c < ShadowCascades::CascadeCount; ++c )
+        {
+            const auto& cascade = cascades[c];
+            ImGui::Text( "cascade %u: %.1f to %.1f, box radius %.1f%s", c, cascade.splitNear, cascade.splitFar, cascade.radius, cascade.rendered ? " (rendered)" : "" );
+            ImGui::Text( "    static  %5u casters %4u draws  %6u renders (last: %-6s) %7.3f ms", cascade.staticCasters, cascade.staticDraws,
+                cascade.staticRenders, ShadowCascades::name( cascade.lastInvalidation ), scopeMs( ShadowCascades::staticPassName( c ), true ) );
+            ImGui::Text( "    dynamic %5u casters %4u draws  copy %7.3f ms  draw %7.3f ms", cascade.dynamicCasters, cascade.dynamicDraws,
+                scopeMs( ShadowCascades::copyPassName( c ), false ), scopeMs( ShadowCascades::dynamicPassName( c ), false ) );
+        }
+    }
 
-    submitInfo.setWaitSemaphores( getCurrentFrame().presentSemaphore );
-    submitInfo.setWaitDstStageMask( waitStage );
-    submitInfo.setCommandBuffers( getCurrentFrame().mainCommandBuffer );
-    submitInfo.setSignalSemaphores( getCurrentFrame().renderSemaphore );
-    try
+    if( ImGui::CollapsingHeader( "GPU scopes" ) )
     {
-        _graphicsQueue.submit( submitInfo, getCurrentFrame().renderFence );
-    } ENGINE_CATCH
+        for( const auto& timing : _gpuProfiler.timings() )
+            ImGui::Text( "%-24s %7.3f ms (max %.3f ms)", timing.name.c_str(), timing.averageMs, timing.maxMs );
+    }
 
+    /**
+     * @brief VMA usage of every heap
+     */
+    if( ImGui::CollapsingHeader( "Memory" ) )
+    {
+        ImGui::Text( "budget: %s", _memoryMonitor.budgetExtension() ? "VK_EXT_memory_budget" : "estimated" );
+        const auto& heaps = _memoryMonitor.heaps();
+        for( uint32_t heap = 0; heap < heaps.size(); ++heap )
+        {
+            const auto& report = heaps[heap];
+            char label[64];
+            snprintf( label, sizeof(label), "%.1f / %.1f MiB", report.usage / 1048576.0, report.budget / 1048576.0 );
+            ImGui::Text( "heap %u%s", heap, report.deviceLocal ? " (device local)" : "" );
+            ImGui::ProgressBar( report.budget > 0 ? static_cast<float>( report.usage ) / report.budget : 0.0f, ImVec2{ 300.0f, 0.0f }, label );
+            ImGui::Text( "  %u blocks (%.1f MiB), %u allocations (%.1f MiB)", 
+                report.blockCount, report.blockBytes / 1048576.0, report.allocationCount, report.allocationBytes / 1048576.0 );
+        }
+        if( ImGui::Button( "Dump VMA statistics (F10)" ) )
+            dumpMemoryStats();
+    }
 
     /**
-     * @brief Present Info ( it's just the present queue )
+     * @brief Toggles
      */
-    vk::PresentInfoKHR presentInfo {};
-    presentInfo.setWaitSemaphores( getCurrentFrame().renderSemaphore );
+    ImGui::Separator();
+    ImGui::Checkbox( "Frustum culling", &_cullingEnabled );
+    ImGui::Checkbox( "Depth prepass", &_depthPrepassEnabled );
+    if( _occlusionCullingSupported )
+        ImGui::Checkbox( "Occlusion culling", &_occlusionCullingEnabled );
+
+    const std::array<vk::PresentModeKHR, 4> presentModes = { 
+        vk::PresentModeKHR::eFifo, vk::PresentModeKHR::eFifoRelaxed, vk::PresentModeKHR::eMailbox, vk::PresentModeKHR::eImmediate 
+    };
+    if( ImGui::BeginCombo( "Present mode", vk::to_string( _presentMode ).c_str() ) )
+    {
+        for( auto presentMode : presentModes )
+        {
+            if( ImGui::Selectable( vk::to_string( presentMode ).c_str(), presentMode == _presentMode ) )
+                setPresentMode( presentMode );
+        }
+        ImGui::EndCombo();
+    }
 
-    std::vector<vk::SwapchainKHR> swapchains = { _swapchain };
-    presentInfo.setSwapchains( swapchains );
-    presentInfo.setImageIndices( _imageIndex );
+    bool dynamicResolution = _resolutionScaler.enabled();
+    if( ImGui::Checkbox( "Dynamic resolution", &dynamicResolution ) )
+        _resolutionScaler.setEnabled( dynamicResolution && _gpuProfiler.hasTimestamps() );
+    float scale = _resolutionScaler.scale();
+    if( dynamicResolution )
+        ImGui::Text( "Resolution scale %.0f%% (budget %.2f ms)", scale * 100.0f, _resolutionScaler.budgetMs() );
+    else if( ImGui::SliderFloat( "Resolution scale", &scale, _resolutionScaler.minScale(), _resolutionScaler.maxScale(), "%.2f" ) )
+        _resolutionScaler.setScale( scale );
 
-    auto result = _presentQueue.presentKHR( presentInfo );
-    if( result != vk::Result::eSuccess )
-        throw std::runtime_error( "Failed to presenting (_presentQueue)" );
+    ImGui::End();
+}
+
+void Engine::reportStats() 
+{
+    char frameTime[64];
+    snprintf( frameTime, sizeof(frameTime), "%.2f ms (jitter %.2f ms)", _framePacer.averageFrameTimeMs(), _framePacer.jitterMs() );
+    char renderScale[96];
+    snprintf( renderScale, sizeof(renderScale), "%ux%u (%.0f%%, gpu %.2f ms)", _renderExtent.width, _renderExtent.height, _resolutionScaler.scale() * 100.0f, _gpuTimeMs );
+
+    std::string title = "Vulkan Application"
+        " | " + vk::to_string( _presentMode ) +
+        " | " + std::string( frameTime ) +
+        " | " + std::string( renderScale ) +
+        " | objects: "          + std::to_string( _renderStats.visibleObjects ) + "/" + std::to_string( _renderStats.totalObjects ) +
+        " | draws: "            + std::to_string( _renderStats.commands.issued[CommandStateTracker::CommandDraw] ) +
+        " | pipeline binds: "   + std::to_string( _renderStats.commands.issued[CommandStateTracker::CommandPipeline] ) +
+        " | set binds: "        + std::to_string( _renderStats.commands.issued[CommandStateTracker::CommandDescriptorSet] ) +
+        " | vertex binds: "     + std::to_string( _renderStats.commands.issued[CommandStateTracker::CommandVertexBuffer] ) +
+        " | elided: "           + std::to_string( _renderStats.commands.totalElided() );
+    if( _occlusionActive )
+        title += " | occluded: " + std::to_string( _occlusionCuller.stats().occludedObjects );
+
+    if( _config.headless )
+    {
+        std::cout << title << "\n";
+        char line[128];
+        for( const auto& timing : _gpuProfiler.timings() )
+        {
+            snprintf( line, sizeof(line), "    gpu %-24s %8.3f ms (max %.3f ms)", timing.name.c_str(), timing.averageMs, timing.maxMs );
+            std::cout << line << "\n";
+        }
+        const auto& heaps = _memoryMonitor.heaps();
+        for( uint32_t heap = 0; heap < heaps.size(); ++heap )
+        {
+            snprintf( line, sizeof(line), "    heap %u%-15s %8.1f / %.1f MiB, %u allocations", heap, heaps[heap].deviceLocal ? " (device local)" : "",
+                heaps[heap].usage / 1048576.0, heaps[heap].budget / 1048576.0, heaps[heap].allocationCount );
+            std::cout << line << "\n";
+        }
+    }
+    else
+        glfwSetWindowTitle( _window, title.c_str() );
+}
+
+void Engine::dumpMemoryStats() 
+{
+    _memoryMonitor.dumpJson( "vma_stats_" + std::to_string( _totalFrames ) + ".json" );
 }
 
 void Engine::uploadMesh(Mesh& mesh) 
 {
+    PROFILE_FUNCTION();
+    mesh.computeBounds();
+
     size_t size = mesh.vertices.size() * sizeof(Vertex);
     vma::AllocationCreateInfo allocInfo {}; // informasi untuk membuat buffer
 
@@ -757,18 +1777,49 @@ void Engine::uploadMesh(Mesh& mesh)
 
 void Engine::createObjectToRender() 
 {
+    PROFILE_FUNCTION();
     createMeshes();
     initDescriptors();  // the descriptor set layout member variable is used when creating material
-    createMaterials();
+    {
+        auto start = std::chrono::steady_clock::now();
+        createMaterials();
+        _materialsMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    }
     loadImages();
     initRenderObject();
 }
 
 void Engine::createMaterials() 
 {
-    // defaultMaterial();
-    // colorMaterial();
-    texturedMaterial();
+    /**
+     * @brief Every material is a variant of the uber shader, the variants are compiled together on the build queue threads
+     */
+    PipelineBuildQueue buildQueue;
+    buildQueue.init( _device.get(), &_pipelineCache );
+    _materialVariants.init( _device.get(), _renderPass, _swapchainExtent, { _globalSetLayout, _objectSetLayout, _textureTable.layout() }, _mainDeletionQueue );
+
+    const std::vector<std::pair<std::string, uint32_t>> materials = {
+        { "defaultMaterial",    0 },
+        { "colorMaterial",      MaterialAmbient | MaterialLights | MaterialSun },
+        { "texturedMaterial",   MaterialTextured | MaterialLights | MaterialSun },
+    };
+    for( const auto& material : materials )
+        _materialVariants.request( material.second, buildQueue );
+
+    buildQueue.build( _mainDeletionQueue );
+    _pipelineBuild = buildQueue.stats();
+
+    for( const auto& material : materials )
+    {
+        auto variant = _materialVariants.get( material.second );
+        _sceneManag.createMaterial( variant.pipeline, variant.layout, material.first );
+
+        // all of them are opaque without discard, so their depth can be laid down before shading
+        auto pMaterial = _sceneManag.getPMaterial( material.first );
+        pMaterial->depthPipeline = variant.depthPipeline;
+        pMaterial->equalPipeline = variant.equalPipeline;
+        pMaterial->depthPrepass = true;
+    }
 }
 
 void Engine::initRenderObject() 
@@ -818,46 +1869,36 @@ void Engine::initRenderObject()
         map.pTexture = _sceneManag.getPTexture( "empireMapTexture" );
         map.transformMatrix = glm::translate( glm::vec3{ 5, -10, 0 } );
 
-        auto samplerCreateInfo = vk::SamplerCreateInfo {};
-        vk::Sampler blockySampler;
-        try
-        {
-            blockySampler = _device->createSampler( samplerCreateInfo );
-        } ENGINE_CATCH
-
-        vk::DescriptorSetAllocateInfo setAllocInfo {};
-        setAllocInfo.setDescriptorPool( _descriptorPool );
-        setAllocInfo.setSetLayouts( _singleTextureSetLayout );
-        setAllocInfo.setDescriptorSetCount( 1 );
-
-        try
-        {
-            map.pMaterial->textureSet = _device->allocateDescriptorSets( setAllocInfo ).front();
-        } ENGINE_CATCH
-
-        vk::DescriptorImageInfo imageInfo {};
-        imageInfo.setImageLayout( vk::ImageLayout::eShaderReadOnlyOptimal );
-        imageInfo.setImageView( _sceneManag.getPTexture("empireMapTexture")->imageView );
-        imageInfo.setSampler( blockySampler );
-
-        auto setWrite = vk::WriteDescriptorSet {
-            map.pMaterial->textureSet,
-            0,
-            0,
-            vk::DescriptorType::eCombinedImageSampler,
-            imageInfo,
-            nullptr,
-            nullptr
-        };
-
-        _device->updateDescriptorSets( setWrite, nullptr );
+        // the default sampler of the table is the same blocky (nearest) sampler
+        map.pMaterial->textureIndex = map.pTexture->tableIndex;
+        map.pMaterial->samplerIndex = TextureTable::DefaultSampler;
 
         _sceneManag.pushRenderableObject( map );
     }
+
+    /**
+     * @brief Dynamic shadow casters
+     * Monkeys that go around over the map (see animateObjects), their shadows are rendered every frame
+     */
+    for( uint32_t i = 0; i < _config.dynamicCasters; ++i )
+    {
+        RenderObject monkey;
+        monkey.pMesh = _sceneManag.getPMehs( "monkey" );
+        assert( monkey.pMesh != nullptr );
+        monkey.pMaterial = _sceneManag.getPMaterial( "colorMaterial" );
+        assert( monkey.pMaterial != nullptr );
+        monkey.pTexture = nullptr;
+        monkey.transformMatrix = glm::mat4{ 1.0f };
+        monkey.dynamic = true;
+
+        _dynamicObjects.push_back( static_cast<uint32_t>( _sceneManag.renderable.size() ) );
+        _sceneManag.pushRenderableObject( monkey );
+    }
 }
 
 void Engine::createMeshes() 
 {
+    PROFILE_FUNCTION();
     createTriangleMesh();
     createMonkeyMesh();
 
@@ -875,6 +1916,7 @@ void Engine::createMeshes()
 
 void Engine::loadImages() 
 {
+    PROFILE_FUNCTION();
     Texture lostEmpire;
 
     lostEmpire.image = loadImageFromFile( "resources/lost_empire-RGBA.png" );
@@ -893,6 +1935,7 @@ void Engine::loadImages()
         }
     );
 
+    lostEmpire.tableIndex = _textureTable.addTexture( lostEmpire.imageView );
     _sceneManag.createTexture( lostEmpire, "empireMapTexture" );
 }
 
@@ -929,282 +1972,60 @@ void Engine::createMonkeyMesh()
     _sceneManag.createMesh( monkeyMesh, "monkey" );
 }
 
-void Engine::defaultMaterial() 
-{
-    vk::PipelineLayout layout;
-    vk::Pipeline pipeline;
-
-    /**
-     * @brief Pipeline layout info
-     */
-    vk::PushConstantRange pushConstant {};
-    pushConstant.setOffset( 0 );
-    pushConstant.setSize( sizeof( MeshPushConstant ) );
-    pushConstant.setStageFlags( vk::ShaderStageFlagBits::eVertex );
-
-    vk::PipelineLayoutCreateInfo pipelineLayoutInfo {};
-    pipelineLayoutInfo.setPushConstantRanges( pushConstant );
-    pipelineLayoutInfo.setSetLayouts( _globalSetLayout );   // descriptor set layout must be initialized first at the order of initVulkan
-    try
-    {
-        layout = _device->createPipelineLayout( pipelineLayoutInfo );
-    } ENGINE_CATCH
-    _mainDeletionQueue.pushFunction(
-        [d = _device.get(), pl = layout](){
-            d.destroyPipelineLayout( pl );
-        }
-    );
-
-    /**
-     * @brief Depth Stencil Info
-     */
-    auto depthStencilInfo = GraphicsPipeline::createDepthStencilInfo( true, true, vk::CompareOp::eLessOrEqual );
-
-    /**
-     * @brief init default pipeline builder
-     */
-    GraphicsPipeline builder;
-    builder.init( _device.get(), "shaders/vertex_shader.spv", "shaders/frag.spv", _swapchainExtent );
-
-    /**
-     * @brief Vertex Input state info
-     */
-    builder.m_vertexInputDesc = Vertex::getVertexInputDescription();
-    builder.m_vertexInputStateInfo.setVertexBindingDescriptions( builder.m_vertexInputDesc.bindings );
-    builder.m_vertexInputStateInfo.setVertexAttributeDescriptions( builder.m_vertexInputDesc.attributs );
-
-    /**
-     * @brief initialize the depth stencil
-     */
-    builder.m_useDepthStencil = true;
-    builder.m_depthStencilStateInfo = depthStencilInfo;
-
-    builder.createGraphicsPipeline( _renderPass, layout, _mainDeletionQueue );
-    pipeline = builder.m_graphicsPipeline;
-
-    _sceneManag.createMaterial( pipeline, layout, "defaultMaterial" );
-}
-
-void Engine::colorMaterial() 
-{
-    vk::PipelineLayout layout;
-    vk::Pipeline pipeline;
-
-    /**
-     * @brief Pipeline layout info
-     */
-    vk::PushConstantRange pushConstant {};
-    pushConstant.setOffset( 0 );
-    pushConstant.setSize( sizeof( MeshPushConstant ) );
-    pushConstant.setStageFlags( vk::ShaderStageFlagBits::eVertex );
-
-    vk::PipelineLayoutCreateInfo pipelineLayoutInfo {};
-    pipelineLayoutInfo.setPushConstantRanges( pushConstant );
-    std::vector<vk::DescriptorSetLayout> descriptorSetLayouts = { _globalSetLayout, _objectSetLayout };
-    pipelineLayoutInfo.setSetLayouts( descriptorSetLayouts );   // descriptor set layout must be initialized first at the order of initVulkan
-    try
-    {
-        layout = _device->createPipelineLayout( pipelineLayoutInfo );
-    } ENGINE_CATCH
-    _mainDeletionQueue.pushFunction(
-        [d = _device.get(), pl = layout](){
-            d.destroyPipelineLayout( pl );
-        }
-    );
-
-    /**
-     * @brief Depth Stencil Info
-     */
-    auto depthStencilInfo = GraphicsPipeline::createDepthStencilInfo( true, true, vk::CompareOp::eLessOrEqual );
-
-    /**
-     * @brief init default pipeline builder
-     */
-    GraphicsPipeline builder;
-    builder.init( _device.get(), "shaders/vertex_shader.spv", "shaders/fragment_shader.spv", _swapchainExtent );
-
-    /**
-     * @brief Vertex Input state info
-     */
-    builder.m_vertexInputDesc = Vertex::getVertexInputDescription();
-    builder.m_vertexInputStateInfo.setVertexBindingDescriptions( builder.m_vertexInputDesc.bindings );
-    builder.m_vertexInputStateInfo.setVertexAttributeDescriptions( builder.m_vertexInputDesc.attributs );
-
-    /**
-     * @brief initialize the depth stencil
-     */
-    builder.m_useDepthStencil = true;
-    builder.m_depthStencilStateInfo = depthStencilInfo;
-
-    builder.createGraphicsPipeline( _renderPass, layout, _mainDeletionQueue );
-    pipeline = builder.m_graphicsPipeline;
-
-    _sceneManag.createMaterial( pipeline, layout, "colorMaterial" );
-}
-
-void Engine::texturedMaterial() 
-{
-    vk::PipelineLayout layout;
-    vk::Pipeline pipeline;
-
-    {
-        vk::PushConstantRange pushConstant {};
-        pushConstant.setOffset( 0 );
-        pushConstant.setSize( sizeof( MeshPushConstant ) );
-        pushConstant.setStageFlags( vk::ShaderStageFlagBits::eVertex );
-
-        std::vector<vk::DescriptorSetLayout> setLayout = { _globalSetLayout, _objectSetLayout, _singleTextureSetLayout };
-
-        vk::PipelineLayoutCreateInfo layoutInfo {};
-        layoutInfo.setSetLayouts( setLayout );
-        layoutInfo.setPushConstantRanges( pushConstant );
-
-        try
-        {
-            layout = _device->createPipelineLayout( layoutInfo );
-        } ENGINE_CATCH
-        _mainDeletionQueue.pushFunction(
-            [d = _device.get(), l = layout](){
-                d.destroyPipelineLayout( l );
-            }
-        );
-    }
-
-    auto depthStencilState = GraphicsPipeline::createDepthStencilInfo( true, true, vk::CompareOp::eLessOrEqual );
-    auto vertexInputState = Vertex::getVertexInputDescription();
-
-    GraphicsPipeline builder;
-
-    builder.init( _device.get(), "shaders/vertex_shader.spv", "shaders/textured.spv", _swapchainExtent );
-
-    // depth stencil
-    builder.m_useDepthStencil = true;
-    builder.m_depthStencilStateInfo = depthStencilState;
-    // vertex input
-    builder.m_vertexInputStateInfo.setVertexAttributeDescriptions( vertexInputState.attributs );
-    builder.m_vertexInputStateInfo.setVertexBindingDescriptions( vertexInputState.bindings );
-
-    // create the pipeline
-    builder.createGraphicsPipeline( _renderPass, layout, _mainDeletionQueue );
-
-    pipeline = builder.getGraphicsPipeline();
-
-    _sceneManag.createMaterial( pipeline, layout, "texturedMaterial" );
-}
-
 void Engine::initDescriptors() 
 {
     /**
-     * @brief Create Descriptor pool
+     * @brief Descriptor allocators
+     * The persistent one holds the sets that live as long as the engine (frame sets, material textures),
+     * the one of every frame is reset when the frame begins again, for the sets that are used by a single frame
      */
     {
-        uint32_t maxSets = 10;
-        std::vector<vk::DescriptorPoolSize> sizes;
-
-        // this Descriptor Pool will be hold 10 Uniform Buffer.
-        vk::DescriptorPoolSize uniformbuffer {};
-        uniformbuffer.setType( vk::DescriptorType::eUniformBuffer );
-        uniformbuffer.setDescriptorCount( 10 );
-        sizes.emplace_back( uniformbuffer );
-
-        // the Desc Pool will be hold 10 Dynamic Uniform Buffer.
-        vk::DescriptorPoolSize dynamicUniformBuffer {};
-        dynamicUniformBuffer.setType( vk::DescriptorType::eUniformBufferDynamic );
-        dynamicUniformBuffer.setDescriptorCount( 10 );
-        sizes.emplace_back( dynamicUniformBuffer );
-
-        // the pool will be hold 10 Storage Buffer.
-        vk::DescriptorPoolSize storageBuffer {};
-        storageBuffer.setType( vk::DescriptorType::eStorageBuffer );
-        storageBuffer.setDescriptorCount( 10 );
-        sizes.emplace_back( storageBuffer );
-
-        // the pool will be hold 10 combined image sampler
-        vk::DescriptorPoolSize textureBuffer {};
-        textureBuffer.setType( vk::DescriptorType::eCombinedImageSampler );
-        textureBuffer.setDescriptorCount( 10 );
-        sizes.emplace_back( textureBuffer );
-
-        vk::DescriptorPoolCreateInfo descriptorPoolInfo {};
-        descriptorPoolInfo.setMaxSets( maxSets ); // the maximum descriptor sets that can be store to the pool
-        descriptorPoolInfo.setPoolSizes( sizes ); // the poolsize struct
-        try
-        {
-            _descriptorPool = _device->createDescriptorPool( descriptorPoolInfo );
-        } ENGINE_CATCH
+        const std::vector<DescriptorAllocator::PoolSizeRatio> ratios = {
+            { vk::DescriptorType::eUniformBuffer,           1.0f },
+            { vk::DescriptorType::eUniformBufferDynamic,    1.0f },
+            { vk::DescriptorType::eStorageBuffer,           4.0f },
+            { vk::DescriptorType::eCombinedImageSampler,    1.0f },
+            { vk::DescriptorType::eStorageImage,            1.0f },     // the HZB levels
+        };
+        _descriptorAllocator.init( _device.get(), 10, ratios );
         _mainDeletionQueue.pushFunction(
-            [d = _device.get(), dp = _descriptorPool](){
-                d.destroyDescriptorPool( dp );
+            [this](){
+                _descriptorAllocator.destroy();
             }
         );
-    }
 
-    /**
-     * @brief Create Descriptor set layout
-     */
-    {
+        for( auto& frame : _frames )
         {
-            // Camera binding
-            vk::DescriptorSetLayoutBinding camBinding = init::dsc::initDescriptorSetLayoutBinding(
-                0, vk::DescriptorType::eUniformBuffer, vk::ShaderStageFlagBits::eVertex
-            );
-            // Scene binding
-            vk::DescriptorSetLayoutBinding sceneBinding = init::dsc::initDescriptorSetLayoutBinding(
-                1, vk::DescriptorType::eUniformBufferDynamic, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment
-            );
-
-            // just create 1 descriptor layout, because we just need 1 descriptor set
-            vk::DescriptorSetLayoutCreateInfo setLayoutInfo {};
-            std::vector<vk::DescriptorSetLayoutBinding> setLayoutBinding = { camBinding, sceneBinding };
-            setLayoutInfo.setBindings( std::array<vk::DescriptorSetLayoutBinding, 2>{ camBinding, sceneBinding } );
-
-            try
-            {
-                _globalSetLayout = _device->createDescriptorSetLayout( setLayoutInfo );
-            } ENGINE_CATCH
+            frame.transientDescriptors.init( _device.get(), 16, ratios );
             _mainDeletionQueue.pushFunction(
-                [d = _device.get(), sl = _globalSetLayout](){
-                    d.destroyDescriptorSetLayout( sl );
+                [&frame](){
+                    frame.transientDescriptors.destroy();
                 }
             );
         }
-        {
-            auto objectBinding = init::dsc::initDescriptorSetLayoutBinding(
-                0,                                  // binding
-                vk::DescriptorType::eStorageBuffer, // descriptor type
-                vk::ShaderStageFlagBits::eVertex    // shader stage
-            );
-            vk::DescriptorSetLayoutCreateInfo setLayoutInfo {};
-            setLayoutInfo.setBindings( objectBinding );
-            try
-            {
-                _objectSetLayout = _device->createDescriptorSetLayout( setLayoutInfo );
-            } ENGINE_CATCH
-            _mainDeletionQueue.pushFunction(
-                [d = _device.get(), sl = _objectSetLayout](){
-                    d.destroyDescriptorSetLayout( sl );
-                }
-            );
+    }
+
+    /**
+     * @brief Layout cache
+     * The global and object layouts come out of the builder with their sets (below)
+     */
+    _layoutCache.init( _device.get() );
+    _mainDeletionQueue.pushFunction(
+        [this](){
+            _layoutCache.destroy();
         }
-        {
-            auto textureBinding = init::dsc::initDescriptorSetLayoutBinding(
-                0,
-                vk::DescriptorType::eCombinedImageSampler,
-                vk::ShaderStageFlagBits::eFragment
-            );
-            vk::DescriptorSetLayoutCreateInfo setLayoutInfo {};
-            setLayoutInfo.setBindings( textureBinding );
-            try
-            {
-                _singleTextureSetLayout = _device->createDescriptorSetLayout( setLayoutInfo );
-            } ENGINE_CATCH
-            _mainDeletionQueue.pushFunction(
-                [d = _device.get(), sl = _singleTextureSetLayout](){
-                    d.destroyDescriptorSetLayout( sl );
-                }
-            );
+    );
+
+    /**
+     * @brief Texture table
+     * The bindless set 2 of every material, it has its own pool and layout (update after bind)
+     */
+    _textureTable.init( _device.get(), _physicalDevice );
+    _mainDeletionQueue.pushFunction(
+        [this](){
+            _textureTable.destroy();
         }
-    }
+    );
 
     /**
      * @brief Create Scene Parameter Buffer
@@ -1227,13 +2048,26 @@ void Engine::initDescriptors()
         );
     }
 
-    for( int i = 0; i < FRAME_OVERLAP; ++i )
+    /**
+     * @brief Object Storage
+     * The ceiling is also limited by the biggest storage buffer that the device can bind
+     */
+    {
+        size_t deviceMaxObjects = _physicalDeviceProperties.limits.maxStorageBufferRange / sizeof( GpuObjectData );
+        _objectStorage.init( _allocator, _device.get(), ObjectStorage::MinCapacity, std::min( _maxObjectCount, deviceMaxObjects ) );
+        _mainDeletionQueue.pushFunction(
+            [ this ](){
+                _objectStorage.destroy();
+            }
+        );
+    }
+
+    for( uint32_t i = 0; i < FRAME_OVERLAP; ++i )
     {
         /**
          * @brief Creating Buffer for each frame
          * 
          */
-        const int maxObjectCount = 10000;
         {
             /**
              * @brief Camera Buffer
@@ -1251,125 +2085,51 @@ void Engine::initDescriptors()
                     }
                 );
             }
-            /**
-             * @brief Object Buffer
-             * buffer type --> Storage Buffer
-             * Note: Storage buffer is kinda like std::vector, it's can store a lot data to it, 
-             *       but of course the price is it's slower than the normal/dynamic uniform buffer
-             */
-            {
-                _frames[i].objectBuffer = AllocatedBuffer::createBuffer( 
-                    sizeof(GpuObjectData) * maxObjectCount,
-                    vk::BufferUsageFlagBits::eStorageBuffer,
-                    _allocator,
-                    vma::MemoryUsage::eCpuToGpu
-                );
-                _mainDeletionQueue.pushFunction(
-                    [ a = _allocator, b = _frames[i].objectBuffer ](){
-                        a.destroyBuffer( b.buffer, b.allocation );
-                    }
-                );
-            }
         }
 
         /**
-         * @brief Allocate Descriptor Set for each frame
+         * @brief Descriptor Sets of each frame
+         * camera at binding 0, the scene parameter at binding 1 (dynamic, the offset of the frame is given when it's bound),
+         * the buffers of the clustered lighting at binding 2, 3, 4, and the shadow maps at binding 5 to 8
          */
         {
-            {
-                vk::DescriptorSetAllocateInfo setAllocInfo {};
-                setAllocInfo.setDescriptorPool( _descriptorPool );
-                setAllocInfo.setSetLayouts( _globalSetLayout );
-                setAllocInfo.setDescriptorSetCount( 1 );    // just 1 descriptor set
-                // "front()" because we just have a single descriptor set that we want to allocate
-                // auto tmp = _device->allocateDescriptorSets( setAllocInfo );
-                try
-                {
-                    _frames[i].globalDescriptorSet = _device->allocateDescriptorSets( setAllocInfo )[0];
-                } ENGINE_CATCH
-            }
-            {
-                vk::DescriptorSetAllocateInfo setAllocInfo {};
-                setAllocInfo.setDescriptorPool( _descriptorPool );
-                setAllocInfo.setSetLayouts( _objectSetLayout );
-                setAllocInfo.setDescriptorSetCount( 1 );
-                try
-                {
-                    _frames[i].objectDescriptorSet = _device->allocateDescriptorSets( setAllocInfo ).front();
-                } ENGINE_CATCH
-            }
+            vk::DescriptorBufferInfo camBuffInfo { _frames[i].cameraBuffer.buffer, 0, sizeof( GpuCameraData ) };
+            vk::DescriptorBufferInfo sceneBuffInfo { _sceneParameter.allocationBuffer.buffer, 0, sizeof( GpuSceneParameterData ) };
+
+            DescriptorBuilder::begin( _layoutCache, _descriptorAllocator )
+                .bindBuffer( 0, camBuffInfo, vk::DescriptorType::eUniformBuffer, vk::ShaderStageFlagBits::eVertex )
+                .bindBuffer( 1, sceneBuffInfo, vk::DescriptorType::eUniformBufferDynamic, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment )
+                // the lights, clusters, and light indices of the clustered lighting, written by LightClusters::prepare
+                .bindEmpty( 2, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eFragment )
+                .bindEmpty( 3, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eFragment )
+                .bindEmpty( 4, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eFragment )
+                // the shadow map of every cascade, written by ShadowCascades::writeDescriptors
+                .bindEmpty( ShadowCascades::FirstBinding + 0, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment )
+                .bindEmpty( ShadowCascades::FirstBinding + 1, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment )
+                .bindEmpty( ShadowCascades::FirstBinding + 2, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment )
+                .bindEmpty( ShadowCascades::FirstBinding + 3, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment )
+                .build( _frames[i].globalDescriptorSet, _globalSetLayout );
         }
 
-        {
-            /**
-             * @brief Information about the buffer that we want to point at in the descriptor
-             */
-            std::vector<vk::WriteDescriptorSet> setWrite;
-            vk::DeviceSize offset = vk::DeviceSize{ 0U };
-            /**
-             * @brief Write each descriptor to each buffer info
-             */
-            vk::DescriptorBufferInfo camBuffInfo {};
-            vk::DescriptorBufferInfo sceneBuffInfo {};
-            vk::DescriptorBufferInfo objectBuffInfo {};
-            vk::WriteDescriptorSet camDescSetBuff {};
-            vk::WriteDescriptorSet sceneDescSetBuff {};
-            vk::WriteDescriptorSet objectDescSetBuff {};
-        {
-            {
-                    camBuffInfo.setBuffer( _frames[i].cameraBuffer.buffer );
-                    camBuffInfo.setOffset( offset );    // at offset 0
-                    camBuffInfo.setRange( sizeof( GpuCameraData ) ); // this struct is used for uniform buffer (in vertex)
-
-                    camDescSetBuff.setDstSet( _frames[i].globalDescriptorSet );
-                    camDescSetBuff.setDstBinding( 0 );
-                    camDescSetBuff.setDescriptorType( vk::DescriptorType::eUniformBuffer );
-                    camDescSetBuff.setBufferInfo( camBuffInfo );
-                    setWrite.emplace_back( camDescSetBuff );
-                }
-                {
-                    sceneBuffInfo.setBuffer( _sceneParameter.allocationBuffer.buffer );
-                    sceneBuffInfo.setOffset( offset );  // the start of read the data
-                    sceneBuffInfo.setRange( sizeof( GpuSceneParameterData ) ); // this struct is used for uniform buffer (in vertex)
-
-                    sceneDescSetBuff = vk::WriteDescriptorSet {
-                        _frames[i].globalDescriptorSet,
-                        1,  // binding
-                        0,
-                        vk::DescriptorType::eUniformBufferDynamic,
-                        nullptr,
-                        sceneBuffInfo,
-                        nullptr
-                    };
-                    setWrite.push_back( sceneDescSetBuff );
-                }
-                {
-                    objectBuffInfo.setBuffer( _frames[i].objectBuffer.buffer );
-                    objectBuffInfo.setOffset( offset );
-                    objectBuffInfo.setRange( sizeof( GpuObjectData ) * maxObjectCount );
-
-                    objectDescSetBuff = vk::WriteDescriptorSet {
-                        _frames[i].objectDescriptorSet,
-                        0,
-                        0,
-                        vk::DescriptorType::eStorageBuffer,
-                        nullptr,
-                        objectBuffInfo,
-                        nullptr
-                    };
-                    setWrite.push_back( objectDescSetBuff );
-                }
-            }
-
-            // updating the descriptor set
-            _device->updateDescriptorSets( setWrite, nullptr );
-        }
+        /**
+         * @brief Object Buffer and Instance Buffer
+         * buffer type --> Storage Buffer
+         * Note: Storage buffer is kinda like std::vector, it's can store a lot data to it, 
+         *       but of course the price is it's slower than the normal/dynamic uniform buffer
+         * These buffers are owned by the object storage, so they can grow with the scene.
+         * This first update allocates the initial capacity and writes the object descriptor set (binding 0 and 1).
+         */
+        DescriptorBuilder::begin( _layoutCache, _descriptorAllocator )
+            .bindEmpty( 0, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eVertex )
+            .bindEmpty( 1, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eVertex )
+            .build( _frames[i].objectDescriptorSet, _objectSetLayout );
+        _objectStorage.update( i, _frames[i].objectDescriptorSet );
     }
 }
 
 FrameData& Engine::getCurrentFrame() 
 {
-    _frames[ _frameNumber % FRAME_OVERLAP ];
+    return _frames[ _frameNumber % FRAME_OVERLAP ];
 }
 
 size_t Engine::padUniformBufferSize(size_t originalSize) 
@@ -1385,6 +2145,7 @@ size_t Engine::padUniformBufferSize(size_t originalSize)
 
 void Engine::immediateSubmit(std::function<void( vk::CommandBuffer )>&& func) 
 {
+    PROFILE_FUNCTION();
     vk::CommandBuffer cmdBuffer;
     {
         vk::CommandBufferAllocateInfo cmdAllocInfo {};
@@ -1406,7 +2167,11 @@ void Engine::immediateSubmit(std::function<void( vk::CommandBuffer )>&& func)
         cmdBuffer.begin( beginInfo );
 
         // start executing
-        func( cmdBuffer );
+        _gpuProfiler.begin( GpuProfiler::ImmediateContext, cmdBuffer );
+        {
+            GpuScope scope( _gpuProfiler, cmdBuffer, "immediate submit" );
+            func( cmdBuffer );
+        }
 
         cmdBuffer.end();
     } ENGINE_CATCH
@@ -1424,6 +2189,9 @@ void Engine::immediateSubmit(std::function<void( vk::CommandBuffer )>&& func)
     _device->waitForFences( _uploadContext.uploadFence, VK_TRUE, UINT64_MAX );
     _device->resetFences( _uploadContext.uploadFence );
 
+    // the fence is already waited, so this doesn't stall more than before
+    _gpuProfiler.collect( GpuProfiler::ImmediateContext );
+
     /**
      * @brief Clearing/Freeing command pool, this will also dealocate the command buffer(s) too.
      */
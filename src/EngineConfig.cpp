@@ -0,0 +1,152 @@
+#include "EngineConfig.hpp"
+
+#include <iostream>
+#include <filesystem>
+#include <sstream>
+
+EngineConfig EngineConfig::fromArguments( int argc, char** argv )
+{
+    EngineConfig config;
+
+    for( int i = 1; i < argc; ++i )
+    {
+        std::string argument = argv[i];
+        auto equal = argument.find( '=' );
+        std::string key = argument.substr( 0, equal );
+        std::string value = equal != std::string::npos ? argument.substr( equal + 1 ) : "";
+
+        if( key == "--present-mode" )
+        {
+            if( !utils::parsePresentMode( value, config.presentMode ) )
+                throw std::runtime_error( "Unknown present mode: " + value );
+        }
+        else if( key == "--fps" )
+        {
+            config.targetFrameRate = std::stod( value );
+        }
+        else if( key == "--headless" )
+        {
+            config.headless = true;
+        }
+        else if( key == "--frames" )
+        {
+            config.frameCount = std::stoull( value );
+        }
+        else if( key == "--readback" )
+        {
+            config.readbackDirectory = value;
+        }
+        else if( key == "--dynamic-resolution" )
+        {
+            if( value != "on" && value != "off" )
+                throw std::runtime_error( "--dynamic-resolution is on or off, not: " + value );
+            config.dynamicResolution = value == "on";
+        }
+        else if( key == "--gpu-budget" )
+        {
+            config.gpuBudgetMs = std::stod( value );
+        }
+        else if( key == "--min-render-scale" )
+        {
+            config.minRenderScale = std::stof( value );
+        }
+        else if( key == "--trace" )
+        {
+            config.traceFrames = static_cast<uint32_t>( std::stoul( value ) );
+        }
+        else if( key == "--memory-warn" )
+        {
+            config.memoryWarnings.clear();
+            std::stringstream list( value );
+            std::string fraction;
+            while( std::getline( list, fraction, ',' ) )
+            {
+                double warning = std::stod( fraction );
+                if( warning <= 0.0 || warning > 1.0 )
+                    throw std::runtime_error( "--memory-warn fractions are in (0, 1], not: " + fraction );
+                config.memoryWarnings.push_back( warning );
+            }
+        }
+        else if( key == "--pipeline-cache" )
+        {
+            config.pipelineCacheFile = value == "off" ? "" : value;
+        }
+        else if( key == "--vma-dump" )
+        {
+            config.vmaDumpFile = value;
+        }
+        else if( key == "--depth-prepass" )
+        {
+            if( value != "on" && value != "off" )
+                throw std::runtime_error( "--depth-prepass is on or off, not: " + value );
+            config.depthPrepass = value == "on";
+        }
+        else if( key == "--occlusion-culling" )
+        {
+            if( value != "on" && value != "off" )
+                throw std::runtime_error( "--occlusion-culling is on or off, not: " + value );
+            config.occlusionCulling = value == "on";
+        }
+        else if( key == "--lights" )
+        {
+            config.lightCount = static_cast<uint32_t>( std::stoul( value ) );
+        }
+        else if( key == "--light-sweep" )
+        {
+            config.lightSweep.clear();
+            std::stringstream list( value );
+            std::string count;
+            while( std::getline( list, count, ',' ) )
+                config.lightSweep.push_back( static_cast<uint32_t>( std::stoul( count ) ) );
+        }
+        else if( key == "--dynamic-casters" )
+        {
+            config.dynamicCasters = static_cast<uint32_t>( std::stoul( value ) );
+        }
+        else if( key == "--shadow-cache" )
+        {
+            if( value != "on" && value != "off" )
+                throw std::runtime_error( "--shadow-cache is on or off, not: " + value );
+            config.shadowCache = value == "on";
+        }
+        else
+        {
+            std::cerr << "Unknown argument: " << argument << '\n';
+        }
+    }
+
+    if( !config.readbackDirectory.empty() && !config.headless )
+        std::cerr << "--readback is only used in headless mode\n";
+    if( !config.readbackDirectory.empty() && config.headless )
+        std::filesystem::create_directories( config.readbackDirectory );
+#ifndef ENGINE_PROFILE
+    if( config.traceFrames > 0 )
+        std::cerr << "--trace needs the CPU profiler, build with PROFILE=1\n";
+#endif
+    if( !config.lightSweep.empty() && config.frameCount > 0 )
+        std::cerr << "--light-sweep stops by itself, --frames is ignored\n";
+    if( config.headless && config.frameCount == 0 && config.lightSweep.empty() )
+        std::cerr << "--headless without --frames runs until the process is killed\n";
+
+    return config;
+}
+
+double EngineConfig::resolvedGpuBudgetMs() const
+{
+    if( gpuBudgetMs > 0.0 )
+        return gpuBudgetMs;
+
+    return 1000.0 / ( targetFrameRate > 0.0 ? targetFrameRate : 60.0 );
+}
+
+bool utils::parsePresentMode( const std::string& name, vk::PresentModeKHR& outPresentMode )
+{
+    if( name == "fifo" )                outPresentMode = vk::PresentModeKHR::eFifo;
+    else if( name == "fifo-relaxed" )   outPresentMode = vk::PresentModeKHR::eFifoRelaxed;
+    else if( name == "mailbox" )        outPresentMode = vk::PresentModeKHR::eMailbox;
+    else if( name == "immediate" )      outPresentMode = vk::PresentModeKHR::eImmediate;
+    else
+        return false;
+
+    return true;
+}
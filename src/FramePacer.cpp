@@ -0,0 +1,89 @@
+#include "FramePacer.hpp"
+
+#include <thread>
+#include <cmath>
+#include <algorithm>
+
+void FramePacer::setTargetFrameRate( double framesPerSecond )
+{
+    if( framesPerSecond <= 0.0 )
+        m_targetFrameTime = Clock::duration::zero();
+    else
+        m_targetFrameTime = std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( 1.0 / framesPerSecond ) );
+
+    m_started = false;
+}
+
+double FramePacer::targetFrameTimeMs() const
+{
+    return std::chrono::duration<double, std::milli>( m_targetFrameTime ).count();
+}
+
+void FramePacer::wait()
+{
+    if( m_targetFrameTime == Clock::duration::zero() )
+    {
+        record( Clock::now() );
+        return;
+    }
+
+    auto now = Clock::now();
+    if( !m_started )
+    {
+        m_deadline = now;
+        m_started = true;
+    }
+    m_deadline += m_targetFrameTime;
+
+    // if the frame is already late by more than a whole frame, don't try to catch up with a burst of short frames
+    if( now > m_deadline + m_targetFrameTime )
+        m_deadline = now;
+
+    /**
+     * @brief Sleep, then spin
+     */
+    if( m_deadline - now > m_spinMargin )
+        std::this_thread::sleep_until( m_deadline - m_spinMargin );
+
+    while( Clock::now() < m_deadline )
+        std::this_thread::yield();
+
+    record( Clock::now() );
+}
+
+void FramePacer::record( Clock::time_point now )
+{
+    if( m_lastFrame == Clock::time_point{} )
+    {
+        m_lastFrame = now;
+        return;
+    }
+
+    double frameMs = std::chrono::duration<double, std::milli>( now - m_lastFrame ).count();
+    m_lastFrame = now;
+    m_lastMs = frameMs;
+
+    m_samples[m_sampleIndex] = frameMs;
+    m_sampleIndex = ( m_sampleIndex + 1 ) % SampleCount;
+    m_sampleFilled = std::min( m_sampleFilled + 1, SampleCount );
+
+    /**
+     * @brief Jitter statistic
+     * When the pacing is on, the deviation is measured againts the target, otherwise againts the average
+     */
+    double sum = 0.0;
+    for( size_t i = 0; i < m_sampleFilled; ++i )
+        sum += m_samples[i];
+    m_averageMs = sum / m_sampleFilled;
+
+    double reference = m_targetFrameTime != Clock::duration::zero() ? targetFrameTimeMs() : m_averageMs;
+    double variance = 0.0;
+    m_maxDeviationMs = 0.0;
+    for( size_t i = 0; i < m_sampleFilled; ++i )
+    {
+        double deviation = m_samples[i] - reference;
+        variance += deviation * deviation;
+        m_maxDeviationMs = std::max( m_maxDeviationMs, std::abs( deviation ) );
+    }
+    m_jitterMs = std::sqrt( variance / m_sampleFilled );
+}
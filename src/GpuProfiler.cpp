@@ -0,0 +1,179 @@
+#include "GpuProfiler.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <cstring>
+
+bool GpuProfiler::init( vk::Instance instance, vk::PhysicalDevice physicalDevice, vk::Device device, uint32_t queueFamily )
+{
+    m_device = device;
+
+    // null if VK_EXT_debug_utils is not enabled, then the scopes are just not labeled
+    m_cmdBeginLabel = ( PFN_vkCmdBeginDebugUtilsLabelEXT )vkGetInstanceProcAddr( instance, "vkCmdBeginDebugUtilsLabelEXT" );
+    m_cmdEndLabel = ( PFN_vkCmdEndDebugUtilsLabelEXT )vkGetInstanceProcAddr( instance, "vkCmdEndDebugUtilsLabelEXT" );
+
+    auto queueFamilies = physicalDevice.getQueueFamilyProperties();
+    float period = physicalDevice.getProperties().limits.timestampPeriod;
+    if( queueFamilies[queueFamily].timestampValidBits == 0 || period == 0.0f )
+        return false;
+
+    m_timestampPeriod = period;
+    for( auto& context : m_contexts )
+    {
+        vk::QueryPoolCreateInfo queryPoolInfo {};
+        queryPoolInfo.setQueryType( vk::QueryType::eTimestamp );
+        queryPoolInfo.setQueryCount( MaxScopes * 2 );
+        context.pool = m_device.createQueryPool( queryPoolInfo );
+    }
+    m_results.resize( MaxScopes * 2 );
+
+    return true;
+}
+
+void GpuProfiler::destroy()
+{
+    for( auto& context : m_contexts )
+    {
+        if( context.pool )
+            m_device.destroyQueryPool( context.pool );
+        context = Context{};
+    }
+}
+
+void GpuProfiler::begin( uint32_t context, vk::CommandBuffer cmd )
+{
+    m_current = context;
+    auto& current = m_contexts[m_current];
+
+    // the results that have not been collected are dropped
+    current.scopes.clear();
+    current.pending = false;
+
+    if( hasTimestamps() )
+        cmd.resetQueryPool( current.pool, 0, MaxScopes * 2 );
+}
+
+bool GpuProfiler::collect( uint32_t context, double* outSpanMs )
+{
+    auto& current = m_contexts[context];
+    if( !current.pending || current.scopes.empty() )
+        return false;
+
+    uint32_t timedCount = 0;
+    while( timedCount < current.scopes.size() && current.scopes[timedCount].timed )
+        ++timedCount;
+
+    /**
+     * @brief Without the wait flag, this returns eNotReady instead of blocking
+     */
+    auto result = m_device.getQueryPoolResults(
+        current.pool, 0, timedCount * 2,
+        timedCount * 2 * sizeof(uint64_t), m_results.data(), sizeof(uint64_t),
+        vk::QueryResultFlagBits::e64
+    );
+    if( result != vk::Result::eSuccess )
+        return false;
+    current.pending = false;
+
+    /**
+     * @brief Sum the scopes with the same name, then push them to the averages
+     */
+    const double toMs = m_timestampPeriod / 1000000.0;
+    uint64_t spanBegin = std::numeric_limits<uint64_t>::max();
+    uint64_t spanEnd = 0;
+    std::vector<std::pair<const char*, double>> frameSums;
+    for( uint32_t i = 0; i < timedCount; ++i )
+    {
+        uint64_t begin = m_results[i * 2];
+        uint64_t end = m_results[i * 2 + 1];
+        double ms = end > begin ? static_cast<double>( end - begin ) * toMs : 0.0;
+        spanBegin = std::min( spanBegin, begin );
+        spanEnd = std::max( spanEnd, end );
+
+        auto found = std::find_if( frameSums.begin(), frameSums.end(), 
+            [name = current.scopes[i].name.c_str()]( const auto& sum ){ return std::strcmp( sum.first, name ) == 0; } 
+        );
+        if( found != frameSums.end() )
+            found->second += ms;
+        else
+            frameSums.emplace_back( current.scopes[i].name.c_str(), ms );
+    }
+
+    for( const auto& sum : frameSums )
+        addSample( sum.first, sum.second );
+
+    if( outSpanMs )
+        *outSpanMs = spanEnd > spanBegin ? static_cast<double>( spanEnd - spanBegin ) * toMs : 0.0;
+
+    return true;
+}
+
+uint32_t GpuProfiler::beginScope( vk::CommandBuffer cmd, const char* name )
+{
+    auto& current = m_contexts[m_current];
+
+    if( m_cmdBeginLabel )
+    {
+        VkDebugUtilsLabelEXT label {};
+        label.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+        label.pLabelName = name;
+        m_cmdBeginLabel( cmd, &label );
+    }
+
+    uint32_t scope = static_cast<uint32_t>( current.scopes.size() );
+    bool timed = hasTimestamps() && scope < MaxScopes;
+    current.scopes.push_back( Scope{ name, timed } );
+
+    if( timed )
+    {
+        cmd.writeTimestamp( vk::PipelineStageFlagBits::eTopOfPipe, current.pool, scope * 2 );
+        current.pending = true;
+    }
+
+    return scope;
+}
+
+void GpuProfiler::endScope( vk::CommandBuffer cmd, uint32_t scope )
+{
+    auto& current = m_contexts[m_current];
+
+    if( current.scopes[scope].timed )
+        cmd.writeTimestamp( vk::PipelineStageFlagBits::eBottomOfPipe, current.pool, scope * 2 + 1 );
+
+    if( m_cmdEndLabel )
+        m_cmdEndLabel( cmd );
+}
+
+const GpuProfiler::Timing* GpuProfiler::find( const std::string& name ) const
+{
+    auto found = m_timingIndex.find( name );
+    return found != m_timingIndex.end() ? &m_timings[found->second] : nullptr;
+}
+
+void GpuProfiler::addSample( const char* name, double ms )
+{
+    auto found = m_timingIndex.find( name );
+    if( found == m_timingIndex.end() )
+    {
+        found = m_timingIndex.emplace( name, m_timings.size() ).first;
+        m_timings.push_back( Timing{ name } );
+        m_windows.emplace_back();
+    }
+
+    auto& timing = m_timings[found->second];
+    auto& window = m_windows[found->second];
+
+    window[timing.samples % AverageWindow] = ms;
+    ++timing.samples;
+    timing.lastMs = ms;
+
+    size_t count = std::min<uint64_t>( timing.samples, AverageWindow );
+    double sum = 0.0;
+    timing.maxMs = 0.0;
+    for( size_t i = 0; i < count; ++i )
+    {
+        sum += window[i];
+        timing.maxMs = std::max( timing.maxMs, window[i] );
+    }
+    timing.averageMs = sum / count;
+}
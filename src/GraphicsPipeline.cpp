@@ -1,5 +1,7 @@
 #include "GraphicsPipeline.hpp"
 
+#include <algorithm>
+
 #include "Initializer.hpp"
 #include "Mesh.hpp"
 #include "utils.hpp"
@@ -26,6 +28,7 @@ void GraphicsPipeline::init( vk::Device device,
     createRasterizationState();
     createMultisampleState();
     createColorBlendState();
+    createDynamicState();
 
     hasInit = true;
 }
@@ -33,27 +36,51 @@ void GraphicsPipeline::init( vk::Device device,
 void GraphicsPipeline::createShaderStage( const std::string& vertFile, const std::string& fragFile ) 
 {
     auto vertShaderCode = utils::gp::readFile( vertFile );
-    auto fragShaderCode = utils::gp::readFile( fragFile );
-
     m_vertShaderModule = utils::gp::createShaderModule( device, vertShaderCode );
-    m_fragShaderModule = utils::gp::createShaderModule( device, fragShaderCode );
 
     vk::PipelineShaderStageCreateInfo vertexShader {};
     vertexShader.setStage( vk::ShaderStageFlagBits::eVertex );
     vertexShader.setModule( m_vertShaderModule.get() );
     vertexShader.setPName( "main" );
 
-    vk::PipelineShaderStageCreateInfo fragShader {};
-    fragShader.setStage( vk::ShaderStageFlagBits::eFragment );
-    fragShader.setModule( m_fragShaderModule.get() );
-    fragShader.setPName( "main" );
+    m_shaderStagesInfo = { vertexShader };
 
+    // no fragment shader is a depth only pipeline
+    if( !fragFile.empty() )
+    {
+        auto fragShaderCode = utils::gp::readFile( fragFile );
+        m_fragShaderModule = utils::gp::createShaderModule( device, fragShaderCode );
 
-    m_shaderStagesInfo = { vertexShader, fragShader };
+        vk::PipelineShaderStageCreateInfo fragShader {};
+        fragShader.setStage( vk::ShaderStageFlagBits::eFragment );
+        fragShader.setModule( m_fragShaderModule.get() );
+        fragShader.setPName( "main" );
+
+        m_shaderStagesInfo.push_back( fragShader );
+    }
 
     m_graphicsPipelineInfo.setStages( m_shaderStagesInfo );
 }
 
+void GraphicsPipeline::setSpecializationInfo( vk::ShaderStageFlagBits stage, const vk::SpecializationInfo& info ) 
+{
+    assert( hasInit );
+    size_t index = stage == vk::ShaderStageFlagBits::eVertex ? 0 : 1;
+    assert( index < m_shaderStagesInfo.size() && m_shaderStagesInfo[index].stage == stage );
+
+    auto& specialization = m_specializations[index];
+    specialization.entries.assign( info.pMapEntries, info.pMapEntries + info.mapEntryCount );
+    auto data = reinterpret_cast<const uint8_t*>( info.pData );
+    specialization.data.assign( data, data + info.dataSize );
+    specialization.info = vk::SpecializationInfo{ 
+        static_cast<uint32_t>( specialization.entries.size() ), specialization.entries.data(), 
+        specialization.data.size(), specialization.data.data() 
+    };
+
+    m_shaderStagesInfo[index].setPSpecializationInfo( &specialization.info );
+    m_graphicsPipelineInfo.setStages( m_shaderStagesInfo );
+}
+
 void GraphicsPipeline::createVertexInputState() 
 {
     // for basic drawing triangle, we not gonna use the vertex input description
@@ -130,6 +157,42 @@ void GraphicsPipeline::createColorBlendState()
     m_graphicsPipelineInfo.setPColorBlendState( &m_colorBlendStateInfo );
 }
 
+void GraphicsPipeline::createDynamicState() 
+{
+    m_dynamicStates = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+    m_dynamicStateInfo.setDynamicStates( m_dynamicStates );
+
+    m_graphicsPipelineInfo.setPDynamicState( &m_dynamicStateInfo );
+}
+
+void GraphicsPipeline::makeDepthOnly() 
+{
+    assert( hasInit );
+
+    // the fragment stage is dropped (the depth comes from the rasterizer), and so its specialization
+    m_shaderStagesInfo.resize( 1 );
+    m_fragShaderModule.reset();
+    m_specializations[1] = StageSpecialization{};
+    m_graphicsPipelineInfo.setStages( m_shaderStagesInfo );
+
+    // position only, the other attributes are not fetched (the binding keeps the stride of the whole vertex)
+    auto& attributes = m_vertexInputDesc.attributs;
+    attributes.erase( 
+        std::remove_if( attributes.begin(), attributes.end(), []( const vk::VertexInputAttributeDescription& attribute ){ return attribute.location != 0; } ),
+        attributes.end()
+    );
+    m_vertexInputStateInfo.setVertexBindingDescriptions( m_vertexInputDesc.bindings );
+    m_vertexInputStateInfo.setVertexAttributeDescriptions( attributes );
+
+    // without fragment shader the color outputs are undefined, so nothing is written to the color attachment
+    m_colorBlendAttachment.setBlendEnable( VK_FALSE );
+    m_colorBlendAttachment.setColorWriteMask( vk::ColorComponentFlags{} );
+    m_colorBlendStateInfo.setAttachments( m_colorBlendAttachment );
+
+    m_useDepthStencil = true;
+    m_depthStencilStateInfo = createDepthStencilInfo( true, true, vk::CompareOp::eLessOrEqual );
+}
+
 vk::PipelineDepthStencilStateCreateInfo GraphicsPipeline::createDepthStencilInfo(bool bDepthTest, bool bDepthWrite, vk::CompareOp compareOp) 
 {
     vk::PipelineDepthStencilStateCreateInfo depthStencilInfo {};
@@ -144,7 +207,7 @@ vk::PipelineDepthStencilStateCreateInfo GraphicsPipeline::createDepthStencilInfo
     return depthStencilInfo;
 }
 
-void GraphicsPipeline::createGraphicsPipeline( const vk::RenderPass& renderpass, vk::PipelineLayout pipelineLayout, DeletionQueue& deletor ) 
+void GraphicsPipeline::createGraphicsPipeline( const vk::RenderPass& renderpass, vk::PipelineLayout pipelineLayout, DeletionQueue& deletor, vk::PipelineCache pipelineCache ) 
 {
     assert( hasInit );
     m_graphicsPipelineInfo.setLayout( pipelineLayout );
@@ -161,7 +224,7 @@ void GraphicsPipeline::createGraphicsPipeline( const vk::RenderPass& renderpass,
     m_graphicsPipelineInfo.setBasePipelineHandle      ( nullptr                    );
     m_graphicsPipelineInfo.setBasePipelineIndex       ( 0                          );
 
-    auto success = device.createGraphicsPipeline( nullptr, m_graphicsPipelineInfo );
+    auto success = device.createGraphicsPipeline( pipelineCache, m_graphicsPipelineInfo );
     if( success.result == vk::Result::eSuccess )
     {
         m_graphicsPipeline = success.value;
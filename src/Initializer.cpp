@@ -2,6 +2,8 @@
 
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <cstring>
 
 #include <GLFW/glfw3.h>
 
@@ -81,12 +83,17 @@ std::vector<const char*> getValidationLayers()
     return { "VK_LAYER_KHRONOS_validation" };
 }
 
-std::vector<const char*> getRequiredExtensions() {
-    uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+std::vector<const char*> getRequiredExtensions( bool headless ) {
+    std::vector<const char*> extensions;
 
-    std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    if( !headless )
+    {
+        uint32_t glfwExtensionCount = 0;
+        const char** glfwExtensions;
+        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
 
     extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 
@@ -122,6 +129,14 @@ void DestroyDebugUtilsMessengerEXT(
         func( instance, debugMessenger, pAllocator );
 }
 
+bool HasDeviceExtension( const vk::PhysicalDevice& physicalDevice, const char* extensionName )
+{
+    auto deviceExtensions = physicalDevice.enumerateDeviceExtensionProperties();
+    return std::any_of( deviceExtensions.begin(), deviceExtensions.end(),
+        [extensionName]( const vk::ExtensionProperties& ext ){ return strcmp( ext.extensionName, extensionName ) == 0; }
+    );
+}
+
 bool IsDeviceSuitable(  const vk::PhysicalDevice& physicalDevice,
                         const vk::SurfaceKHR& surface )
 {
@@ -138,6 +153,19 @@ QueueFamilyIndices FindQueueFamilyIndices(  const vk::PhysicalDevice& physicalDe
     size_t i = 0;
     for( const auto& q : queueFamilies )
     {
+        // headless, no need to present
+        if( !surface )
+        {
+            if( q.queueCount > 0 && q.queueFlags & vk::QueueFlagBits::eGraphics )
+            {
+                queueFamilyIndices.graphicsFamily = i;
+                queueFamilyIndices.presentFamily = i;
+                break;
+            }
+            ++i;
+            continue;
+        }
+
         // if graphics and present queue family are the same index
         if( q.queueCount > 0 
             && q.queueFlags & vk::QueueFlagBits::eGraphics
@@ -225,19 +253,19 @@ namespace utils
             return surfaceFormats[0];
         }
 
-        vk::PresentModeKHR choosePresentMode(std::vector<vk::PresentModeKHR>& presentModes) 
+        vk::PresentModeKHR choosePresentMode(std::vector<vk::PresentModeKHR>& presentModes, vk::PresentModeKHR preferred) 
         {
             // choose the present mode
             for( auto& presentMode : presentModes )
             {
-                if( presentMode == vk::PresentModeKHR::eFifo )
+                if( presentMode == preferred )
                 {
                     return presentMode;
                 }
             }
 
-            // otherwise, just choose the available present mode
-            return presentModes[0];
+            // otherwise, FIFO is always available
+            return vk::PresentModeKHR::eFifo;
         }
     }
 
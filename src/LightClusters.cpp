@@ -0,0 +1,267 @@
+#include "LightClusters.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <glm/glm.hpp>
+
+#include "Initializer.hpp"
+#include "Vulkan_Init.hpp"
+
+#ifndef ENGINE_CATCH
+#define ENGINE_CATCH                            \
+    catch( const vk::SystemError& err )         \
+    {                                           \
+        throw std::runtime_error( err.what() ); \
+    }
+#endif
+
+namespace
+{
+constexpr uint32_t AssignGroupSize = 64;    // local_size_x of light_cluster.comp
+constexpr uint32_t StatsCount = 4;          // lightIndices, maxClusterLights, overflowedClusters, padding
+
+AllocatedBuffer createLightIndexBuffer( vma::Allocator allocator, uint32_t capacity )
+{
+    return AllocatedBuffer::createBuffer( capacity * sizeof( uint32_t ),
+        vk::BufferUsageFlagBits::eStorageBuffer, allocator, vma::MemoryUsage::eGpuOnly );
+}
+} // namespace
+
+void LightClusters::init( vk::Device device, vma::Allocator allocator, DescriptorLayoutCache& layoutCache, vk::PipelineCache pipelineCache )
+{
+    m_device = device;
+    m_allocator = allocator;
+    m_layoutCache = &layoutCache;
+
+    createPipeline( pipelineCache );
+
+    /**
+     * @brief The clusters have a fixed size, the light buffer and the light index pool grow (in prepare)
+     */
+    for( auto& frame : m_frames )
+    {
+        frame.clusterBuffer = AllocatedBuffer::createBuffer( ClusterCount * 2 * sizeof( uint32_t ),
+            vk::BufferUsageFlagBits::eStorageBuffer, m_allocator, vma::MemoryUsage::eGpuOnly );
+        frame.lightIndexCapacity = MinLightIndices;
+        frame.lightIndexBuffer = createLightIndexBuffer( m_allocator, frame.lightIndexCapacity );
+        frame.statsBuffer = AllocatedBuffer::createBuffer( StatsCount * sizeof( uint32_t ),
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, m_allocator, vma::MemoryUsage::eGpuToCpu );
+        frame.stats = reinterpret_cast<uint32_t*>( m_allocator.mapMemory( frame.statsBuffer.allocation ) );
+    }
+}
+
+void LightClusters::destroy()
+{
+    for( auto& frame : m_frames )
+    {
+        for( auto* buffer : { &frame.lightBuffer, &frame.statsBuffer } )
+        {
+            if( !buffer->buffer )
+                continue;
+            m_allocator.unmapMemory( buffer->allocation );
+            m_allocator.destroyBuffer( buffer->buffer, buffer->allocation );
+        }
+        for( auto* buffer : { &frame.clusterBuffer, &frame.lightIndexBuffer } )
+        {
+            if( buffer->buffer )
+                m_allocator.destroyBuffer( buffer->buffer, buffer->allocation );
+        }
+        frame = FrameBuffers{};
+    }
+
+    m_deletionQueue.flush();
+}
+
+void LightClusters::createPipeline( vk::PipelineCache pipelineCache )
+{
+    const auto compute = vk::ShaderStageFlagBits::eCompute;
+    m_setLayout = m_layoutCache->createLayout( {
+        init::dsc::initDescriptorSetLayoutBinding( 0, vk::DescriptorType::eStorageBuffer, compute ),      // lights
+        init::dsc::initDescriptorSetLayoutBinding( 1, vk::DescriptorType::eStorageBuffer, compute ),      // clusters
+        init::dsc::initDescriptorSetLayoutBinding( 2, vk::DescriptorType::eStorageBuffer, compute ),      // light indices
+        init::dsc::initDescriptorSetLayoutBinding( 3, vk::DescriptorType::eStorageBuffer, compute ),      // stats
+    } );
+
+    vk::PushConstantRange pushConstant { compute, 0, sizeof( AssignPushConstant ) };
+    vk::PipelineLayoutCreateInfo layoutInfo {};
+    layoutInfo.setSetLayouts( m_setLayout );
+    layoutInfo.setPushConstantRanges( pushConstant );
+
+    auto module = utils::gp::createShaderModule( m_device, utils::gp::readFile( "shaders/light_cluster.spv" ) );
+    vk::PipelineShaderStageCreateInfo stage {};
+    stage.setStage( compute );
+    stage.setModule( module.get() );
+    stage.setPName( "main" );
+
+    try
+    {
+        m_layout = m_device.createPipelineLayout( layoutInfo );
+
+        vk::ComputePipelineCreateInfo pipelineInfo {};
+        pipelineInfo.setStage( stage );
+        pipelineInfo.setLayout( m_layout );
+        auto result = m_device.createComputePipeline( pipelineCache, pipelineInfo );
+        if( result.result != vk::Result::eSuccess )
+            throw std::runtime_error( "Failed to create the compute pipeline of shaders/light_cluster.spv" );
+        m_pipeline = result.value;
+    } ENGINE_CATCH
+
+    m_deletionQueue.pushFunction(
+        [d = m_device, l = m_layout, p = m_pipeline](){
+            d.destroyPipeline( p );
+            d.destroyPipelineLayout( l );
+        }
+    );
+}
+
+glm::vec4 LightClusters::clusterScale( vk::Extent2D renderExtent, float zNear, float zFar )
+{
+    // slice = log( depth / near ) / log( far / near ) * ClusterZ
+    const float sliceScale = static_cast<float>( ClusterZ ) / std::log( zFar / zNear );
+    return glm::vec4{
+        static_cast<float>( ClusterX ) / static_cast<float>( std::max( renderExtent.width, 1U ) ),
+        static_cast<float>( ClusterY ) / static_cast<float>( std::max( renderExtent.height, 1U ) ),
+        sliceScale,
+        -std::log( zNear ) * sliceScale
+    };
+}
+
+void LightClusters::prepare( uint32_t frameIndex, vk::DescriptorSet globalSet, const std::vector<Light>& lights, const glm::mat4& view, const glm::mat4& viewproj )
+{
+    auto& frame = m_frames[frameIndex];
+
+    /**
+     * @brief The stats of the last recording of this slot (its fence has been waited)
+     */
+    if( frame.recorded )
+    {
+        m_allocator.invalidateAllocation( frame.statsBuffer.allocation, 0, VK_WHOLE_SIZE );
+        m_stats.lights = frame.totalLights;
+        m_stats.visibleLights = frame.lightCount;
+        m_stats.lightIndices = frame.stats[0];
+        m_stats.lightIndexCapacity = frame.lightIndexCapacity;
+        m_stats.maxClusterLights = frame.stats[1];
+        m_stats.overflowedClusters = frame.stats[2];
+    }
+
+    /**
+     * @brief Growth (doubling) of the light index pool, when the last recording of this slot didn't fit
+     * The slot's fence has been waited, the GPU is done with the old pool
+     */
+    bool writeSet = !frame.lightBuffer.buffer;
+    if( frame.recorded && frame.stats[0] > frame.lightIndexCapacity )
+    {
+        m_allocator.destroyBuffer( frame.lightIndexBuffer.buffer, frame.lightIndexBuffer.allocation );
+        frame.lightIndexCapacity = std::max( frame.lightIndexCapacity * 2, frame.stats[0] );
+        frame.lightIndexBuffer = createLightIndexBuffer( m_allocator, frame.lightIndexCapacity );
+        writeSet = true;
+    }
+
+    /**
+     * @brief The lights in the view frustum, in view space
+     * A light is a sphere of its range (a spot too, its cone is tested by the clusters)
+     */
+    Frustum frustum = Frustum::fromViewProjection( viewproj );
+    m_visible.clear();
+    for( const auto& light : lights )
+    {
+        bool inside = true;
+        for( const auto& plane : frustum.planes )
+            inside = inside && glm::dot( glm::vec3{ plane }, light.position ) + plane.w >= -light.range;
+        if( !inside )
+            continue;
+
+        const bool spot = light.outerAngle > 0.0f;
+        GpuLight gpuLight;
+        gpuLight.positionRange = glm::vec4{ glm::vec3{ view * glm::vec4{ light.position, 1.0f } }, light.range };
+        gpuLight.colorCosInner = glm::vec4{ light.color * light.intensity, spot ? std::cos( light.innerAngle ) : -2.0f };
+        gpuLight.directionCosOuter = spot
+            ? glm::vec4{ glm::normalize( glm::vec3{ view * glm::vec4{ light.direction, 0.0f } } ), std::cos( light.outerAngle ) }
+            : glm::vec4{ 0.0f, 0.0f, -1.0f, -2.0f };
+        m_visible.push_back( gpuLight );
+    }
+
+    /**
+     * @brief Growth (doubling) of the light buffer, it's not used by the GPU anymore
+     */
+    if( m_visible.size() > frame.lightCapacity || !frame.lightBuffer.buffer )
+    {
+        if( frame.lightBuffer.buffer )
+        {
+            m_allocator.unmapMemory( frame.lightBuffer.allocation );
+            m_allocator.destroyBuffer( frame.lightBuffer.buffer, frame.lightBuffer.allocation );
+        }
+        frame.lightCapacity = std::max<size_t>( std::max<size_t>( frame.lightCapacity * 2, m_visible.size() ), 256 );
+        frame.lightBuffer = AllocatedBuffer::createBuffer( frame.lightCapacity * sizeof( GpuLight ),
+            vk::BufferUsageFlagBits::eStorageBuffer, m_allocator, vma::MemoryUsage::eCpuToGpu );
+        frame.lights = reinterpret_cast<GpuLight*>( m_allocator.mapMemory( frame.lightBuffer.allocation ) );
+        writeSet = true;
+    }
+
+    if( !m_visible.empty() )
+        std::memcpy( frame.lights, m_visible.data(), m_visible.size() * sizeof( GpuLight ) );
+    frame.lightCount = static_cast<uint32_t>( m_visible.size() );
+    frame.totalLights = static_cast<uint32_t>( lights.size() );
+
+    /**
+     * @brief Point the global set of this frame to the buffers (binding 2, 3, 4 of material.frag)
+     */
+    if( writeSet )
+    {
+        vk::DescriptorBufferInfo lightInfo { frame.lightBuffer.buffer, 0, VK_WHOLE_SIZE };
+        vk::DescriptorBufferInfo clusterInfo { frame.clusterBuffer.buffer, 0, VK_WHOLE_SIZE };
+        vk::DescriptorBufferInfo indexInfo { frame.lightIndexBuffer.buffer, 0, VK_WHOLE_SIZE };
+        std::array<vk::WriteDescriptorSet, 3> setWrite = {
+            vk::WriteDescriptorSet{ globalSet, 2, 0, vk::DescriptorType::eStorageBuffer, nullptr, lightInfo, nullptr },
+            vk::WriteDescriptorSet{ globalSet, 3, 0, vk::DescriptorType::eStorageBuffer, nullptr, clusterInfo, nullptr },
+            vk::WriteDescriptorSet{ globalSet, 4, 0, vk::DescriptorType::eStorageBuffer, nullptr, indexInfo, nullptr }
+        };
+        m_device.updateDescriptorSets( setWrite, nullptr );
+    }
+}
+
+void LightClusters::recordAssign( vk::CommandBuffer cmd, uint32_t frameIndex, const glm::mat4& projection, vk::Extent2D renderExtent,
+                                  float zNear, float zFar, DescriptorAllocator& transientDescriptors )
+{
+    auto& frame = m_frames[frameIndex];
+
+    /**
+     * @brief Reset the counts
+     */
+    cmd.fillBuffer( frame.statsBuffer.buffer, 0, VK_WHOLE_SIZE, 0 );
+    vk::MemoryBarrier barrier { vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+    cmd.pipelineBarrier( vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr );
+    frame.recorded = true;
+
+    /**
+     * @brief Assign, one work group per cluster
+     */
+    vk::DescriptorSet set;
+    vk::DescriptorBufferInfo lightInfo { frame.lightBuffer.buffer, 0, VK_WHOLE_SIZE };
+    vk::DescriptorBufferInfo clusterInfo { frame.clusterBuffer.buffer, 0, VK_WHOLE_SIZE };
+    vk::DescriptorBufferInfo indexInfo { frame.lightIndexBuffer.buffer, 0, VK_WHOLE_SIZE };
+    vk::DescriptorBufferInfo statsInfo { frame.statsBuffer.buffer, 0, VK_WHOLE_SIZE };
+    DescriptorBuilder::begin( *m_layoutCache, transientDescriptors )
+        .bindBuffer( 0, lightInfo, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute )
+        .bindBuffer( 1, clusterInfo, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute )
+        .bindBuffer( 2, indexInfo, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute )
+        .bindBuffer( 3, statsInfo, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute )
+        .build( set );
+
+    AssignPushConstant push {};
+    push.inverseProjection = glm::inverse( projection );
+    push.renderSize[0] = static_cast<float>( renderExtent.width );
+    push.renderSize[1] = static_cast<float>( renderExtent.height );
+    push.zNear = zNear;
+    push.zFar = zFar;
+    push.lightCount = frame.lightCount;
+    push.lightIndexCapacity = frame.lightIndexCapacity;
+
+    cmd.bindPipeline( vk::PipelineBindPoint::eCompute, m_pipeline );
+    cmd.bindDescriptorSets( vk::PipelineBindPoint::eCompute, m_layout, 0, set, nullptr );
+    cmd.pushConstants<AssignPushConstant>( m_layout, vk::ShaderStageFlagBits::eCompute, 0, push );
+    // every cluster is written, the ones without light get a count of 0
+    cmd.dispatch( ClusterX, ClusterY, ClusterZ );
+}
@@ -0,0 +1,111 @@
+#include "MaterialVariants.hpp"
+
+#include "Mesh.hpp"
+#include "utils.hpp"
+
+#ifndef ENGINE_CATCH
+#define ENGINE_CATCH                            \
+    catch( const vk::SystemError& err )         \
+    {                                           \
+        throw std::runtime_error( err.what() ); \
+    }
+#endif
+
+void MaterialVariants::init( vk::Device device, vk::RenderPass renderPass, vk::Extent2D extent, 
+    const std::vector<vk::DescriptorSetLayout>& setLayouts, DeletionQueue& deletor )
+{
+    m_device = device;
+    m_renderPass = renderPass;
+    m_extent = extent;
+
+    /**
+     * @brief The layout of every variant
+     * The textures are bindless, so the variants without texture have the same layout as the textured ones,
+     * and the sets don't have to be bound again when the pipeline changes
+     */
+    vk::PushConstantRange pushConstant {};
+    pushConstant.setOffset( 0 );
+    pushConstant.setSize( sizeof( MeshPushConstant ) );
+    pushConstant.setStageFlags( vk::ShaderStageFlagBits::eVertex );
+
+    vk::PipelineLayoutCreateInfo layoutInfo {};
+    layoutInfo.setSetLayouts( setLayouts );
+    layoutInfo.setPushConstantRanges( pushConstant );
+    try
+    {
+        m_layout = m_device.createPipelineLayout( layoutInfo );
+    } ENGINE_CATCH
+    deletor.pushFunction(
+        [d = m_device, l = m_layout](){
+            d.destroyPipelineLayout( l );
+        }
+    );
+}
+
+void MaterialVariants::request( uint32_t features, PipelineBuildQueue& buildQueue )
+{
+    if( m_variants.count( features ) > 0 )
+        return;
+
+    Entry entry;
+    entry.layout = m_layout;
+
+    auto configure = [features]( GraphicsPipeline& builder ){
+        builder.m_vertexInputDesc = Vertex::getVertexInputDescription();
+        builder.m_vertexInputStateInfo.setVertexBindingDescriptions( builder.m_vertexInputDesc.bindings );
+        builder.m_vertexInputStateInfo.setVertexAttributeDescriptions( builder.m_vertexInputDesc.attributs );
+
+        builder.m_useDepthStencil = true;
+        builder.m_depthStencilStateInfo = GraphicsPipeline::createDepthStencilInfo( true, true, vk::CompareOp::eLessOrEqual );
+
+        // constant_id 0 of material.frag
+        vk::SpecializationMapEntry entry { 0, 0, sizeof(uint32_t) };
+        builder.setSpecializationInfo( vk::ShaderStageFlagBits::eFragment, vk::SpecializationInfo{ 1, &entry, sizeof(uint32_t), &features } );
+    };
+
+    PipelineDescription description { name( features ), "shaders/vertex_shader.spv", "shaders/material.spv", m_renderPass, entry.layout, m_extent, configure };
+    entry.pipeline = buildQueue.push( std::move( description ) ).share();
+
+    // the depth is already written by the prepass, so only the nearest fragment passes and it doesn't write again
+    PipelineDescription equalDescription { name( features ) + " (after prepass)", "shaders/vertex_shader.spv", "shaders/material.spv", m_renderPass, entry.layout, m_extent, 
+        [configure]( GraphicsPipeline& builder ){
+            configure( builder );
+            builder.m_depthStencilStateInfo = GraphicsPipeline::createDepthStencilInfo( true, false, vk::CompareOp::eEqual );
+        }
+    };
+    entry.equalPipeline = buildQueue.push( std::move( equalDescription ) ).share();
+
+    if( !m_depthPipeline.valid() )
+    {
+        PipelineDescription depthDescription { "depth prepass", "shaders/depth_only.spv", "", m_renderPass, m_layout, m_extent, 
+            []( GraphicsPipeline& builder ){
+                builder.m_vertexInputDesc = Vertex::getVertexInputDescription();
+                builder.makeDepthOnly();
+            }
+        };
+        m_depthPipeline = buildQueue.push( std::move( depthDescription ) ).share();
+    }
+
+    m_variants.emplace( features, std::move( entry ) );
+}
+
+MaterialVariants::Variant MaterialVariants::get( uint32_t features ) const
+{
+    auto found = m_variants.find( features );
+    if( found == m_variants.end() )
+        throw std::runtime_error( "The material variant (" + name( features ) + ") has not been requested" );
+
+    return { found->second.layout, found->second.pipeline.get(), found->second.equalPipeline.get(), m_depthPipeline.get() };
+}
+
+std::string MaterialVariants::name( uint32_t features )
+{
+    std::string name = "material";
+    if( features & MaterialTextured )   name += " textured";
+    if( features & MaterialAmbient )    name += " ambient";
+    if( features & MaterialFog )        name += " fog";
+    if( features & MaterialLights )     name += " lights";
+    if( features & MaterialSun )        name += " sun";
+
+    return name;
+}
@@ -0,0 +1,100 @@
+#include "MemoryMonitor.hpp"
+
+#include <array>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+
+void MemoryMonitor::init( vma::Allocator allocator, vk::PhysicalDevice physicalDevice, bool budgetExtension )
+{
+    m_allocator = allocator;
+    m_budgetExtension = budgetExtension;
+
+    auto memoryProperties = physicalDevice.getMemoryProperties();
+    m_heaps.resize( memoryProperties.memoryHeapCount );
+    for( uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i )
+    {
+        m_heaps[i].size = memoryProperties.memoryHeaps[i].size;
+        m_heaps[i].deviceLocal = static_cast<bool>( memoryProperties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal );
+    }
+
+    // the first update also calculates the statistics
+    m_updateCount = 0;
+    update();
+}
+
+void MemoryMonitor::setWarningThresholds( std::vector<double> fractions )
+{
+    std::sort( fractions.begin(), fractions.end() );
+    m_thresholds = std::move( fractions );
+    for( auto& heap : m_heaps )
+        heap.warningLevel = 0;
+}
+
+void MemoryMonitor::update()
+{
+    std::array<vma::Budget, VK_MAX_MEMORY_HEAPS> budgets;
+    m_allocator.getBudget( budgets.data() );
+    for( uint32_t i = 0; i < m_heaps.size(); ++i )
+    {
+        m_heaps[i].budget = budgets[i].budget;
+        m_heaps[i].usage = budgets[i].usage;
+        m_heaps[i].blockBytes = budgets[i].blockBytes;
+        m_heaps[i].allocationBytes = budgets[i].allocationBytes;
+        checkThresholds( i );
+    }
+
+    if( m_updateCount++ % m_statsInterval == 0 )
+    {
+        vma::Stats stats = m_allocator.calculateStats();
+        for( uint32_t i = 0; i < m_heaps.size(); ++i )
+        {
+            m_heaps[i].blockCount = stats.memoryHeap[i].blockCount;
+            m_heaps[i].allocationCount = stats.memoryHeap[i].allocationCount;
+            m_heaps[i].unusedBytes = stats.memoryHeap[i].unusedBytes;
+        }
+    }
+}
+
+void MemoryMonitor::checkThresholds( uint32_t heapIndex )
+{
+    auto& heap = m_heaps[heapIndex];
+    if( heap.budget == 0 )
+        return;
+
+    double fraction = static_cast<double>( heap.usage ) / heap.budget;
+    size_t level = 0;
+    while( level < m_thresholds.size() && fraction >= m_thresholds[level] )
+        ++level;
+
+    // only warn when the usage goes up past a threshold, going down just rearms it
+    if( level > heap.warningLevel )
+    {
+        char message[160];
+        snprintf( message, sizeof(message), "Memory warning: heap %u%s uses %.0f%% of its budget (%.1f / %.1f MiB)",
+            heapIndex, heap.deviceLocal ? " (device local)" : "", fraction * 100.0, heap.usage / 1048576.0, heap.budget / 1048576.0 );
+        std::cerr << message << "\n";
+    }
+    heap.warningLevel = level;
+}
+
+bool MemoryMonitor::dumpJson( const std::string& filename ) const
+{
+    char* statsString = nullptr;
+    vmaBuildStatsString( static_cast<VmaAllocator>( m_allocator ), &statsString, VK_TRUE );
+
+    std::ofstream file( filename );
+    if( file )
+        file << statsString;
+    vmaFreeStatsString( static_cast<VmaAllocator>( m_allocator ), statsString );
+
+    if( !file )
+    {
+        std::cerr << "Failed to write " << filename << "\n";
+        return false;
+    }
+
+    std::cout << "VMA statistics written to " << filename << "\n";
+    return true;
+}
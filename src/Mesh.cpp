@@ -80,4 +80,25 @@ bool Mesh::loadFromObj(const std::string& filename)
         }
 
         return true;
+}
+
+void Mesh::computeBounds() 
+{
+    if( vertices.empty() )
+        return;
+
+    glm::vec3 minPos = vertices[0].position;
+    glm::vec3 maxPos = vertices[0].position;
+    for( const auto& vertex : vertices )
+    {
+        minPos = glm::min( minPos, vertex.position );
+        maxPos = glm::max( maxPos, vertex.position );
+    }
+
+    glm::vec3 center = ( minPos + maxPos ) * 0.5f;
+    float radius = 0.0f;
+    for( const auto& vertex : vertices )
+        radius = std::max( radius, glm::length( vertex.position - center ) );
+
+    bounds = glm::vec4{ center, radius };
 }
\ No newline at end of file
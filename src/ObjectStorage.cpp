@@ -0,0 +1,97 @@
+#include "ObjectStorage.hpp"
+
+#include <algorithm>
+
+void ObjectStorage::init( vma::Allocator allocator, vk::Device device, size_t initialCapacity, size_t maxCapacity )
+{
+    m_allocator = allocator;
+    m_device = device;
+    m_maxCapacity = std::max( maxCapacity, MinCapacity );
+    m_targetCapacity = std::clamp( initialCapacity, MinCapacity, m_maxCapacity );
+}
+
+void ObjectStorage::destroy()
+{
+    for( auto& frame : m_frames )
+        release( frame );
+}
+
+void ObjectStorage::reserve( size_t objectCount )
+{
+    if( objectCount > m_maxCapacity )
+        throw std::runtime_error( "The number of objects (" + std::to_string( objectCount ) + ") is more than the object storage limit (" + std::to_string( m_maxCapacity ) + ")" );
+
+    /**
+     * @brief Growing: double the capacity until it's enough
+     * Shrinking: halve the capacity when less than a quarter is used,
+     * the gap between them avoid reallocating every frame when the count goes up and down around the capacity
+     */
+    size_t capacity = m_targetCapacity;
+    while( capacity < objectCount )
+        capacity *= 2;
+    while( capacity > MinCapacity && objectCount < capacity / 4 )
+        capacity /= 2;
+
+    m_targetCapacity = std::clamp( capacity, MinCapacity, m_maxCapacity );
+}
+
+bool ObjectStorage::update( uint32_t frameIndex, vk::DescriptorSet objectSet )
+{
+    auto& frame = m_frames[frameIndex];
+    if( frame.capacity == m_targetCapacity )
+        return false;
+
+    // the fence of this frame has been waited, so nobody use the old buffers
+    release( frame );
+
+    frame.capacity = m_targetCapacity;
+    frame.objectBuffer = AllocatedBuffer::createBuffer(
+        sizeof(GpuObjectData) * frame.capacity,
+        vk::BufferUsageFlagBits::eStorageBuffer,
+        m_allocator,
+        vma::MemoryUsage::eCpuToGpu
+    );
+    frame.instanceBuffer = AllocatedBuffer::createBuffer(
+        sizeof(uint32_t) * InstanceSlots * frame.capacity,
+        vk::BufferUsageFlagBits::eStorageBuffer,
+        m_allocator,
+        vma::MemoryUsage::eCpuToGpu
+    );
+    frame.objectData = reinterpret_cast<GpuObjectData*>( m_allocator.mapMemory( frame.objectBuffer.allocation ) );
+    frame.instanceData = reinterpret_cast<uint32_t*>( m_allocator.mapMemory( frame.instanceBuffer.allocation ) );
+
+    /**
+     * @brief Point the descriptor set to the new buffers
+     */
+    vk::DescriptorBufferInfo objectBuffInfo { frame.objectBuffer.buffer, 0, VK_WHOLE_SIZE };
+    vk::DescriptorBufferInfo instanceBuffInfo { frame.instanceBuffer.buffer, 0, VK_WHOLE_SIZE };
+    std::array<vk::WriteDescriptorSet, 2> setWrite = {
+        vk::WriteDescriptorSet{ objectSet, 0, 0, vk::DescriptorType::eStorageBuffer, nullptr, objectBuffInfo, nullptr },
+        vk::WriteDescriptorSet{ objectSet, 1, 0, vk::DescriptorType::eStorageBuffer, nullptr, instanceBuffInfo, nullptr }
+    };
+    m_device.updateDescriptorSets( setWrite, nullptr );
+
+    return true;
+}
+
+vk::DeviceSize ObjectStorage::reservedBytes() const
+{
+    vk::DeviceSize bytes = 0;
+    for( const auto& frame : m_frames )
+        bytes += frame.capacity * ( sizeof(GpuObjectData) + sizeof(uint32_t) * InstanceSlots );
+
+    return bytes;
+}
+
+void ObjectStorage::release( FrameBuffers& frame )
+{
+    if( frame.capacity == 0 )
+        return;
+
+    m_allocator.unmapMemory( frame.objectBuffer.allocation );
+    m_allocator.unmapMemory( frame.instanceBuffer.allocation );
+    m_allocator.destroyBuffer( frame.objectBuffer.buffer, frame.objectBuffer.allocation );
+    m_allocator.destroyBuffer( frame.instanceBuffer.buffer, frame.instanceBuffer.allocation );
+
+    frame = FrameBuffers{};
+}
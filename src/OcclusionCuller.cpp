@@ -0,0 +1,439 @@
+#include "OcclusionCuller.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "Initializer.hpp"
+#include "Vulkan_Init.hpp"
+
+#ifndef ENGINE_CATCH
+#define ENGINE_CATCH                            \
+    catch( const vk::SystemError& err )         \
+    {                                           \
+        throw std::runtime_error( err.what() ); \
+    }
+#endif
+
+namespace
+{
+constexpr uint32_t CullGroupSize = 64;      // local_size_x of occlusion_cull.comp
+constexpr uint32_t ReduceGroupSize = 8;     // local_size_x/y of hzb_reduce.comp
+constexpr uint32_t StatsCount = 4;          // phase1Objects, phase2Objects, occludedObjects, padding
+
+uint32_t levelCount( vk::Extent2D extent )
+{
+    return static_cast<uint32_t>( std::floor( std::log2( std::max( extent.width, extent.height ) ) ) ) + 1;
+}
+
+vk::Extent2D levelExtent( vk::Extent2D extent, uint32_t level )
+{
+    return { std::max( extent.width >> level, 1U ), std::max( extent.height >> level, 1U ) };
+}
+} // namespace
+
+bool OcclusionCuller::isSupported( vk::PhysicalDevice physicalDevice )
+{
+    return physicalDevice.getFeatures().drawIndirectFirstInstance;
+}
+
+void OcclusionCuller::init( vk::Device device, vma::Allocator allocator, DescriptorLayoutCache& layoutCache, vk::PipelineCache pipelineCache )
+{
+    m_device = device;
+    m_allocator = allocator;
+    m_layoutCache = &layoutCache;
+
+    /**
+     * @brief The sampler of the depth image and the HZB, they're read with texelFetch, so it's just nearest and clamped
+     */
+    vk::SamplerCreateInfo samplerInfo {};
+    samplerInfo.setMagFilter( vk::Filter::eNearest );
+    samplerInfo.setMinFilter( vk::Filter::eNearest );
+    samplerInfo.setMipmapMode( vk::SamplerMipmapMode::eNearest );
+    samplerInfo.setAddressModeU( vk::SamplerAddressMode::eClampToEdge );
+    samplerInfo.setAddressModeV( vk::SamplerAddressMode::eClampToEdge );
+    samplerInfo.setAddressModeW( vk::SamplerAddressMode::eClampToEdge );
+    samplerInfo.setMaxLod( VK_LOD_CLAMP_NONE );
+    try
+    {
+        m_sampler = m_device.createSampler( samplerInfo );
+    } ENGINE_CATCH
+    m_deletionQueue.pushFunction(
+        [d = m_device, s = m_sampler](){
+            d.destroySampler( s );
+        }
+    );
+
+    createPipelines( pipelineCache );
+}
+
+void OcclusionCuller::destroy()
+{
+    for( auto& frame : m_frames )
+    {
+        for( auto* buffer : { &frame.candidateBuffer, &frame.drawBuffer, &frame.statsBuffer } )
+        {
+            if( !buffer->buffer )
+                continue;
+            m_allocator.unmapMemory( buffer->allocation );
+            m_allocator.destroyBuffer( buffer->buffer, buffer->allocation );
+        }
+        frame = FrameBuffers{};
+    }
+
+    if( m_visibilityBuffer.buffer )
+        m_allocator.destroyBuffer( m_visibilityBuffer.buffer, m_visibilityBuffer.allocation );
+    for( auto& retired : m_retiredBuffers )
+        m_allocator.destroyBuffer( retired.second.buffer, retired.second.allocation );
+    m_retiredBuffers.clear();
+
+    m_deletionQueue.flush();
+}
+
+void OcclusionCuller::createPipelines( vk::PipelineCache pipelineCache )
+{
+    /**
+     * @brief Set layouts
+     */
+    const auto compute = vk::ShaderStageFlagBits::eCompute;
+    m_cullSetLayout = m_layoutCache->createLayout( {
+        init::dsc::initDescriptorSetLayoutBinding( 0, vk::DescriptorType::eStorageBuffer, compute ),          // candidates
+        init::dsc::initDescriptorSetLayoutBinding( 1, vk::DescriptorType::eStorageBuffer, compute ),          // visibility
+        init::dsc::initDescriptorSetLayoutBinding( 2, vk::DescriptorType::eStorageBuffer, compute ),          // indirect draws
+        init::dsc::initDescriptorSetLayoutBinding( 3, vk::DescriptorType::eStorageBuffer, compute ),          // instances
+        init::dsc::initDescriptorSetLayoutBinding( 4, vk::DescriptorType::eStorageBuffer, compute ),          // stats
+        init::dsc::initDescriptorSetLayoutBinding( 5, vk::DescriptorType::eCombinedImageSampler, compute ),   // HZB
+    } );
+    m_reduceSetLayout = m_layoutCache->createLayout( {
+        init::dsc::initDescriptorSetLayoutBinding( 0, vk::DescriptorType::eCombinedImageSampler, compute ),   // depth image
+        init::dsc::initDescriptorSetLayoutBinding( 1, vk::DescriptorType::eCombinedImageSampler, compute ),   // HZB (the previous level)
+        init::dsc::initDescriptorSetLayoutBinding( 2, vk::DescriptorType::eStorageImage, compute ),           // HZB (the level being written)
+    } );
+
+    /**
+     * @brief Pipeline layouts and pipelines
+     */
+    auto createPipeline = [&]( const std::string& file, vk::DescriptorSetLayout setLayout, uint32_t pushSize, vk::PipelineLayout& outLayout, vk::Pipeline& outPipeline ){
+        vk::PushConstantRange pushConstant { compute, 0, pushSize };
+        vk::PipelineLayoutCreateInfo layoutInfo {};
+        layoutInfo.setSetLayouts( setLayout );
+        layoutInfo.setPushConstantRanges( pushConstant );
+
+        auto module = utils::gp::createShaderModule( m_device, utils::gp::readFile( file ) );
+        vk::PipelineShaderStageCreateInfo stage {};
+        stage.setStage( compute );
+        stage.setModule( module.get() );
+        stage.setPName( "main" );
+
+        try
+        {
+            outLayout = m_device.createPipelineLayout( layoutInfo );
+
+            vk::ComputePipelineCreateInfo pipelineInfo {};
+            pipelineInfo.setStage( stage );
+            pipelineInfo.setLayout( outLayout );
+            auto result = m_device.createComputePipeline( pipelineCache, pipelineInfo );
+            if( result.result != vk::Result::eSuccess )
+                throw std::runtime_error( "Failed to create the compute pipeline of " + file );
+            outPipeline = result.value;
+        } ENGINE_CATCH
+
+        m_deletionQueue.pushFunction(
+            [d = m_device, l = outLayout, p = outPipeline](){
+                d.destroyPipeline( p );
+                d.destroyPipelineLayout( l );
+            }
+        );
+    };
+
+    createPipeline( "shaders/occlusion_cull.spv", m_cullSetLayout, sizeof( CullPushConstant ), m_cullLayout, m_cullPipeline );
+    createPipeline( "shaders/hzb_reduce.spv", m_reduceSetLayout, sizeof( ReducePushConstant ), m_reduceLayout, m_reducePipeline );
+}
+
+void OcclusionCuller::createTargets( vk::Extent2D depthExtent, DeletionQueue& swapchainDeletor )
+{
+    m_hzbExtent = levelExtent( depthExtent, 1 );
+    const uint32_t levels = levelCount( m_hzbExtent );
+
+    auto imageInfo = init::image::initImageInfo(
+        vk::Format::eR32Sfloat,
+        vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+        vk::Extent3D{ m_hzbExtent.width, m_hzbExtent.height, 1 }
+    );
+    imageInfo.setMipLevels( levels );
+
+    vma::AllocationCreateInfo allocInfo {};
+    allocInfo.setUsage( vma::MemoryUsage::eGpuOnly );
+    {
+        auto temp = m_allocator.createImage( imageInfo, allocInfo );
+        m_hzbImage.image = temp.first;
+        m_hzbImage.allocation = temp.second;
+    }
+
+    auto viewInfo = init::image::initImageViewInfo( vk::Format::eR32Sfloat, m_hzbImage.image, vk::ImageAspectFlagBits::eColor );
+    viewInfo.subresourceRange.setLevelCount( levels );
+    try
+    {
+        m_hzbView = m_device.createImageView( viewInfo );
+
+        m_hzbLevelViews.resize( levels );
+        for( uint32_t level = 0; level < levels; ++level )
+        {
+            viewInfo.subresourceRange.setBaseMipLevel( level );
+            viewInfo.subresourceRange.setLevelCount( 1 );
+            m_hzbLevelViews[level] = m_device.createImageView( viewInfo );
+        }
+    } ENGINE_CATCH
+
+    m_hzbInitialized = false;
+
+    swapchainDeletor.pushFunction(
+        [d = m_device, a = m_allocator, i = m_hzbImage, v = m_hzbView, levelViews = m_hzbLevelViews](){
+            for( auto view : levelViews )
+                d.destroyImageView( view );
+            d.destroyImageView( v );
+            a.destroyImage( i.image, i.allocation );
+        }
+    );
+}
+
+void OcclusionCuller::prepare( uint32_t frameIndex, uint32_t objectCount, const std::vector<Candidate>& candidates,
+                               const std::vector<uint32_t>& vertexCounts, const std::vector<uint32_t>& firstInstances )
+{
+    auto& frame = m_frames[frameIndex];
+    ++m_prepareCount;
+
+    /**
+     * @brief The counts of the last recording of this slot (its fence has been waited)
+     */
+    if( frame.recorded )
+    {
+        m_allocator.invalidateAllocation( frame.statsBuffer.allocation, 0, VK_WHOLE_SIZE );
+        m_stats.candidates = frame.candidateCount;
+        m_stats.phase1Objects = frame.stats[0];
+        m_stats.phase2Objects = frame.stats[1];
+        m_stats.occludedObjects = frame.stats[2];
+    }
+
+    /**
+     * @brief The buffers that no frame in flight can use anymore
+     */
+    m_retiredBuffers.erase(
+        std::remove_if( m_retiredBuffers.begin(), m_retiredBuffers.end(), [this]( const std::pair<uint64_t, AllocatedBuffer>& retired ){
+            if( m_prepareCount < retired.first + FRAME_OVERLAP )
+                return false;
+            m_allocator.destroyBuffer( retired.second.buffer, retired.second.allocation );
+            return true;
+        } ),
+        m_retiredBuffers.end()
+    );
+
+    /**
+     * @brief Growth (doubling), the buffers of this frame slot are not used by the GPU anymore
+     */
+    auto grow = [this]( AllocatedBuffer& buffer, size_t& capacity, size_t needed, size_t elementSize, vk::BufferUsageFlags usage, void** outData ){
+        if( needed <= capacity && buffer.buffer )
+            return;
+        if( buffer.buffer )
+        {
+            m_allocator.unmapMemory( buffer.allocation );
+            m_allocator.destroyBuffer( buffer.buffer, buffer.allocation );
+        }
+        capacity = std::max<size_t>( std::max<size_t>( capacity * 2, needed ), 256 );
+        buffer = AllocatedBuffer::createBuffer( capacity * elementSize, usage, m_allocator, vma::MemoryUsage::eCpuToGpu );
+        *outData = m_allocator.mapMemory( buffer.allocation );
+    };
+
+    grow( frame.candidateBuffer, frame.candidateCapacity, candidates.size(), sizeof( Candidate ),
+        vk::BufferUsageFlagBits::eStorageBuffer, reinterpret_cast<void**>( &frame.candidates ) );
+    grow( frame.drawBuffer, frame.drawCapacity, vertexCounts.size() * 2, sizeof( vk::DrawIndirectCommand ),
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, reinterpret_cast<void**>( &frame.draws ) );
+    if( !frame.statsBuffer.buffer )
+    {
+        frame.statsBuffer = AllocatedBuffer::createBuffer( StatsCount * sizeof( uint32_t ),
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, m_allocator, vma::MemoryUsage::eGpuToCpu );
+        frame.stats = reinterpret_cast<uint32_t*>( m_allocator.mapMemory( frame.statsBuffer.allocation ) );
+    }
+
+    /**
+     * @brief The visibility is shared by the frames, a bigger one starts again with nothing visible (phase 2 draws everything once)
+     */
+    if( objectCount > m_visibilityCapacity || !m_visibilityBuffer.buffer )
+    {
+        if( m_visibilityBuffer.buffer )
+            retireBuffer( m_visibilityBuffer );
+        m_visibilityCapacity = std::max<size_t>( std::max<size_t>( m_visibilityCapacity * 2, objectCount ), 1024 );
+        m_visibilityBuffer = AllocatedBuffer::createBuffer( m_visibilityCapacity * sizeof( uint32_t ),
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, m_allocator, vma::MemoryUsage::eGpuOnly );
+        m_visibilityCleared = false;
+    }
+
+    /**
+     * @brief Candidates and the indirect draws of both phases (the instance counts are added by the GPU, except the blended ones)
+     */
+    m_candidateCount = static_cast<uint32_t>( candidates.size() );
+    m_drawCount = static_cast<uint32_t>( vertexCounts.size() );
+    frame.candidateCount = m_candidateCount;
+    std::memcpy( frame.candidates, candidates.data(), candidates.size() * sizeof( Candidate ) );
+    for( uint32_t phase = 0; phase < 2; ++phase )
+    {
+        for( uint32_t draw = 0; draw < m_drawCount; ++draw )
+        {
+            frame.draws[phase * m_drawCount + draw] = vk::DrawIndirectCommand{
+                vertexCounts[draw],                                 // vertex count
+                0,                                                  // instance count
+                0,                                                  // first vertex
+                phase * m_candidateCount + firstInstances[draw]     // first instance
+            };
+        }
+    }
+    for( const auto& candidate : candidates )
+    {
+        if( candidate.flags & CandidateBlended )
+            ++frame.draws[m_drawCount + candidate.draw].instanceCount;
+    }
+}
+
+void OcclusionCuller::recordCull( vk::CommandBuffer cmd, uint32_t frameIndex, uint32_t phase, const glm::mat4& viewproj, vk::Extent2D renderExtent,
+                                  vk::Buffer instanceBuffer, DescriptorAllocator& transientDescriptors )
+{
+    auto& frame = m_frames[frameIndex];
+
+    if( phase == 0 )
+    {
+        /**
+         * @brief Reset the counts (and the new visibility), and wait the visibility writes of the last frame
+         */
+        cmd.fillBuffer( frame.statsBuffer.buffer, 0, VK_WHOLE_SIZE, 0 );
+        if( !m_visibilityCleared )
+        {
+            cmd.fillBuffer( m_visibilityBuffer.buffer, 0, VK_WHOLE_SIZE, 0 );
+            m_visibilityCleared = true;
+        }
+        if( !m_hzbInitialized )
+        {
+            // phase 1 doesn't read the HZB, but it's bound, so it has to be in the layout of the descriptor
+            vk::ImageMemoryBarrier hzbBarrier {};
+            hzbBarrier.setOldLayout( vk::ImageLayout::eUndefined );
+            hzbBarrier.setNewLayout( vk::ImageLayout::eGeneral );
+            hzbBarrier.setDstAccessMask( vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite );
+            hzbBarrier.setSrcQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED );
+            hzbBarrier.setDstQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED );
+            hzbBarrier.setImage( m_hzbImage.image );
+            hzbBarrier.setSubresourceRange( { vk::ImageAspectFlagBits::eColor, 0, VK_REMAINING_MIP_LEVELS, 0, 1 } );
+            cmd.pipelineBarrier( vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, nullptr, hzbBarrier );
+            m_hzbInitialized = true;
+        }
+
+        vk::MemoryBarrier barrier {
+            vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eShaderWrite,
+            vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite
+        };
+        cmd.pipelineBarrier( vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader,
+            {}, barrier, nullptr, nullptr );
+        frame.recorded = true;
+    }
+
+    /**
+     * @brief Cull
+     */
+    vk::DescriptorSet set;
+    vk::DescriptorBufferInfo candidateInfo { frame.candidateBuffer.buffer, 0, VK_WHOLE_SIZE };
+    vk::DescriptorBufferInfo visibilityInfo { m_visibilityBuffer.buffer, 0, VK_WHOLE_SIZE };
+    vk::DescriptorBufferInfo drawInfo { frame.drawBuffer.buffer, 0, VK_WHOLE_SIZE };
+    vk::DescriptorBufferInfo instanceInfo { instanceBuffer, 0, VK_WHOLE_SIZE };
+    vk::DescriptorBufferInfo statsInfo { frame.statsBuffer.buffer, 0, VK_WHOLE_SIZE };
+    vk::DescriptorImageInfo hzbInfo { m_sampler, m_hzbView, vk::ImageLayout::eGeneral };
+    DescriptorBuilder::begin( *m_layoutCache, transientDescriptors )
+        .bindBuffer( 0, candidateInfo, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute )
+        .bindBuffer( 1, visibilityInfo, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute )
+        .bindBuffer( 2, drawInfo, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute )
+        .bindBuffer( 3, instanceInfo, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute )
+        .bindBuffer( 4, statsInfo, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute )
+        .bindImage( 5, hzbInfo, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eCompute )
+        .build( set );
+
+    vk::Extent2D hzbSize = levelExtent( renderExtent, 1 );
+    CullPushConstant push {};
+    push.viewproj = viewproj;
+    push.viewportSize[0] = static_cast<float>( renderExtent.width );
+    push.viewportSize[1] = static_cast<float>( renderExtent.height );
+    push.hzbSize[0] = static_cast<int32_t>( hzbSize.width );
+    push.hzbSize[1] = static_cast<int32_t>( hzbSize.height );
+    push.candidateCount = m_candidateCount;
+    push.drawCount = m_drawCount;
+    push.phase = phase;
+    push.hzbLevels = static_cast<int32_t>( std::min<size_t>( levelCount( hzbSize ), m_hzbLevelViews.size() ) );
+
+    cmd.bindPipeline( vk::PipelineBindPoint::eCompute, m_cullPipeline );
+    cmd.bindDescriptorSets( vk::PipelineBindPoint::eCompute, m_cullLayout, 0, set, nullptr );
+    cmd.pushConstants<CullPushConstant>( m_cullLayout, vk::ShaderStageFlagBits::eCompute, 0, push );
+    if( m_candidateCount > 0 )
+        cmd.dispatch( ( m_candidateCount + CullGroupSize - 1 ) / CullGroupSize, 1, 1 );
+}
+
+void OcclusionCuller::recordHzb( vk::CommandBuffer cmd, vk::ImageView depthView, vk::Extent2D renderExtent, DescriptorAllocator& transientDescriptors )
+{
+    /**
+     * @brief The HZB of the last frame has been read by its phase 2 (write after read, the execution dependency is enough)
+     * The depth of phase 1 is already readable, the render graph did it
+     */
+    vk::ImageMemoryBarrier hzbBarrier {};
+    hzbBarrier.setOldLayout( vk::ImageLayout::eGeneral );
+    hzbBarrier.setNewLayout( vk::ImageLayout::eGeneral );
+    hzbBarrier.setSrcAccessMask( vk::AccessFlagBits::eShaderRead );
+    hzbBarrier.setDstAccessMask( vk::AccessFlagBits::eShaderWrite );
+    hzbBarrier.setSrcQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED );
+    hzbBarrier.setDstQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED );
+    hzbBarrier.setImage( m_hzbImage.image );
+    hzbBarrier.setSubresourceRange( { vk::ImageAspectFlagBits::eColor, 0, VK_REMAINING_MIP_LEVELS, 0, 1 } );
+
+    cmd.pipelineBarrier( vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader,
+        {}, nullptr, nullptr, hzbBarrier );
+
+    /**
+     * @brief One dispatch per level, every level waits the one before
+     * Only the rendered part of the depth image (the render extent) is reduced
+     */
+    cmd.bindPipeline( vk::PipelineBindPoint::eCompute, m_reducePipeline );
+
+    vk::Extent2D srcSize = renderExtent;
+    vk::Extent2D usedSize = levelExtent( renderExtent, 1 );
+    const uint32_t levels = std::min<uint32_t>( levelCount( usedSize ), static_cast<uint32_t>( m_hzbLevelViews.size() ) );
+    for( uint32_t level = 0; level < levels; ++level )
+    {
+        vk::Extent2D dstSize = levelExtent( usedSize, level );
+
+        vk::DescriptorSet set;
+        vk::DescriptorImageInfo depthInfo { m_sampler, depthView, vk::ImageLayout::eShaderReadOnlyOptimal };
+        vk::DescriptorImageInfo hzbInfo { m_sampler, m_hzbView, vk::ImageLayout::eGeneral };
+        vk::DescriptorImageInfo levelInfo { nullptr, m_hzbLevelViews[level], vk::ImageLayout::eGeneral };
+        DescriptorBuilder::begin( *m_layoutCache, transientDescriptors )
+            .bindImage( 0, depthInfo, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eCompute )
+            .bindImage( 1, hzbInfo, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eCompute )
+            .bindImage( 2, levelInfo, vk::DescriptorType::eStorageImage, vk::ShaderStageFlagBits::eCompute )
+            .build( set );
+
+        ReducePushConstant push {};
+        push.srcSize[0] = static_cast<int32_t>( srcSize.width );
+        push.srcSize[1] = static_cast<int32_t>( srcSize.height );
+        push.dstSize[0] = static_cast<int32_t>( dstSize.width );
+        push.dstSize[1] = static_cast<int32_t>( dstSize.height );
+        push.srcLevel = static_cast<int32_t>( level ) - 1;
+
+        cmd.bindDescriptorSets( vk::PipelineBindPoint::eCompute, m_reduceLayout, 0, set, nullptr );
+        cmd.pushConstants<ReducePushConstant>( m_reduceLayout, vk::ShaderStageFlagBits::eCompute, 0, push );
+        cmd.dispatch( ( dstSize.width + ReduceGroupSize - 1 ) / ReduceGroupSize, ( dstSize.height + ReduceGroupSize - 1 ) / ReduceGroupSize, 1 );
+
+        // the next level (and the phase 2 cull after the last one) reads this level
+        vk::MemoryBarrier barrier { vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead };
+        cmd.pipelineBarrier( vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr );
+
+        srcSize = dstSize;
+    }
+}
+
+void OcclusionCuller::retireBuffer( AllocatedBuffer buffer )
+{
+    m_retiredBuffers.emplace_back( m_prepareCount, buffer );
+}
@@ -0,0 +1,322 @@
+#include "Overlay.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+#include "imgui.h"
+#include "Vulkan_Init.hpp"
+#include "GraphicsPipeline.hpp"
+
+void Overlay::init( vk::Device device, vma::Allocator allocator, vk::RenderPass renderPass, vk::PipelineCache pipelineCache )
+{
+    m_device = device;
+    m_allocator = allocator;
+    m_renderPass = renderPass;
+
+    ImGui::CreateContext();
+    ImGui::StyleColorsDark();
+    ImGui::GetIO().IniFilename = nullptr;   // don't write imgui.ini next to the executable
+
+    createFontTexture();
+    createPipeline( pipelineCache );
+}
+
+void Overlay::destroy()
+{
+    for( auto& geometry : m_geometry )
+    {
+        if( geometry.vertexCapacity > 0 )
+        {
+            m_allocator.unmapMemory( geometry.vertexBuffer.allocation );
+            m_allocator.destroyBuffer( geometry.vertexBuffer.buffer, geometry.vertexBuffer.allocation );
+        }
+        if( geometry.indexCapacity > 0 )
+        {
+            m_allocator.unmapMemory( geometry.indexBuffer.allocation );
+            m_allocator.destroyBuffer( geometry.indexBuffer.buffer, geometry.indexBuffer.allocation );
+        }
+        geometry = FrameGeometry{};
+    }
+
+    m_deletionQueue.flush();
+    ImGui::DestroyContext();
+}
+
+void Overlay::createFontTexture()
+{
+    /**
+     * @brief Font atlas, copied to the staging buffer here, and to the image by recordFontUpload()
+     */
+    unsigned char* pixels;
+    int width, height;
+    ImGui::GetIO().Fonts->GetTexDataAsRGBA32( &pixels, &width, &height );
+    size_t size = static_cast<size_t>( width ) * height * 4;
+
+    m_uploadBuffer = AllocatedBuffer::createBuffer( size, vk::BufferUsageFlagBits::eTransferSrc, m_allocator, vma::MemoryUsage::eCpuOnly );
+    void* data = m_allocator.mapMemory( m_uploadBuffer.allocation );
+    memcpy( data, pixels, size );
+    m_allocator.unmapMemory( m_uploadBuffer.allocation );
+
+    m_fontExtent = vk::Extent3D{ static_cast<uint32_t>( width ), static_cast<uint32_t>( height ), 1 };
+    auto imageInfo = init::image::initImageInfo( vk::Format::eR8G8B8A8Unorm, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled, m_fontExtent );
+
+    vma::AllocationCreateInfo imageAllocInfo {};
+    imageAllocInfo.setUsage( vma::MemoryUsage::eGpuOnly );
+    {
+        auto temp = m_allocator.createImage( imageInfo, imageAllocInfo );
+        m_fontImage.image = temp.first;
+        m_fontImage.allocation = temp.second;
+    }
+    m_fontImageView = m_device.createImageView( init::image::initImageViewInfo( vk::Format::eR8G8B8A8Unorm, m_fontImage.image, vk::ImageAspectFlagBits::eColor ) );
+
+    vk::SamplerCreateInfo samplerInfo {};
+    samplerInfo.setMagFilter( vk::Filter::eLinear );
+    samplerInfo.setMinFilter( vk::Filter::eLinear );
+    samplerInfo.setAddressModeU( vk::SamplerAddressMode::eClampToEdge );
+    samplerInfo.setAddressModeV( vk::SamplerAddressMode::eClampToEdge );
+    samplerInfo.setAddressModeW( vk::SamplerAddressMode::eClampToEdge );
+    m_fontSampler = m_device.createSampler( samplerInfo );
+
+    m_deletionQueue.pushFunction(
+        [d = m_device, a = m_allocator, i = m_fontImage, iv = m_fontImageView, s = m_fontSampler](){
+            d.destroySampler( s );
+            d.destroyImageView( iv );
+            a.destroyImage( i.image, i.allocation );
+        }
+    );
+
+    /**
+     * @brief The descriptor set of the font, it has its own pool because it's the only set of the overlay
+     */
+    vk::DescriptorPoolSize poolSize { vk::DescriptorType::eCombinedImageSampler, 1 };
+    vk::DescriptorPoolCreateInfo poolInfo {};
+    poolInfo.setMaxSets( 1 );
+    poolInfo.setPoolSizes( poolSize );
+    m_descriptorPool = m_device.createDescriptorPool( poolInfo );
+
+    vk::DescriptorSetLayoutBinding binding { 0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment };
+    vk::DescriptorSetLayoutCreateInfo setLayoutInfo {};
+    setLayoutInfo.setBindings( binding );
+    m_setLayout = m_device.createDescriptorSetLayout( setLayoutInfo );
+
+    m_deletionQueue.pushFunction(
+        [d = m_device, dp = m_descriptorPool, sl = m_setLayout](){
+            d.destroyDescriptorSetLayout( sl );
+            d.destroyDescriptorPool( dp );
+        }
+    );
+
+    vk::DescriptorSetAllocateInfo setAllocInfo {};
+    setAllocInfo.setDescriptorPool( m_descriptorPool );
+    setAllocInfo.setSetLayouts( m_setLayout );
+    m_fontSet = m_device.allocateDescriptorSets( setAllocInfo ).front();
+
+    vk::DescriptorImageInfo fontImageInfo { m_fontSampler, m_fontImageView, vk::ImageLayout::eShaderReadOnlyOptimal };
+    vk::WriteDescriptorSet setWrite { m_fontSet, 0, 0, vk::DescriptorType::eCombinedImageSampler, fontImageInfo, nullptr, nullptr };
+    m_device.updateDescriptorSets( setWrite, nullptr );
+
+    // there is only one texture, so the texture id is not used by render()
+    ImGui::GetIO().Fonts->SetTexID( reinterpret_cast<ImTextureID>( static_cast<VkDescriptorSet>( m_fontSet ) ) );
+}
+
+void Overlay::recordFontUpload( vk::CommandBuffer cmd )
+{
+    vk::ImageSubresourceRange range { vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 };
+
+    vk::ImageMemoryBarrier toTransfer {};
+    toTransfer.setOldLayout( vk::ImageLayout::eUndefined );
+    toTransfer.setNewLayout( vk::ImageLayout::eTransferDstOptimal );
+    toTransfer.setSrcAccessMask( {} );
+    toTransfer.setDstAccessMask( vk::AccessFlagBits::eTransferWrite );
+    toTransfer.setImage( m_fontImage.image );
+    toTransfer.setSubresourceRange( range );
+    cmd.pipelineBarrier( vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, toTransfer );
+
+    vk::BufferImageCopy copyRegion {};
+    copyRegion.setImageSubresource( vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, 0, 0, 1 } );
+    copyRegion.setImageExtent( m_fontExtent );
+    cmd.copyBufferToImage( m_uploadBuffer.buffer, m_fontImage.image, vk::ImageLayout::eTransferDstOptimal, copyRegion );
+
+    vk::ImageMemoryBarrier toRead = toTransfer;
+    toRead.setOldLayout( vk::ImageLayout::eTransferDstOptimal );
+    toRead.setNewLayout( vk::ImageLayout::eShaderReadOnlyOptimal );
+    toRead.setSrcAccessMask( vk::AccessFlagBits::eTransferWrite );
+    toRead.setDstAccessMask( vk::AccessFlagBits::eShaderRead );
+    cmd.pipelineBarrier( vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, {}, nullptr, nullptr, toRead );
+}
+
+void Overlay::releaseUploadBuffer()
+{
+    m_allocator.destroyBuffer( m_uploadBuffer.buffer, m_uploadBuffer.allocation );
+    m_uploadBuffer = AllocatedBuffer{};
+}
+
+void Overlay::createPipeline( vk::PipelineCache pipelineCache )
+{
+    vk::PushConstantRange pushConstant { vk::ShaderStageFlagBits::eVertex, 0, sizeof(OverlayPushConstant) };
+
+    vk::PipelineLayoutCreateInfo layoutInfo {};
+    layoutInfo.setSetLayouts( m_setLayout );
+    layoutInfo.setPushConstantRanges( pushConstant );
+    m_pipelineLayout = m_device.createPipelineLayout( layoutInfo );
+    m_deletionQueue.pushFunction(
+        [d = m_device, l = m_pipelineLayout](){
+            d.destroyPipelineLayout( l );
+        }
+    );
+
+    /**
+     * @brief ImDrawVert: position (2 float), uv (2 float), and color (4 unorm byte)
+     */
+    vk::VertexInputBindingDescription binding { 0, sizeof(ImDrawVert), vk::VertexInputRate::eVertex };
+    std::array<vk::VertexInputAttributeDescription, 3> attributes = {
+        vk::VertexInputAttributeDescription{ 0, 0, vk::Format::eR32G32Sfloat,   static_cast<uint32_t>( offsetof( ImDrawVert, pos ) ) },
+        vk::VertexInputAttributeDescription{ 1, 0, vk::Format::eR32G32Sfloat,   static_cast<uint32_t>( offsetof( ImDrawVert, uv ) ) },
+        vk::VertexInputAttributeDescription{ 2, 0, vk::Format::eR8G8B8A8Unorm,  static_cast<uint32_t>( offsetof( ImDrawVert, col ) ) }
+    };
+
+    GraphicsPipeline builder;
+    builder.init( m_device, "shaders/overlay_vert.spv", "shaders/overlay_frag.spv", vk::Extent2D{ 1, 1 } );
+
+    builder.m_vertexInputStateInfo.setVertexBindingDescriptions( binding );
+    builder.m_vertexInputStateInfo.setVertexAttributeDescriptions( attributes );
+
+    // the usual alpha blending of ImGui
+    builder.m_colorBlendAttachment.setBlendEnable( VK_TRUE );
+    builder.m_colorBlendAttachment.setSrcColorBlendFactor( vk::BlendFactor::eSrcAlpha );
+    builder.m_colorBlendAttachment.setDstColorBlendFactor( vk::BlendFactor::eOneMinusSrcAlpha );
+    builder.m_colorBlendAttachment.setColorBlendOp( vk::BlendOp::eAdd );
+    builder.m_colorBlendAttachment.setSrcAlphaBlendFactor( vk::BlendFactor::eOne );
+    builder.m_colorBlendAttachment.setDstAlphaBlendFactor( vk::BlendFactor::eOneMinusSrcAlpha );
+    builder.m_colorBlendAttachment.setAlphaBlendOp( vk::BlendOp::eAdd );
+
+    builder.createGraphicsPipeline( m_renderPass, m_pipelineLayout, m_deletionQueue, pipelineCache );
+    m_pipeline = builder.getGraphicsPipeline();
+}
+
+void Overlay::pushFrameTimes( float cpuMs, float gpuMs )
+{
+    m_cpuHistory[m_historyOffset] = cpuMs;
+    m_gpuHistory[m_historyOffset] = gpuMs;
+    m_historyOffset = ( m_historyOffset + 1 ) % HistorySize;
+}
+
+void Overlay::newFrame( GLFWwindow* window, float deltaTime )
+{
+    ImGuiIO& io = ImGui::GetIO();
+    io.DisplaySize = ImVec2{ static_cast<float>( m_extent.width ), static_cast<float>( m_extent.height ) };
+    io.DeltaTime = deltaTime > 0.0f ? deltaTime : 1.0f / 60.0f;
+
+    if( window )
+    {
+        double x, y;
+        glfwGetCursorPos( window, &x, &y );
+        io.MousePos = ImVec2{ static_cast<float>( x ), static_cast<float>( y ) };
+        for( int button = 0; button < 3; ++button )
+            io.MouseDown[button] = glfwGetMouseButton( window, button ) == GLFW_PRESS;
+    }
+    io.MouseWheel = m_scroll;
+    m_scroll = 0.0f;
+
+    ImGui::NewFrame();
+}
+
+void Overlay::reserveGeometry( uint32_t frameIndex, size_t vertexCount, size_t indexCount )
+{
+    auto& geometry = m_geometry[frameIndex];
+
+    // this frame's fence has been waited, so its old buffers are free to go
+    if( vertexCount > geometry.vertexCapacity )
+    {
+        if( geometry.vertexCapacity > 0 )
+        {
+            m_allocator.unmapMemory( geometry.vertexBuffer.allocation );
+            m_allocator.destroyBuffer( geometry.vertexBuffer.buffer, geometry.vertexBuffer.allocation );
+        }
+        geometry.vertexCapacity = std::max<size_t>( 4096, vertexCount * 2 );
+        geometry.vertexBuffer = AllocatedBuffer::createBuffer( geometry.vertexCapacity * sizeof(ImDrawVert), vk::BufferUsageFlagBits::eVertexBuffer, m_allocator, vma::MemoryUsage::eCpuToGpu );
+        geometry.vertexData = m_allocator.mapMemory( geometry.vertexBuffer.allocation );
+    }
+
+    if( indexCount > geometry.indexCapacity )
+    {
+        if( geometry.indexCapacity > 0 )
+        {
+            m_allocator.unmapMemory( geometry.indexBuffer.allocation );
+            m_allocator.destroyBuffer( geometry.indexBuffer.buffer, geometry.indexBuffer.allocation );
+        }
+        geometry.indexCapacity = std::max<size_t>( 8192, indexCount * 2 );
+        geometry.indexBuffer = AllocatedBuffer::createBuffer( geometry.indexCapacity * sizeof(ImDrawIdx), vk::BufferUsageFlagBits::eIndexBuffer, m_allocator, vma::MemoryUsage::eCpuToGpu );
+        geometry.indexData = m_allocator.mapMemory( geometry.indexBuffer.allocation );
+    }
+}
+
+void Overlay::render( vk::CommandBuffer cmd, uint32_t frameIndex )
+{
+    ImGui::Render();
+    ImDrawData* drawData = ImGui::GetDrawData();
+
+    /**
+     * @brief Copy all the draw lists to one vertex buffer and one index buffer
+     */
+    reserveGeometry( frameIndex, static_cast<size_t>( drawData->TotalVtxCount ), static_cast<size_t>( drawData->TotalIdxCount ) );
+    auto& geometry = m_geometry[frameIndex];
+    {
+        auto vertexDst = reinterpret_cast<ImDrawVert*>( geometry.vertexData );
+        auto indexDst = reinterpret_cast<ImDrawIdx*>( geometry.indexData );
+        for( int n = 0; n < drawData->CmdListsCount; ++n )
+        {
+            const ImDrawList* cmdList = drawData->CmdLists[n];
+            memcpy( vertexDst, cmdList->VtxBuffer.Data, cmdList->VtxBuffer.Size * sizeof(ImDrawVert) );
+            memcpy( indexDst, cmdList->IdxBuffer.Data, cmdList->IdxBuffer.Size * sizeof(ImDrawIdx) );
+            vertexDst += cmdList->VtxBuffer.Size;
+            indexDst += cmdList->IdxBuffer.Size;
+        }
+    }
+
+    /**
+     * @brief The render pass has been begun by the render graph, it's ended there too
+     */
+    if( drawData->TotalVtxCount > 0 )
+    {
+        cmd.bindPipeline( vk::PipelineBindPoint::eGraphics, m_pipeline );
+        cmd.bindDescriptorSets( vk::PipelineBindPoint::eGraphics, m_pipelineLayout, 0, m_fontSet, nullptr );
+        cmd.bindVertexBuffers( 0, geometry.vertexBuffer.buffer, vk::DeviceSize{ 0 } );
+        cmd.bindIndexBuffer( geometry.indexBuffer.buffer, 0, sizeof(ImDrawIdx) == 2 ? vk::IndexType::eUint16 : vk::IndexType::eUint32 );
+
+        vk::Viewport viewport { 0.0f, 0.0f, drawData->DisplaySize.x, drawData->DisplaySize.y, 0.0f, 1.0f };
+        cmd.setViewport( 0, viewport );
+
+        OverlayPushConstant pushConstant;
+        pushConstant.scale[0] = 2.0f / drawData->DisplaySize.x;
+        pushConstant.scale[1] = 2.0f / drawData->DisplaySize.y;
+        pushConstant.translate[0] = -1.0f - drawData->DisplayPos.x * pushConstant.scale[0];
+        pushConstant.translate[1] = -1.0f - drawData->DisplayPos.y * pushConstant.scale[1];
+        cmd.pushConstants<OverlayPushConstant>( m_pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, pushConstant );
+
+        uint32_t vertexOffset = 0;
+        uint32_t indexOffset = 0;
+        for( int n = 0; n < drawData->CmdListsCount; ++n )
+        {
+            const ImDrawList* cmdList = drawData->CmdLists[n];
+            for( const ImDrawCmd& drawCmd : cmdList->CmdBuffer )
+            {
+                float clipMinX = std::max( drawCmd.ClipRect.x - drawData->DisplayPos.x, 0.0f );
+                float clipMinY = std::max( drawCmd.ClipRect.y - drawData->DisplayPos.y, 0.0f );
+                float clipMaxX = std::min( drawCmd.ClipRect.z - drawData->DisplayPos.x, static_cast<float>( m_extent.width ) );
+                float clipMaxY = std::min( drawCmd.ClipRect.w - drawData->DisplayPos.y, static_cast<float>( m_extent.height ) );
+                if( clipMaxX <= clipMinX || clipMaxY <= clipMinY )
+                    continue;
+
+                vk::Rect2D scissor {
+                    { static_cast<int32_t>( clipMinX ), static_cast<int32_t>( clipMinY ) },
+                    { static_cast<uint32_t>( clipMaxX - clipMinX ), static_cast<uint32_t>( clipMaxY - clipMinY ) }
+                };
+                cmd.setScissor( 0, scissor );
+                cmd.drawIndexed( drawCmd.ElemCount, 1, indexOffset + drawCmd.IdxOffset, static_cast<int32_t>( vertexOffset + drawCmd.VtxOffset ), 0 );
+            }
+            vertexOffset += static_cast<uint32_t>( cmdList->VtxBuffer.Size );
+            indexOffset += static_cast<uint32_t>( cmdList->IdxBuffer.Size );
+        }
+    }
+}
@@ -0,0 +1,104 @@
+#include "PipelineBuildQueue.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include "CpuProfiler.hpp"
+
+void PipelineBuildQueue::init( vk::Device device, PipelineCache* pipelineCache, unsigned int threadCount )
+{
+    m_device = device;
+    m_pipelineCache = pipelineCache;
+    m_threadCount = threadCount > 0 ? threadCount : std::max( 1U, std::thread::hardware_concurrency() );
+}
+
+std::future<vk::Pipeline> PipelineBuildQueue::push( PipelineDescription description )
+{
+    m_jobs.push_back( Job{ std::move( description ), std::promise<vk::Pipeline>{} } );
+    return m_jobs.back().promise.get_future();
+}
+
+void PipelineBuildQueue::build( DeletionQueue& deletor )
+{
+    PROFILE_FUNCTION();
+    if( m_jobs.empty() )
+        return;
+
+    auto start = std::chrono::steady_clock::now();
+
+    /**
+     * @brief The workers pick the next job until there is no more
+     * The pipelines are slow to compile and not equally slow, so they're picked one by one instead of split in chunks
+     */
+    const unsigned int threadCount = std::min<unsigned int>( m_threadCount, static_cast<unsigned int>( m_jobs.size() ) );
+    std::atomic<size_t> nextJob { 0 };
+    std::vector<DeletionQueue> workerDeletors( threadCount );
+    std::vector<std::thread> workers;
+    workers.reserve( threadCount );
+    for( unsigned int t = 0; t < threadCount; ++t )
+    {
+        workers.emplace_back(
+            [&, t](){
+                PROFILE_ZONE( "pipeline worker" );
+                // an exception can't leave the thread, the jobs that are left get it (buildJob never throws)
+                try
+                {
+                    vk::PipelineCache cache = m_pipelineCache ? m_pipelineCache->createThreadCache() : vk::PipelineCache{};
+                    for( size_t i = nextJob++; i < m_jobs.size(); i = nextJob++ )
+                        buildJob( m_jobs[i], workerDeletors[t], cache );
+                    if( m_pipelineCache )
+                        m_pipelineCache->merge( cache );
+                }
+                catch( ... )
+                {
+                    for( size_t i = nextJob++; i < m_jobs.size(); i = nextJob++ )
+                        m_jobs[i].promise.set_exception( std::current_exception() );
+                }
+            }
+        );
+    }
+    for( auto& worker : workers )
+        worker.join();
+
+    // the deletion queue is not thread safe, so the workers have their own, and they're handed over here
+    for( auto& workerDeletor : workerDeletors )
+    {
+        deletor.pushFunction(
+            [q = std::make_shared<DeletionQueue>( std::move( workerDeletor ) )](){
+                q->flush();
+            }
+        );
+    }
+
+    m_stats.pipelines = m_jobs.size();
+    m_stats.threads = threadCount;
+    m_stats.ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    m_jobs.clear();
+}
+
+void PipelineBuildQueue::buildJob( Job& job, DeletionQueue& workerDeletor, vk::PipelineCache cache )
+{
+    PROFILE_ZONE( "build pipeline" );
+    try
+    {
+        const auto& description = job.description;
+
+        GraphicsPipeline builder;
+        builder.init( m_device, description.vertFile, description.fragFile, description.extent );
+        if( description.configure )
+            description.configure( builder );
+
+        builder.createGraphicsPipeline( description.renderPass, description.layout, workerDeletor, cache );
+        if( !builder.m_graphicsPipeline )
+            throw std::runtime_error( "Failed to create the pipeline of " + description.name );
+
+        job.promise.set_value( builder.m_graphicsPipeline );
+    }
+    catch( ... )
+    {
+        job.promise.set_exception( std::current_exception() );
+    }
+}
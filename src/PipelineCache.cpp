@@ -0,0 +1,194 @@
+#include "PipelineCache.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#ifndef ENGINE_CATCH
+#define ENGINE_CATCH                            \
+    catch( const vk::SystemError& err )         \
+    {                                           \
+        throw std::runtime_error( err.what() ); \
+    }
+#endif
+
+void PipelineCache::init( vk::Device device, const vk::PhysicalDeviceProperties& properties, const std::string& filename )
+{
+    m_device = device;
+    m_properties = properties;
+    m_filename = filename;
+
+    std::vector<char> data;
+    if( !m_filename.empty() )
+        data = loadFile();
+    m_loadedBytes = data.size();
+
+    vk::PipelineCacheCreateInfo cacheInfo {};
+    cacheInfo.setInitialDataSize( data.size() );
+    cacheInfo.setPInitialData( data.empty() ? nullptr : data.data() );
+    try
+    {
+        m_cache = m_device.createPipelineCache( cacheInfo );
+    } ENGINE_CATCH
+}
+
+void PipelineCache::destroy()
+{
+    if( !m_cache )
+        return;
+
+    save();
+    m_device.destroyPipelineCache( m_cache );
+    m_cache = nullptr;
+}
+
+bool PipelineCache::save()
+{
+    if( m_filename.empty() )
+        return false;
+
+    std::vector<uint8_t> data;
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        data = m_device.getPipelineCacheData( m_cache );
+    }
+
+    FileHeader header {};
+    header.magic = Magic;
+    header.version = Version;
+    header.dataSize = data.size();
+    header.checksum = checksum( reinterpret_cast<const char*>( data.data() ), data.size() );
+    header.driverVersion = m_properties.driverVersion;
+    header.vendorID = m_properties.vendorID;
+    header.deviceID = m_properties.deviceID;
+    std::memcpy( header.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE );
+
+    /**
+     * @brief Atomic save
+     * The rename replaces the old file in one step, the reader sees either the old cache or the new one
+     */
+    std::string temporary = m_filename + ".tmp";
+    {
+        std::ofstream file( temporary, std::ios::binary | std::ios::trunc );
+        file.write( reinterpret_cast<const char*>( &header ), sizeof(header) );
+        file.write( reinterpret_cast<const char*>( data.data() ), data.size() );
+        if( !file )
+        {
+            std::cerr << "Failed to write the pipeline cache to " << temporary << "\n";
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename( temporary, m_filename, error );
+    if( error )
+    {
+        std::cerr << "Failed to replace " << m_filename << ": " << error.message() << "\n";
+        std::filesystem::remove( temporary, error );
+        return false;
+    }
+
+    return true;
+}
+
+vk::PipelineCache PipelineCache::createThreadCache() const
+{
+    try
+    {
+        return m_device.createPipelineCache( vk::PipelineCacheCreateInfo{} );
+    } ENGINE_CATCH
+}
+
+void PipelineCache::merge( vk::PipelineCache threadCache )
+{
+    {
+        // the destination of vkMergePipelineCaches must be externally synchronized
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_device.mergePipelineCaches( m_cache, threadCache );
+    }
+    m_device.destroyPipelineCache( threadCache );
+}
+
+std::vector<char> PipelineCache::loadFile() const
+{
+    std::ifstream file( m_filename, std::ios::binary | std::ios::ate );
+    if( !file )
+        return {};
+
+    size_t fileSize = static_cast<size_t>( file.tellg() );
+    if( fileSize < sizeof(FileHeader) )
+        return {};
+
+    FileHeader header;
+    file.seekg( 0 );
+    file.read( reinterpret_cast<char*>( &header ), sizeof(header) );
+    if( header.magic != Magic || header.version != Version || header.dataSize != fileSize - sizeof(FileHeader) )
+    {
+        std::cout << "Pipeline cache: " << m_filename << " is not a valid cache file, it's ignored\n";
+        return {};
+    }
+
+    std::vector<char> data( header.dataSize );
+    file.read( data.data(), data.size() );
+    if( !file || !isValid( header, data.data() ) )
+        return {};
+
+    return data;
+}
+
+bool PipelineCache::isValid( const FileHeader& header, const char* data ) const
+{
+    if( header.checksum != checksum( data, header.dataSize ) )
+    {
+        std::cout << "Pipeline cache: the checksum doesn't match, the cache is ignored\n";
+        return false;
+    }
+
+    /**
+     * @brief Both headers have to match this device
+     * The driver would reject data of an other device, but some drivers have crashed on it, so it's never given to them
+     */
+    bool sameDevice = header.vendorID == m_properties.vendorID
+        && header.deviceID == m_properties.deviceID
+        && header.driverVersion == m_properties.driverVersion
+        && std::memcmp( header.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE ) == 0;
+
+    // the header that the driver writes in front of its data (VkPipelineCacheHeaderVersionOne)
+    struct DriverHeader
+    {
+        uint32_t headerSize;
+        uint32_t headerVersion;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint8_t  pipelineCacheUUID[VK_UUID_SIZE];
+    } driverHeader;
+    if( sameDevice && header.dataSize >= sizeof(DriverHeader) )
+    {
+        std::memcpy( &driverHeader, data, sizeof(DriverHeader) );
+        sameDevice = driverHeader.headerVersion == static_cast<uint32_t>( vk::PipelineCacheHeaderVersion::eOne )
+            && driverHeader.headerSize >= sizeof(DriverHeader)
+            && driverHeader.vendorID == m_properties.vendorID
+            && driverHeader.deviceID == m_properties.deviceID
+            && std::memcmp( driverHeader.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE ) == 0;
+    }
+    else
+        sameDevice = false;
+
+    if( !sameDevice )
+        std::cout << "Pipeline cache: made by an other device or driver, the cache is ignored\n";
+
+    return sameDevice;
+}
+
+uint64_t PipelineCache::checksum( const char* data, size_t size )
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for( size_t i = 0; i < size; ++i )
+    {
+        hash ^= static_cast<uint8_t>( data[i] );
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
@@ -0,0 +1,994 @@
+#include "RenderGraph.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+#include "Vulkan_Init.hpp"
+
+#ifndef ENGINE_CATCH
+#define ENGINE_CATCH                            \
+    catch( const vk::SystemError& err )         \
+    {                                           \
+        throw std::runtime_error( err.what() ); \
+    }
+#endif
+
+namespace
+{
+constexpr vk::ImageUsageFlags AttachmentUsage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eDepthStencilAttachment
+                                          | vk::ImageUsageFlagBits::eInputAttachment;
+
+vma::AllocationCreateInfo lazyAllocationInfo()
+{
+    vma::AllocationCreateInfo allocInfo {};
+    allocInfo.setUsage( vma::MemoryUsage::eGpuLazilyAllocated );
+    return allocInfo;
+}
+
+constexpr vk::AccessFlags WriteAccess = vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite
+                                      | vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite;
+
+class CommandBufferSink : public RenderGraph::BarrierSink
+{
+public:
+    explicit CommandBufferSink( vk::CommandBuffer cmd ) : m_cmd( cmd ) {}
+
+    void pipelineBarrier( const char*, vk::PipelineStageFlags srcStages, vk::PipelineStageFlags dstStages,
+                          const vk::MemoryBarrier* memoryBarrier, const std::vector<vk::ImageMemoryBarrier>& imageBarriers ) override
+    {
+        m_cmd.pipelineBarrier( srcStages, dstStages, {},
+            memoryBarrier ? vk::ArrayProxy<const vk::MemoryBarrier>( *memoryBarrier ) : vk::ArrayProxy<const vk::MemoryBarrier>( nullptr ), nullptr, imageBarriers );
+    }
+
+private:
+    vk::CommandBuffer m_cmd;
+};
+} // namespace
+
+/**
+ * @brief PassBuilder
+ */
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::use( Resource resource, Access access, bool clear, vk::ClearValue clearValue )
+{
+    if( resource >= m_graph.m_resources.size() )
+        throw std::runtime_error( std::string( "The pass " ) + m_graph.m_passes[m_pass].name + " uses a resource that is not in the graph" );
+
+    m_graph.m_passes[m_pass].uses.push_back( Use{ resource, access, clear, clearValue } );
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::colorAttachment( Resource image, std::optional<vk::ClearColorValue> clear )
+{
+    return use( image, Access::eColorAttachment, clear.has_value(), clear ? vk::ClearValue{ *clear } : vk::ClearValue{} );
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::depthAttachment( Resource image, std::optional<vk::ClearDepthStencilValue> clear )
+{
+    return use( image, Access::eDepthAttachment, clear.has_value(), clear ? vk::ClearValue{ *clear } : vk::ClearValue{} );
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::sampled( Resource image )      { return use( image, Access::eSampled ); }
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::storageRead( Resource resource ) { return use( resource, Access::eStorageRead ); }
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::storageWrite( Resource resource ) { return use( resource, Access::eStorageWrite ); }
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::transferSrc( Resource resource ) { return use( resource, Access::eTransferSrc ); }
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::transferDst( Resource resource ) { return use( resource, Access::eTransferDst ); }
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::indirect( Resource buffer )     { return use( buffer, Access::eIndirect ); }
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::renderArea( vk::Extent2D extent )
+{
+    m_graph.m_passes[m_pass].renderArea = extent;
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::sideEffect()
+{
+    m_graph.m_passes[m_pass].sideEffect = true;
+    return *this;
+}
+
+void RenderGraph::PassBuilder::execute( std::function<void( vk::CommandBuffer )> record )
+{
+    m_graph.m_passes[m_pass].record = std::move( record );
+}
+
+/**
+ * @brief RenderGraph
+ */
+void RenderGraph::init( vk::Device device, vma::Allocator allocator )
+{
+    m_device = device;
+    m_allocator = allocator;
+
+    // the tilers have it, the desktop GPUs usually don't
+    uint32_t memoryType = 0;
+    auto allocInfo = lazyAllocationInfo();
+    m_lazySupported = m_allocator.findMemoryTypeIndex( UINT32_MAX, &allocInfo, &memoryType ) == vk::Result::eSuccess;
+}
+
+void RenderGraph::destroy()
+{
+    releaseTargets();
+
+    for( auto& renderPass : m_renderPasses )
+        m_device.destroyRenderPass( renderPass.second );
+    m_renderPasses.clear();
+}
+
+void RenderGraph::releaseTargets()
+{
+    retireTargets();
+    for( auto& retired : m_retired )
+        retired.destroy();
+    m_retired.clear();
+}
+
+void RenderGraph::reset()
+{
+    ++m_frame;
+
+    // the fence of this frame slot has been waited, so what was retired FRAME_OVERLAP frames ago is not used anymore
+    m_retired.erase(
+        std::remove_if( m_retired.begin(), m_retired.end(), [this]( Retired& retired ){
+            if( m_frame < retired.frame + FRAME_OVERLAP )
+                return false;
+            retired.destroy();
+            return true;
+        } ),
+        m_retired.end()
+    );
+
+    m_resources.clear();
+    m_passes.clear();
+    m_lastStats = m_stats;
+    m_stats = Stats{};
+    m_lastTraffic.swap( m_traffic );
+    m_traffic.clear();
+}
+
+RenderGraph::Resource RenderGraph::importImage( const char* name, const ImportedImage& image )
+{
+    ResourceNode node {};
+    node.name = name;
+    node.imported = true;
+    node.desc = image.desc;
+    node.importedImage = image;
+    node.state.layout = image.initialLayout;
+    node.state.writeStages = image.initialStages;
+    node.state.writeAccess = image.initialAccess;
+    m_resources.push_back( node );
+    return static_cast<Resource>( m_resources.size() - 1 );
+}
+
+RenderGraph::Resource RenderGraph::importBuffer( const char* name, vk::Buffer buffer )
+{
+    ResourceNode node {};
+    node.name = name;
+    node.isImage = false;
+    node.imported = true;
+    node.buffer = buffer;
+    m_resources.push_back( node );
+    return static_cast<Resource>( m_resources.size() - 1 );
+}
+
+RenderGraph::Resource RenderGraph::createImage( const char* name, const ImageDesc& desc )
+{
+    ResourceNode node {};
+    node.name = name;
+    node.desc = desc;
+    m_resources.push_back( node );
+    return static_cast<Resource>( m_resources.size() - 1 );
+}
+
+RenderGraph::PassBuilder RenderGraph::addPass( const char* name, PassType type )
+{
+    Pass pass {};
+    pass.name = name;
+    pass.type = type;
+    m_passes.push_back( std::move( pass ) );
+    return PassBuilder( *this, static_cast<uint32_t>( m_passes.size() - 1 ) );
+}
+
+vk::Image RenderGraph::image( Resource resource ) const
+{
+    const auto& node = m_resources.at( resource );
+    if( node.imported )
+        return node.importedImage.image;
+    return node.physical < m_physicalImages.size() ? m_physicalImages[node.physical].image : vk::Image{};
+}
+
+vk::ImageView RenderGraph::imageView( Resource resource ) const
+{
+    const auto& node = m_resources.at( resource );
+    if( node.imported )
+        return node.importedImage.view;
+    return node.physical < m_physicalImages.size() ? m_physicalImages[node.physical].view : vk::ImageView{};
+}
+
+RenderGraph::UseInfo RenderGraph::useInfo( Access access, PassType type )
+{
+    const vk::PipelineStageFlags shaderStages = type == PassType::eGraphics
+        ? vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader
+        : vk::PipelineStageFlags{ vk::PipelineStageFlagBits::eComputeShader };
+
+    switch( access )
+    {
+        case Access::eColorAttachment:
+            return { vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                     vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite,
+                     vk::ImageLayout::eColorAttachmentOptimal, vk::ImageUsageFlagBits::eColorAttachment, true };
+        case Access::eDepthAttachment:
+            return { vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
+                     vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                     vk::ImageLayout::eDepthStencilAttachmentOptimal, vk::ImageUsageFlagBits::eDepthStencilAttachment, true };
+        case Access::eSampled:
+            return { shaderStages, vk::AccessFlagBits::eShaderRead,
+                     vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageUsageFlagBits::eSampled, false };
+        case Access::eStorageRead:
+            return { shaderStages, vk::AccessFlagBits::eShaderRead,
+                     vk::ImageLayout::eGeneral, vk::ImageUsageFlagBits::eStorage, false };
+        case Access::eStorageWrite:
+            return { shaderStages, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+                     vk::ImageLayout::eGeneral, vk::ImageUsageFlagBits::eStorage, true };
+        case Access::eTransferSrc:
+            return { vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferRead,
+                     vk::ImageLayout::eTransferSrcOptimal, vk::ImageUsageFlagBits::eTransferSrc, false };
+        case Access::eTransferDst:
+            return { vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite,
+                     vk::ImageLayout::eTransferDstOptimal, vk::ImageUsageFlagBits::eTransferDst, true };
+        case Access::eIndirect:
+        default:
+            return { vk::PipelineStageFlagBits::eDrawIndirect, vk::AccessFlagBits::eIndirectCommandRead,
+                     vk::ImageLayout::eUndefined, {}, false };
+    }
+}
+
+vk::ImageAspectFlags RenderGraph::aspectOf( vk::Format format )
+{
+    switch( format )
+    {
+        case vk::Format::eD16Unorm:
+        case vk::Format::eX8D24UnormPack32:
+        case vk::Format::eD32Sfloat:
+            return vk::ImageAspectFlagBits::eDepth;
+        case vk::Format::eS8Uint:
+            return vk::ImageAspectFlagBits::eStencil;
+        case vk::Format::eD16UnormS8Uint:
+        case vk::Format::eD24UnormS8Uint:
+        case vk::Format::eD32SfloatS8Uint:
+            return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+        default:
+            return vk::ImageAspectFlagBits::eColor;
+    }
+}
+
+vk::DeviceSize RenderGraph::texelSize( vk::Format format )
+{
+    switch( format )
+    {
+        case vk::Format::eS8Uint:
+        case vk::Format::eR8Unorm:
+            return 1;
+        case vk::Format::eD16Unorm:
+        case vk::Format::eR16Sfloat:
+            return 2;
+        case vk::Format::eD16UnormS8Uint:
+        case vk::Format::eX8D24UnormPack32:
+        case vk::Format::eD24UnormS8Uint:
+        case vk::Format::eD32Sfloat:
+            return 4;
+        case vk::Format::eD32SfloatS8Uint:
+        case vk::Format::eR16G16B16A16Sfloat:
+        case vk::Format::eR32G32Sfloat:
+            return 8;
+        case vk::Format::eR32G32B32A32Sfloat:
+            return 16;
+        default:
+            return 4;   // the 8 bit RGBA and BGRA of the swapchain, and the other 32 bit formats
+    }
+}
+
+void RenderGraph::compile()
+{
+    cullPasses();
+    computeLifetimes();
+    allocateTransients();
+    planRenderPasses();
+    createRenderPasses();
+}
+
+std::vector<RenderGraph::AttachmentOps> RenderGraph::planAttachments()
+{
+    cullPasses();
+    computeLifetimes();
+    planRenderPasses();
+
+    std::vector<AttachmentOps> ops;
+    for( const auto& pass : m_passes )
+    {
+        for( size_t a = 0; !pass.culled && a < pass.attachments.size(); ++a )
+        {
+            const auto& description = pass.attachmentDescriptions[a];
+            ops.push_back( AttachmentOps{ pass.name, m_resources[pass.attachments[a]].name, description.loadOp, description.storeOp } );
+        }
+    }
+    return ops;
+}
+
+void RenderGraph::computeLifetimes()
+{
+    /**
+     * @brief The lifetime (first and last pass) and the usage of every resource, from the passes that are left
+     */
+    for( uint32_t i = 0; i < m_passes.size(); ++i )
+    {
+        const auto& pass = m_passes[i];
+        if( pass.culled )
+            continue;
+
+        for( const auto& use : pass.uses )
+        {
+            auto& node = m_resources[use.resource];
+            node.firstPass = std::min( node.firstPass, i );
+            node.lastPass = std::max( node.lastPass, i );
+            node.usage |= useInfo( use.access, pass.type ).usage;
+        }
+    }
+
+    /**
+     * @brief The transient images that are only the attachments of one render pass
+     * Nothing loads or stores them, so they never need memory behind the tiles.
+     */
+    for( auto& node : m_resources )
+    {
+        const bool attachmentOnly = node.usage && !( node.usage & ~AttachmentUsage );
+        if( m_lazySupported && !node.imported && attachmentOnly && node.firstPass == node.lastPass )
+            node.usage |= vk::ImageUsageFlagBits::eTransientAttachment;
+    }
+}
+
+void RenderGraph::cullPasses()
+{
+    /**
+     * @brief From the last pass to the first one, a pass is needed if it writes something that is needed
+     * The imported resources are needed after the graph (except the images that don't want to be kept),
+     * and a needed pass needs everything it reads, and the old content of what it doesn't clear.
+     */
+    std::vector<bool> needed( m_resources.size(), false );
+    for( size_t i = 0; i < m_resources.size(); ++i )
+    {
+        const auto& node = m_resources[i];
+        needed[i] = node.imported && ( !node.isImage || node.importedImage.finalLayout != vk::ImageLayout::eUndefined );
+    }
+
+    for( size_t i = m_passes.size(); i-- > 0; )
+    {
+        auto& pass = m_passes[i];
+        bool live = pass.sideEffect;
+        for( const auto& use : pass.uses )
+            live = live || ( useInfo( use.access, pass.type ).write && needed[use.resource] );
+
+        pass.culled = !live;
+        if( pass.culled )
+        {
+            ++m_stats.culledPasses;
+            continue;
+        }
+
+        ++m_stats.passes;
+        for( const auto& use : pass.uses )
+            needed[use.resource] = !use.clear;
+    }
+}
+
+void RenderGraph::allocateTransients()
+{
+    std::vector<Resource> transients;
+    for( Resource i = 0; i < m_resources.size(); ++i )
+    {
+        if( !m_resources[i].imported && m_resources[i].firstPass != UINT32_MAX )
+            transients.push_back( i );
+    }
+
+    /**
+     * @brief Same images with the same lifetimes as the last compile: nothing to create
+     * The lifetimes are numbered over the passes where a transient image starts or ends, so the passes that come and go
+     * around them (a pass that only runs on some frames) don't change the key, the sharing only depends on their order.
+     */
+    std::vector<uint32_t> bounds;
+    for( Resource i : transients )
+    {
+        bounds.push_back( m_resources[i].firstPass );
+        bounds.push_back( m_resources[i].lastPass );
+    }
+    std::sort( bounds.begin(), bounds.end() );
+    bounds.erase( std::unique( bounds.begin(), bounds.end() ), bounds.end() );
+    auto relative = [&bounds]( uint32_t pass ){
+        return static_cast<uint64_t>( std::lower_bound( bounds.begin(), bounds.end(), pass ) - bounds.begin() );
+    };
+
+    std::vector<uint64_t> key = { m_aliasing ? 1U : 0U };
+    for( Resource i : transients )
+    {
+        const auto& node = m_resources[i];
+        key.insert( key.end(), {
+            static_cast<uint64_t>( node.desc.format ), node.desc.extent.width, node.desc.extent.height, node.desc.mipLevels,
+            static_cast<uint64_t>( static_cast<VkImageUsageFlags>( node.usage ) ), relative( node.firstPass ), relative( node.lastPass )
+        } );
+    }
+
+    auto hasLazyType = [this]( uint32_t memoryTypeBits ){
+        uint32_t memoryType = 0;
+        auto allocInfo = lazyAllocationInfo();
+        return m_allocator.findMemoryTypeIndex( memoryTypeBits, &allocInfo, &memoryType ) == vk::Result::eSuccess;
+    };
+
+    if( key != m_transientKey )
+    {
+        retireTargets();
+        m_transientKey = key;
+
+        /**
+         * @brief The images, without memory
+         */
+        for( Resource i : transients )
+        {
+            const auto& node = m_resources[i];
+            auto imageInfo = init::image::initImageInfo( node.desc.format, node.usage, vk::Extent3D{ node.desc.extent.width, node.desc.extent.height, 1 } );
+            imageInfo.setMipLevels( node.desc.mipLevels );
+
+            PhysicalImage physical {};
+            physical.desc = node.desc;
+            physical.usage = node.usage;
+            try
+            {
+                physical.image = m_device.createImage( imageInfo );
+            } ENGINE_CATCH
+            physical.requirements = m_device.getImageMemoryRequirements( physical.image );
+            physical.lazy = ( node.usage & vk::ImageUsageFlagBits::eTransientAttachment ) && hasLazyType( physical.requirements.memoryTypeBits );
+            m_physicalImages.push_back( physical );
+        }
+
+        /**
+         * @brief The memory
+         */
+        std::vector<TransientImage> images;
+        for( uint32_t i = 0; i < transients.size(); ++i )
+        {
+            const auto& node = m_resources[transients[i]];
+            images.push_back( TransientImage{ node.firstPass, node.lastPass, m_physicalImages[i].requirements, m_physicalImages[i].lazy } );
+        }
+        auto packing = packTransients( images, m_aliasing, hasLazyType );
+        for( const auto& packed : packing.blocks )
+        {
+            MemoryBlock block {};
+            block.requirements = packed.requirements;
+            block.lazy = packed.lazy;
+            m_blocks.push_back( block );
+        }
+        for( uint32_t i = 0; i < m_physicalImages.size(); ++i )
+            m_physicalImages[i].block = packing.imageBlocks[i];
+
+        vma::AllocationCreateInfo allocInfo {};
+        allocInfo.setUsage( vma::MemoryUsage::eGpuOnly );
+        allocInfo.setRequiredFlags( vk::MemoryPropertyFlagBits::eDeviceLocal );
+        try
+        {
+            for( auto& block : m_blocks )
+                block.allocation = m_allocator.allocateMemory( block.requirements, block.lazy ? lazyAllocationInfo() : allocInfo );
+
+            for( auto& physical : m_physicalImages )
+            {
+                m_allocator.bindImageMemory( m_blocks[physical.block].allocation, physical.image );
+
+                auto viewInfo = init::image::initImageViewInfo( physical.desc.format, physical.image, aspectOf( physical.desc.format ) );
+                viewInfo.subresourceRange.setLevelCount( physical.desc.mipLevels );
+                physical.view = m_device.createImageView( viewInfo );
+            }
+        } ENGINE_CATCH
+    }
+
+    for( uint32_t i = 0; i < transients.size(); ++i )
+        m_resources[transients[i]].physical = i;
+
+    m_stats.transientImages = static_cast<uint32_t>( m_physicalImages.size() );
+    m_stats.transientBlocks = static_cast<uint32_t>( m_blocks.size() );
+    for( const auto& block : m_blocks )
+    {
+        m_stats.transientBytes += block.requirements.size;
+        if( block.lazy )
+            m_stats.lazyBytes += block.requirements.size;
+    }
+    for( const auto& physical : m_physicalImages )
+        m_stats.lazyImages += physical.lazy ? 1 : 0;
+    for( const auto& physical : m_physicalImages )
+        m_stats.unaliasedBytes += physical.requirements.size;
+}
+
+RenderGraph::TransientPacking RenderGraph::packTransients( const std::vector<TransientImage>& images, bool aliasing,
+                                                           const std::function<bool( uint32_t memoryTypeBits )>& hasLazyType )
+{
+    TransientPacking packing;
+    packing.imageBlocks.assign( images.size(), UINT32_MAX );
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> lifetimes;     // the passes of the images of every block
+
+    std::vector<uint32_t> order( images.size() );
+    std::iota( order.begin(), order.end(), 0U );
+    std::stable_sort( order.begin(), order.end(), [&images]( uint32_t a, uint32_t b ){
+        return images[a].requirements.size > images[b].requirements.size;
+    } );
+
+    for( uint32_t index : order )
+    {
+        const auto& image = images[index];
+        const auto& requirements = image.requirements;
+
+        for( uint32_t b = 0; aliasing && b < packing.blocks.size(); ++b )
+        {
+            auto& block = packing.blocks[b];
+            bool overlaps = std::any_of( lifetimes[b].begin(), lifetimes[b].end(), [&image]( const std::pair<uint32_t, uint32_t>& lifetime ){
+                return image.firstPass <= lifetime.second && lifetime.first <= image.lastPass;
+            } );
+            const uint32_t memoryTypeBits = block.requirements.memoryTypeBits & requirements.memoryTypeBits;
+            if( overlaps || block.lazy != image.lazy || !memoryTypeBits || ( block.lazy && !hasLazyType( memoryTypeBits ) ) )
+                continue;
+
+            block.requirements.size = std::max( block.requirements.size, requirements.size );
+            block.requirements.alignment = std::max( block.requirements.alignment, requirements.alignment );
+            block.requirements.memoryTypeBits &= requirements.memoryTypeBits;
+            lifetimes[b].emplace_back( image.firstPass, image.lastPass );
+            packing.imageBlocks[index] = b;
+            break;
+        }
+
+        if( packing.imageBlocks[index] == UINT32_MAX )
+        {
+            packing.blocks.push_back( TransientBlock{ requirements, image.lazy } );
+            lifetimes.push_back( { { image.firstPass, image.lastPass } } );
+            packing.imageBlocks[index] = static_cast<uint32_t>( packing.blocks.size() - 1 );
+        }
+    }
+    return packing;
+}
+
+void RenderGraph::planRenderPasses()
+{
+    for( auto& node : m_resources )
+        node.hasContent = node.imported && node.state.layout != vk::ImageLayout::eUndefined;
+
+    for( uint32_t i = 0; i < m_passes.size(); ++i )
+    {
+        auto& pass = m_passes[i];
+        if( pass.culled )
+            continue;
+
+        if( pass.type == PassType::eGraphics )
+        {
+            /**
+             * @brief The attachments, the colors in the order they're declared, and then the depth
+             * Load: clear if the pass asks for it, load if something was there before, and don't care if nothing was.
+             * Store: only if a later pass uses it, or it's imported and kept after the graph.
+             * The layout doesn't change in the render pass, the barrier in front of the pass does it.
+             * The stencil ops follow the depth ops only if the format has a stencil.
+             */
+            std::vector<const Use*> attachments;
+            for( const auto& use : pass.uses )
+            {
+                if( use.access == Access::eColorAttachment )
+                    attachments.push_back( &use );
+            }
+            pass.hasDepth = false;
+            for( const auto& use : pass.uses )
+            {
+                if( use.access == Access::eDepthAttachment && !pass.hasDepth )
+                {
+                    attachments.push_back( &use );
+                    pass.hasDepth = true;
+                }
+            }
+
+            pass.attachments.clear();
+            pass.attachmentDescriptions.clear();
+            pass.clearValues.clear();
+            pass.framebufferExtent = vk::Extent2D{ UINT32_MAX, UINT32_MAX };
+            for( const Use* use : attachments )
+            {
+                const auto& node = m_resources[use->resource];
+                const bool keep = node.lastPass > i || ( node.imported && node.importedImage.finalLayout != vk::ImageLayout::eUndefined );
+                const vk::AttachmentLoadOp loadOp = use->clear ? vk::AttachmentLoadOp::eClear
+                                                  : node.hasContent ? vk::AttachmentLoadOp::eLoad : vk::AttachmentLoadOp::eDontCare;
+                const vk::AttachmentStoreOp storeOp = keep ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare;
+                const bool hasStencil = static_cast<bool>( aspectOf( node.desc.format ) & vk::ImageAspectFlagBits::eStencil );
+                const vk::ImageLayout layout = useInfo( use->access, pass.type ).layout;
+
+                vk::AttachmentDescription description {};
+                description.setFormat( node.desc.format );
+                description.setSamples( vk::SampleCountFlagBits::e1 );
+                description.setLoadOp( loadOp );
+                description.setStoreOp( storeOp );
+                description.setStencilLoadOp( hasStencil ? loadOp : vk::AttachmentLoadOp::eDontCare );
+                description.setStencilStoreOp( hasStencil ? storeOp : vk::AttachmentStoreOp::eDontCare );
+                description.setInitialLayout( layout );
+                description.setFinalLayout( layout );
+
+                pass.attachments.push_back( use->resource );
+                pass.attachmentDescriptions.push_back( description );
+                pass.clearValues.push_back( use->clearValue );
+                pass.framebufferExtent.width = std::min( pass.framebufferExtent.width, node.desc.extent.width );
+                pass.framebufferExtent.height = std::min( pass.framebufferExtent.height, node.desc.extent.height );
+            }
+
+            if( pass.attachments.empty() )
+                throw std::runtime_error( std::string( "The graphics pass " ) + pass.name + " has no attachment" );
+        }
+
+        for( const auto& use : pass.uses )
+        {
+            if( useInfo( use.access, pass.type ).write )
+                m_resources[use.resource].hasContent = true;
+        }
+    }
+}
+
+void RenderGraph::createRenderPasses()
+{
+    for( auto& pass : m_passes )
+    {
+        if( pass.culled || pass.type != PassType::eGraphics )
+            continue;
+
+        /**
+         * @brief What the ops of every attachment move, over the render area
+         */
+        const vk::Extent2D area = pass.renderArea.value_or( pass.framebufferExtent );
+        const vk::DeviceSize pixels = static_cast<vk::DeviceSize>( area.width ) * area.height;
+        std::vector<vk::ImageView> views;
+        for( size_t a = 0; a < pass.attachments.size(); ++a )
+        {
+            const auto& node = m_resources[pass.attachments[a]];
+            const auto& description = pass.attachmentDescriptions[a];
+            const bool lazy = !node.imported && m_physicalImages[node.physical].lazy;
+            const vk::DeviceSize bytes = texelSize( node.desc.format ) * pixels;
+
+            AttachmentTraffic traffic { { pass.name, node.name, description.loadOp, description.storeOp }, lazy,
+                                        description.loadOp == vk::AttachmentLoadOp::eLoad ? bytes : 0,
+                                        description.storeOp == vk::AttachmentStoreOp::eStore ? bytes : 0 };
+            m_stats.attachmentLoadBytes += traffic.loadBytes;
+            m_stats.attachmentStoreBytes += traffic.storeBytes;
+            m_traffic.push_back( traffic );
+
+            views.push_back( imageView( pass.attachments[a] ) );
+        }
+
+        pass.renderPass = getRenderPass( pass.attachmentDescriptions, pass.hasDepth );
+        pass.framebuffer = getFramebuffer( pass.renderPass, views, pass.framebufferExtent );
+    }
+}
+
+vk::RenderPass RenderGraph::getRenderPass( const std::vector<vk::AttachmentDescription>& attachments, bool hasDepth )
+{
+    std::vector<uint32_t> key = { hasDepth ? 1U : 0U };
+    for( const auto& attachment : attachments )
+    {
+        key.insert( key.end(), {
+            static_cast<uint32_t>( attachment.format ),
+            static_cast<uint32_t>( attachment.loadOp ), static_cast<uint32_t>( attachment.storeOp ),
+            static_cast<uint32_t>( attachment.stencilLoadOp ), static_cast<uint32_t>( attachment.stencilStoreOp ),
+            static_cast<uint32_t>( attachment.initialLayout ), static_cast<uint32_t>( attachment.finalLayout )
+        } );
+    }
+
+    auto found = m_renderPasses.find( key );
+    if( found != m_renderPasses.end() )
+        return found->second;
+
+    const uint32_t colorCount = static_cast<uint32_t>( attachments.size() ) - ( hasDepth ? 1U : 0U );
+    std::vector<vk::AttachmentReference> colorRefs;
+    for( uint32_t i = 0; i < colorCount; ++i )
+        colorRefs.push_back( vk::AttachmentReference{ i, vk::ImageLayout::eColorAttachmentOptimal } );
+    vk::AttachmentReference depthRef { colorCount, vk::ImageLayout::eDepthStencilAttachmentOptimal };
+
+    vk::SubpassDescription subpass {};
+    subpass.setPipelineBindPoint( vk::PipelineBindPoint::eGraphics );
+    subpass.setColorAttachments( colorRefs );
+    if( hasDepth )
+        subpass.setPDepthStencilAttachment( &depthRef );
+
+    // no dependencies, the graph records the barriers outside of the render pass
+    vk::RenderPassCreateInfo renderPassInfo {};
+    renderPassInfo.setAttachments( attachments );
+    renderPassInfo.setSubpasses( subpass );
+
+    vk::RenderPass renderPass;
+    try
+    {
+        renderPass = m_device.createRenderPass( renderPassInfo );
+    } ENGINE_CATCH
+
+    m_renderPasses.emplace( key, renderPass );
+    return renderPass;
+}
+
+vk::RenderPass RenderGraph::compatibleRenderPass( const std::vector<vk::Format>& colorFormats, vk::Format depthFormat )
+{
+    std::vector<vk::AttachmentDescription> attachments;
+    auto add = [&attachments]( vk::Format format, vk::ImageLayout layout ){
+        vk::AttachmentDescription description {};
+        description.setFormat( format );
+        description.setSamples( vk::SampleCountFlagBits::e1 );
+        description.setLoadOp( vk::AttachmentLoadOp::eDontCare );
+        description.setStoreOp( vk::AttachmentStoreOp::eDontCare );
+        description.setStencilLoadOp( vk::AttachmentLoadOp::eDontCare );
+        description.setStencilStoreOp( vk::AttachmentStoreOp::eDontCare );
+        description.setInitialLayout( layout );
+        description.setFinalLayout( layout );
+        attachments.push_back( description );
+    };
+
+    for( auto format : colorFormats )
+        add( format, vk::ImageLayout::eColorAttachmentOptimal );
+    if( depthFormat != vk::Format::eUndefined )
+        add( depthFormat, vk::ImageLayout::eDepthStencilAttachmentOptimal );
+
+    return getRenderPass( attachments, depthFormat != vk::Format::eUndefined );
+}
+
+vk::Framebuffer RenderGraph::getFramebuffer( vk::RenderPass renderPass, const std::vector<vk::ImageView>& views, vk::Extent2D extent )
+{
+    FramebufferKey key { renderPass, views, extent.width, extent.height };
+    auto found = m_framebuffers.find( key );
+    if( found != m_framebuffers.end() )
+        return found->second;
+
+    vk::FramebufferCreateInfo framebufferInfo {};
+    framebufferInfo.setRenderPass( renderPass );
+    framebufferInfo.setAttachments( views );
+    framebufferInfo.setWidth( extent.width );
+    framebufferInfo.setHeight( extent.height );
+    framebufferInfo.setLayers( 1 );
+
+    vk::Framebuffer framebuffer;
+    try
+    {
+        framebuffer = m_device.createFramebuffer( framebufferInfo );
+    } ENGINE_CATCH
+
+    m_framebuffers.emplace( key, framebuffer );
+    return framebuffer;
+}
+
+void RenderGraph::execute( vk::CommandBuffer cmd, GpuProfiler* profiler )
+{
+    CommandBufferSink sink( cmd );
+    record( sink, cmd, profiler );
+}
+
+void RenderGraph::executeBarriers( BarrierSink& sink )
+{
+    record( sink, vk::CommandBuffer{}, nullptr );
+}
+
+void RenderGraph::record( BarrierSink& sink, vk::CommandBuffer cmd, GpuProfiler* profiler )
+{
+    for( uint32_t i = 0; i < m_passes.size(); ++i )
+    {
+        auto& pass = m_passes[i];
+        if( pass.culled )
+            continue;
+
+        /**
+         * @brief The barriers in front of the pass, all of them in one call
+         * Image layout changes are image barriers, the rest (buffers, and images in the same layout) is one memory barrier.
+         * A read waits the last write if its stages haven't seen it yet, a write waits the last write and the reads after it.
+         * The stages of a write haven't seen it (a compute read after a compute write waits it), only a layout transition makes it visible.
+         */
+        vk::PipelineStageFlags srcStages;
+        vk::PipelineStageFlags dstStages;
+        vk::MemoryBarrier memoryBarrier {};
+        bool hasMemoryBarrier = false;
+        std::vector<vk::ImageMemoryBarrier> imageBarriers;
+
+        // the uses of the same resource in this pass are merged
+        std::vector<std::pair<Resource, UseInfo>> merged;
+        for( const auto& use : pass.uses )
+        {
+            UseInfo info = useInfo( use.access, pass.type );
+            auto same = std::find_if( merged.begin(), merged.end(), [&use]( const std::pair<Resource, UseInfo>& m ){ return m.first == use.resource; } );
+            if( same == merged.end() )
+            {
+                merged.emplace_back( use.resource, info );
+                continue;
+            }
+            same->second.stages |= info.stages;
+            same->second.access |= info.access;
+            same->second.write = same->second.write || info.write;
+            if( same->second.layout != info.layout )
+                same->second.layout = vk::ImageLayout::eGeneral;
+        }
+
+        for( const auto& entry : merged )
+        {
+            auto& node = m_resources[entry.first];
+            const UseInfo& info = entry.second;
+            SyncState& state = node.state;
+
+            // the first use of a transient image waits what the last image in its memory did (this frame, or the frame before)
+            MemoryBlock* block = nullptr;
+            if( !node.imported && node.isImage )
+            {
+                block = &m_blocks[m_physicalImages[node.physical].block];
+                if( i == node.firstPass )
+                {
+                    state = SyncState{};
+                    state.writeStages = block->stages;
+                    state.writeAccess = block->writeAccess;
+                    block->stages = {};
+                    block->writeAccess = {};
+                }
+            }
+
+            const bool layoutChange = node.isImage && state.layout != info.layout;
+            bool needed = false;
+            vk::PipelineStageFlags waitStages;
+            if( info.write )
+            {
+                needed = layoutChange || state.writeStages || state.readStages;
+                waitStages = state.writeStages | state.readStages;
+            }
+            else
+            {
+                needed = layoutChange || ( state.writeStages && ( info.stages & ~state.visibleStages ) );
+                waitStages = state.writeStages | ( layoutChange ? state.readStages : vk::PipelineStageFlags{} );
+            }
+
+            if( needed )
+            {
+                if( layoutChange )
+                {
+                    vk::ImageMemoryBarrier barrier {};
+                    barrier.setSrcAccessMask( state.writeAccess );
+                    barrier.setDstAccessMask( info.access );
+                    barrier.setOldLayout( state.layout );
+                    barrier.setNewLayout( info.layout );
+                    barrier.setSrcQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED );
+                    barrier.setDstQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED );
+                    barrier.setImage( image( entry.first ) );
+                    barrier.setSubresourceRange( { aspectOf( node.desc.format ), 0, VK_REMAINING_MIP_LEVELS, 0, 1 } );
+                    imageBarriers.push_back( barrier );
+                }
+                else
+                {
+                    memoryBarrier.srcAccessMask |= state.writeAccess;
+                    memoryBarrier.dstAccessMask |= info.access;
+                    hasMemoryBarrier = true;
+                }
+                srcStages |= waitStages ? waitStages : vk::PipelineStageFlags{ vk::PipelineStageFlagBits::eTopOfPipe };
+                dstStages |= info.stages;
+            }
+
+            if( info.write || layoutChange )
+            {
+                // a layout transition is a write too, the later uses chain on it
+                state.layout = node.isImage ? info.layout : state.layout;
+                state.writeStages = info.stages;
+                state.writeAccess = info.access & WriteAccess;
+                state.readStages = {};
+                state.visibleStages = info.write ? vk::PipelineStageFlags{} : info.stages;
+            }
+            else
+            {
+                state.readStages |= info.stages;
+                state.visibleStages |= info.stages;
+            }
+
+            if( block )
+            {
+                block->stages |= info.stages;
+                block->writeAccess |= info.access & WriteAccess;
+            }
+        }
+
+        if( !imageBarriers.empty() || hasMemoryBarrier )
+        {
+            sink.pipelineBarrier( pass.name, srcStages, dstStages, hasMemoryBarrier ? &memoryBarrier : nullptr, imageBarriers );
+            ++m_stats.barrierBatches;
+            m_stats.imageBarriers += static_cast<uint32_t>( imageBarriers.size() );
+        }
+
+        /**
+         * @brief The pass
+         */
+        if( !cmd )
+            continue;
+        uint32_t scope = profiler ? profiler->beginScope( cmd, pass.name ) : 0;
+        if( pass.type == PassType::eGraphics )
+        {
+            vk::RenderPassBeginInfo renderPassBeginInfo {};
+            renderPassBeginInfo.setRenderPass( pass.renderPass );
+            renderPassBeginInfo.setFramebuffer( pass.framebuffer );
+            renderPassBeginInfo.setRenderArea( vk::Rect2D{ { 0, 0 }, pass.renderArea.value_or( pass.framebufferExtent ) } );
+            renderPassBeginInfo.setClearValues( pass.clearValues );
+            cmd.beginRenderPass( renderPassBeginInfo, vk::SubpassContents::eInline );
+            if( pass.record )
+                pass.record( cmd );
+            cmd.endRenderPass();
+        }
+        else if( pass.record )
+        {
+            pass.record( cmd );
+        }
+        if( profiler )
+            profiler->endScope( cmd, scope );
+    }
+
+    /**
+     * @brief The imported images that are kept go to their final layout
+     */
+    vk::PipelineStageFlags srcStages;
+    std::vector<vk::ImageMemoryBarrier> finalBarriers;
+    for( Resource i = 0; i < m_resources.size(); ++i )
+    {
+        auto& node = m_resources[i];
+        const auto finalLayout = node.importedImage.finalLayout;
+        if( !node.imported || !node.isImage || finalLayout == vk::ImageLayout::eUndefined || finalLayout == node.state.layout )
+            continue;
+
+        vk::ImageMemoryBarrier barrier {};
+        barrier.setSrcAccessMask( node.state.writeAccess );
+        barrier.setDstAccessMask( {} );
+        barrier.setOldLayout( node.state.layout );
+        barrier.setNewLayout( finalLayout );
+        barrier.setSrcQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED );
+        barrier.setDstQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED );
+        barrier.setImage( node.importedImage.image );
+        barrier.setSubresourceRange( { aspectOf( node.desc.format ), 0, VK_REMAINING_MIP_LEVELS, 0, 1 } );
+        finalBarriers.push_back( barrier );
+
+        const auto waitStages = node.state.writeStages | node.state.readStages;
+        srcStages |= waitStages ? waitStages : vk::PipelineStageFlags{ vk::PipelineStageFlagBits::eTopOfPipe };
+        node.state.layout = finalLayout;
+    }
+    if( !finalBarriers.empty() )
+    {
+        sink.pipelineBarrier( nullptr, srcStages, vk::PipelineStageFlagBits::eBottomOfPipe, nullptr, finalBarriers );
+        ++m_stats.barrierBatches;
+        m_stats.imageBarriers += static_cast<uint32_t>( finalBarriers.size() );
+    }
+}
+
+void RenderGraph::retire( std::function<void()> destroy )
+{
+    m_retired.push_back( Retired{ m_frame, std::move( destroy ) } );
+}
+
+void RenderGraph::retireTargets()
+{
+    /**
+     * @brief The frames in flight may still use them, they're destroyed FRAME_OVERLAP frames later
+     * The framebuffers go too, some of them have the views of the transient images.
+     */
+    if( !m_physicalImages.empty() || !m_blocks.empty() )
+    {
+        retire( [d = m_device, a = m_allocator, images = m_physicalImages, blocks = m_blocks](){
+            for( const auto& physical : images )
+            {
+                d.destroyImageView( physical.view );
+                d.destroyImage( physical.image );
+            }
+            for( const auto& block : blocks )
+                a.freeMemory( block.allocation );
+        } );
+    }
+    if( !m_framebuffers.empty() )
+    {
+        retire( [d = m_device, framebuffers = m_framebuffers](){
+            for( const auto& framebuffer : framebuffers )
+                d.destroyFramebuffer( framebuffer.second );
+        } );
+    }
+
+    m_physicalImages.clear();
+    m_blocks.clear();
+    m_framebuffers.clear();
+    m_transientKey.clear();
+    ++m_generation;
+}
@@ -0,0 +1,96 @@
+#include "RenderQueue.hpp"
+#include "CpuProfiler.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace sortkey
+{
+uint64_t make( const Material& material, const Mesh& mesh, float depth )
+{
+    constexpr uint64_t depthMax = ( 1ULL << DepthBits ) - 1ULL;
+    uint64_t quantizedDepth = static_cast<uint64_t>( std::clamp( depth, 0.0f, 1.0f ) * static_cast<float>( depthMax ) );
+
+    uint64_t pipeline = material.pipelineId & ( ( 1ULL << PipelineBits ) - 1ULL );
+    uint64_t materialId = material.id & ( ( 1ULL << MaterialBits ) - 1ULL );
+    uint64_t meshId = mesh.id & ( ( 1ULL << MeshBits ) - 1ULL );
+
+    if( !material.blended )
+    {
+        return ( 0ULL << 63 )
+            | ( pipeline << ( MeshBits + MaterialBits + DepthBits ) )
+            | ( meshId << ( MaterialBits + DepthBits ) )
+            | ( materialId << DepthBits )
+            | quantizedDepth;
+    }
+
+    // the farthest object has the smallest key
+    return ( 1ULL << 63 )
+        | ( ( depthMax - quantizedDepth ) << ( PipelineBits + MeshBits + MaterialBits ) )
+        | ( pipeline << ( MeshBits + MaterialBits ) )
+        | ( meshId << MaterialBits )
+        | materialId;
+}
+} // namespace sortkey
+
+void RenderQueue::clear()
+{
+    m_items.clear();
+}
+
+void RenderQueue::push( uint64_t key, uint32_t objectIndex )
+{
+    m_items.push_back( DrawItem{ key, objectIndex } );
+}
+
+void RenderQueue::sort()
+{
+    PROFILE_FUNCTION();
+    /**
+     * @brief LSD radix sort, 8 bits (1 byte) each pass, so 8 passes for 64 bit key.
+     * All the 8 histograms are built with a single read of the keys,
+     * and the pass is skipped when all keys have the same byte (it's common for the high bytes, i.e. the pass and pipeline bits).
+     * The sort is stable, so the objects with the same key are still in the order of the visible list.
+     */
+    const size_t count = m_items.size();
+    if( count < 2 )
+        return;
+
+    std::array<std::array<uint32_t, 256>, 8> histograms {};
+    for( const auto& item : m_items )
+    {
+        for( size_t byte = 0; byte < 8; ++byte )
+            ++histograms[byte][( item.key >> ( byte * 8 ) ) & 0xFF];
+    }
+
+    m_scratch.resize( count );
+    DrawItem* src = m_items.data();
+    DrawItem* dst = m_scratch.data();
+
+    for( size_t byte = 0; byte < 8; ++byte )
+    {
+        auto& histogram = histograms[byte];
+
+        // skip this byte if every key falls to the same bucket
+        if( histogram[( src[0].key >> ( byte * 8 ) ) & 0xFF] == count )
+            continue;
+
+        // exclusive prefix sum, so the histogram become the first output position of every bucket
+        uint32_t offset = 0;
+        for( auto& bucket : histogram )
+        {
+            uint32_t bucketCount = bucket;
+            bucket = offset;
+            offset += bucketCount;
+        }
+
+        for( size_t i = 0; i < count; ++i )
+            dst[histogram[( src[i].key >> ( byte * 8 ) ) & 0xFF]++] = src[i];
+
+        std::swap( src, dst );
+    }
+
+    // the result is on the scratch buffer if the number of done passes is odd
+    if( src != m_items.data() )
+        m_items.swap( m_scratch );
+}
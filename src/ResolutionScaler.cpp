@@ -0,0 +1,89 @@
+#include "ResolutionScaler.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+void ResolutionScaler::setBudget( double gpuBudgetMs )
+{
+    m_budgetMs = std::max( gpuBudgetMs, 0.0 );
+    if( m_budgetMs == 0.0 )
+        m_scale = m_maxScale;
+}
+
+void ResolutionScaler::setRange( float minScale, float maxScale )
+{
+    // 50% per axis at the lowest, under it the upscale blit is too blurry to be worth the time
+    m_maxScale = std::clamp( maxScale, 0.5f, 1.0f );
+    m_minScale = std::clamp( minScale, 0.5f, m_maxScale );
+    m_scale = std::clamp( m_scale, m_minScale, m_maxScale );
+}
+
+void ResolutionScaler::setEnabled( bool enabled )
+{
+    if( enabled && !m_enabled )
+    {
+        // the average was measured while the scale was set by hand
+        m_cooldown = m_cooldownFrames;
+        m_smoothedMs = 0.0;
+    }
+    m_enabled = enabled;
+}
+
+void ResolutionScaler::setScale( float scale )
+{
+    m_scale = std::clamp( scale, m_minScale, m_maxScale );
+    m_cooldown = m_cooldownFrames;
+    m_smoothedMs = 0.0;
+}
+
+float ResolutionScaler::update( double gpuTimeMs )
+{
+    if( gpuTimeMs <= 0.0 )
+        return m_scale;
+
+    m_smoothedMs = m_smoothedMs == 0.0 ? gpuTimeMs : m_smoothedMs + m_smoothing * ( gpuTimeMs - m_smoothedMs );
+
+    if( !enabled() )
+        return m_scale;
+
+    if( m_cooldown > 0 )
+    {
+        --m_cooldown;
+        return m_scale;
+    }
+
+    /**
+     * @brief Over budget: jump straight to the scale that fits (a bit under it)
+     * Under the headroom: grow toward the scale that fits the headroom, but not more than m_maxStepUp
+     */
+    float newScale = m_scale;
+    if( m_smoothedMs > m_budgetMs )
+    {
+        newScale = m_scale * static_cast<float>( std::sqrt( m_budgetMs / m_smoothedMs ) ) * 0.97f;
+    }
+    else if( m_smoothedMs < m_budgetMs * m_headroom )
+    {
+        float fit = m_scale * static_cast<float>( std::sqrt( m_budgetMs * m_headroom / m_smoothedMs ) );
+        newScale = std::min( fit, m_scale + m_maxStepUp );
+    }
+
+    newScale = std::clamp( newScale, m_minScale, m_maxScale );
+    // ignore the tiny changes, it's just noise and it'd restart the cooldown
+    if( std::abs( newScale - m_scale ) < 0.01f )
+        return m_scale;
+
+    m_scale = newScale;
+    m_cooldown = m_cooldownFrames;
+    // the average belongs to the old scale
+    m_smoothedMs = 0.0;
+
+    return m_scale;
+}
+
+vk::Extent2D ResolutionScaler::scaledExtent( vk::Extent2D fullExtent ) const
+{
+    return vk::Extent2D{
+        std::max( 1U, static_cast<uint32_t>( fullExtent.width * m_scale ) ),
+        std::max( 1U, static_cast<uint32_t>( fullExtent.height * m_scale ) )
+    };
+}
@@ -1,13 +1,54 @@
 #include "SceneManagement.hpp"
 
+#include <algorithm>
+
 void SceneManagement::pushRenderableObject( RenderObject renderObject )
 {
     renderable.emplace_back( renderObject );
+    pendingFrames.push_back( 0 );
+    markDirty( static_cast<uint32_t>( renderable.size() - 1 ) );
 }
 
-void SceneManagement::createMaterial( vk::Pipeline pipeline, vk::PipelineLayout layout, const std::string& name, vk::DescriptorSet dscSet )
+void SceneManagement::setTransform( uint32_t index, const glm::mat4& transform )
 {
-    materials[name] = { dscSet, layout, pipeline };
+    renderable[index].transformMatrix = transform;
+    markDirty( index );
+}
+
+void SceneManagement::markDirty( uint32_t index )
+{
+    // it's already on the dirty list, just restart the count down
+    if( pendingFrames[index] == 0 )
+        dirtyObjects.push_back( index );
+
+    pendingFrames[index] = FRAME_OVERLAP;
+}
+
+void SceneManagement::takeDirtyObjects( std::vector<uint32_t>& outDirty )
+{
+    std::sort( dirtyObjects.begin(), dirtyObjects.end() );
+    outDirty = dirtyObjects;
+
+    size_t keep = 0;
+    for( uint32_t index : dirtyObjects )
+    {
+        if( --pendingFrames[index] > 0 )
+            dirtyObjects[keep++] = index;
+    }
+    dirtyObjects.resize( keep );
+}
+
+void SceneManagement::createMaterial( vk::Pipeline pipeline, vk::PipelineLayout layout, const std::string& name )
+{
+    auto pipelineId = pipelineIds.emplace( static_cast<VkPipeline>( pipeline ), static_cast<uint32_t>( pipelineIds.size() ) ).first->second;
+
+    auto found = materials.find( name );
+    uint32_t id = found != materials.end() ? found->second.id : static_cast<uint32_t>( materials.size() );
+
+    materials[name] = { layout, pipeline };
+    materials[name].id = id;
+    materials[name].pipelineId = pipelineId;
+    materials[name].name = name;
 }
 
 // void SceneManagement::createMaterial( Material material, const std::string& name )
@@ -17,6 +58,9 @@ void SceneManagement::createMaterial( vk::Pipeline pipeline, vk::PipelineLayout
 
 void SceneManagement::createMesh( Mesh mesh, const std::string& name )
 {
+    auto found = meshes.find( name );
+    mesh.id = found != meshes.end() ? found->second.id : static_cast<uint32_t>( meshes.size() );
+
     meshes[name] = mesh;
 }
 
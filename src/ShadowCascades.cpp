@@ -0,0 +1,489 @@
+#include "ShadowCascades.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "GraphicsPipeline.hpp"
+#include "Initializer.hpp"
+#include "Vulkan_Init.hpp"
+
+#ifndef ENGINE_CATCH
+#define ENGINE_CATCH                            \
+    catch( const vk::SystemError& err )         \
+    {                                           \
+        throw std::runtime_error( err.what() ); \
+    }
+#endif
+
+namespace
+{
+// the resources and the passes of the render graph, the pass names are also the GPU scopes
+constexpr const char* StaticMapNames[]      = { "shadow map 0", "shadow map 1", "shadow map 2", "shadow map 3" };
+constexpr const char* CompositeMapNames[]   = { "shadow composite 0", "shadow composite 1", "shadow composite 2", "shadow composite 3" };
+constexpr const char* StaticPassNames[]     = { "shadow static 0", "shadow static 1", "shadow static 2", "shadow static 3" };
+constexpr const char* CopyPassNames[]       = { "shadow copy 0", "shadow copy 1", "shadow copy 2", "shadow copy 3" };
+constexpr const char* DynamicPassNames[]    = { "shadow dynamic 0", "shadow dynamic 1", "shadow dynamic 2", "shadow dynamic 3" };
+static_assert( sizeof( StaticPassNames ) / sizeof( StaticPassNames[0] ) == ShadowCascades::CascadeCount, "a name for every cascade" );
+
+// glm::ortho is -1 to 1 in depth (without GLM_FORCE_DEPTH_ZERO_TO_ONE), the shadow maps use the 0 to 1 depth of Vulkan
+glm::mat4 orthoZeroToOne( float left, float right, float bottom, float top, float zNear, float zFar )
+{
+    glm::mat4 projection { 1.0f };
+    projection[0][0] = 2.0f / ( right - left );
+    projection[1][1] = 2.0f / ( top - bottom );
+    projection[2][2] = -1.0f / ( zFar - zNear );
+    projection[3][0] = -( right + left ) / ( right - left );
+    projection[3][1] = -( top + bottom ) / ( top - bottom );
+    projection[3][2] = -zNear / ( zFar - zNear );
+    return projection;
+}
+} // namespace
+
+void ShadowCascades::init( vk::Device device, vma::Allocator allocator, DescriptorLayoutCache& layoutCache, vk::RenderPass renderPass, vk::PipelineCache pipelineCache )
+{
+    m_device = device;
+    m_allocator = allocator;
+    m_layoutCache = &layoutCache;
+
+    createPipeline( renderPass, pipelineCache );
+    createMaps();
+
+    /**
+     * @brief The sampler of material.frag: the compare of the depth is done by the sampler, and linear filtering
+     * blends the four nearest results (2x2 PCF). Outside of the map is white, i.e. lit.
+     */
+    vk::SamplerCreateInfo samplerInfo {};
+    samplerInfo.setMagFilter( vk::Filter::eLinear );
+    samplerInfo.setMinFilter( vk::Filter::eLinear );
+    samplerInfo.setMipmapMode( vk::SamplerMipmapMode::eNearest );
+    samplerInfo.setAddressModeU( vk::SamplerAddressMode::eClampToBorder );
+    samplerInfo.setAddressModeV( vk::SamplerAddressMode::eClampToBorder );
+    samplerInfo.setAddressModeW( vk::SamplerAddressMode::eClampToBorder );
+    samplerInfo.setBorderColor( vk::BorderColor::eFloatOpaqueWhite );
+    samplerInfo.setCompareEnable( VK_TRUE );
+    samplerInfo.setCompareOp( vk::CompareOp::eLessOrEqual );
+    samplerInfo.setMaxLod( 0.0f );
+    try
+    {
+        m_sampler = m_device.createSampler( samplerInfo );
+    } ENGINE_CATCH
+
+    m_deletionQueue.pushFunction(
+        [d = m_device, s = m_sampler](){
+            d.destroySampler( s );
+        }
+    );
+}
+
+void ShadowCascades::destroy()
+{
+    for( auto& frame : m_frames )
+    {
+        if( frame.instanceBuffer.buffer )
+        {
+            m_allocator.unmapMemory( frame.instanceBuffer.allocation );
+            m_allocator.destroyBuffer( frame.instanceBuffer.buffer, frame.instanceBuffer.allocation );
+        }
+        frame = FrameBuffers{};
+    }
+
+    m_deletionQueue.flush();
+}
+
+void ShadowCascades::createPipeline( vk::RenderPass renderPass, vk::PipelineCache pipelineCache )
+{
+    const auto vertex = vk::ShaderStageFlagBits::eVertex;
+    m_setLayout = m_layoutCache->createLayout( {
+        init::dsc::initDescriptorSetLayoutBinding( 0, vk::DescriptorType::eStorageBuffer, vertex ),   // objects
+        init::dsc::initDescriptorSetLayoutBinding( 1, vk::DescriptorType::eStorageBuffer, vertex ),   // the casters of the cascades
+    } );
+
+    vk::PushConstantRange pushConstant { vertex, 0, sizeof( CasterPushConstant ) };
+    vk::PipelineLayoutCreateInfo layoutInfo {};
+    layoutInfo.setSetLayouts( m_setLayout );
+    layoutInfo.setPushConstantRanges( pushConstant );
+    try
+    {
+        m_layout = m_device.createPipelineLayout( layoutInfo );
+    } ENGINE_CATCH
+    m_deletionQueue.pushFunction(
+        [d = m_device, l = m_layout](){
+            d.destroyPipelineLayout( l );
+        }
+    );
+
+    /**
+     * @brief Depth only, with the slope scaled bias against the shadow acne of the surfaces that face the sun at a grazing angle
+     */
+    GraphicsPipeline builder;
+    builder.init( m_device, "shaders/shadow.spv", "", vk::Extent2D{ Resolution, Resolution } );
+    builder.m_vertexInputDesc = Vertex::getVertexInputDescription();
+    builder.makeDepthOnly();
+    // the shadow passes have no color attachment at all
+    builder.m_colorBlendStateInfo.setAttachments( nullptr );
+    builder.m_rasterizationStateInfo.setDepthBiasEnable( VK_TRUE );
+    builder.m_rasterizationStateInfo.setDepthBiasConstantFactor( 1.25f );
+    builder.m_rasterizationStateInfo.setDepthBiasSlopeFactor( 1.75f );
+
+    builder.createGraphicsPipeline( renderPass, m_layout, m_deletionQueue, pipelineCache );
+    m_pipeline = builder.getGraphicsPipeline();
+}
+
+void ShadowCascades::createMaps()
+{
+    /**
+     * @brief The static map of every cascade, a separate image each
+     * (the render graph tracks the layout of a whole image, so the cascades can't be the layers of one image)
+     */
+    for( auto& cascade : m_cascades )
+    {
+        auto imageInfo = init::image::initImageInfo(
+            Format,
+            vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc,
+            vk::Extent3D{ Resolution, Resolution, 1 }
+        );
+
+        vma::AllocationCreateInfo allocInfo {};
+        allocInfo.setUsage( vma::MemoryUsage::eGpuOnly );
+        {
+            auto temp = m_allocator.createImage( imageInfo, allocInfo );
+            cascade.image.image = temp.first;
+            cascade.image.allocation = temp.second;
+        }
+
+        auto viewInfo = init::image::initImageViewInfo( Format, cascade.image.image, vk::ImageAspectFlagBits::eDepth );
+        try
+        {
+            cascade.view = m_device.createImageView( viewInfo );
+        } ENGINE_CATCH
+
+        m_deletionQueue.pushFunction(
+            [d = m_device, a = m_allocator, i = cascade.image, v = cascade.view](){
+                d.destroyImageView( v );
+                a.destroyImage( i.image, i.allocation );
+            }
+        );
+    }
+}
+
+void ShadowCascades::prepare( uint32_t frameIndex, const glm::mat4& view, float fovY, float aspect, float zNear, const glm::vec3& sunDirection,
+                              const BoundsSoA& bounds, const std::vector<RenderObject>& renderable, FrustumCuller& culler, bool staticChanged )
+{
+    auto& frame = m_frames[frameIndex];
+    const glm::vec3 direction = glm::normalize( sunDirection );
+    const glm::mat4 inverseView = glm::inverse( view );
+
+    /**
+     * @brief The splits, between the uniform and the logarithmic ones
+     */
+    const float zFar = std::max( m_settings.distance, zNear * 2.0f );
+    for( uint32_t i = 0; i < CascadeCount; ++i )
+    {
+        const float p = static_cast<float>( i + 1 ) / static_cast<float>( CascadeCount );
+        const float logarithmic = zNear * std::pow( zFar / zNear, p );
+        const float uniform = zNear + ( zFar - zNear ) * p;
+        m_splits[i] = uniform + ( logarithmic - uniform ) * m_settings.splitLambda;
+    }
+
+    // the casters of one kind in the box of a cascade, sorted by mesh, to the instances and the runs
+    auto addRuns = [&]( bool dynamic, std::vector<uint32_t>& outRuns ) -> uint32_t {
+        m_casters.clear();
+        for( uint32_t i : m_visible )
+        {
+            if( renderable[i].dynamic == dynamic )
+                m_casters.push_back( i );
+        }
+        std::sort( m_casters.begin(), m_casters.end(), [&renderable]( uint32_t a, uint32_t b ){
+            return std::less<const Mesh*>()( renderable[a].pMesh, renderable[b].pMesh );
+        } );
+
+        outRuns.clear();
+        for( size_t first = 0; first < m_casters.size(); )
+        {
+            const Mesh* mesh = renderable[m_casters[first]].pMesh;
+            size_t last = first + 1;
+            while( last < m_casters.size() && renderable[m_casters[last]].pMesh == mesh )
+                ++last;
+
+            outRuns.push_back( static_cast<uint32_t>( m_runs.size() ) );
+            m_runs.push_back( Run{ mesh, static_cast<uint32_t>( m_instances.size() ), static_cast<uint32_t>( last - first ) } );
+            m_instances.insert( m_instances.end(), m_casters.begin() + first, m_casters.begin() + last );
+            first = last;
+        }
+        return static_cast<uint32_t>( m_casters.size() );
+    };
+
+    m_runs.clear();
+    m_instances.clear();
+    const float tanHalf = std::tan( fovY * 0.5f );
+    const float cornerScale = tanHalf * tanHalf * ( 1.0f + aspect * aspect );     // squared distance of a corner from the axis, per squared depth
+    for( uint32_t c = 0; c < CascadeCount; ++c )
+    {
+        auto& cascade = m_cascades[c];
+        auto& stats = m_stats[c];
+        CachedBox& box = cascade.box;
+
+        /**
+         * @brief The bounding sphere of the slice of the view frustum
+         * Its center is on the view axis, where the near and the far corners are at the same distance (or at the far plane).
+         */
+        const float sliceNear = c == 0 ? zNear : m_splits[c - 1];
+        const float sliceFar = m_splits[c];
+        const float centerDepth = std::min( ( sliceNear + sliceFar ) * ( 1.0f + cornerScale ) * 0.5f, sliceFar );
+        const float radius = std::sqrt( sliceFar * sliceFar * cornerScale + ( sliceFar - centerDepth ) * ( sliceFar - centerDepth ) );
+        const glm::vec3 center = glm::vec3{ inverseView * glm::vec4{ 0.0f, 0.0f, -centerDepth, 1.0f } };
+
+        /**
+         * @brief Is the cached static map still good for this cascade
+         */
+        Invalidation invalidation = Invalidation::eNone;
+        if( !box.valid )
+            invalidation = Invalidation::eFirst;
+        else if( m_forceInvalidation || !m_cacheEnabled )
+            invalidation = Invalidation::eForced;
+        else if( staticChanged )
+            invalidation = Invalidation::eScene;
+        else if( glm::dot( box.sunDirection, direction ) < m_settings.lightThreshold )
+            invalidation = Invalidation::eLight;
+        else if( glm::length( center - box.center ) + radius > box.radius )
+            invalidation = Invalidation::eBounds;
+
+        if( invalidation != Invalidation::eNone )
+        {
+            /**
+             * @brief A new box around the cascade, bigger by the margin
+             * The light view goes through the world origin along the sun direction, so it only changes with the sun:
+             * the box is moved in it to whole texels of the map, and the edges of the shadows don't crawl when it's rendered again.
+             * The depth range starts far enough on the sun side to have the casters in front of the cascade.
+             */
+            const float boxRadius = radius * ( 1.0f + m_settings.margin );
+            const float texel = 2.0f * boxRadius / static_cast<float>( Resolution );
+            const glm::vec3 up = std::abs( direction.y ) > 0.99f ? glm::vec3{ 0.0f, 0.0f, 1.0f } : glm::vec3{ 0.0f, 1.0f, 0.0f };
+            const glm::mat4 lightView = glm::lookAt( glm::vec3{ 0.0f }, direction, up );
+
+            const glm::vec4 origin = lightView * glm::vec4{ center, 1.0f };
+            const float x = std::floor( origin.x / texel ) * texel;
+            const float y = std::floor( origin.y / texel ) * texel;
+            const float depth = -origin.z;
+            const glm::mat4 projection = orthoZeroToOne( x - boxRadius, x + boxRadius, y - boxRadius, y + boxRadius,
+                                                         depth - boxRadius - m_settings.casterDistance, depth + boxRadius );
+
+            box.viewproj = projection * lightView;
+            box.center = center;
+            box.radius = boxRadius - 2.0f * texel;
+            box.sunDirection = direction;
+            box.valid = true;
+
+            ++stats.staticRenders;
+            stats.lastInvalidation = invalidation;
+        }
+
+        stats.splitNear = sliceNear;
+        stats.splitFar = sliceFar;
+        stats.radius = box.radius;
+        stats.rendered = invalidation != Invalidation::eNone;
+
+        /**
+         * @brief The casters of this cascade: in its box, the static ones only when the static map is rendered
+         * (the near plane of the frustum comes out as -1 in depth, so the culling keeps a bit more behind the sun side, which is harmless)
+         */
+        culler.cull( Frustum::fromViewProjection( box.viewproj ), bounds, m_visible );
+        cascade.staticRuns.clear();
+        if( stats.rendered )
+        {
+            stats.staticCasters = addRuns( false, cascade.staticRuns );
+            stats.staticDraws = static_cast<uint32_t>( cascade.staticRuns.size() );
+        }
+        else
+        {
+            stats.staticDraws = 0;
+        }
+        stats.dynamicCasters = addRuns( true, cascade.dynamicRuns );
+        stats.dynamicDraws = static_cast<uint32_t>( cascade.dynamicRuns.size() );
+    }
+    m_forceInvalidation = false;
+
+    /**
+     * @brief Growth (doubling) of the instance buffer of this frame, it's not used by the GPU anymore
+     */
+    if( m_instances.size() > frame.capacity || !frame.instanceBuffer.buffer )
+    {
+        if( frame.instanceBuffer.buffer )
+        {
+            m_allocator.unmapMemory( frame.instanceBuffer.allocation );
+            m_allocator.destroyBuffer( frame.instanceBuffer.buffer, frame.instanceBuffer.allocation );
+        }
+        frame.capacity = std::max<size_t>( std::max<size_t>( frame.capacity * 2, m_instances.size() ), 256 );
+        frame.instanceBuffer = AllocatedBuffer::createBuffer( frame.capacity * sizeof( uint32_t ),
+            vk::BufferUsageFlagBits::eStorageBuffer, m_allocator, vma::MemoryUsage::eCpuToGpu );
+        frame.instances = reinterpret_cast<uint32_t*>( m_allocator.mapMemory( frame.instanceBuffer.allocation ) );
+    }
+    std::memcpy( frame.instances, m_instances.data(), m_instances.size() * sizeof( uint32_t ) );
+}
+
+void ShadowCascades::fillSceneParameters( GpuSceneParameterData& data, const glm::mat4& view ) const
+{
+    // material.frag has the view space position, so every matrix goes from the view space of the camera to its cascade
+    const glm::mat4 inverseView = glm::inverse( view );
+    data.cascadeSplits = glm::vec4{ m_splits[0], m_splits[1], m_splits[2], m_splits[3] };
+    for( uint32_t c = 0; c < CascadeCount; ++c )
+        data.cascadeViewproj[c] = m_cascades[c].box.viewproj * inverseView;
+}
+
+std::array<RenderGraph::Resource, ShadowCascades::CascadeCount> ShadowCascades::addPasses( RenderGraph& graph, uint32_t frameIndex, vk::Buffer objectBuffer,
+                                                                                           DescriptorAllocator& transientDescriptors )
+{
+    vk::DescriptorSet set;
+    vk::DescriptorBufferInfo objectInfo { objectBuffer, 0, VK_WHOLE_SIZE };
+    vk::DescriptorBufferInfo instanceInfo { m_frames[frameIndex].instanceBuffer.buffer, 0, VK_WHOLE_SIZE };
+    DescriptorBuilder::begin( *m_layoutCache, transientDescriptors )
+        .bindBuffer( 0, objectInfo, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eVertex )
+        .bindBuffer( 1, instanceInfo, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eVertex )
+        .build( set );
+
+    for( uint32_t c = 0; c < CascadeCount; ++c )
+    {
+        auto& cascade = m_cascades[c];
+        const bool rendered = m_stats[c].rendered;
+        const bool hasDynamic = !cascade.dynamicRuns.empty();
+
+        /**
+         * @brief The static map lives across the frames
+         * Writing it, or moving it to be copied, has to wait the scene passes of the frame before that sampled it.
+         * The frames that only sample it need nothing.
+         */
+        RenderGraph::ImportedImage map {};
+        map.image = cascade.image.image;
+        map.view = cascade.view;
+        map.desc = { Format, { Resolution, Resolution } };
+        map.initialLayout = cascade.layout;
+        map.initialStages = rendered || hasDynamic ? vk::PipelineStageFlags{ vk::PipelineStageFlagBits::eFragmentShader } : vk::PipelineStageFlags{};
+        map.finalLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+        auto staticMap = graph.importImage( StaticMapNames[c], map );
+        cascade.layout = map.finalLayout;
+
+        if( rendered )
+        {
+            graph.addPass( StaticPassNames[c], RenderGraph::PassType::eGraphics )
+                .depthAttachment( staticMap, vk::ClearDepthStencilValue{ 1.0f, 0 } )
+                .execute( [this, c, set]( vk::CommandBuffer cmd ){
+                    recordCasters( cmd, m_cascades[c].box.viewproj, set, m_cascades[c].staticRuns );
+                } );
+        }
+        m_sampled[c] = staticMap;
+
+        /**
+         * @brief The dynamic casters on a copy of the static map, with the same box
+         */
+        if( hasDynamic )
+        {
+            auto composite = graph.createImage( CompositeMapNames[c], { Format, { Resolution, Resolution } } );
+            graph.addPass( CopyPassNames[c], RenderGraph::PassType::eTransfer )
+                .transferSrc( staticMap )
+                .transferDst( composite )
+                .execute( [&graph, staticMap, composite]( vk::CommandBuffer cmd ){
+                    vk::ImageCopy copyRegion {};
+                    copyRegion.setSrcSubresource( vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eDepth, 0, 0, 1 } );
+                    copyRegion.setDstSubresource( vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eDepth, 0, 0, 1 } );
+                    copyRegion.setExtent( vk::Extent3D{ Resolution, Resolution, 1 } );
+                    cmd.copyImage(
+                        graph.image( staticMap ), vk::ImageLayout::eTransferSrcOptimal,
+                        graph.image( composite ), vk::ImageLayout::eTransferDstOptimal,
+                        copyRegion
+                    );
+                } );
+
+            graph.addPass( DynamicPassNames[c], RenderGraph::PassType::eGraphics )
+                .depthAttachment( composite )
+                .execute( [this, c, set]( vk::CommandBuffer cmd ){
+                    recordCasters( cmd, m_cascades[c].box.viewproj, set, m_cascades[c].dynamicRuns );
+                } );
+            m_sampled[c] = composite;
+        }
+    }
+
+    return m_sampled;
+}
+
+void ShadowCascades::recordCasters( vk::CommandBuffer cmd, const glm::mat4& viewproj, vk::DescriptorSet set, const std::vector<uint32_t>& runs ) const
+{
+    vk::Viewport viewport { 0.0f, 0.0f, static_cast<float>( Resolution ), static_cast<float>( Resolution ), 0.0f, 1.0f };
+    vk::Rect2D scissor { { 0, 0 }, { Resolution, Resolution } };
+    cmd.setViewport( 0, viewport );
+    cmd.setScissor( 0, scissor );
+
+    cmd.bindPipeline( vk::PipelineBindPoint::eGraphics, m_pipeline );
+    cmd.bindDescriptorSets( vk::PipelineBindPoint::eGraphics, m_layout, 0, set, nullptr );
+    CasterPushConstant push { viewproj };
+    cmd.pushConstants<CasterPushConstant>( m_layout, vk::ShaderStageFlagBits::eVertex, 0, push );
+
+    // one instanced draw per mesh, gl_InstanceIndex picks the caster from the instance buffer
+    const vk::DeviceSize offset = 0;
+    for( uint32_t r : runs )
+    {
+        const Run& run = m_runs[r];
+        cmd.bindVertexBuffers( 0, run.mesh->vertexBuffer.buffer, offset );
+        cmd.draw( static_cast<uint32_t>( run.mesh->vertices.size() ), run.count, 0, run.first );
+    }
+}
+
+void ShadowCascades::writeDescriptors( const RenderGraph& graph, uint32_t frameIndex, vk::DescriptorSet globalSet )
+{
+    auto& frame = m_frames[frameIndex];
+
+    // a view of a new transient image can have the handle of a destroyed one, so nothing bound before is trusted
+    if( frame.graphGeneration != graph.generation() )
+    {
+        frame.boundViews = {};
+        frame.graphGeneration = graph.generation();
+    }
+
+    std::array<vk::DescriptorImageInfo, CascadeCount> imageInfos;
+    std::vector<vk::WriteDescriptorSet> setWrites;
+    for( uint32_t c = 0; c < CascadeCount; ++c )
+    {
+        vk::ImageView view = graph.imageView( m_sampled[c] );
+        if( view == frame.boundViews[c] )
+            continue;
+
+        imageInfos[c] = vk::DescriptorImageInfo{ m_sampler, view, vk::ImageLayout::eShaderReadOnlyOptimal };
+        setWrites.push_back( vk::WriteDescriptorSet{ globalSet, FirstBinding + c, 0, vk::DescriptorType::eCombinedImageSampler, imageInfos[c], nullptr, nullptr } );
+        frame.boundViews[c] = view;
+    }
+
+    if( !setWrites.empty() )
+        m_device.updateDescriptorSets( setWrites, nullptr );
+}
+
+const char* ShadowCascades::staticPassName( uint32_t cascade )
+{
+    return StaticPassNames[cascade];
+}
+
+const char* ShadowCascades::copyPassName( uint32_t cascade )
+{
+    return CopyPassNames[cascade];
+}
+
+const char* ShadowCascades::dynamicPassName( uint32_t cascade )
+{
+    return DynamicPassNames[cascade];
+}
+
+const char* ShadowCascades::name( Invalidation invalidation )
+{
+    switch( invalidation )
+    {
+        case Invalidation::eFirst:  return "first";
+        case Invalidation::eScene:  return "scene";
+        case Invalidation::eLight:  return "light";
+        case Invalidation::eBounds: return "bounds";
+        case Invalidation::eForced: return "forced";
+        case Invalidation::eNone:
+        default:                    return "none";
+    }
+}
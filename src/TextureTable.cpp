@@ -0,0 +1,132 @@
+#include "TextureTable.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#ifndef ENGINE_CATCH
+#define ENGINE_CATCH                            \
+    catch( const vk::SystemError& err )         \
+    {                                           \
+        throw std::runtime_error( err.what() ); \
+    }
+#endif
+
+vk::PhysicalDeviceDescriptorIndexingFeaturesEXT TextureTable::requiredFeatures()
+{
+    vk::PhysicalDeviceDescriptorIndexingFeaturesEXT features {};
+    features.setShaderSampledImageArrayNonUniformIndexing( VK_TRUE );
+    features.setDescriptorBindingSampledImageUpdateAfterBind( VK_TRUE );
+    features.setDescriptorBindingPartiallyBound( VK_TRUE );
+    features.setRuntimeDescriptorArray( VK_TRUE );
+
+    return features;
+}
+
+bool TextureTable::isSupported( vk::PhysicalDevice physicalDevice )
+{
+    auto extensions = physicalDevice.enumerateDeviceExtensionProperties();
+    bool hasExtension = std::any_of( extensions.begin(), extensions.end(),
+        []( const vk::ExtensionProperties& ext ){ return strcmp( ext.extensionName, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME ) == 0; }
+    );
+    if( !hasExtension )
+        return false;
+
+    auto chain = physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceDescriptorIndexingFeaturesEXT>();
+    const auto& features = chain.get<vk::PhysicalDeviceDescriptorIndexingFeaturesEXT>();
+
+    return features.shaderSampledImageArrayNonUniformIndexing
+        && features.descriptorBindingSampledImageUpdateAfterBind
+        && features.descriptorBindingPartiallyBound
+        && features.runtimeDescriptorArray;
+}
+
+void TextureTable::init( vk::Device device, vk::PhysicalDevice physicalDevice )
+{
+    m_device = device;
+
+    auto properties = physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>();
+    const auto& indexing = properties.get<vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>();
+    m_textureCapacity = std::min( { MaxTextures, indexing.maxPerStageDescriptorUpdateAfterBindSampledImages, indexing.maxDescriptorSetUpdateAfterBindSampledImages } );
+
+    /**
+     * @brief Layout
+     * Partially bound: the slots that are never written are fine as long as the shaders don't read them
+     */
+    std::array<vk::DescriptorSetLayoutBinding, 2> bindings = {
+        vk::DescriptorSetLayoutBinding{ 0, vk::DescriptorType::eSampledImage, m_textureCapacity, vk::ShaderStageFlagBits::eFragment },
+        vk::DescriptorSetLayoutBinding{ 1, vk::DescriptorType::eSampler, MaxSamplers, vk::ShaderStageFlagBits::eFragment }
+    };
+    std::array<vk::DescriptorBindingFlagsEXT, 2> bindingFlags = {
+        vk::DescriptorBindingFlagBitsEXT::ePartiallyBound | vk::DescriptorBindingFlagBitsEXT::eUpdateAfterBind,
+        vk::DescriptorBindingFlagBitsEXT::ePartiallyBound
+    };
+    vk::DescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo {};
+    bindingFlagsInfo.setBindingFlags( bindingFlags );
+
+    vk::DescriptorSetLayoutCreateInfo layoutInfo {};
+    layoutInfo.setFlags( vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPoolEXT );
+    layoutInfo.setBindings( bindings );
+    layoutInfo.setPNext( &bindingFlagsInfo );
+
+    /**
+     * @brief Pool of the one set
+     */
+    std::array<vk::DescriptorPoolSize, 2> sizes = {
+        vk::DescriptorPoolSize{ vk::DescriptorType::eSampledImage, m_textureCapacity },
+        vk::DescriptorPoolSize{ vk::DescriptorType::eSampler, MaxSamplers }
+    };
+    vk::DescriptorPoolCreateInfo poolInfo {};
+    poolInfo.setFlags( vk::DescriptorPoolCreateFlagBits::eUpdateAfterBindEXT );
+    poolInfo.setMaxSets( 1 );
+    poolInfo.setPoolSizes( sizes );
+
+    try
+    {
+        m_layout = m_device.createDescriptorSetLayout( layoutInfo );
+        m_pool = m_device.createDescriptorPool( poolInfo );
+
+        vk::DescriptorSetAllocateInfo setAllocInfo {};
+        setAllocInfo.setDescriptorPool( m_pool );
+        setAllocInfo.setSetLayouts( m_layout );
+        m_set = m_device.allocateDescriptorSets( setAllocInfo ).front();
+
+        // the same sampler as the textures had before the table (all default: nearest, repeat)
+        m_defaultSampler = m_device.createSampler( vk::SamplerCreateInfo{} );
+    } ENGINE_CATCH
+
+    m_textureCount = 0;
+    m_samplerCount = 0;
+    addSampler( m_defaultSampler );
+}
+
+void TextureTable::destroy()
+{
+    m_device.destroySampler( m_defaultSampler );
+    m_device.destroyDescriptorPool( m_pool );
+    m_device.destroyDescriptorSetLayout( m_layout );
+}
+
+uint32_t TextureTable::addTexture( vk::ImageView imageView )
+{
+    if( m_textureCount >= m_textureCapacity )
+        throw std::runtime_error( "The texture table is full (" + std::to_string( m_textureCapacity ) + " textures)" );
+
+    vk::DescriptorImageInfo imageInfo { nullptr, imageView, vk::ImageLayout::eShaderReadOnlyOptimal };
+    vk::WriteDescriptorSet setWrite { m_set, 0, m_textureCount, 1, vk::DescriptorType::eSampledImage, &imageInfo, nullptr, nullptr };
+    m_device.updateDescriptorSets( setWrite, nullptr );
+
+    return m_textureCount++;
+}
+
+uint32_t TextureTable::addSampler( vk::Sampler sampler )
+{
+    if( m_samplerCount >= MaxSamplers )
+        throw std::runtime_error( "The texture table is full (" + std::to_string( MaxSamplers ) + " samplers)" );
+
+    vk::DescriptorImageInfo samplerInfo { sampler, nullptr, vk::ImageLayout::eUndefined };
+    vk::WriteDescriptorSet setWrite { m_set, 1, m_samplerCount, 1, vk::DescriptorType::eSampler, &samplerInfo, nullptr, nullptr };
+    m_device.updateDescriptorSets( setWrite, nullptr );
+
+    return m_samplerCount++;
+}
@@ -2,6 +2,8 @@
 
 #include "stb_image.h"
 
+#include <iostream>
+
 #include "Engine.hpp"
 #include "utils.hpp"
 
@@ -13,7 +15,7 @@
     }
 #endif
 
-vk::UniqueInstance init::createInstance()
+vk::UniqueInstance init::createInstance( bool headless )
 {
     auto appInfo = vk::ApplicationInfo{
         "Vulkan Engine",
@@ -27,7 +29,7 @@ vk::UniqueInstance init::createInstance()
      * The Extensension
      */
     auto instanceExtensions = vk::enumerateInstanceExtensionProperties();
-    auto enabledExtensions = utils::getRequiredExtensions();
+    auto enabledExtensions = utils::getRequiredExtensions( headless );
     for ( const auto& extension : enabledExtensions )
     {
         auto found = std::find_if( instanceExtensions.begin(), instanceExtensions.end(),
@@ -46,9 +48,14 @@ vk::UniqueInstance init::createInstance()
     for( const auto& layer : validationLayers )
     {
         auto found = std::find_if( instanceLayers.begin(), instanceLayers.end(),
-                            [&layer]( const vk::LayerProperties& l ){ return strcmp( l.layerName, layer ); }
+                            [&layer]( const vk::LayerProperties& l ){ return strcmp( l.layerName, layer ) == 0; }
         );
-        assert( found != instanceLayers.end() );
+        // CI machines and render farm usually don't have the validation layers installed, so just skip it
+        if( found == instanceLayers.end() )
+        {
+            std::cout << layer << " is not available, it won't be enabled\n";
+            continue;
+        }
         enableValidationLayers.push_back( layer );
     }
 
@@ -120,7 +127,7 @@ vk::PhysicalDevice init::pickPhysicalDevice( const vk::Instance& instance, const
     return choose;
 }
 
-vk::UniqueDevice init::createDevice( const vk::PhysicalDevice& physicalDevice, const vk::SurfaceKHR& surface )
+vk::UniqueDevice init::createDevice( const vk::PhysicalDevice& physicalDevice, const vk::SurfaceKHR& surface, const std::vector<const char*>& extraExtensions, void* featureChain )
 {
     auto graphicsAndPresentQueueFamily = utils::FindQueueFamilyIndices( physicalDevice, surface );
 
@@ -133,7 +140,10 @@ vk::UniqueDevice init::createDevice( const vk::PhysicalDevice& physicalDevice, c
     };
 
     auto deviceExtensions = physicalDevice.enumerateDeviceExtensionProperties();
-    std::vector<const char*> enabledExtension = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+    std::vector<const char*> enabledExtension;
+    if( surface )
+        enabledExtension.push_back( VK_KHR_SWAPCHAIN_EXTENSION_NAME );
+    enabledExtension.insert( enabledExtension.end(), extraExtensions.begin(), extraExtensions.end() );
     std::vector<const char*> extensions; extensions.reserve( enabledExtension.size() );
     for ( const auto& extension : enabledExtension )
     {
@@ -153,13 +163,22 @@ vk::UniqueDevice init::createDevice( const vk::PhysicalDevice& physicalDevice, c
         &deviceFeatures                 // device features
     };
 
+    // the features of the extensions can only be enabled through vk::PhysicalDeviceFeatures2, which takes the place of pEnabledFeatures
+    vk::PhysicalDeviceFeatures2 deviceFeatures2 { deviceFeatures };
+    if( featureChain )
+    {
+        deviceFeatures2.setPNext( featureChain );
+        deviceInfo.setPEnabledFeatures( nullptr );
+        deviceInfo.setPNext( &deviceFeatures2 );
+    }
+
     try
     {
         return physicalDevice.createDeviceUnique( deviceInfo );
     } ENGINE_CATCH
 }
 
-vk::SwapchainKHR init::sc::createSwapchain( const vk::PhysicalDevice& physicalDevice, const vk::Device& device, const vk::SurfaceKHR& surface )
+vk::SwapchainKHR init::sc::createSwapchain( const vk::PhysicalDevice& physicalDevice, const vk::Device& device, const vk::SurfaceKHR& surface, vk::PresentModeKHR preferredPresentMode, vk::SwapchainKHR oldSwapchain )
 {
     auto surfaceCapability = physicalDevice.getSurfaceCapabilitiesKHR( surface );
     auto surfaceFormats = physicalDevice.getSurfaceFormatsKHR( surface );
@@ -167,7 +186,9 @@ vk::SwapchainKHR init::sc::createSwapchain( const vk::PhysicalDevice& physicalDe
 
     auto surfaceExtent = utils::sc::chooseSurfaceExtent( surfaceCapability );
     auto surfaceFormat = utils::sc::chooseSurfaceFormat( surfaceFormats );
-    auto presentMode = utils::sc::choosePresentMode( surfacePresentModes );
+    auto presentMode = utils::sc::choosePresentMode( surfacePresentModes, preferredPresentMode );
+    if( presentMode != preferredPresentMode )
+        std::cout << vk::to_string( preferredPresentMode ) << " is not supported, fall back to " << vk::to_string( presentMode ) << "\n";
 
     uint32_t imageCount = surfaceCapability.minImageCount + 1;
     if (surfaceCapability.maxImageCount > 0 && imageCount > surfaceCapability.maxImageCount) {
@@ -182,14 +203,15 @@ vk::SwapchainKHR init::sc::createSwapchain( const vk::PhysicalDevice& physicalDe
         surfaceFormat.colorSpace,   // surfaceFormat.colorspace == image colorspace
         surfaceExtent,
         1,
-        vk::ImageUsageFlagBits::eColorAttachment,
+        // the scene is rendered to its own image, and then blitted (upscaled) to the swapchain image
+        vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferDst,
         {},  // sharing mode
         {},  // queue family indices
         surfaceCapability.currentTransform,     // transform
         vk::CompositeAlphaFlagBitsKHR::eOpaque, // composite alpha
         presentMode,
         VK_TRUE,                                // clipped
-        nullptr                                 // old swapchain
+        oldSwapchain                            // old swapchain
     };
 
     auto graphicsAndPresentQueueFamily = utils::FindQueueFamilyIndices( physicalDevice, surface );
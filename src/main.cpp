@@ -2,10 +2,10 @@
 
 #include "Engine.hpp"
 
-int main() {
+int main( int argc, char** argv ) {
     try
     {
-        Engine engine;
+        Engine engine( EngineConfig::fromArguments( argc, argv ) );
     }
     catch(const vk::SystemError& err)
     {
@@ -1,5 +1,13 @@
 #include "utils.hpp"
 
+#include <cstring>
+#include <fstream>
+#include <array>
+
+#if defined( __SSE2__ )
+#include <emmintrin.h>
+#endif
+
 #define VMA_IMPLEMENTATION
 
 AllocatedBuffer AllocatedBuffer::createBuffer( size_t allocSize, vk::BufferUsageFlags bufferUsage, vma::Allocator allocator, vma::MemoryUsage memoryUsage )
@@ -17,4 +25,128 @@ AllocatedBuffer AllocatedBuffer::createBuffer( size_t allocSize, vk::BufferUsage
     newbuffer.allocation = temp.second;
 
     return newbuffer;
+}
+
+void utils::mem::streamCopy( void* dst, const void* src, size_t size )
+{
+#if defined( __SSE2__ )
+    auto* d = reinterpret_cast<float*>( dst );
+    auto* s = reinterpret_cast<const float*>( src );
+    for( size_t i = 0; i < size / sizeof(float); i += 4 )
+    {
+        _mm_stream_ps( d + i, _mm_loadu_ps( s + i ) );
+    }
+#else
+    memcpy( dst, src, size );
+#endif
+}
+
+void utils::mem::streamFence()
+{
+#if defined( __SSE2__ )
+    _mm_sfence();
+#endif
+}
+
+namespace
+{
+uint32_t crc32( const uint8_t* data, size_t size, uint32_t crc = 0 )
+{
+    static const auto table = [](){
+        std::array<uint32_t, 256> t {};
+        for( uint32_t n = 0; n < 256; ++n )
+        {
+            uint32_t c = n;
+            for( int k = 0; k < 8; ++k )
+                c = ( c & 1 ) ? 0xEDB88320U ^ ( c >> 1 ) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+
+    crc = ~crc;
+    for( size_t i = 0; i < size; ++i )
+        crc = table[( crc ^ data[i] ) & 0xFF] ^ ( crc >> 8 );
+    return ~crc;
+}
+
+void pushBigEndian( std::vector<uint8_t>& out, uint32_t value )
+{
+    out.push_back( static_cast<uint8_t>( value >> 24 ) );
+    out.push_back( static_cast<uint8_t>( value >> 16 ) );
+    out.push_back( static_cast<uint8_t>( value >> 8 ) );
+    out.push_back( static_cast<uint8_t>( value ) );
+}
+
+void writeChunk( std::ofstream& file, const char* type, const std::vector<uint8_t>& data )
+{
+    std::vector<uint8_t> chunk;
+    chunk.reserve( data.size() + 12 );
+    pushBigEndian( chunk, static_cast<uint32_t>( data.size() ) );
+    chunk.insert( chunk.end(), type, type + 4 );
+    chunk.insert( chunk.end(), data.begin(), data.end() );
+    // the crc covers the type and the data, not the length
+    pushBigEndian( chunk, crc32( chunk.data() + 4, chunk.size() - 4 ) );
+
+    file.write( reinterpret_cast<const char*>( chunk.data() ), chunk.size() );
+}
+} // namespace
+
+bool utils::image::writePng( const std::string& filename, uint32_t width, uint32_t height, const uint8_t* pixels, size_t rowPitch )
+{
+    std::ofstream file( filename, std::ios::binary );
+    if( !file.is_open() )
+        return false;
+
+    const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    file.write( reinterpret_cast<const char*>( signature ), sizeof(signature) );
+
+    /**
+     * @brief IHDR: width, height, 8 bit depth, color type 6 (RGBA), default compression/filter, no interlace
+     */
+    std::vector<uint8_t> header;
+    pushBigEndian( header, width );
+    pushBigEndian( header, height );
+    header.insert( header.end(), { 8, 6, 0, 0, 0 } );
+    writeChunk( file, "IHDR", header );
+
+    /**
+     * @brief IDAT: every row starts with filter type 0 (none), and the rows are wrapped by zlib stored blocks
+     */
+    std::vector<uint8_t> raw;
+    const size_t rowSize = size_t{ width } * 4;
+    raw.reserve( ( rowSize + 1 ) * height );
+    for( uint32_t y = 0; y < height; ++y )
+    {
+        raw.push_back( 0 );
+        raw.insert( raw.end(), pixels + y * rowPitch, pixels + y * rowPitch + rowSize );
+    }
+
+    std::vector<uint8_t> zlib = { 0x78, 0x01 };
+    size_t offset = 0;
+    do
+    {
+        size_t blockSize = std::min<size_t>( raw.size() - offset, 65535 );
+        bool last = offset + blockSize == raw.size();
+        zlib.push_back( last ? 1 : 0 );
+        zlib.push_back( static_cast<uint8_t>( blockSize ) );
+        zlib.push_back( static_cast<uint8_t>( blockSize >> 8 ) );
+        zlib.push_back( static_cast<uint8_t>( ~blockSize ) );
+        zlib.push_back( static_cast<uint8_t>( ~blockSize >> 8 ) );
+        zlib.insert( zlib.end(), raw.begin() + offset, raw.begin() + offset + blockSize );
+        offset += blockSize;
+    } while( offset < raw.size() );
+
+    uint32_t a = 1, b = 0;
+    for( uint8_t byte : raw )
+    {
+        a = ( a + byte ) % 65521;
+        b = ( b + a ) % 65521;
+    }
+    pushBigEndian( zlib, ( b << 16 ) | a );
+    writeChunk( file, "IDAT", zlib );
+
+    writeChunk( file, "IEND", {} );
+
+    return file.good();
 }
\ No newline at end of file